@@ -0,0 +1,304 @@
+#pragma once
+// Priority alert scheduler.
+//
+// Alerts are submitted with a strict priority class and queued per delivery
+// channel (SMS, ...). Each channel keeps at most one pending alert per class:
+// a newer alert of the same class replaces the text and bumps a counter, and
+// when a message goes out every lower-priority pending alert is folded into it,
+// so a burst of mixed alerts costs one request instead of one each.
+//
+// Sending happens on two lanes per channel. The urgent lane only carries
+// CRITICAL alerts, so a CRITICAL never waits behind an in-flight SEPSIS send;
+// when one arrives the normal lane is asked to abort at its next checkpoint and
+// whatever it was carrying is re-queued (and folded into the CRITICAL message
+// if that has not gone out yet). Every send draws a token from the channel's
+// token bucket; the normal lane leaves the last one for a CRITICAL alert.
+//
+// The scheduler itself does no I/O and takes time as a parameter, so it can be
+// driven from a simulation on the host as well as from the firmware tasks.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#define ALERT_MESSAGE_LEN   160
+#define ALERT_MAX_CHANNELS  2
+#define ALERT_MAX_ATTEMPTS  3
+
+enum AlertPriority {
+  ALERT_CRITICAL = 0,
+  ALERT_SEIZURE,
+  ALERT_SEPSIS,
+  ALERT_SYSTEM,
+  ALERT_PRIORITY_COUNT
+};
+
+enum AlertLane {
+  ALERT_LANE_URGENT = 0, // CRITICAL only
+  ALERT_LANE_NORMAL,
+  ALERT_LANE_COUNT
+};
+
+enum AlertResult {
+  ALERT_SENT,
+  ALERT_FAILED,   // transport error, retried up to ALERT_MAX_ATTEMPTS
+  ALERT_ABORTED,  // preempted by a CRITICAL alert before sending, re-queued
+  ALERT_DEFERRED  // no network, re-queued without using up an attempt
+};
+
+inline const char* alertPriorityName(int p) {
+  static const char* names[ALERT_PRIORITY_COUNT] = {"CRITICAL", "SEIZURE", "SEPSIS", "SYSTEM"};
+  return (p >= 0 && p < ALERT_PRIORITY_COUNT) ? names[p] : "?";
+}
+
+struct TokenBucket {
+  float capacity = 1;
+  float tokens = 1;
+  float refill_per_ms = 0;
+  uint32_t last_ms = 0;
+
+  void init(float burst, float per_hour, uint32_t now_ms) {
+    capacity = burst;
+    tokens = burst;
+    refill_per_ms = per_hour / 3600000.0f;
+    last_ms = now_ms;
+  }
+
+  // The lane tasks read millis() before taking the lock, so now_ms can be a
+  // little older than the last refill; that must not wrap to a full bucket
+  void refill(uint32_t now_ms) {
+    int32_t dt = (int32_t)(now_ms - last_ms);
+    if (dt <= 0) return;
+    tokens += dt * refill_per_ms;
+    if (tokens > capacity) tokens = capacity;
+    last_ms = now_ms;
+  }
+
+  // Leaves `reserve` tokens in the bucket for other takers
+  bool tryTake(uint32_t now_ms, float reserve = 0) {
+    refill(now_ms);
+    if (tokens < 1.0f + reserve) return false;
+    tokens -= 1.0f;
+    return true;
+  }
+
+  void refund() {
+    tokens += 1.0f;
+    if (tokens > capacity) tokens = capacity;
+  }
+};
+
+struct QueuedAlert {
+  bool pending = false;
+  uint16_t count = 0;     // submissions folded into this entry
+  uint8_t attempts = 0;
+  uint32_t first_ms = 0;  // oldest submission, for time-to-delivery
+  char message[ALERT_MESSAGE_LEN];
+};
+
+struct AlertDeliveryStats {
+  uint32_t submitted = 0;
+  uint32_t delivered = 0;      // alerts (not messages) that reached the channel
+  uint32_t coalesced = 0;      // submissions that rode along in another message
+  uint32_t preempted = 0;
+  uint32_t failed = 0;
+  uint32_t dropped = 0;        // gave up after ALERT_MAX_ATTEMPTS
+  uint32_t total_delivery_ms = 0;
+  uint32_t max_delivery_ms = 0;
+
+  uint32_t meanDeliveryMs() const { return delivered ? total_delivery_ms / delivered : 0; }
+};
+
+class AlertScheduler {
+public:
+#ifdef ARDUINO
+  // The lock exists before setup() runs, so any task may submit from its
+  // first instruction without racing another task to create it.
+  AlertScheduler() { lock = xSemaphoreCreateMutex(); }
+#endif
+
+  // Register a channel carrying the priorities in `priority_mask` (bit per
+  // AlertPriority), limited to `burst` sends at once and `per_hour` on average.
+  int addChannel(const char* name, uint8_t priority_mask, float burst, float per_hour, uint32_t now_ms) {
+    if (channel_count >= ALERT_MAX_CHANNELS) return -1;
+    Channel& c = channels[channel_count];
+    c.name = name;
+    c.priority_mask = priority_mask;
+    c.bucket.init(burst, per_hour, now_ms);
+    return channel_count++;
+  }
+
+  // Queue an alert on every channel that carries its priority
+  void submit(AlertPriority priority, const char* message, uint32_t now_ms) {
+    enter();
+    stats[priority].submitted++;
+    for (int ch = 0; ch < channel_count; ch++) {
+      Channel& c = channels[ch];
+      if (!(c.priority_mask & (1 << priority))) continue;
+
+      QueuedAlert& q = c.pending[priority];
+      if (q.pending) {
+        stats[priority].coalesced++;
+      } else {
+        q.pending = true;
+        q.count = 0;
+        q.attempts = 0;
+        q.first_ms = now_ms;
+      }
+      q.count++;
+      copyMessage(q.message, message);
+
+      if (priority == ALERT_CRITICAL && c.lanes[ALERT_LANE_NORMAL].active) {
+        c.lanes[ALERT_LANE_NORMAL].abort = true;
+      }
+    }
+    leave();
+  }
+
+  // Build the next message for a lane. Returns false if nothing is pending for
+  // the lane or the channel is out of tokens.
+  bool next(int ch, AlertLane lane, uint32_t now_ms, char* out, size_t out_len, AlertPriority* top) {
+    enter();
+    Channel& c = channels[ch];
+    Lane& l = c.lanes[lane];
+    int first = -1;
+    if (!l.active) {
+      int lo = lane == ALERT_LANE_URGENT ? ALERT_CRITICAL : ALERT_SEIZURE;
+      int hi = lane == ALERT_LANE_URGENT ? ALERT_CRITICAL : ALERT_PRIORITY_COUNT - 1;
+      for (int p = lo; p <= hi; p++) {
+        if (c.pending[p].pending) { first = p; break; }
+      }
+    }
+    // Keep a token back for CRITICAL on channels that carry it and can spare one
+    bool keep = lane == ALERT_LANE_NORMAL && (c.priority_mask & (1 << ALERT_CRITICAL)) && c.bucket.capacity >= 2;
+    if (first < 0 || !c.bucket.tryTake(now_ms, keep ? 1.0f : 0.0f)) {
+      leave();
+      return false;
+    }
+
+    // Head message plus a short tag for each lower-priority alert folded in
+    size_t n = snprintf(out, out_len, "%s", c.pending[first].message);
+    if (c.pending[first].count > 1 && n < out_len) {
+      n += snprintf(out + n, out_len - n, " (x%u)", c.pending[first].count);
+    }
+    l.active = true;
+    l.abort = false;
+    for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) l.items[p].pending = false;
+    for (int p = first; p < ALERT_PRIORITY_COUNT; p++) {
+      QueuedAlert& q = c.pending[p];
+      if (!q.pending) continue;
+      if (p != first && n < out_len) {
+        n += snprintf(out + n, out_len - n, " | %s", alertPriorityName(p));
+        if (q.count > 1 && n < out_len) n += snprintf(out + n, out_len - n, " x%u", q.count);
+      }
+      l.items[p] = q;
+      q.pending = false;
+    }
+    *top = (AlertPriority)first;
+    leave();
+    return true;
+  }
+
+  // Transport checkpoint: true if a CRITICAL alert wants this lane's send dropped
+  bool abortRequested(int ch, AlertLane lane) {
+    return channels[ch].lanes[lane].abort;
+  }
+
+  void complete(int ch, AlertLane lane, AlertResult result, uint32_t now_ms) {
+    enter();
+    Channel& c = channels[ch];
+    Lane& l = c.lanes[lane];
+    if (result == ALERT_DEFERRED || result == ALERT_ABORTED) c.bucket.refund();
+
+    for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+      QueuedAlert& item = l.items[p];
+      if (!item.pending) continue;
+      AlertDeliveryStats& s = stats[p];
+
+      if (result == ALERT_SENT) {
+        uint32_t latency = now_ms - item.first_ms;
+        s.delivered += item.count;
+        s.total_delivery_ms += latency * item.count;
+        if (latency > s.max_delivery_ms) s.max_delivery_ms = latency;
+        continue;
+      }
+
+      if (result == ALERT_ABORTED) s.preempted++;
+      if (result == ALERT_FAILED) {
+        s.failed++;
+        if (++item.attempts >= ALERT_MAX_ATTEMPTS) {
+          s.dropped += item.count;
+          continue;
+        }
+      }
+      requeue(c.pending[p], item);
+    }
+    l.active = false;
+    l.abort = false;
+    leave();
+  }
+
+  bool idle(int ch) {
+    enter();
+    Channel& c = channels[ch];
+    bool busy = c.lanes[ALERT_LANE_URGENT].active || c.lanes[ALERT_LANE_NORMAL].active;
+    for (int p = 0; p < ALERT_PRIORITY_COUNT && !busy; p++) {
+      busy = c.pending[p].pending;
+    }
+    leave();
+    return !busy;
+  }
+
+  const char* channelName(int ch) const { return channels[ch].name; }
+  int channelCount() const { return channel_count; }
+  const AlertDeliveryStats& deliveryStats(AlertPriority p) const { return stats[p]; }
+
+private:
+  struct Lane {
+    bool active = false;
+    volatile bool abort = false;
+    QueuedAlert items[ALERT_PRIORITY_COUNT];
+  };
+
+  struct Channel {
+    const char* name = "";
+    uint8_t priority_mask = 0;
+    TokenBucket bucket;
+    QueuedAlert pending[ALERT_PRIORITY_COUNT];
+    Lane lanes[ALERT_LANE_COUNT];
+  };
+
+  Channel channels[ALERT_MAX_CHANNELS];
+  int channel_count = 0;
+  AlertDeliveryStats stats[ALERT_PRIORITY_COUNT];
+
+#ifdef ARDUINO
+  SemaphoreHandle_t lock;
+  void enter() { xSemaphoreTake(lock, portMAX_DELAY); }
+  void leave() { xSemaphoreGive(lock); }
+#else
+  void enter() {}
+  void leave() {}
+#endif
+
+  static void copyMessage(char* dst, const char* src) {
+    strncpy(dst, src, ALERT_MESSAGE_LEN - 1);
+    dst[ALERT_MESSAGE_LEN - 1] = '\0';
+  }
+
+  // Put an unsent alert back; a newer pending alert of the same class keeps
+  // its text, but the original submission time and count carry over.
+  static void requeue(QueuedAlert& pending, const QueuedAlert& item) {
+    if (!pending.pending) {
+      pending = item;
+      return;
+    }
+    pending.count += item.count;
+    if ((int32_t)(item.first_ms - pending.first_ms) < 0) pending.first_ms = item.first_ms;
+    if (item.attempts > pending.attempts) pending.attempts = item.attempts;
+  }
+};
@@ -0,0 +1,152 @@
+#pragma once
+// Boot timeline: start/end timestamps per initialisation phase plus one-off
+// milestones (first sample, first packet), recorded from whichever task does
+// the work. Printed over Serial and served as JSON.
+
+#include <Arduino.h>
+
+#define BOOT_MAX_PHASES 16
+
+enum BootPhaseStatus {
+  BOOT_RUNNING = 0,
+  BOOT_OK,
+  BOOT_RETRYING,
+  BOOT_FAILED
+};
+
+struct BootPhase {
+  const char* name;
+  uint32_t start_ms;
+  uint32_t end_ms;       // 0 while running; equals start_ms for milestones
+  uint16_t attempts;
+  uint8_t status;        // BootPhaseStatus
+};
+
+class BootTimeline {
+public:
+  // Start a phase; returns its id for end()/retry()
+  int begin(const char* name) {
+    portENTER_CRITICAL(&mux);
+    int id = count < BOOT_MAX_PHASES ? count++ : -1;
+    if (id >= 0) {
+      phases[id].name = name;
+      phases[id].start_ms = millis();
+      phases[id].end_ms = 0;
+      phases[id].attempts = 1;
+      phases[id].status = BOOT_RUNNING;
+    }
+    portEXIT_CRITICAL(&mux);
+    return id;
+  }
+
+  void end(int id, bool ok = true) {
+    if (id < 0) return;
+    portENTER_CRITICAL(&mux);
+    phases[id].end_ms = millis();
+    phases[id].status = ok ? BOOT_OK : BOOT_FAILED;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void retry(int id) {
+    if (id < 0) return;
+    portENTER_CRITICAL(&mux);
+    phases[id].attempts++;
+    phases[id].status = BOOT_RETRYING;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Record a milestone once; later calls are ignored
+  void mark(const char* name) {
+    portENTER_CRITICAL(&mux);
+    for (int i = 0; i < count; i++) {
+      if (strcmp(phases[i].name, name) == 0) {
+        portEXIT_CRITICAL(&mux);
+        return;
+      }
+    }
+    int id = count < BOOT_MAX_PHASES ? count++ : -1;
+    if (id >= 0) {
+      phases[id].name = name;
+      phases[id].start_ms = phases[id].end_ms = millis();
+      phases[id].attempts = 1;
+      phases[id].status = BOOT_OK;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // millis() of a finished phase or milestone, 0 if not reached yet
+  uint32_t reachedAt(const char* name) {
+    uint32_t at = 0;
+    portENTER_CRITICAL(&mux);
+    for (int i = 0; i < count; i++) {
+      if (strcmp(phases[i].name, name) == 0 && phases[i].status == BOOT_OK) at = phases[i].end_ms;
+    }
+    portEXIT_CRITICAL(&mux);
+    return at;
+  }
+
+  // True once no phase is still running or retrying
+  bool complete() {
+    bool done = true;
+    portENTER_CRITICAL(&mux);
+    for (int i = 0; i < count; i++) {
+      if (phases[i].status == BOOT_RUNNING || phases[i].status == BOOT_RETRYING) done = false;
+    }
+    portEXIT_CRITICAL(&mux);
+    return done;
+  }
+
+  void print(Print& out) {
+    BootPhase copy[BOOT_MAX_PHASES];
+    int n = snapshot(copy);
+    out.println("=== BOOT TIMELINE (ms since boot) ===");
+    for (int i = 0; i < n; i++) {
+      const BootPhase& p = copy[i];
+      if (p.end_ms == 0) {
+        out.printf("%-16s %6u ..      %s (attempt %u)\n", p.name, p.start_ms, statusName(p.status), p.attempts);
+      } else if (p.end_ms == p.start_ms && p.status == BOOT_OK) {
+        out.printf("%-16s %6u\n", p.name, p.start_ms);
+      } else {
+        out.printf("%-16s %6u .. %6u %s (%u ms, %u attempts)\n", p.name, p.start_ms, p.end_ms,
+                   statusName(p.status), p.end_ms - p.start_ms, p.attempts);
+      }
+    }
+  }
+
+  String toJson() {
+    BootPhase copy[BOOT_MAX_PHASES];
+    int n = snapshot(copy);
+    String json = "{\"phases\":[";
+    for (int i = 0; i < n; i++) {
+      const BootPhase& p = copy[i];
+      if (i) json += ",";
+      json += "{\"name\":\"" + String(p.name) + "\",\"start\":" + String(p.start_ms) +
+              ",\"end\":" + String(p.end_ms) + ",\"attempts\":" + String(p.attempts) +
+              ",\"status\":\"" + statusName(p.status) + "\"}";
+    }
+    json += "]}";
+    return json;
+  }
+
+private:
+  BootPhase phases[BOOT_MAX_PHASES];
+  int count = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+  int snapshot(BootPhase* copy) {
+    portENTER_CRITICAL(&mux);
+    int n = count;
+    memcpy(copy, phases, n * sizeof(BootPhase));
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  static const char* statusName(uint8_t s) {
+    switch (s) {
+      case BOOT_OK: return "ok";
+      case BOOT_RETRYING: return "retrying";
+      case BOOT_FAILED: return "failed";
+      default: return "running";
+    }
+  }
+};
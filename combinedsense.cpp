@@ -1,10 +1,27 @@
 #include <Wire.h>
 #include <WiFi.h>
 #include <HTTPClient.h>
+#include <WebServer.h>
+#include <Preferences.h>
 #include <base64.h>
+#include <esp_timer.h>
 #include "MAX30100_PulseOximeter.h"
 #include <Adafruit_MPU6050.h>
 #include <Adafruit_Sensor.h>
+#include "i2c_scheduler.h"
+#include "alert_scheduler.h"
+#include "rule_engine.h"
+#include "wifi_manager.h"
+#include "boot_timeline.h"
+#include "vitals_history.h"
+#include "vitals_stats.h"
+#include "hrv.h"
+#include "window_ops.h"
+#include "telemetry_uplink.h"
+#include "imu_kernels.h"
+#include "imu_calibration.h"
+#include "i2c_recovery.h"
+#include "seqlock.h"
 
 // WiFi Configuration - REPLACE WITH YOUR CREDENTIALS
 const char* ssid = "OnePlus Nord CE3 5G";
@@ -17,14 +34,70 @@ const char* twilio_phone_number = "+12566634185"; // +1234567890
 const char* personal_phone_number = "+919661666199"; // +1234567890
 
 // I2C Configuration for multiple sensors
-TwoWire I2C_1 = TwoWire(0); // For MPU6050 (default I2C)
-TwoWire I2C_2 = TwoWire(1); // For MAX30100 (custom I2C)
+// The MAX30100 library always talks to Wire (port 0), so it gets that bus to
+// itself and the MPU6050 moves to Wire1 (port 1). Both run in 400 kHz Fast-mode.
+TwoWire& I2C_1 = Wire1; // For MPU6050
+TwoWire& I2C_2 = Wire;  // For MAX30100
+const uint32_t I2C_FAST_MODE_HZ = 400000;
+const int MPU_SDA = 21;
+const int MPU_SCL = 22;
+
+// I2C scheduler: one task per bus, sensors read by deadline, results delivered in loop()
+I2CScheduler i2c;
+const uint8_t MPU_BUS = 0;
+const uint8_t MAX30100_BUS = 1;
+const uint32_t MPU_PERIOD_US = 50000;      // FIFO drained at 20 Hz, ~5 samples each
+const uint32_t MAX30100_PERIOD_US = 10000; // pox.update() every 10 ms
+
+// MPU6050 registers and scale factors for the ranges configured below
+const uint8_t MPU_ADDR = 0x68;
+const uint8_t MPU_REG_SMPLRT_DIV = 0x19;
+const uint8_t MPU_REG_FIFO_EN = 0x23;
+const uint8_t MPU_REG_USER_CTRL = 0x6A;
+const uint8_t MPU_REG_FIFO_COUNT_H = 0x72;
+const uint8_t MPU_REG_FIFO_R_W = 0x74;
+const uint8_t MPU_REG_CONFIG = 0x1A;
+const uint8_t MPU_REG_GYRO_CONFIG = 0x1B;
+const uint8_t MPU_REG_ACCEL_CONFIG = 0x1C;
+const uint8_t MPU_REG_PWR_MGMT_1 = 0x6B;
+const uint8_t MPU_REG_WHO_AM_I = 0x75;
+const uint8_t MPU_WHO_AM_I_ID = 0x68;
+const uint8_t MPU_FIFO_ACCEL_GYRO = 0x78;     // accel + gyro x/y/z: 12 bytes per sample
+const uint8_t MPU_USER_CTRL_FIFO_ON = 0x40;
+const uint8_t MPU_USER_CTRL_FIFO_RESET = 0x04;
+const uint8_t MPU_SAMPLE_RATE_DIV = 9;        // 1 kHz / (1 + 9) = 100 Hz with the DLPF on
+const uint16_t MPU_FIFO_BYTES = 1024;
+const size_t MPU_FIFO_SAMPLE_BYTES = 12;
+const size_t MPU_FIFO_MAX_SAMPLES = 32;       // per drain, the rest waits for the next one
+const size_t MPU_FIFO_READ_SAMPLES = 10;      // per burst, within the 128-byte Wire buffer
+const float MPU_ACCEL_LSB_PER_G = 4096.0;  // MPU6050_RANGE_8_G
+const float MPU_GYRO_LSB_PER_DPS = 65.5;   // MPU6050_RANGE_500_DEG
+
+// What one FIFO drain hands to loop(), packed into I2CTransaction::data
+struct MPUBlockSummary {
+  uint16_t samples;
+  uint16_t fifo_resets;  // FIFO overflowed or lost alignment and was reset
+  float accel_max;       // g
+  float gyro_max;        // deg/s
+  float gyro_rms;        // deg/s
+};
+uint32_t mpu_fifo_resets = 0;
+
+// Gyro bias and accel offset/scale, estimated while the sensor is still and
+// applied to the raw FIFO samples. Kept in NVS so a warm boot corrects from
+// the first sample; rewritten at most every IMU_CAL_SAVE_INTERVAL_MS.
+ImuCalibrator imu_cal;
+ImuCalibration imu_cal_saved;
+uint32_t imu_cal_saved_version = 0;
+unsigned long imu_cal_saved_ms = 0;
+const unsigned long IMU_CAL_SAVE_INTERVAL_MS = 600000;
 
 // Sensor objects
 PulseOximeter pox;
 Adafruit_MPU6050 mpu;
 
-// Medical thresholds for alerts
+// Default medical thresholds. The rule set built from these is only the
+// fallback: a rule set stored in NVS, or posted to /rules, replaces it.
 struct MedicalThresholds {
   // Heart rate thresholds (BPM)
   float hr_sepsis_high = 100.0;
@@ -38,6 +111,12 @@ struct MedicalThresholds {
   float spo2_seizure_low = 90.0;
   float spo2_critical_low = 85.0;
   
+  // Sepsis trends against the patient's own baseline
+  float hr_baseline_rise = 15.0;   // BPM, 30 min median over baseline
+  float spo2_baseline_drop = 3.0;  // %
+  float hr_drift_cusum = 150.0;    // BPM-minutes past the allowance
+  float spo2_drift_cusum = 30.0;   // %-minutes
+  
   // Motion thresholds
   float accel_seizure_threshold = 3.0;  // g
   float gyro_seizure_threshold = 50.0;  // deg/s
@@ -56,6 +135,94 @@ struct MedicalThresholds {
 
 MedicalThresholds thresholds;
 
+// Rule engine: alert rules as data, persisted in NVS and replaceable over HTTP
+RuleEngine rules;
+Preferences rule_store;
+String active_rules_text = "";
+// Authorization: Bearer <token>. Set it here or store it under rules/token in
+// NVS; POST /rules is refused while it is still the placeholder.
+#define RULES_TOKEN_PLACEHOLDER "REPLACE_WITH_A_LONG_RANDOM_TOKEN"
+String rules_api_token = RULES_TOKEN_PLACEHOLDER;
+const size_t RULES_MAX_TEXT = 3800; // NVS string limit is ~4000 bytes
+
+// HTTP server for rule management
+WebServer server(80);
+
+// WiFi connects in the background; sampling does not wait for it
+WiFiManager wifi;
+
+// Boot timeline: per-phase timestamps, printed once boot settles and served on /boot
+BootTimeline boot;
+int wifi_phase = -1;
+
+// Sensor bring-up runs on one task per sensor and retries in the background
+// instead of halting the device
+struct SensorBringUp {
+  const char* name;
+  bool (*init)();
+  int stream;  // I2C scheduler stream, enabled once the sensor is up
+  int phase;
+};
+const uint32_t SENSOR_RETRY_MIN_MS = 500;
+const uint32_t SENSOR_RETRY_MAX_MS = 10000;
+
+// Runtime I2C faults on the MPU bus are recovered by its bus task between
+// drains: bus unstick, register re-sync, then reinit with the same backoff
+// (i2c_recovery.h). Served on /i2c.
+I2CRecovery mpu_recovery;
+SeqLock<I2CRecoveryStats> mpu_recovery_stats;  // published by the bus task
+const uint8_t MPU_EMPTY_DRAINS_MAX = 4;  // ~20 samples due and none came: FIFO or clock lost
+
+// What initializeMPU6050() configures, rewritten by the re-sync
+const uint8_t MPU_RESYNC_REGS[][2] = {
+  {MPU_REG_PWR_MGMT_1, 0x01},    // awake, clock from the X gyro PLL
+  {MPU_REG_ACCEL_CONFIG, 0x10},  // MPU6050_RANGE_8_G
+  {MPU_REG_GYRO_CONFIG, 0x08},   // MPU6050_RANGE_500_DEG
+  {MPU_REG_CONFIG, 0x04},        // MPU6050_BAND_21_HZ
+  {MPU_REG_SMPLRT_DIV, MPU_SAMPLE_RATE_DIV},
+  {MPU_REG_FIFO_EN, MPU_FIFO_ACCEL_GYRO},
+  {MPU_REG_USER_CTRL, MPU_USER_CTRL_FIFO_ON | MPU_USER_CTRL_FIFO_RESET},
+};
+
+// Alert delivery: SMS sends run on their own tasks, CRITICAL on a dedicated lane
+AlertScheduler alerts;
+int sms_channel = -1;
+const float SMS_BURST = 4;          // sends allowed back to back
+const float SMS_PER_HOUR = 60;      // long-run SMS rate limit
+const uint16_t SMS_HTTP_TIMEOUT_MS = 8000;
+
+// Compressed multi-resolution history of the vitals, served on /history
+VitalsHistory history;
+
+// Long-horizon HR/SpO2 trends (30 min medians, baselines) for the sepsis rules
+VitalsStats vitals_stats;
+
+// Beat timestamps from the MAX30100 callback (on its bus task) to loop(), and
+// HRV over them. A beat is stamped when pox.update() processes it, so the
+// timestamps carry up to MAX30100_PERIOD_US of jitter.
+BeatRing<32> beat_ring;
+HrvEngine hrv;
+
+// Sliding windows for the windowed rule metrics, fed by the sensor callbacks
+// at each sensor's own rate (MAX30100 every 10 ms, MPU blocks at 20 Hz). The
+// min/max deques only hold a run of distinct values; the MPU ones can see 200
+// blocks in 10 s. About 8 KB in all.
+const uint32_t VITALS_WINDOW_MS = 20000;
+const uint32_t MOTION_WINDOW_MS = 10000;
+WindowMin<64> hr_min_window;
+WindowMax<64> hr_max_window;
+WindowMin<64> spo2_min_window;
+WindowMax<256> accel_max_window;
+WindowSum<256> gyro_sq_window;        // block RMS squared x samples, weighted by samples
+WindowMax<256> gyro_rms_peak_window;  // of the 10 s RMS
+TimeSinceTrue motion_seen;
+
+// MQTT telemetry uplink: batched frames, QoS 1, buffered in flash while offline
+const char* mqtt_broker_uri = "mqtt://192.168.1.10:1883"; // REPLACE WITH YOUR BROKER
+TelemetryUplink uplink;
+String uplink_client_id = "";
+String uplink_topic = "";
+
 // Global variables for monitoring
 float current_hr = 0;
 float current_spo2 = 0;
@@ -63,9 +230,6 @@ float accel_magnitude = 0;
 float gyro_magnitude = 0;
 bool motion_detected = false;
 unsigned long motion_start_time = 0;
-unsigned long last_sepsis_alert = 0;
-unsigned long last_seizure_alert = 0;
-unsigned long last_critical_alert = 0;
 
 // Status flags
 bool sepsis_detected = false;
@@ -76,33 +240,86 @@ void setup() {
   Serial.begin(115200);
   Serial.println("ESP32 Medical Alert System Starting...");
   
-  // Initialize I2C buses
-  I2C_1.begin(21, 22, 100000); // SDA=21, SCL=22 for MPU6050
-  I2C_2.begin(4, 5, 100000);   // SDA=4, SCL=5 for MAX30100
+  // Sensors first: buses, scheduler, then both sensors come up in parallel
+  int phase = boot.begin("i2c_buses");
+  // pox.begin() calls Wire.begin() again, which keeps these pins
+  I2C_1.begin(MPU_SDA, MPU_SCL, I2C_FAST_MODE_HZ); // SDA=21, SCL=22 for MPU6050
+  I2C_2.begin(4, 5, I2C_FAST_MODE_HZ);   // SDA=4, SCL=5 for MAX30100
+  boot.end(phase);
+  
+  history.begin();
+  vitals_stats.begin();
+  hrv.begin();
+  initializeRuleWindows();
+  
+  phase = boot.begin("i2c_scheduler");
+  initializeSensorScheduler();
+  boot.end(phase);
   
-  // Initialize WiFi
+  // Before the MPU stream starts: the bus task applies it from the first block
+  phase = boot.begin("imu_calibration");
+  initializeImuCalibration();
+  boot.end(phase);
+  
+  startSensorBringUp();
+  
+  // Load alert rules (NVS, or defaults from thresholds)
+  phase = boot.begin("rules");
+  initializeRules();
+  boot.end(phase);
+  
+  // Start WiFi (non-blocking, the phase ends in loop() once connected)
+  wifi_phase = boot.begin("wifi");
   initializeWiFi();
   
-  // Initialize MAX30100
-  initializeMAX30100();
+  phase = boot.begin("web_server");
+  initializeWebServer();
+  boot.end(phase);
   
-  // Initialize MPU6050
-  initializeMPU6050();
+  phase = boot.begin("uplink");
+  boot.end(phase, initializeUplink());
   
-  Serial.println("System initialized successfully!");
-  Serial.println("Monitoring for medical conditions...");
+  // Start alert delivery and queue the startup notification
+  phase = boot.begin("alerts");
+  initializeAlerts();
+  alerts.submit(ALERT_SYSTEM, "Medical Alert System Online", millis());
+  boot.end(phase);
   
-  // Send startup notification
-  sendSMS("Medical Alert System Online", "SYSTEM");
+  Serial.println("Monitoring for medical conditions...");
 }
 
 void loop() {
-  // Update sensor readings
-  updateSensorReadings();
+  // Collect sensor readings completed by the I2C bus tasks
+  i2c.poll();
+  
+  // Beats captured since the last pass
+  uint64_t beat_us;
+  while (beat_ring.pop(beat_us)) hrv.addBeat(beat_us);
+  
+  // Keep WiFi up; rule updates and other HTTP requests
+  wifi.loop(millis());
+  if (wifi_phase >= 0 && wifi.connected()) {
+    boot.end(wifi_phase);
+    wifi_phase = -1;
+  }
+  server.handleClient();
   
   // Check for medical conditions
   checkMedicalConditions();
   
+  // Batch state into telemetry frames and publish when due
+  updateUplink();
+  
+  // Persist the IMU calibration when it has moved
+  saveImuCalibration();
+  
+  // Boot timeline once every phase has finished
+  static bool timeline_printed = false;
+  if (!timeline_printed && boot.complete()) {
+    boot.print(Serial);
+    timeline_printed = true;
+  }
+  
   // Print status every 5 seconds
   static unsigned long last_print = 0;
   if (millis() - last_print > 5000) {
@@ -110,74 +327,307 @@ void loop() {
     last_print = millis();
   }
   
-  delay(100); // Small delay for stability
+  delay(10); // Sampling runs on the bus tasks; loop only evaluates
 }
 
 void initializeWiFi() {
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi");
-  
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  
-  Serial.println();
-  Serial.print("WiFi connected! IP address: ");
-  Serial.println(WiFi.localIP());
+  Serial.println("Connecting to WiFi in the background");
+  wifi.begin(ssid, password);
 }
 
-void initializeMAX30100() {
-  Serial.print("Initializing MAX30100...");
-  
+bool initializeMAX30100() {
   if (!pox.begin()) {
-    Serial.println("FAILED!");
-    Serial.println("Check MAX30100 wiring and restart ESP32");
-    while(1);
+    Serial.println("Initializing MAX30100... FAILED! Check MAX30100 wiring");
+    return false;
   }
   
-  Serial.println("SUCCESS");
-  
   // Configure MAX30100
   pox.setIRLedCurrent(MAX30100_LED_CURR_7_6MA);
   pox.setOnBeatDetectedCallback(onBeatDetected);
+  I2C_2.setClock(I2C_FAST_MODE_HZ);
+  Serial.println("Initializing MAX30100... SUCCESS");
+  return true;
 }
 
-void initializeMPU6050() {
-  Serial.print("Initializing MPU6050...");
-  
+bool initializeMPU6050() {
   if (!mpu.begin(0x68, &I2C_1)) {
-    Serial.println("FAILED!");
-    Serial.println("Check MPU6050 wiring and restart ESP32");
-    while(1);
+    Serial.println("Initializing MPU6050... FAILED! Check MPU6050 wiring");
+    return false;
   }
   
-  Serial.println("SUCCESS");
-  
   // Configure MPU6050
   mpu.setAccelerometerRange(MPU6050_RANGE_8_G);
   mpu.setGyroRange(MPU6050_RANGE_500_DEG);
   mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
+  I2C_1.setClock(I2C_FAST_MODE_HZ);
+  
+  // Samples collect in the FIFO at 100 Hz and are drained in blocks
+  if (!mpuWrite(I2C_1, MPU_REG_SMPLRT_DIV, MPU_SAMPLE_RATE_DIV) ||
+      !mpuWrite(I2C_1, MPU_REG_FIFO_EN, MPU_FIFO_ACCEL_GYRO) ||
+      !mpuWrite(I2C_1, MPU_REG_USER_CTRL, MPU_USER_CTRL_FIFO_ON | MPU_USER_CTRL_FIFO_RESET)) {
+    Serial.println("Initializing MPU6050... FIFO setup FAILED");
+    return false;
+  }
+  Serial.println("Initializing MPU6050... SUCCESS");
+  return true;
 }
 
-void updateSensorReadings() {
-  // Update MAX30100 readings
+SensorBringUp mpu_bringup = {"mpu6050", initializeMPU6050, -1, -1};
+SensorBringUp max30100_bringup = {"max30100", initializeMAX30100, -1, -1};
+
+// The sensors sit on different buses, so they are brought up concurrently.
+// A sensor's stream stays paused until its init succeeds, so the bring-up task
+// has the bus to itself.
+void startSensorBringUp() {
+  mpu_bringup.phase = boot.begin(mpu_bringup.name);
+  max30100_bringup.phase = boot.begin(max30100_bringup.name);
+  xTaskCreatePinnedToCore(sensorBringUpTask, "init-mpu", 4096, &mpu_bringup, 6, NULL, 1);
+  xTaskCreatePinnedToCore(sensorBringUpTask, "init-max", 4096, &max30100_bringup, 6, NULL, 1);
+}
+
+void sensorBringUpTask(void* arg) {
+  SensorBringUp* sensor = (SensorBringUp*)arg;
+  uint32_t backoff = SENSOR_RETRY_MIN_MS;
+  
+  while (!sensor->init()) {
+    boot.retry(sensor->phase);
+    Serial.printf("%s not ready, retrying in %u ms\n", sensor->name, backoff);
+    vTaskDelay(pdMS_TO_TICKS(backoff));
+    backoff = backoff * 2 > SENSOR_RETRY_MAX_MS ? SENSOR_RETRY_MAX_MS : backoff * 2;
+  }
+  
+  i2c.setActive(sensor->stream, true);
+  boot.end(sensor->phase);
+  vTaskDelete(NULL);
+}
+
+void initializeSensorScheduler() {
+  i2c.attachBus(MPU_BUS, &I2C_1);
+  i2c.attachBus(MAX30100_BUS, &I2C_2);
+  
+  // MPU6050: FIFO drained in blocks, features computed on the bus task
+  mpu_bringup.stream = i2c.addJob(MPU_BUS, readMPU, MPU_PERIOD_US, onMPUSample);
+  mpu_recovery.begin({unstickMPUBus, resyncMPU6050, initializeMPU6050}, SENSOR_RETRY_MIN_MS, SENSOR_RETRY_MAX_MS);
+  
+  // MAX30100: the library drives its own FIFO reads and beat detection
+  max30100_bringup.stream = i2c.addJob(MAX30100_BUS, updatePulseOximeter,
+                                       MAX30100_PERIOD_US, onPulseOximeterSample);
+  
+  // Paused until the bring-up tasks have configured the sensors
+  i2c.setActive(mpu_bringup.stream, false);
+  i2c.setActive(max30100_bringup.stream, false);
+  
+  if (!i2c.begin()) {
+    Serial.println("Failed to start I2C scheduler tasks");
+  }
+}
+
+// Runs on the MAX30100 bus task
+bool updatePulseOximeter(TwoWire& bus, I2CTransaction& t) {
   pox.update();
-  current_hr = pox.getHeartRate();
-  current_spo2 = pox.getSpO2();
+  float hr = pox.getHeartRate();
+  float spo2 = pox.getSpO2();
+  memcpy(t.data, &hr, sizeof(hr));
+  memcpy(t.data + sizeof(hr), &spo2, sizeof(spo2));
+  t.len = sizeof(hr) + sizeof(spo2);
+  return true;
+}
+
+void onPulseOximeterSample(const I2CTransaction& t) {
+  memcpy(&current_hr, t.data, sizeof(current_hr));
+  memcpy(&current_spo2, t.data + sizeof(current_hr), sizeof(current_spo2));
+  
+  uint32_t now_s = millis() / 1000;
+  history.add(HISTORY_HR, now_s, current_hr);
+  history.add(HISTORY_SPO2, now_s, current_spo2);
+  vitals_stats.add(millis(), current_hr, current_spo2);
+  
+  // 0 means no reading (no finger, not locked yet), not a low value
+  uint32_t now = millis();
+  if (current_hr > 0) {
+    hr_min_window.add(now, current_hr);
+    hr_max_window.add(now, current_hr);
+  }
+  if (current_spo2 > 0) spo2_min_window.add(now, current_spo2);
+}
+
+bool mpuWrite(TwoWire& bus, uint8_t reg, uint8_t value) {
+  bus.beginTransmission(MPU_ADDR);
+  bus.write(reg);
+  bus.write(value);
+  return bus.endTransmission() == 0;
+}
+
+bool mpuRead(TwoWire& bus, uint8_t reg, uint8_t* data, size_t len) {
+  bus.beginTransmission(MPU_ADDR);
+  bus.write(reg);
+  if (bus.endTransmission(false) != 0) return false;
+  if (bus.requestFrom(MPU_ADDR, len) != len) return false;
+  for (size_t i = 0; i < len; i++) data[i] = bus.read();
+  return true;
+}
+
+// Runs on the MPU bus task: a FIFO drain, or after a bus fault the next
+// recovery step. Neither waits, so the MAX30100 bus and loop() carry on.
+// A sensor that reset itself (brown-out) still answers but has its FIFO off,
+// so a run of empty drains counts as a failed read too.
+bool readMPU(TwoWire& bus, I2CTransaction& t) {
+  static uint8_t empty_drains = 0;
+  uint32_t now = millis();
+  bool ok = false;
+  if (mpu_recovery.healthy()) {
+    ok = drainMPUFifo(bus, t);
+    MPUBlockSummary summary;
+    memcpy(&summary, t.data, sizeof(summary));
+    if (ok && summary.samples == 0 && summary.fifo_resets == 0) {
+      if (++empty_drains >= MPU_EMPTY_DRAINS_MAX) ok = false;
+    } else {
+      empty_drains = 0;
+    }
+    if (ok) {
+      mpu_recovery.readOk(now);
+    } else {
+      empty_drains = 0;
+      mpu_recovery.readFailed(now);
+    }
+  }
+  if (!mpu_recovery.healthy()) mpu_recovery.step(now);
+  mpu_recovery_stats.write(mpu_recovery.stats(now));
+  return ok;
+}
+
+bool unstickMPUBus() {
+  return i2cUnstickBus(I2C_1, MPU_SDA, MPU_SCL, I2C_FAST_MODE_HZ, MPU_ADDR);
+}
+
+bool resyncMPU6050() {
+  return i2cResync(I2C_1, MPU_ADDR, MPU_REG_WHO_AM_I, MPU_WHO_AM_I_ID, MPU_RESYNC_REGS,
+                   sizeof(MPU_RESYNC_REGS) / sizeof(MPU_RESYNC_REGS[0]));
+}
+
+// Drain the FIFO and reduce the block to a summary
+bool drainMPUFifo(TwoWire& bus, I2CTransaction& t) {
+  static ImuRawSample block[MPU_FIFO_MAX_SAMPLES];
+  static uint32_t accel_sq[MPU_FIFO_MAX_SAMPLES];
+  static uint32_t gyro_sq[MPU_FIFO_MAX_SAMPLES];
+  static float accel_mag[MPU_FIFO_MAX_SAMPLES];
+  static float gyro_mag[MPU_FIFO_MAX_SAMPLES];
+  
+  MPUBlockSummary summary;
+  memset(&summary, 0, sizeof(summary));
+  t.len = sizeof(summary);
+  
+  uint8_t count_bytes[2];
+  if (!mpuRead(bus, MPU_REG_FIFO_COUNT_H, count_bytes, 2)) return false;
+  uint16_t count = (count_bytes[0] << 8) | count_bytes[1];
+  
+  // A full FIFO has dropped samples and may be mid-sample: start over
+  if (count % MPU_FIFO_SAMPLE_BYTES != 0 || count > MPU_FIFO_BYTES - MPU_FIFO_SAMPLE_BYTES) {
+    summary.fifo_resets = 1;
+    memcpy(t.data, &summary, sizeof(summary));
+    return mpuWrite(bus, MPU_REG_USER_CTRL, MPU_USER_CTRL_FIFO_ON | MPU_USER_CTRL_FIFO_RESET);
+  }
+  
+  size_t n = count / MPU_FIFO_SAMPLE_BYTES;
+  if (n > MPU_FIFO_MAX_SAMPLES) n = MPU_FIFO_MAX_SAMPLES;
+  for (size_t done = 0; done < n;) {
+    uint8_t raw[MPU_FIFO_READ_SAMPLES * MPU_FIFO_SAMPLE_BYTES];
+    size_t chunk = n - done < MPU_FIFO_READ_SAMPLES ? n - done : MPU_FIFO_READ_SAMPLES;
+    if (!mpuRead(bus, MPU_REG_FIFO_R_W, raw, chunk * MPU_FIFO_SAMPLE_BYTES)) return false;
+    // Big-endian int16: ax, ay, az, gx, gy, gz
+    for (size_t j = 0; j < chunk; j++) {
+      for (int k = 0; k < IMU_AXES; k++) {
+        const uint8_t* p = raw + j * MPU_FIFO_SAMPLE_BYTES + 2 * k;
+        block[done + j].v[k] = (int16_t)((p[0] << 8) | p[1]);
+      }
+    }
+    done += chunk;
+  }
+  
+  // Stillness windows see the raw samples, features the corrected ones
+  imu_cal.observe(block, n);
+  imu_cal.apply(block, n);
+  
+  ImuBlockFeatures features;
+  features.accel_sq = accel_sq;
+  features.gyro_sq = gyro_sq;
+  features.accel_mag = accel_mag;
+  features.gyro_mag = gyro_mag;
+  features.freefall = NULL;
+  imuBlockFeatures(block, n, 0, 1.0f / MPU_ACCEL_LSB_PER_G, 1.0f / MPU_GYRO_LSB_PER_DPS, features);
   
-  // Update MPU6050 readings
-  sensors_event_t a, g, temp;
-  mpu.getEvent(&a, &g, &temp);
+  summary.samples = n;
+  for (size_t i = 0; i < n; i++) {
+    if (accel_mag[i] > summary.accel_max) summary.accel_max = accel_mag[i];
+    if (gyro_mag[i] > summary.gyro_max) summary.gyro_max = gyro_mag[i];
+  }
+  if (n > 0) summary.gyro_rms = sqrtf((float)features.gyro_sq_sum / n) / MPU_GYRO_LSB_PER_DPS;
+  memcpy(t.data, &summary, sizeof(summary));
+  return true;
+}
+
+void onMPUSample(const I2CTransaction& t) {
+  if (!t.ok) return;
+  MPUBlockSummary summary;
+  memcpy(&summary, t.data, sizeof(summary));
+  mpu_fifo_resets += summary.fifo_resets;
+  if (summary.samples == 0) return;
+  boot.mark("first_sample");
   
-  // Calculate motion magnitudes
-  accel_magnitude = sqrt(a.acceleration.x * a.acceleration.x + 
-                        a.acceleration.y * a.acceleration.y + 
-                        a.acceleration.z * a.acceleration.z);
+  // Peaks over the block, so a single-sample spike still counts as motion
+  updateSensorReadings(summary.accel_max, summary.gyro_max);
   
-  gyro_magnitude = sqrt(g.gyro.x * g.gyro.x + 
-                       g.gyro.y * g.gyro.y + 
-                       g.gyro.z * g.gyro.z) * 180.0 / PI; // Convert to deg/s
+  uint32_t now = millis();
+  accel_max_window.add(now, summary.accel_max);
+  gyro_sq_window.add(now, summary.gyro_rms * summary.gyro_rms * summary.samples, summary.samples);
+  gyro_rms_peak_window.add(now, sqrtf(gyro_sq_window.mean(now)));
+  motion_seen.add(now, motion_detected);
+}
+
+void initializeRuleWindows() {
+  hr_min_window.begin(VITALS_WINDOW_MS);
+  hr_max_window.begin(VITALS_WINDOW_MS);
+  spo2_min_window.begin(VITALS_WINDOW_MS);
+  accel_max_window.begin(MOTION_WINDOW_MS);
+  gyro_sq_window.begin(MOTION_WINDOW_MS);
+  gyro_rms_peak_window.begin(MOTION_WINDOW_MS);
+  motion_seen.begin();
+}
+
+void initializeImuCalibration() {
+  bool stored = ImuCalibrator::load(imu_cal_saved);
+  imu_cal.begin(MPU_ACCEL_LSB_PER_G, MPU_GYRO_LSB_PER_DPS, stored ? &imu_cal_saved : NULL);
+  imu_cal_saved_version = imu_cal.read(imu_cal_saved);
+  imu_cal_saved_ms = millis();
+  Serial.println(imu_cal.warmStart() ? "Applied IMU calibration from NVS"
+                                     : "No usable IMU calibration stored, calibrating while still");
+}
+
+// A first gyro or accel result is saved right away, later drift at most every
+// IMU_CAL_SAVE_INTERVAL_MS to spare the flash
+void saveImuCalibration() {
+  if (imu_cal.version() == imu_cal_saved_version) return;
+  ImuCalibration current;
+  uint32_t version = imu_cal.read(current);
+  bool new_result = current.flags != imu_cal_saved.flags;
+  if (!new_result && millis() - imu_cal_saved_ms < IMU_CAL_SAVE_INTERVAL_MS) return;
+  imu_cal_saved_version = version;
+  if (!ImuCalibrator::differs(imu_cal_saved, current)) return;
+  if (ImuCalibrator::save(current)) {
+    imu_cal_saved = current;
+    imu_cal_saved_ms = millis();
+    Serial.println("IMU calibration saved to NVS");
+  }
+}
+
+void updateSensorReadings(float accel_g, float gyro_dps) {
+  // Motion magnitudes (g and deg/s)
+  accel_magnitude = accel_g;
+  gyro_magnitude = gyro_dps;
+  
+  uint32_t now_s = millis() / 1000;
+  history.add(HISTORY_ACCEL, now_s, accel_magnitude);
+  history.add(HISTORY_GYRO, now_s, gyro_magnitude);
   
   // Check for significant motion
   if (accel_magnitude > thresholds.accel_seizure_threshold || 
@@ -194,93 +644,350 @@ void updateSensorReadings() {
 
 void checkMedicalConditions() {
   unsigned long current_time = millis();
-  bool send_alert = false;
-  String alert_message = "";
-  String alert_type = "";
-  
-  // Reset condition flags
-  sepsis_detected = false;
-  seizure_detected = false;
-  critical_condition = false;
-  
-  // Check for CRITICAL conditions first
-  if ((current_hr > thresholds.hr_critical_high || current_hr < thresholds.hr_critical_low) ||
-      (current_spo2 < thresholds.spo2_critical_low) ||
-      (accel_magnitude > thresholds.accel_critical_threshold) ||
-      (gyro_magnitude > thresholds.gyro_critical_threshold) ||
-      (motion_detected && (current_time - motion_start_time) > thresholds.critical_motion_duration)) {
-    
-    critical_condition = true;
-    
-    if (current_time - last_critical_alert > thresholds.critical_cooldown) {
-      alert_message = "CRITICAL ALERT! ";
-      if (current_hr > thresholds.hr_critical_high) alert_message += "Extreme Tachycardia ";
-      if (current_hr < thresholds.hr_critical_low) alert_message += "Extreme Bradycardia ";
-      if (current_spo2 < thresholds.spo2_critical_low) alert_message += "Severe Hypoxemia ";
-      if (accel_magnitude > thresholds.accel_critical_threshold) alert_message += "Violent Motion ";
-      if (motion_detected && (current_time - motion_start_time) > thresholds.critical_motion_duration) {
-        alert_message += "Prolonged Seizure Activity ";
-      }
-      alert_message += "HR:" + String(current_hr) + " SpO2:" + String(current_spo2);
-      alert_type = "CRITICAL";
-      send_alert = true;
-      last_critical_alert = current_time;
-    }
+  
+  float metrics[METRIC_COUNT];
+  metrics[METRIC_HR] = current_hr;
+  metrics[METRIC_SPO2] = current_spo2;
+  metrics[METRIC_ACCEL] = accel_magnitude;
+  metrics[METRIC_GYRO] = gyro_magnitude;
+  metrics[METRIC_MOTION_MS] = motion_detected ? (float)(current_time - motion_start_time) : 0;
+  
+  VitalTrendSnapshot hr = vitals_stats.hr.snapshot(current_time);
+  metrics[METRIC_HR_AVG] = hr.fast;
+  metrics[METRIC_HR_P50] = hr.p50;
+  metrics[METRIC_HR_BASE] = hr.baseline;
+  metrics[METRIC_HR_DEV] = hr.deviation;
+  metrics[METRIC_HR_CUSUM] = hr.cusum;
+  VitalTrendSnapshot spo2 = vitals_stats.spo2.snapshot(current_time);
+  metrics[METRIC_SPO2_AVG] = spo2.fast;
+  metrics[METRIC_SPO2_P50] = spo2.p50;
+  metrics[METRIC_SPO2_BASE] = spo2.baseline;
+  metrics[METRIC_SPO2_DEV] = spo2.deviation;
+  metrics[METRIC_SPO2_CUSUM] = spo2.cusum;
+  HrvSnapshot beats = hrv.snapshot((uint32_t)(esp_timer_get_time() / 1000));
+  metrics[METRIC_HR_BEAT] = beats.hr_bpm;
+  metrics[METRIC_HRV_RMSSD] = beats.rmssd_ms;
+  metrics[METRIC_HRV_SDNN] = beats.sdnn_ms;
+  uint32_t now = current_time;
+  metrics[METRIC_HR_MIN_20S] = hr_min_window.value(now);
+  metrics[METRIC_HR_MAX_20S] = hr_max_window.value(now);
+  metrics[METRIC_SPO2_MIN_20S] = spo2_min_window.value(now);
+  metrics[METRIC_ACCEL_MAX_10S] = accel_max_window.value(now);
+  metrics[METRIC_GYRO_RMS_10S] = sqrtf(gyro_sq_window.mean(now));
+  metrics[METRIC_GYRO_RMS_PEAK] = gyro_rms_peak_window.value(now);
+  metrics[METRIC_MOTION_AGO_MS] = (float)motion_seen.since(now);
+  
+  RuleResult result = rules.evaluate(metrics, current_time);
+  
+  // Condition flags follow the most severe active rule
+  critical_condition = result.top_severity == ALERT_CRITICAL;
+  seizure_detected = result.top_severity == ALERT_SEIZURE;
+  sepsis_detected = result.top_severity == ALERT_SEPSIS;
+  
+  if (result.alerts == 0) return;
+  
+  // One message naming every rule that alerted
+  const RuleSet& set = rules.rules();
+  AlertPriority alert_priority = (AlertPriority)result.top_severity;
+  String alert_message = String(alertPriorityName(alert_priority)) + " ALERT! ";
+  for (int i = 0; i < set.rule_count; i++) {
+    if (result.alerts & (1UL << i)) alert_message += String(set.rules[i].label) + " ";
+  }
+  alert_message += "HR:" + String(current_hr) + " SpO2:" + String(current_spo2);
+  
+  Serial.println("MEDICAL ALERT TRIGGERED!");
+  Serial.println("Alert Type: " + String(alertPriorityName(alert_priority)));
+  Serial.println("Message: " + alert_message);
+  alerts.submit(alert_priority, alert_message.c_str(), current_time);
+}
+
+bool initializeUplink() {
+  // Client id and topic from the MAC, so every device publishes separately
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  char id[24];
+  snprintf(id, sizeof(id), "byteheal-%02x%02x%02x", mac[3], mac[4], mac[5]);
+  uplink_client_id = id;
+  uplink_topic = "byteheal/" + uplink_client_id + "/telemetry";
+  
+  // The MQTT client connects on its own once WiFi is up, and reconnects
+  if (!uplink.begin(mqtt_broker_uri, uplink_client_id.c_str(), uplink_topic.c_str())) {
+    Serial.println("Telemetry uplink failed to start");
+    return false;
   }
+  Serial.println("Telemetry uplink publishing to " + uplink_topic);
+  return true;
+}
+
+void updateUplink() {
+  unsigned long current_time = millis();
+  
+  UplinkState state;
+  state.hr = current_hr;
+  state.spo2 = current_spo2;
+  state.accel_g = accel_magnitude;
+  state.gyro_dps = gyro_magnitude;
+  state.flags = (motion_detected ? UPLINK_MOTION : 0) |
+                (sepsis_detected ? UPLINK_SEPSIS : 0) |
+                (seizure_detected ? UPLINK_SEIZURE : 0) |
+                (critical_condition ? UPLINK_CRITICAL : 0);
+  state.motion_ms = motion_detected ? current_time - motion_start_time : 0;
+  
+  uplink.sample(state, current_time);
+  uplink.loop(current_time);
+}
+
+// Rule set equivalent to the compiled-in thresholds
+String defaultRules(const MedicalThresholds& t) {
+  String r = "# severity cooldown_ms for_ms label: conditions\n";
+  String critical = "CRITICAL " + String(t.critical_cooldown) + " 0 ";
+  r += critical + "Extreme Tachycardia: hr > " + String(t.hr_critical_high) + "\n";
+  r += critical + "Extreme Bradycardia: hr < " + String(t.hr_critical_low) + "\n";
+  r += critical + "Severe Hypoxemia: spo2 < " + String(t.spo2_critical_low) + "\n";
+  r += critical + "Violent Motion: accel > " + String(t.accel_critical_threshold) + "\n";
+  r += critical + "Violent Rotation: gyro > " + String(t.gyro_critical_threshold) + "\n";
+  r += critical + "Prolonged Seizure Activity: motion_ms > " + String(t.critical_motion_duration) + "\n";
+  String seizure = "SEIZURE " + String(t.seizure_cooldown) + " 0 ";
+  r += seizure + "High HR: hr > " + String(t.hr_seizure_high) + "\n";
+  r += seizure + "Low SpO2: spo2 < " + String(t.spo2_seizure_low) + "\n";
+  r += seizure + "Prolonged Motion: motion_ms > " + String(t.motion_duration_threshold) + "\n";
+  String sepsis = "SEPSIS " + String(t.sepsis_cooldown) + " 0 ";
+  // Sepsis is a trend: 30 min medians, so one noisy PPG reading cannot trigger it
+  r += sepsis + "Tachycardia: hr_p50 > " + String(t.hr_sepsis_high) + "\n";
+  r += sepsis + "Bradycardia: hr_p50 < " + String(t.hr_sepsis_low) + " & hr_p50 > 0\n";
+  r += sepsis + "Hypoxemia: spo2_p50 < " + String(t.spo2_sepsis_low) + " & spo2_p50 > 0\n";
+  r += sepsis + "HR Above Baseline: hr_dev > " + String(t.hr_baseline_rise) + " & hr_cusum > " +
+       String(t.hr_drift_cusum) + "\n";
+  r += sepsis + "SpO2 Below Baseline: spo2_dev < " + String(-t.spo2_baseline_drop) + " & spo2_cusum > " +
+       String(t.spo2_drift_cusum) + "\n";
+  return r;
+}
+
+void initializeRules() {
+  char error[RULE_ERROR_LEN];
   
-  // Check for SEIZURE conditions
-  else if ((current_hr > thresholds.hr_seizure_high) ||
-           (current_spo2 < thresholds.spo2_seizure_low) ||
-           (motion_detected && (current_time - motion_start_time) > thresholds.motion_duration_threshold)) {
-    
-    seizure_detected = true;
-    
-    if (current_time - last_seizure_alert > thresholds.seizure_cooldown) {
-      alert_message = "SEIZURE ALERT! ";
-      if (current_hr > thresholds.hr_seizure_high) alert_message += "High HR ";
-      if (current_spo2 < thresholds.spo2_seizure_low) alert_message += "Low SpO2 ";
-      if (motion_detected) alert_message += "Prolonged Motion ";
-      alert_message += "HR:" + String(current_hr) + " SpO2:" + String(current_spo2);
-      alert_type = "SEIZURE";
-      send_alert = true;
-      last_seizure_alert = current_time;
+  rule_store.begin("rules", false);
+  String stored_token = rule_store.getString("token", "");
+  if (stored_token.length() > 0) rules_api_token = stored_token;
+  if (rules_api_token == RULES_TOKEN_PLACEHOLDER) {
+    Serial.println("No rules API token set: POST /rules disabled");
+  }
+  
+  String stored = rule_store.getString("text", "");
+  if (stored.length() > 0) {
+    if (rules.load(stored.c_str(), error, sizeof(error))) {
+      active_rules_text = stored;
+      Serial.println("Loaded alert rules from NVS");
+      return;
     }
+    Serial.println("Stored alert rules rejected: " + String(error));
   }
   
-  // Check for SEPSIS conditions
-  else if ((current_hr > thresholds.hr_sepsis_high || current_hr < thresholds.hr_sepsis_low) ||
-           (current_spo2 < thresholds.spo2_sepsis_low)) {
-    
-    sepsis_detected = true;
-    
-    if (current_time - last_sepsis_alert > thresholds.sepsis_cooldown) {
-      alert_message = "SEPSIS ALERT! ";
-      if (current_hr > thresholds.hr_sepsis_high) alert_message += "Tachycardia ";
-      if (current_hr < thresholds.hr_sepsis_low) alert_message += "Bradycardia ";
-      if (current_spo2 < thresholds.spo2_sepsis_low) alert_message += "Hypoxemia ";
-      alert_message += "HR:" + String(current_hr) + " SpO2:" + String(current_spo2);
-      alert_type = "SEPSIS";
-      send_alert = true;
-      last_sepsis_alert = current_time;
+  active_rules_text = defaultRules(thresholds);
+  if (!rules.load(active_rules_text.c_str(), error, sizeof(error))) {
+    Serial.println("Default alert rules rejected: " + String(error));
+  }
+}
+
+void initializeWebServer() {
+  static const char* headers[] = {"Authorization"};
+  server.collectHeaders(headers, 1);
+  server.on("/rules", HTTP_GET, handleGetRules);
+  server.on("/rules", HTTP_POST, handlePostRules);
+  server.on("/boot", HTTP_GET, handleBootTimeline);
+  server.on("/history", HTTP_GET, handleHistory);
+  server.on("/calibration", HTTP_GET, handleCalibration);
+  server.on("/trends", HTTP_GET, handleTrends);
+  server.on("/i2c", HTTP_GET, handleI2CRecovery);
+  server.begin();
+}
+
+void handleBootTimeline() {
+  server.send(200, "application/json", boot.toJson());
+}
+
+// HR and SpO2 trend statistics the sepsis rules see
+void handleTrends() {
+  uint32_t now = millis();
+  String json = "{";
+  for (int i = 0; i < 2; i++) {
+    VitalTrendSnapshot t = i == 0 ? vitals_stats.hr.snapshot(now) : vitals_stats.spo2.snapshot(now);
+    json += String(i ? ",\"spo2\"" : "\"hr\"") + ":{\"avg\":" + String(t.fast, 2) + ",\"p50\":" + String(t.p50, 2) +
+            ",\"baseline\":" + String(t.baseline, 2) + ",\"deviation\":" + String(t.deviation, 2) +
+            ",\"cusum\":" + String(t.cusum, 1) + "}";
+  }
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
+// MPU6050 fault recovery counters and time blind
+void handleI2CRecovery() {
+  char json[320];
+  i2cRecoveryJson(mpu_recovery_stats.read(), json, sizeof(json));
+  server.send(200, "application/json", json);
+}
+
+// Current IMU calibration in physical units
+void handleCalibration() {
+  ImuCalibration c;
+  imu_cal.read(c);
+  String json = "{\"warm_start\":" + String(imu_cal.warmStart() ? "true" : "false") +
+                ",\"gyro_valid\":" + String(c.flags & IMU_CAL_GYRO_VALID ? "true" : "false") +
+                ",\"accel_valid\":" + String(c.flags & IMU_CAL_ACCEL_VALID ? "true" : "false") + ",\"gyro_bias_dps\":[";
+  for (int k = 0; k < 3; k++) json += String(k ? "," : "") + String(c.gyro_bias_q8[k] / 256.0f / c.lsb_per_dps, 3);
+  json += "],\"accel_offset_g\":[";
+  for (int k = 0; k < 3; k++) json += String(k ? "," : "") + String(c.accel_offset_q8[k] / 256.0f / c.lsb_per_g, 4);
+  json += "],\"accel_scale\":[";
+  for (int k = 0; k < 3; k++) json += String(k ? "," : "") + String((float)c.accel_scale_q14[k] / IMU_CAL_SCALE_ONE, 4);
+  json += "],\"accel_residual_g\":" + String(c.accel_residual_g, 4) + ",\"still_windows\":" + String(c.still_windows) +
+          ",\"accel_fits\":" + String(c.accel_fits) + "}";
+  server.send(200, "application/json", json);
+}
+
+// /history?metric=hr&from=-600&step=10
+//   metric: hr, spo2, accel, gyro (omit for storage statistics)
+//   from:   uptime seconds, or negative for seconds before now (default -600)
+//   step:   seconds per point (rounded up to the stored resolution); by default
+//           the resolution of the finest tier that reaches back to `from`
+// Points are [t, min, max, mean], streamed in chunks.
+void handleHistory() {
+  uint32_t now_s = millis() / 1000;
+  
+  if (!server.hasArg("metric")) {
+    handleHistoryStats();
+    return;
+  }
+  int metric = historyMetricFromName(server.arg("metric").c_str());
+  if (metric < 0) {
+    server.send(400, "text/plain", "metric must be hr, spo2, accel or gyro");
+    return;
+  }
+  long from = server.hasArg("from") ? server.arg("from").toInt() : -600;
+  uint32_t from_s = from < 0 ? (uint32_t)max(0L, (long)now_s + from) : (uint32_t)from;
+  long step_arg = server.hasArg("step") ? server.arg("step").toInt() : 0;
+  uint32_t step = step_arg > 0 ? step_arg : 0;
+  
+  MetricHistory& series = history.metric(metric);
+  step = series.resolveStep(from_s, step);
+  
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  String chunk = "{\"metric\":\"" + String(historyMetricName(metric)) + "\",\"now\":" + String(now_s) +
+                 ",\"step\":" + String(step) + ",\"points\":[";
+  bool first = true;
+  series.query(from_s, step, [&](const HistoryPoint& p) {
+    if (!first) chunk += ",";
+    first = false;
+    chunk += "[" + String(p.t) + "," + String(p.min, 3) + "," + String(p.max, 3) + "," + String(p.mean, 3) + "]";
+    if (chunk.length() > 1024) {
+      server.sendContent(chunk);
+      chunk = "";
     }
+  });
+  chunk += "]}";
+  server.sendContent(chunk);
+  server.sendContent("");
+}
+
+// Storage use per metric and tier
+void handleHistoryStats() {
+  String json = "{\"budget_bytes\":" + String(VitalsHistory::bytes()) + ",\"metrics\":[";
+  for (int m = 0; m < HISTORY_METRIC_COUNT; m++) {
+    MetricHistory& series = history.metric(m);
+    if (m) json += ",";
+    json += "{\"name\":\"" + String(historyMetricName(m)) + "\",\"samples\":" + String(series.samples) + ",\"tiers\":[";
+    for (int t = 0; t < HISTORY_TIERS; t++) {
+      uint32_t points = series.tierPoints(t);
+      uint32_t bits = series.tierBits(t);
+      if (t) json += ",";
+      json += "{\"step\":" + String(HISTORY_TIER_CONFIG[t].step_s) + ",\"points\":" + String(points) +
+              ",\"bits_per_point\":" + String(points ? (float)bits / points : 0.0f, 1) +
+              ",\"oldest\":" + String(series.oldest(t)) + "}";
+    }
+    json += "]}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+void handleGetRules() {
+  server.sendHeader("X-Rules-Version", String(rules.version()));
+  server.send(200, "text/plain", active_rules_text);
+}
+
+// Compares every byte whatever the first mismatch, so the time taken says
+// nothing about how much of the token a guess got right
+bool tokenMatches(const String& given, const String& expected) {
+  if (given.length() != expected.length()) return false;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < expected.length(); i++) diff |= (uint8_t)(given[i] ^ expected[i]);
+  return diff == 0;
+}
+
+// Replace the rule set: compiled, staged, then swapped in by the next evaluation
+void handlePostRules() {
+  if (rules_api_token.length() == 0 || rules_api_token == RULES_TOKEN_PLACEHOLDER) {
+    server.send(403, "text/plain", "Rule updates disabled: no API token set");
+    return;
   }
+  if (!tokenMatches(server.header("Authorization"), "Bearer " + rules_api_token)) {
+    server.send(401, "text/plain", "Unauthorized");
+    return;
+  }
+  
+  String text = server.arg("plain");
+  if (text.length() > RULES_MAX_TEXT) {
+    server.send(413, "text/plain", "Rule set too large");
+    return;
+  }
+  
+  char error[RULE_ERROR_LEN];
+  if (!rules.load(text.c_str(), error, sizeof(error))) {
+    server.send(400, "text/plain", error);
+    return;
+  }
+  
+  rule_store.putString("text", text);
+  active_rules_text = text;
+  Serial.println("Alert rules replaced over HTTP");
+  server.send(200, "text/plain", "OK");
+}
+
+void initializeAlerts() {
+  sms_channel = alerts.addChannel("SMS", 0xFF, SMS_BURST, SMS_PER_HOUR, millis());
   
-  // Send SMS alert if conditions are met
-  if (send_alert) {
-    Serial.println("MEDICAL ALERT TRIGGERED!");
-    Serial.println("Alert Type: " + alert_type);
-    Serial.println("Message: " + alert_message);
-    sendSMS(alert_message, alert_type);
+  static const AlertLane lanes[ALERT_LANE_COUNT] = {ALERT_LANE_URGENT, ALERT_LANE_NORMAL};
+  xTaskCreatePinnedToCore(alertTask, "alert-urgent", 8192, (void*)&lanes[ALERT_LANE_URGENT], 3, NULL, 0);
+  xTaskCreatePinnedToCore(alertTask, "alert-normal", 8192, (void*)&lanes[ALERT_LANE_NORMAL], 2, NULL, 0);
+}
+
+// One task per lane: takes the next (coalesced) message and sends it
+void alertTask(void* arg) {
+  AlertLane lane = *(const AlertLane*)arg;
+  char message[ALERT_MESSAGE_LEN];
+  AlertPriority priority;
+  
+  for (;;) {
+    if (!alerts.next(sms_channel, lane, millis(), message, sizeof(message), &priority)) {
+      vTaskDelay(pdMS_TO_TICKS(50));
+      continue;
+    }
+    AlertResult result = sendSMS(message, lane);
+    alerts.complete(sms_channel, lane, result, millis());
+    if (result == ALERT_DEFERRED) vTaskDelay(pdMS_TO_TICKS(1000));
   }
 }
 
-void sendSMS(String message, String alert_type) {
+AlertResult sendSMS(String message, AlertLane lane) {
   if (WiFi.status() != WL_CONNECTED) {
     Serial.println("WiFi not connected, cannot send SMS");
-    return;
+    return ALERT_DEFERRED;
   }
+  if (alerts.abortRequested(sms_channel, lane)) return ALERT_ABORTED;
   
   HTTPClient http;
+  http.setConnectTimeout(SMS_HTTP_TIMEOUT_MS);
+  http.setTimeout(SMS_HTTP_TIMEOUT_MS);
   http.begin("https://api.twilio.com/2010-04-01/Accounts/" + String(account_sid) + "/Messages.json");
   
   // Set headers
@@ -296,14 +1003,24 @@ void sendSMS(String message, String alert_type) {
                    "&From=" + String(twilio_phone_number) + 
                    "&Body=" + message;
   
+  // Last chance to give way to a CRITICAL alert before the request goes out
+  if (alerts.abortRequested(sms_channel, lane)) {
+    http.end();
+    Serial.println("SMS preempted by critical alert");
+    return ALERT_ABORTED;
+  }
+  
   Serial.println("Sending SMS...");
   int httpResponseCode = http.POST(postData);
+  AlertResult result = ALERT_FAILED;
+  if (httpResponseCode > 0) boot.mark("first_packet");
   
   if (httpResponseCode > 0) {
     String response = http.getString();
     Serial.println("SMS Response Code: " + String(httpResponseCode));
     if (httpResponseCode == 201) {
       Serial.println("SMS sent successfully!");
+      result = ALERT_SENT;
     } else {
       Serial.println("SMS Error Response: " + response);
     }
@@ -312,20 +1029,34 @@ void sendSMS(String message, String alert_type) {
   }
   
   http.end();
+  return result;
 }
 
+// Runs inside pox.update() on the MAX30100 bus task
 void onBeatDetected() {
-  // This callback is triggered when MAX30100 detects a heartbeat
-  // Can be used for additional processing if needed
+  beat_ring.push(esp_timer_get_time());
 }
 
 void printStatus() {
   Serial.println("=== MEDICAL MONITORING STATUS ===");
   Serial.println("Heart Rate: " + String(current_hr) + " BPM");
   Serial.println("SpO2: " + String(current_spo2) + " %");
+  HrvSnapshot beats = hrv.snapshot((uint32_t)(esp_timer_get_time() / 1000));
+  Serial.println("Beat HR: " + String(beats.hr_bpm, 1) + " BPM, RMSSD: " + String(beats.rmssd_ms, 1) +
+                 " ms, SDNN: " + String(beats.sdnn_ms, 1) + " ms (" + String(beats.intervals) + " RR, " +
+                 String(beats.artifacts) + " artifacts, " + String(beat_ring.dropped()) + " dropped)");
+  uint32_t now = millis();
+  Serial.println("Last 20 s: HR " + String(hr_min_window.value(now)) + ".." + String(hr_max_window.value(now)) +
+                 " BPM, SpO2 min " + String(spo2_min_window.value(now)) + " %; last 10 s: gyro RMS " +
+                 String(sqrtf(gyro_sq_window.mean(now)), 1) + " deg/s, accel peak " +
+                 String(accel_max_window.value(now), 2) + " g");
   Serial.println("Accel Magnitude: " + String(accel_magnitude) + " g");
   Serial.println("Gyro Magnitude: " + String(gyro_magnitude) + " deg/s");
   Serial.println("Motion Detected: " + String(motion_detected ? "YES" : "NO"));
+  I2CRecoveryStats mpu_faults = mpu_recovery_stats.read();
+  Serial.printf("MPU6050 I2C: %s, faults=%u fixed by unstick=%u resync=%u reinit=%u, blind %u ms (worst %u ms)\n",
+                mpu_faults.healthy ? "ok" : "recovering", mpu_faults.faults, mpu_faults.unstick_fixes,
+                mpu_faults.resync_fixes, mpu_faults.reinit_fixes, mpu_faults.blind_ms, mpu_faults.worst_blind_ms);
   
   if (motion_detected) {
     unsigned long motion_duration = (millis() - motion_start_time) / 1000;
@@ -345,5 +1076,29 @@ void printStatus() {
   }
   
   Serial.println("WiFi: " + String(WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected"));
+  Serial.printf("WiFi connects=%u (cached=%u, cache misses=%u) drops=%u last reconnect=%u ms\n",
+                wifi.connects, wifi.fast_connects, wifi.fast_failures, wifi.disconnects,
+                wifi.last_connect_duration_ms);
+  Serial.printf("Uplink %s: frames sent=%u replayed=%u queued=%u dropped=%u publishes=%u bytes=%u\n",
+                uplink.isConnected() ? "connected" : "offline", uplink.frames_sent, uplink.frames_replayed,
+                uplink.queued(), uplink.droppedFrames(), uplink.publishes, uplink.bytes_published);
+  Serial.printf("Boot to first sample: %u ms, to WiFi: %u ms, to first packet: %u ms\n",
+                boot.reachedAt("first_sample"), wifi.first_connect_ms, boot.reachedAt("first_packet"));
+  
+  // Time from alert to SMS delivery per severity
+  for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+    const AlertDeliveryStats& st = alerts.deliveryStats((AlertPriority)p);
+    if (st.submitted == 0) continue;
+    Serial.printf("Alerts %s: submitted=%u delivered=%u coalesced=%u preempted=%u dropped=%u delivery avg=%ums max=%ums\n",
+                  alertPriorityName(p), st.submitted, st.delivered, st.coalesced, st.preempted,
+                  st.dropped, st.meanDeliveryMs(), st.max_delivery_ms);
+  }
+  
+  Serial.printf("MPU FIFO resets: %u\n", mpu_fifo_resets);
+  for (int i = 0; i < i2c.streamCount(); i++) {
+    const I2CStream& st = i2c.stream(i);
+    Serial.printf("I2C stream %d (bus %d): runs=%u errors=%u missed=%u worst_late=%uus\n",
+                  i, st.bus, st.runs, st.errors, st.deadline_misses, st.worst_lateness_us);
+  }
   Serial.println("================================");
 }
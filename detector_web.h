@@ -0,0 +1,159 @@
+#pragma once
+// Web routes of the fall/seizure monitor (iot/newfallseizurelogic.cpp).
+//
+// "/" serves the dashboard, "/data" the flags the loop last published
+// through a SnapshotPublisher, "/resetFall" and "/resetSeizure" queue resets
+// for the detection task, and "/classifier?on=1|0" switches seizure windows
+// between the int8 classifier and the gyro RMS threshold. Every response carries open CORS headers and an
+// OPTIONS preflight gets 200. Handlers never touch detector state, so the same
+// routes also run on the host against the socket-backed server stand-in in
+// tools/host (see tools/http_load.cpp).
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "http_snapshot.h"
+
+// CommandMailbox bits, taken by the detection task
+const uint32_t CMD_RESET_FALL = 1 << 0;
+const uint32_t CMD_RESET_SEIZURE = 1 << 1;
+const uint32_t CMD_CLASSIFIER_ON = 1 << 2;
+const uint32_t CMD_CLASSIFIER_OFF = 1 << 3;
+
+const char INDEX_HTML[] PROGMEM = R"=====(
+  <!DOCTYPE html>
+  <html>
+  <head>
+    <title>ESP32 Fall/Seizure Detector</title>
+    <meta name="viewport" content="width=device-width, initial-scale=1">
+    <style>
+      body { font-family: Arial, sans-serif; text-align: center; margin: 20px; }
+      .flag { font-size: 2em; font-weight: bold; margin: 10px; }
+      .status { padding: 15px; border-radius: 10px; margin: 20px; }
+      .normal { background-color: #d4edda; color: #155724; }
+      .warning { background-color: #fff3cd; color: #856404; }
+      .alert { background-color: #f8d7da; color: #721c24; }
+      button { 
+        background-color: #dc3545; color: white; border: none; 
+        padding: 10px 20px; border-radius: 5px; cursor: pointer;
+        margin-top: 10px; font-size: 1em;
+      }
+    </style>
+  </head>
+  <body>
+    <h1>ESP32 Health Monitor</h1>
+    
+    <div id="fallStatus" class="status normal">
+      <h2>Fall Detection</h2>
+      <p class="flag" id="fallFlag">0</p>
+      <button id="resetFallButton" style="display:none;">Reset Fall Alert</button>
+    </div>
+    
+    <div id="seizureStatus" class="status normal">
+      <h2>Seizure Detection</h2>
+      <p class="flag" id="seizureFlag">0</p>
+      <button id="resetSeizureButton" style="display:none;">Reset Severe Seizure</button>
+    </div>
+    
+    <script>
+      function getStatusClass(flagValue) {
+        if (flagValue == 2) return 'alert';
+        if (flagValue == 1) return 'warning';
+        return 'normal';
+      }
+      
+      function updateData() {
+        fetch('/data')
+          .then(r => r.json())
+          .then(data => {
+            document.getElementById('fallFlag').textContent = data.fallFlag;
+            document.getElementById('seizureFlag').textContent = data.seizureFlag;
+            
+            // Update UI
+            document.getElementById('fallStatus').className = 
+              `status ${data.fallFlag ? 'alert' : 'normal'}`;
+            document.getElementById('seizureStatus').className = 
+              `status ${getStatusClass(data.seizureFlag)}`;
+              
+            // Show/hide buttons
+            document.getElementById('resetFallButton').style.display = 
+              data.fallFlag ? 'inline-block' : 'none';
+            document.getElementById('resetSeizureButton').style.display = 
+              data.seizureFlag == 2 ? 'inline-block' : 'none';
+          });
+      }
+      
+      // Button handlers
+      document.getElementById('resetFallButton').addEventListener('click', () => {
+        fetch('/resetFall').then(updateData);
+      });
+      document.getElementById('resetSeizureButton').addEventListener('click', () => {
+        fetch('/resetSeizure').then(updateData);
+      });
+      
+      // Update every second
+      setInterval(updateData, 1000);
+      updateData();
+    </script>
+  </body>
+  </html>
+  )=====";
+
+// The /data body
+inline String detectorDataJson(int fallFlag, int seizureFlag) {
+  return String("{\"fallFlag\":") + fallFlag + ",\"seizureFlag\":" + seizureFlag + "}";
+}
+
+inline void handleNotFound(AsyncWebServerRequest* request) {
+  // CORS preflight: the default headers carry the answer
+  if (request->method() == HTTP_OPTIONS) {
+    request->send(200);
+    return;
+  }
+
+  String message = "File Not Found\n\n";
+  message += "URI: "; 
+  message += request->url();
+  message += "\nMethod: ";
+  message += request->methodToString();
+  message += "\nArguments: ";
+  message += request->args();
+  message += "\n";
+  
+  for (size_t i = 0; i < request->args(); i++) {
+    message += " " + request->argName(i) + ": " + request->arg(i) + "\n";
+  }
+  
+  request->send(404, "text/plain", message);
+}
+
+inline void addDetectorRoutes(AsyncWebServer& server, SnapshotPublisher& data, CommandMailbox& commands) {
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send_P(200, "text/html", INDEX_HTML);
+  });
+  server.on("/data", HTTP_GET, [&data](AsyncWebServerRequest* request) {
+    data.serve(request, "application/json");
+  });
+  server.on("/resetFall", HTTP_ANY, [&commands](AsyncWebServerRequest* request) {
+    commands.post(CMD_RESET_FALL);
+    request->send(200, "text/plain", "OK");
+  });
+  server.on("/resetSeizure", HTTP_ANY, [&commands](AsyncWebServerRequest* request) {
+    commands.post(CMD_RESET_SEIZURE);
+    request->send(200, "text/plain", "OK");
+  });
+  // The detection task only switches on a model that passed its checks
+  server.on("/classifier", HTTP_ANY, [&commands](AsyncWebServerRequest* request) {
+    if (!request->hasArg("on")) {
+      request->send(400, "text/plain", "on=1 or on=0 required");
+      return;
+    }
+    commands.post(request->arg("on") == "1" ? CMD_CLASSIFIER_ON : CMD_CLASSIFIER_OFF);
+    request->send(200, "text/plain", "OK");
+  });
+  server.onNotFound(handleNotFound);
+
+  // CORS for all routes, as WebServer::enableCORS(true) did
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "*");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "*");
+}
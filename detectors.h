@@ -0,0 +1,129 @@
+#pragma once
+// Fall and seizure detectors shared by the sketches and the host tools.
+//
+// Both take samples in physical units with a millisecond timestamp and keep
+// no global state, so the firmware and tools/threshold_sweep run exactly the
+// same logic.
+//
+// Fall: free fall (|a| below freefall_g) lasting debounce_ms while any gyro
+// axis exceeds gyro_fall_dps raises the flag. It clears after flag_ms, or
+// only on reset() when flag_ms is 0.
+//
+// Seizure: RMS of the gyro magnitude over consecutive windows of
+// window_samples. A window above rms_threshold raises flag 1; flag 1 drops
+// again once a window comes in below the threshold. With alert_ms set, flag 1
+// held for alert_ms escalates to 2, which only reset() clears. The window
+// decision can also come from elsewhere through verdict().
+
+#include <stdint.h>
+#include <math.h>
+
+struct FallDetectorConfig {
+  float freefall_g;
+  float gyro_fall_dps;
+  uint32_t debounce_ms;
+  uint32_t flag_ms;        // 0 = latch until reset()
+};
+
+struct SeizureDetectorConfig {
+  float rms_threshold;     // deg/s
+  uint16_t window_samples;
+  uint32_t alert_ms;       // 0 = never escalate to 2
+};
+
+class FallDetector {
+public:
+  explicit FallDetector(const FallDetectorConfig& config) : config(config) {}
+
+  // Returns the flag after this sample
+  int update(uint32_t now_ms, float amag_g, float wx_dps, float wy_dps, float wz_dps) {
+    if (amag_g < config.freefall_g) {
+      if (!in_freefall) {
+        in_freefall = true;
+        freefall_start_ms = now_ms;
+      } else if (now_ms - freefall_start_ms >= config.debounce_ms &&
+                 (fabsf(wx_dps) > config.gyro_fall_dps || fabsf(wy_dps) > config.gyro_fall_dps ||
+                  fabsf(wz_dps) > config.gyro_fall_dps) &&
+                 (config.flag_ms == 0 || fall_flag == 0)) {
+        if (fall_flag == 0) raised_ms = now_ms;
+        fall_flag = 1;
+      }
+    } else {
+      in_freefall = false;
+    }
+
+    if (config.flag_ms && fall_flag && now_ms - raised_ms >= config.flag_ms) fall_flag = 0;
+    return fall_flag;
+  }
+
+  void reset() { fall_flag = 0; }
+  int flag() const { return fall_flag; }
+  bool inFreefall() const { return in_freefall; }
+
+private:
+  FallDetectorConfig config;
+  bool in_freefall = false;
+  uint32_t freefall_start_ms = 0;
+  uint32_t raised_ms = 0;
+  int fall_flag = 0;
+};
+
+class SeizureDetector {
+public:
+  explicit SeizureDetector(const SeizureDetectorConfig& config) : config(config) {}
+
+  // Returns the flag after this sample
+  int update(uint32_t now_ms, float wmag_dps) {
+    sum_sq += wmag_dps * wmag_dps;
+    if (++count >= config.window_samples) {
+      float rms = sqrtf(sum_sq / count);
+      last_rms = rms;
+      sum_sq = 0;
+      count = 0;
+      verdict(now_ms, rms > config.rms_threshold);
+    }
+    return tick(now_ms);
+  }
+
+  // Window decision from another stage (imu_classifier.h) in place of the
+  // RMS; call tick() every sample instead of update()
+  void verdict(uint32_t now_ms, bool seizure) {
+    active = seizure;
+    if (active && seizure_flag == 0) {
+      seizure_flag = 1;
+      start_ms = now_ms;
+    }
+  }
+
+  // Drops or escalates flag 1; returns the flag
+  int tick(uint32_t now_ms) {
+    if (seizure_flag == 1) {
+      if (!active) {
+        // Condition ended before escalation
+        seizure_flag = 0;
+      } else if (config.alert_ms && now_ms - start_ms >= config.alert_ms) {
+        seizure_flag = 2;
+      }
+    }
+    return seizure_flag;
+  }
+
+  void reset() {
+    seizure_flag = 0;
+    active = false;
+  }
+
+  int flag() const { return seizure_flag; }
+  bool detected() const { return active; }
+  uint32_t startedAt() const { return seizure_flag ? start_ms : 0; }
+  float lastRms() const { return last_rms; }
+
+private:
+  SeizureDetectorConfig config;
+  float sum_sq = 0;
+  uint16_t count = 0;
+  bool active = false;
+  uint32_t start_ms = 0;
+  float last_rms = 0;
+  int seizure_flag = 0;
+};
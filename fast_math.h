@@ -0,0 +1,282 @@
+#pragma once
+// Fast approximations of sqrt, 1/sqrt, atan2, sin and cos.
+//
+// The lookup tables are generated by the compiler (constexpr, C++11) from
+// series that are exact to double precision, so they need no generator script
+// and cannot drift from the code that indexes them; they go into flash.
+// Every kernel has a maximum error, measured over its whole input range by
+// tools/fast_math_bench.cpp, which also times each one against libm. Pick the
+// cheapest one whose bound fits the stage's budget; if nothing needs to be
+// saved, keep libm.
+//
+//   float                       method                              max error
+//   fastRsqrt(x)                table seed (256) + 1 Newton step    FAST_RSQRT_REL_ERROR
+//   fastSqrt(x)                 x * fastRsqrt(x)                    FAST_SQRT_REL_ERROR
+//   fastRsqrtCoarse(x)          bit-trick seed + 1 Newton step      FAST_RSQRT_COARSE_REL_ERROR
+//   fastSqrtCoarse(x)           x * fastRsqrtCoarse(x)              FAST_SQRT_COARSE_REL_ERROR
+//   fastAtan2(y, x)             9th order odd polynomial            FAST_ATAN2_ERROR rad
+//                               (Abramowitz & Stegun 4.4.49)
+//   fastAtan2Coarse(y, x)       pi/4 z - z (z - 1)(0.2447 + 0.0663 z)  FAST_ATAN2_COARSE_ERROR rad
+//   fastSin(x), fastCos(x)      table (1024 per turn), linear       FAST_SIN_ERROR, |x| <= 100
+//
+//   fixed point
+//   fastSqrtQ16(x)              table seed + integer Newton,        exact (floor)
+//                               Q16.16 in and out
+//   fastAtan2Q15(y, x)          ratio table (256), linear; int16    FAST_ATAN2_Q15_ERROR LSB
+//                               in, angle out in units of pi/32768
+//   fastSinQ15(a), fastCosQ15(a)  table (1024 per turn), linear;    FAST_SIN_Q15_ERROR LSB
+//                               angle in pi/32768, Q15 out
+//
+// The fixed-point angle is a binary angle: 65536 units per turn, so it wraps
+// in int16 arithmetic like the angle does, and pi comes out as -32768. The
+// fixed-point kernels use no floating point at all, for chips without an FPU.
+//
+// Domains: the rsqrt kernels take positive normal floats; the sqrt kernels
+// also return 0 for 0, denormals and negatives. atan2 takes finite values and
+// does not tell +0 from -0 (atan2(-0, -1) is +pi, not -pi); atan2(0, 0) is 0.
+// fastSin/fastCos take |x| < 1e7; rounding x to table steps adds an error
+// of about |x| * 6e-8, which is most of FAST_SIN_ERROR at |x| = 100.
+// fastSqrtQ16 costs an integer division and up to 8 digit steps, so on a
+// chip with an FPU the float kernels are the faster choice.
+//
+// Everything here is plain C++ and runs the same on the host.
+
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+
+static const float FAST_RSQRT_REL_ERROR = 5.8e-6f;
+static const float FAST_SQRT_REL_ERROR = 5.9e-6f;
+static const float FAST_RSQRT_COARSE_REL_ERROR = 1.76e-3f;
+static const float FAST_SQRT_COARSE_REL_ERROR = 1.76e-3f;
+static const float FAST_ATAN2_ERROR = 1.2e-5f;
+static const float FAST_ATAN2_COARSE_ERROR = 1.6e-3f;
+static const float FAST_SIN_ERROR = 9.0e-6f;  // |x| <= 100
+static const float FAST_ATAN2_Q15_ERROR = 1.0f;
+static const float FAST_SIN_Q15_ERROR = 1.1f;
+
+// ---- compile-time table generation ----
+
+// Index packs 0..N-1, built by halving so that 1025-entry tables stay well
+// inside the template depth limit
+template <unsigned... I> struct FastMathSeq { typedef FastMathSeq type; };
+template <class A, class B> struct FastMathCat;
+template <unsigned... A, unsigned... B>
+struct FastMathCat<FastMathSeq<A...>, FastMathSeq<B...> > : FastMathSeq<A..., (unsigned)sizeof...(A) + B...> {};
+template <unsigned N>
+struct FastMathMakeSeq
+    : FastMathCat<typename FastMathMakeSeq<N / 2>::type, typename FastMathMakeSeq<N - N / 2>::type> {};
+template <> struct FastMathMakeSeq<0> : FastMathSeq<> {};
+template <> struct FastMathMakeSeq<1> : FastMathSeq<0> {};
+
+static constexpr double FAST_MATH_PI = 3.14159265358979323846;
+
+constexpr double fastMathCtSqrtIter(double x, double y, int n) {
+  return n == 0 ? y : fastMathCtSqrtIter(x, 0.5 * (y + x / y), n - 1);
+}
+
+constexpr double fastMathCtSqrt(double x) { return x <= 0 ? 0 : fastMathCtSqrtIter(x, x < 1 ? 1 : x, 64); }
+
+// Taylor series, |x| <= pi
+constexpr double fastMathCtSinSeries(double x2, double term, int k) {
+  return k > 25 ? 0 : term + fastMathCtSinSeries(x2, -term * x2 / ((2.0 * k + 2) * (2.0 * k + 3)), k + 1);
+}
+
+constexpr double fastMathCtSin(double x) {
+  return x > FAST_MATH_PI ? fastMathCtSin(x - 2 * FAST_MATH_PI) : fastMathCtSinSeries(x * x, x, 0);
+}
+
+// Euler's series, atan(t) = t/(1+t^2) * sum a_n y^n with y = t^2/(1+t^2);
+// y <= 1/2 for t <= 1, so 60 terms are plenty
+constexpr double fastMathCtAtanSeries(double y, double a, int n) {
+  return n > 60 ? 0 : a + y * fastMathCtAtanSeries(y, a * (2.0 * n + 2) / (2.0 * n + 3), n + 1);
+}
+
+constexpr double fastMathCtAtan(double t) {
+  return t / (1 + t * t) * fastMathCtAtanSeries(t * t / (1 + t * t), 1, 0);
+}
+
+constexpr double fastMathCtRound(double x) { return x < 0 ? -(double)(int32_t)(0.5 - x) : (double)(int32_t)(x + 0.5); }
+
+// 1/sqrt seed for the interval selected by the low exponent bit (set: the
+// unbiased exponent is even, mantissa in [1, 2); clear: odd, [2, 4)) and the
+// top 7 mantissa bits. The value minimises the largest relative error over
+// the interval: 2 / (sqrt(a) + sqrt(b)).
+constexpr float fastMathRsqrtSeed(unsigned i) {
+  return (float)(2 / (fastMathCtSqrt((i & 128 ? 1 : 2) * (1 + (i & 127) / 128.0)) +
+                      fastMathCtSqrt((i & 128 ? 1 : 2) * (1 + ((i & 127) + 1) / 128.0))));
+}
+
+// floor(sqrt(n)) seed for n in [i, i+1) * 2^24, i = 64..255 (index i - 64)
+constexpr uint16_t fastMathSqrtQ16Seed(unsigned i) {
+  return (uint16_t)fastMathCtRound(fastMathCtSqrt((i + 64 + 0.5) * 16777216.0));
+}
+
+// atan(i / 256) in units of pi/131072 (two more bits than the result); one
+// entry past 1 so the interpolation never needs a branch
+constexpr uint16_t fastMathAtanQ17(unsigned i) {
+  return (uint16_t)fastMathCtRound(fastMathCtAtan(i / 256.0) * (131072 / FAST_MATH_PI));
+}
+
+constexpr float fastMathSinTurn(unsigned i) { return (float)fastMathCtSin(i * (2 * FAST_MATH_PI / 1024)); }
+
+constexpr int16_t fastMathClampQ15(double v) { return (int16_t)(v > 32767 ? 32767 : v); }
+
+constexpr int16_t fastMathSinQ15(unsigned i) {
+  return fastMathClampQ15(fastMathCtRound(fastMathCtSin(i * (2 * FAST_MATH_PI / 1024)) * 32768));
+}
+
+template <class Seq> struct FastMathRsqrtTable;
+template <unsigned... I> struct FastMathRsqrtTable<FastMathSeq<I...> > {
+  static constexpr float rsqrt_seed[sizeof...(I)] = {fastMathRsqrtSeed(I)...};
+};
+template <unsigned... I> constexpr float FastMathRsqrtTable<FastMathSeq<I...> >::rsqrt_seed[];
+
+template <class Seq> struct FastMathSqrtTable;
+template <unsigned... I> struct FastMathSqrtTable<FastMathSeq<I...> > {
+  static constexpr uint16_t seed[sizeof...(I)] = {fastMathSqrtQ16Seed(I)...};
+};
+template <unsigned... I> constexpr uint16_t FastMathSqrtTable<FastMathSeq<I...> >::seed[];
+
+template <class Seq> struct FastMathAtanTable;
+template <unsigned... I> struct FastMathAtanTable<FastMathSeq<I...> > {
+  static constexpr uint16_t q17[sizeof...(I)] = {fastMathAtanQ17(I)...};
+};
+template <unsigned... I> constexpr uint16_t FastMathAtanTable<FastMathSeq<I...> >::q17[];
+
+template <class Seq> struct FastMathSinTable;
+template <unsigned... I> struct FastMathSinTable<FastMathSeq<I...> > {
+  static constexpr float turn[sizeof...(I)] = {fastMathSinTurn(I)...};
+  static constexpr int16_t q15[sizeof...(I)] = {fastMathSinQ15(I)...};
+};
+template <unsigned... I> constexpr float FastMathSinTable<FastMathSeq<I...> >::turn[];
+template <unsigned... I> constexpr int16_t FastMathSinTable<FastMathSeq<I...> >::q15[];
+
+typedef FastMathRsqrtTable<FastMathMakeSeq<256>::type> FastMathRsqrt;
+typedef FastMathSqrtTable<FastMathMakeSeq<192>::type> FastMathSqrt;
+typedef FastMathAtanTable<FastMathMakeSeq<258>::type> FastMathAtan;
+typedef FastMathSinTable<FastMathMakeSeq<1025>::type> FastMathSin;
+
+// ---- float ----
+
+static inline uint32_t fastMathBits(float x) {
+  uint32_t b;
+  memcpy(&b, &x, 4);
+  return b;
+}
+
+static inline float fastMathFloat(uint32_t b) {
+  float x;
+  memcpy(&x, &b, 4);
+  return x;
+}
+
+static inline float fastRsqrt(float x) {
+  uint32_t b = fastMathBits(x);
+  // Seed in [0.5, 1] for the mantissa, times 2^-floor(e/2) for the exponent
+  int32_t half_exp = (int32_t)(((b >> 23) + 129) >> 1) - 128;
+  float y = fastMathFloat(fastMathBits(FastMathRsqrt::rsqrt_seed[(b >> 16) & 0xFF]) - ((uint32_t)half_exp << 23));
+  return y * (1.5f - 0.5f * x * y * y);
+}
+
+static inline float fastRsqrtCoarse(float x) {
+  float y = fastMathFloat(0x5F375A86u - (fastMathBits(x) >> 1));
+  return y * (1.5f - 0.5f * x * y * y);
+}
+
+static inline float fastSqrt(float x) { return x >= FLT_MIN ? x * fastRsqrt(x) : 0; }
+
+static inline float fastSqrtCoarse(float x) { return x >= FLT_MIN ? x * fastRsqrtCoarse(x) : 0; }
+
+// Folds atan(z), z = min/max of |y|, |x| in [0, 1], out to the full circle
+static inline float fastMathAtan2Fold(float a, float y, float x, bool steep) {
+  const float PI_F = 3.14159265f;
+  if (steep) a = PI_F / 2 - a;
+  if (x < 0) a = PI_F - a;
+  return y < 0 ? -a : a;
+}
+
+static inline float fastAtan2(float y, float x) {
+  float ax = x < 0 ? -x : x, ay = y < 0 ? -y : y;
+  bool steep = ay > ax;
+  float hi = steep ? ay : ax;
+  if (hi == 0) return 0;
+  float z = (steep ? ax : ay) / hi, z2 = z * z;
+  float a = z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+  return fastMathAtan2Fold(a, y, x, steep);
+}
+
+static inline float fastAtan2Coarse(float y, float x) {
+  float ax = x < 0 ? -x : x, ay = y < 0 ? -y : y;
+  bool steep = ay > ax;
+  float hi = steep ? ay : ax;
+  if (hi == 0) return 0;
+  float z = (steep ? ax : ay) / hi;
+  float a = 0.78539816f * z - z * (z - 1) * (0.2447f + 0.0663f * z);
+  return fastMathAtan2Fold(a, y, x, steep);
+}
+
+// sin over a turn of 1024 table steps; `offset` 256 gives cos
+static inline float fastMathSinSteps(float x, int32_t offset) {
+  float t = x * (float)(1024 / (2 * FAST_MATH_PI));
+  int32_t i = (int32_t)t;
+  if ((float)i > t) i--;  // floor for negative x
+  float f = t - (float)i;
+  const float* s = FastMathSin::turn + ((i + offset) & 1023);
+  return s[0] + (s[1] - s[0]) * f;
+}
+
+static inline float fastSin(float x) { return fastMathSinSteps(x, 0); }
+static inline float fastCos(float x) { return fastMathSinSteps(x, 256); }
+
+// ---- fixed point ----
+
+// sqrt of an unsigned Q16.16 value, as Q16.16, rounded down
+static inline uint32_t fastSqrtQ16(uint32_t x) {
+  if (x == 0) return 0;
+  // Normalise to n in [2^30, 2^32) by an even shift, root it to 16 bits
+  int k = __builtin_clz(x) >> 1;
+  uint32_t n = x << (2 * k);
+  uint32_t r = FastMathSqrt::seed[(n >> 24) - 64];
+  r = (r + n / r) >> 1;  // from above, so only ever too large
+  if (r > 0xFFFF) r = 0xFFFF;
+  while (r * r > n) r--;
+  // x * 2^16 = n * 4^(8 - k): shift the root down, or carry on digit by digit
+  // with zero bits coming in
+  if (k >= 8) return r >> (k - 8);
+  uint32_t rem = n - r * r;
+  for (int j = k; j < 8; j++) {
+    rem <<= 2;
+    r <<= 1;
+    if (rem >= 2 * r + 1) {
+      rem -= 2 * r + 1;
+      r++;
+    }
+  }
+  return r;
+}
+
+// Angle of (x, y) in units of pi/32768
+static inline int16_t fastAtan2Q15(int16_t y, int16_t x) {
+  uint32_t ax = x < 0 ? -(int32_t)x : x, ay = y < 0 ? -(int32_t)y : y;
+  bool steep = ay > ax;
+  uint32_t hi = steep ? ay : ax;
+  if (hi == 0) return 0;
+  uint32_t q = ((steep ? ax : ay) << 16) / hi;  // z in Q16, <= 1
+  uint32_t i = q >> 8, f = q & 0xFF;
+  const uint16_t* t = FastMathAtan::q17;
+  uint32_t a = t[i] + (((uint32_t)(t[i + 1] - t[i]) * f + 128) >> 8);
+  a = (a + 2) >> 2;
+  if (steep) a = 16384 - a;
+  if (x < 0) a = 32768 - a;
+  return (int16_t)(uint16_t)(y < 0 ? 0u - a : a);
+}
+
+// sin of an angle in units of pi/32768, Q15 (1.0 saturates to 32767)
+static inline int16_t fastSinQ15(int16_t angle) {
+  uint16_t p = (uint16_t)angle;
+  const int16_t* s = FastMathSin::q15 + (p >> 6);
+  return (int16_t)(s[0] + (((int32_t)(s[1] - s[0]) * (int32_t)(p & 63) + 32) >> 6));
+}
+
+static inline int16_t fastCosQ15(int16_t angle) { return fastSinQ15((int16_t)(uint16_t)((uint16_t)angle + 16384)); }
@@ -0,0 +1,244 @@
+#pragma once
+// Beat timestamp capture and streaming heart-rate variability.
+//
+// BeatRing is a single-producer / single-consumer ring of microsecond
+// timestamps. push() is a bounds check, a store and a release increment: no
+// locks, no allocation, safe from the beat callback (or an ISR, with the
+// methods placed in IRAM). A full ring drops the beat and counts it.
+//
+// HrvEngine takes the beats in order and keeps the RR intervals of the last
+// HRV_WINDOW_MS in a bounded ring, with integer running sums (RR, RR^2,
+// successive difference^2, NN50) that are updated as intervals enter and
+// leave, so a beat costs O(1) and the sums never drift. From those:
+//
+//   RMSSD  root mean square of successive RR differences
+//   SDNN   standard deviation of the RR intervals (n - 1)
+//   pNN50  share of successive differences over 50 ms
+//   HR     60000 / median of the last HRV_REF_BEATS accepted intervals
+//
+// An interval is an artifact (missed or extra beat, PPG glitch) when it is
+// outside HRV_MIN_RR_MS..HRV_MAX_RR_MS or differs from that median by more
+// than HRV_MAX_CHANGE. Artifacts are left out, and a successive difference is
+// only formed between two accepted intervals in a row. After HRV_REF_BEATS
+// rejections in a row the reference is rebuilt, so a genuine step in heart
+// rate is followed.
+//
+// Everything here is plain C++ and runs the same on the host.
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+
+#define HRV_WINDOW_MS   300000  // standard 5 min short-term window
+#define HRV_MAX_BEATS   512     // window capacity; above ~100 BPM it holds fewer than 5 min
+#define HRV_MIN_RR_MS   300     // 200 BPM
+#define HRV_MAX_RR_MS   2000    // 30 BPM
+#define HRV_MAX_CHANGE  0.2f
+#define HRV_REF_BEATS   5
+#define HRV_MIN_BEATS   30      // accepted intervals before RMSSD / SDNN are reported
+#define HRV_STALE_MS    3000    // HR reads 0 after this long without an accepted beat
+
+template <uint32_t N>
+class BeatRing {
+  static_assert((N & (N - 1)) == 0, "BeatRing size must be a power of two");
+
+public:
+  // Producer only; false (and counted) when the ring is full
+  bool push(uint64_t t_us) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) {
+      lost.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slots[h & (N - 1)] = t_us;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only
+  bool pop(uint64_t& t_us) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    t_us = slots[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t dropped() const { return lost.load(std::memory_order_relaxed); }
+
+private:
+  uint64_t slots[N];
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  std::atomic<uint32_t> lost{0};
+};
+
+struct HrvSnapshot {
+  float hr_bpm;      // 0 when stale
+  float mean_hr_bpm; // over the window
+  float rmssd_ms;    // 0 until HRV_MIN_BEATS
+  float sdnn_ms;
+  float pnn50;       // 0..1
+  uint16_t intervals;   // accepted RR intervals in the window
+  uint16_t differences; // successive differences in the window
+  uint32_t accepted;    // since begin()
+  uint32_t artifacts;
+};
+
+class HrvEngine {
+public:
+  void begin() {
+    memset(this, 0, sizeof(*this));
+  }
+
+  // Beat times in order, in microseconds
+  void addBeat(uint64_t t_us) {
+    if (!have_last) {
+      last_us = t_us;
+      have_last = true;
+      return;
+    }
+    uint32_t rr = (uint32_t)((t_us - last_us + 500) / 1000);
+    last_us = t_us;
+    uint32_t now_ms = (uint32_t)(t_us / 1000);
+
+    bool ok = rr >= HRV_MIN_RR_MS && rr <= HRV_MAX_RR_MS;
+    if (ok && ref_count >= 3) {
+      float ref = reference();
+      ok = fabsf(rr - ref) <= HRV_MAX_CHANGE * ref;
+    }
+    if (!ok) {
+      artifacts++;
+      prev_accepted = false;
+      if (++rejected_run >= HRV_REF_BEATS) {
+        ref_count = 0;
+        rejected_run = 0;
+      }
+      return;
+    }
+    rejected_run = 0;
+    accepted++;
+    last_accept_ms = now_ms;
+
+    ref[ref_next] = rr;
+    ref_next = (ref_next + 1) % HRV_REF_BEATS;
+    if (ref_count < HRV_REF_BEATS) ref_count++;
+
+    if (count == HRV_MAX_BEATS) evictOldest();
+    Interval& in = ring[(first + count) % HRV_MAX_BEATS];
+    in.t_ms = now_ms;
+    in.rr_ms = rr;
+    in.diff_ms = prev_accepted ? (int16_t)((int32_t)rr - prev_rr) : NO_DIFF;
+    count++;
+    sum_rr += rr;
+    sum_rr2 += (uint64_t)rr * rr;
+    if (in.diff_ms != NO_DIFF) addDiff(in.diff_ms, 1);
+    prev_rr = rr;
+    prev_accepted = true;
+
+    evictBefore(now_ms);
+  }
+
+  // `now_ms` on the same clock as the beats (t_us / 1000); intervals that
+  // left the window are dropped first
+  HrvSnapshot snapshot(uint32_t now_ms) {
+    evictBefore(now_ms);
+    HrvSnapshot s;
+    memset(&s, 0, sizeof(s));
+    s.accepted = accepted;
+    s.artifacts = artifacts;
+    s.intervals = count;
+    s.differences = diff_count;
+    if (ref_count > 0 && accepted && now_ms - last_accept_ms <= HRV_STALE_MS) s.hr_bpm = 60000.0f / reference();
+    if (count) s.mean_hr_bpm = 60000.0f * count / sum_rr;
+    if (count >= HRV_MIN_BEATS) {
+      int64_t n = count;
+      int64_t spread = n * (int64_t)sum_rr2 - (int64_t)sum_rr * sum_rr;
+      s.sdnn_ms = sqrtf((float)spread / (float)(n * (n - 1)));
+      if (diff_count) {
+        s.rmssd_ms = sqrtf((float)sum_diff2 / diff_count);
+        s.pnn50 = (float)nn50 / diff_count;
+      }
+    }
+    return s;
+  }
+
+private:
+  static const int16_t NO_DIFF = INT16_MIN;
+
+  struct Interval {
+    uint32_t t_ms;    // beat that ended it
+    uint16_t rr_ms;
+    int16_t diff_ms;  // to the previous accepted interval, or NO_DIFF
+  };
+
+  Interval ring[HRV_MAX_BEATS];
+  uint16_t first;
+  uint16_t count;
+  uint32_t sum_rr;
+  uint64_t sum_rr2;
+  uint64_t sum_diff2;
+  uint16_t diff_count;
+  uint16_t nn50;
+
+  uint16_t ref[HRV_REF_BEATS];
+  uint8_t ref_next;
+  uint8_t ref_count;
+  uint8_t rejected_run;
+  bool prev_accepted;
+  uint16_t prev_rr;
+
+  bool have_last;
+  uint64_t last_us;
+  uint32_t last_accept_ms;
+  uint32_t accepted;
+  uint32_t artifacts;
+
+  // Median of the reference intervals
+  float reference() const {
+    uint16_t v[HRV_REF_BEATS];
+    memcpy(v, ref, sizeof(v));
+    for (int i = 1; i < ref_count; i++) {
+      for (int j = i; j > 0 && v[j - 1] > v[j]; j--) {
+        uint16_t t = v[j];
+        v[j] = v[j - 1];
+        v[j - 1] = t;
+      }
+    }
+    return ref_count % 2 ? v[ref_count / 2] : 0.5f * (v[ref_count / 2 - 1] + v[ref_count / 2]);
+  }
+
+  void addDiff(int16_t d, int sign) {
+    uint64_t d2 = (uint64_t)((int32_t)d * d);
+    bool over = d > 50 || d < -50;
+    if (sign > 0) {
+      sum_diff2 += d2;
+      diff_count++;
+      nn50 += over;
+    } else {
+      sum_diff2 -= d2;
+      diff_count--;
+      nn50 -= over;
+    }
+  }
+
+  // The new oldest interval's difference pointed at the one leaving, so it
+  // goes too: n intervals in the window have at most n - 1 differences
+  void evictOldest() {
+    const Interval& out = ring[first];
+    sum_rr -= out.rr_ms;
+    sum_rr2 -= (uint64_t)out.rr_ms * out.rr_ms;
+    first = (first + 1) % HRV_MAX_BEATS;
+    count--;
+    Interval& next = ring[first];
+    if (count && next.diff_ms != NO_DIFF) {
+      addDiff(next.diff_ms, -1);
+      next.diff_ms = NO_DIFF;
+    }
+  }
+
+  void evictBefore(uint32_t now_ms) {
+    while (count && now_ms - ring[first].t_ms > HRV_WINDOW_MS) evictOldest();
+  }
+};
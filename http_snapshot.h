@@ -0,0 +1,82 @@
+#pragma once
+// Pre-serialised responses for the async web server.
+//
+// The sampling loop publishes a body once per state change; HTTP handlers,
+// which run on the async TCP task, serve whichever snapshot is current
+// without touching the sampling state. Snapshots are immutable and shared:
+// a response still streaming an old snapshot keeps it alive. Every snapshot
+// carries an ETag so polling clients get 304 while nothing has changed.
+//
+// Commands from handlers to the sampling loop (resets) go through a
+// CommandMailbox: handlers set bits, the loop takes and applies them.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+#include <memory>
+
+struct HttpSnapshot {
+  String body;
+  String etag;  // quoted, as sent in the ETag header
+};
+
+class SnapshotPublisher {
+public:
+  // Sampling loop: replace the current snapshot
+  void publish(const String& body) {
+    if (boot_id == 0) boot_id = esp_random() | 1; // ETags from a previous boot never match
+    std::shared_ptr<HttpSnapshot> snap = std::make_shared<HttpSnapshot>();
+    snap->body = body;
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%08x-%u\"", boot_id, ++version);
+    snap->etag = etag;
+    std::atomic_store(&snapshot, std::shared_ptr<const HttpSnapshot>(snap));
+  }
+
+  std::shared_ptr<const HttpSnapshot> current() const { return std::atomic_load(&snapshot); }
+
+  // Handler: 304 if the client already has this snapshot, else stream it
+  void serve(AsyncWebServerRequest* request, const char* content_type) const {
+    std::shared_ptr<const HttpSnapshot> snap = current();
+    if (!snap) {
+      request->send(503, "text/plain", "No data yet");
+      return;
+    }
+
+    AsyncWebServerResponse* response;
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == snap->etag) {
+      response = request->beginResponse(304);
+    } else {
+      // Copies straight out of the shared body, however many clients read it
+      response = request->beginResponse(content_type, snap->body.length(),
+        [snap](uint8_t* buffer, size_t max_len, size_t index) -> size_t {
+          size_t n = snap->body.length() - index;
+          if (n > max_len) n = max_len;
+          memcpy(buffer, snap->body.c_str() + index, n);
+          return n;
+        });
+    }
+    response->addHeader("ETag", snap->etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+  }
+
+  uint32_t currentVersion() const { return version; }
+
+private:
+  std::shared_ptr<const HttpSnapshot> snapshot;
+  uint32_t boot_id = 0;
+  uint32_t version = 0;
+};
+
+class CommandMailbox {
+public:
+  // Any task: request commands (bit flags), merged with ones not yet taken
+  void post(uint32_t commands) { pending.fetch_or(commands); }
+
+  // Sampling loop: all pending commands, cleared
+  uint32_t take() { return pending.exchange(0); }
+
+private:
+  std::atomic<uint32_t> pending{0};
+};
@@ -0,0 +1,262 @@
+#pragma once
+// Non-blocking I2C fault recovery for one sensor.
+//
+// When a read fails, the sensor is walked up a ladder, cheapest step first:
+//
+//   unstick  clock SCL until a slave cut off mid-byte lets go of SDA, send
+//            a STOP and restart the driver (i2cUnstickBus(), ~100 us)
+//   resync   register level: check the identity register and rewrite the
+//            configuration, e.g. after a brown-out put the sensor back to
+//            sleep with default ranges (i2cResync(), a few transfers)
+//   reinit   the driver's full init after another unstick, retried with
+//            exponential backoff
+//
+// step() runs the two cheap steps back to back and at most one reinit
+// attempt, and never sleeps: the backoff is a deadline checked on the next
+// call, so whatever else the caller's loop does (other sensors, the web
+// server, the stall watchdog) keeps going. A step that succeeds puts the
+// sensor back in service on probation. If a read fails again within
+// I2C_PROBATION_MS, the ladder resumes one step higher instead of starting
+// over, so a fault the cheap steps cannot fix escalates in one sample.
+//
+// The sensor is blind from the failed read to the next good one; the total
+// and the longest outage are kept with the per-step counters.
+//
+// The state machine is plain C++ and runs the same on the host with a mock
+// bus (tools/i2c_recovery_sim.cpp); the bus helpers at the end need Wire.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <Wire.h>
+#endif
+
+#define I2C_PROBATION_MS 1000
+
+enum I2CRecoveryStep : uint8_t {
+  I2C_STEP_NONE,
+  I2C_STEP_UNSTICK,
+  I2C_STEP_RESYNC,
+  I2C_STEP_REINIT,
+};
+
+// Each returns true if the sensor answers afterwards
+struct I2CRecoverySteps {
+  bool (*unstick)();
+  bool (*resync)();
+  bool (*reinit)();
+};
+
+// A copy for other tasks (publish it, e.g. through a SeqLock)
+struct I2CRecoveryStats {
+  uint8_t healthy;
+  uint8_t next_step;        // I2CRecoveryStep
+  uint32_t blind_now_ms;    // current outage, 0 in service
+  uint32_t backoff_ms;
+  uint32_t faults;          // failed reads that started or resumed recovery
+  uint32_t unstick_attempts;
+  uint32_t unstick_fixes;
+  uint32_t resync_attempts;
+  uint32_t resync_fixes;
+  uint32_t reinit_attempts;
+  uint32_t reinit_fixes;
+  uint32_t blind_ms;        // total time without good reads, including now
+  uint32_t worst_blind_ms;  // longest outage
+  uint32_t last_blind_ms;   // the most recent one that ended
+};
+
+class I2CRecovery {
+public:
+  void begin(const I2CRecoverySteps& steps, uint32_t backoff_min_ms, uint32_t backoff_max_ms) {
+    this->steps = steps;
+    this->backoff_min_ms = backoff_min_ms;
+    this->backoff_max_ms = backoff_max_ms;
+    memset(&counters, 0, sizeof(counters));
+    next = I2C_STEP_NONE;
+    fixed_by = I2C_STEP_NONE;
+    fixed_ms = 0;
+    blind = false;
+    blind_since_ms = 0;
+    backoff_ms = backoff_min_ms;
+    retry_ms = 0;
+  }
+
+  // In service: reads are worth attempting
+  bool healthy() const { return next == I2C_STEP_NONE; }
+  I2CRecoveryStep nextStep() const { return next; }
+
+  // True if this read ended an outage
+  bool readOk(uint32_t now_ms) {
+    if (fixed_by != I2C_STEP_NONE && now_ms - fixed_ms >= I2C_PROBATION_MS) {
+      fixed_by = I2C_STEP_NONE;
+      backoff_ms = backoff_min_ms;
+    }
+    if (!blind) return false;
+    uint32_t outage = now_ms - blind_since_ms;
+    counters.blind_ms += outage;
+    counters.last_blind_ms = outage;
+    if (outage > counters.worst_blind_ms) counters.worst_blind_ms = outage;
+    blind = false;
+    return true;
+  }
+
+  void readFailed(uint32_t now_ms) {
+    if (!healthy()) return;
+    counters.faults++;
+    if (!blind) {
+      blind = true;
+      blind_since_ms = now_ms;
+    }
+    bool probation = fixed_by != I2C_STEP_NONE && now_ms - fixed_ms < I2C_PROBATION_MS;
+    if (!probation) {
+      next = I2C_STEP_UNSTICK;
+      backoff_ms = backoff_min_ms;
+    } else if (fixed_by == I2C_STEP_REINIT) {
+      next = I2C_STEP_REINIT;  // reinit did not hold: keep backing off
+      retry_ms = now_ms + backoff_ms;
+      grow();
+    } else {
+      next = (I2CRecoveryStep)(fixed_by + 1);
+      retry_ms = now_ms;
+    }
+  }
+
+  // Call on every pass while !healthy(); see above for what one call does
+  void step(uint32_t now_ms) {
+    if (next == I2C_STEP_UNSTICK) {
+      counters.unstick_attempts++;
+      if (steps.unstick && steps.unstick()) {
+        counters.unstick_fixes++;
+        fixed(I2C_STEP_UNSTICK, now_ms);
+        return;
+      }
+      next = I2C_STEP_RESYNC;
+    }
+    if (next == I2C_STEP_RESYNC) {
+      counters.resync_attempts++;
+      if (steps.resync && steps.resync()) {
+        counters.resync_fixes++;
+        fixed(I2C_STEP_RESYNC, now_ms);
+        return;
+      }
+      next = I2C_STEP_REINIT;
+      retry_ms = now_ms;
+    }
+    if (next == I2C_STEP_REINIT && (int32_t)(now_ms - retry_ms) >= 0) {
+      counters.reinit_attempts++;
+      // A bus held low again would defeat the init too
+      if (steps.unstick) steps.unstick();
+      if (steps.reinit()) {
+        counters.reinit_fixes++;
+        fixed(I2C_STEP_REINIT, now_ms);
+        return;
+      }
+      retry_ms = now_ms + backoff_ms;
+      grow();
+    }
+  }
+
+  // Counters as of now_ms, with the ongoing outage counted in
+  I2CRecoveryStats stats(uint32_t now_ms) const {
+    I2CRecoveryStats s = counters;
+    s.healthy = healthy();
+    s.next_step = next;
+    s.blind_now_ms = blind ? now_ms - blind_since_ms : 0;
+    s.backoff_ms = backoff_ms;
+    s.blind_ms += s.blind_now_ms;
+    if (s.blind_now_ms > s.worst_blind_ms) s.worst_blind_ms = s.blind_now_ms;
+    return s;
+  }
+
+private:
+  I2CRecoverySteps steps;
+  uint32_t backoff_min_ms;
+  uint32_t backoff_max_ms;
+  I2CRecoveryStats counters;
+  I2CRecoveryStep next;
+  I2CRecoveryStep fixed_by;  // step that last put the sensor back, while on probation
+  uint32_t fixed_ms;
+  bool blind;
+  uint32_t blind_since_ms;
+  uint32_t backoff_ms;       // wait after the next failed reinit
+  uint32_t retry_ms;         // earliest next reinit
+
+  void fixed(I2CRecoveryStep step, uint32_t now_ms) {
+    next = I2C_STEP_NONE;
+    fixed_by = step;
+    fixed_ms = now_ms;
+  }
+
+  void grow() { backoff_ms = backoff_ms * 2 > backoff_max_ms ? backoff_max_ms : backoff_ms * 2; }
+};
+
+// Fixes and attempts per step are [fixes, attempts]
+inline size_t i2cRecoveryJson(const I2CRecoveryStats& s, char* buf, size_t len) {
+  static const char* names[] = {"none", "unstick", "resync", "reinit"};
+  int n = snprintf(buf, len,
+                   "{\"healthy\":%s,\"next\":\"%s\",\"blind_now_ms\":%u,\"faults\":%u,"
+                   "\"unstick\":[%u,%u],\"resync\":[%u,%u],\"reinit\":[%u,%u],"
+                   "\"blind_ms\":%u,\"worst_blind_ms\":%u,\"last_blind_ms\":%u,\"backoff_ms\":%u}",
+                   s.healthy ? "true" : "false", names[s.next_step & 3], (unsigned)s.blind_now_ms,
+                   (unsigned)s.faults, (unsigned)s.unstick_fixes, (unsigned)s.unstick_attempts,
+                   (unsigned)s.resync_fixes, (unsigned)s.resync_attempts, (unsigned)s.reinit_fixes,
+                   (unsigned)s.reinit_attempts, (unsigned)s.blind_ms, (unsigned)s.worst_blind_ms,
+                   (unsigned)s.last_blind_ms, (unsigned)s.backoff_ms);
+  return n < 0 ? 0 : (size_t)n < len ? (size_t)n : (len ? len - 1 : 0);
+}
+
+#ifdef ARDUINO
+// True if a device ACKs its address
+inline bool i2cProbe(TwoWire& wire, uint8_t addr) {
+  wire.beginTransmission(addr);
+  return wire.endTransmission() == 0;
+}
+
+// Frees a bus that a slave holds low because it was cut off mid-byte: up to
+// nine SCL pulses until SDA is released, then a STOP, then the driver is
+// restarted on the same pins. About 100 us. True if `addr` ACKs afterwards.
+inline bool i2cUnstickBus(TwoWire& wire, int sda, int scl, uint32_t frequency, uint8_t addr) {
+  wire.end();
+  pinMode(sda, INPUT_PULLUP);
+  pinMode(scl, OUTPUT_OPEN_DRAIN);
+  digitalWrite(scl, HIGH);
+  delayMicroseconds(5);
+  for (int i = 0; i < 9 && digitalRead(sda) == LOW; i++) {
+    digitalWrite(scl, LOW);
+    delayMicroseconds(5);
+    digitalWrite(scl, HIGH);
+    delayMicroseconds(5);
+  }
+  // STOP: SDA rises while SCL is high
+  digitalWrite(scl, LOW);
+  pinMode(sda, OUTPUT_OPEN_DRAIN);
+  digitalWrite(sda, LOW);
+  delayMicroseconds(5);
+  digitalWrite(scl, HIGH);
+  delayMicroseconds(5);
+  digitalWrite(sda, HIGH);
+  delayMicroseconds(5);
+  pinMode(sda, INPUT_PULLUP);
+  bool released = digitalRead(sda) == HIGH;
+  wire.begin(sda, scl, frequency);
+  return released && i2cProbe(wire, addr);
+}
+
+// Register-level re-sync: the identity register must read `id`, then each
+// {register, value} pair is written in order
+inline bool i2cResync(TwoWire& wire, uint8_t addr, uint8_t id_reg, uint8_t id, const uint8_t (*regs)[2], size_t count) {
+  wire.beginTransmission(addr);
+  wire.write(id_reg);
+  if (wire.endTransmission(false) != 0 || wire.requestFrom(addr, (uint8_t)1) != 1 || wire.read() != id) return false;
+  for (size_t i = 0; i < count; i++) {
+    wire.beginTransmission(addr);
+    wire.write(regs[i][0]);
+    wire.write(regs[i][1]);
+    if (wire.endTransmission() != 0) return false;
+  }
+  return true;
+}
+#endif
@@ -0,0 +1,263 @@
+#pragma once
+// I2C transaction scheduler for the sensor buses.
+//
+// Every device on a bus is registered as a periodic stream: either a plain
+// register burst read, or a job for drivers that do their own I2C (the
+// MAX30100 library only talks to Wire). Each bus gets its own FreeRTOS task
+// that runs the due stream with the earliest deadline first (deadline = next
+// release + period), so a slow read on one bus never delays the other and
+// loop() never waits on the wire. The ESP32 I2C driver is interrupt driven, so
+// the bus task sleeps while a transfer is in flight.
+//
+// Completed transactions are queued and handed to their callbacks from poll(),
+// which runs in the caller's context (loop()), so callbacks can touch sketch
+// globals without extra locking.
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <atomic>
+
+#define I2C_MAX_BUSES       2
+#define I2C_MAX_STREAMS     8
+#define I2C_MAX_READ        32
+#define I2C_COMPLETION_SLOTS 16
+
+struct I2CTransaction;
+
+// Job for library-driven devices: runs on the bus task with exclusive use of
+// the bus, may fill t.data / t.len, returns false on a bus error.
+typedef bool (*I2CJob)(TwoWire& bus, I2CTransaction& t);
+typedef void (*I2CCallback)(const I2CTransaction& t);
+
+struct I2CTransaction {
+  uint8_t stream;
+  uint8_t bus;
+  uint8_t addr;
+  uint8_t reg;
+  uint8_t len;
+  bool ok;
+  uint8_t data[I2C_MAX_READ];
+  uint32_t release_us;   // when it became due
+  uint32_t deadline_us;  // when it should have completed by
+  uint32_t done_us;      // when it actually completed
+};
+
+struct I2CStream {
+  bool active;
+  uint8_t bus;
+  uint8_t addr;
+  uint8_t reg;
+  uint8_t len;
+  uint32_t period_us;
+  uint32_t next_release_us;
+  I2CJob job;
+  I2CCallback callback;
+
+  // Statistics
+  uint32_t runs;
+  uint32_t errors;
+  uint32_t deadline_misses;
+  uint32_t worst_lateness_us;
+};
+
+class I2CScheduler {
+public:
+  I2CScheduler() {
+    memset(buses, 0, sizeof(buses));
+    memset(streams, 0, sizeof(streams));
+  }
+
+  bool attachBus(uint8_t bus, TwoWire* wire) {
+    if (bus >= I2C_MAX_BUSES || started) return false;
+    buses[bus].wire = wire;
+    return true;
+  }
+
+  // Periodic burst read of `len` bytes starting at register `reg`
+  int addRead(uint8_t bus, uint8_t addr, uint8_t reg, uint8_t len,
+              uint32_t period_us, I2CCallback callback) {
+    if (len > I2C_MAX_READ) return -1;
+    return addStream(bus, addr, reg, len, period_us, NULL, callback);
+  }
+
+  // Periodic job for a driver that owns its own transfers
+  int addJob(uint8_t bus, I2CJob job, uint32_t period_us, I2CCallback callback) {
+    return addStream(bus, 0, 0, 0, period_us, job, callback);
+  }
+
+  // Start one task per attached bus. Streams must be registered before this.
+  bool begin(UBaseType_t priority = 5) {
+    if (started) return false;
+    lock = xSemaphoreCreateMutex();
+    completions = xQueueCreate(I2C_COMPLETION_SLOTS, sizeof(I2CTransaction));
+    if (lock == NULL || completions == NULL) return false;
+
+    uint32_t now = micros();
+    for (int i = 0; i < stream_count; i++) streams[i].next_release_us = now;
+
+    started = true;
+    for (uint8_t b = 0; b < I2C_MAX_BUSES; b++) {
+      if (buses[b].wire == NULL) continue;
+      buses[b].owner = this;
+      buses[b].index = b;
+      char name[8] = "i2c0";
+      name[3] = '0' + b;
+      if (xTaskCreatePinnedToCore(busTask, name, 4096, &buses[b], priority,
+                                  &buses[b].task, tskNO_AFFINITY) != pdPASS) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Deliver completed transactions to their callbacks. Call from loop().
+  int poll() {
+    if (!started) return 0;
+    I2CTransaction t;
+    int delivered = 0;
+    while (xQueueReceive(completions, &t, 0) == pdTRUE) {
+      I2CCallback cb = streams[t.stream].callback;
+      if (cb) cb(t);
+      delivered++;
+    }
+    return delivered;
+  }
+
+  // Pause / resume a stream, e.g. while a sensor is being re-initialised
+  void setActive(int stream, bool active) {
+    if (stream < 0 || stream >= stream_count) return;
+    take();
+    streams[stream].active = active;
+    streams[stream].next_release_us = micros();
+    give();
+  }
+
+  int streamCount() const { return stream_count; }
+  const I2CStream& stream(int i) const { return streams[i]; }
+  uint32_t droppedCompletions() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+  struct Bus {
+    TwoWire* wire;
+    TaskHandle_t task;
+    I2CScheduler* owner;
+    uint8_t index;
+  };
+
+  Bus buses[I2C_MAX_BUSES];
+  I2CStream streams[I2C_MAX_STREAMS];
+  int stream_count = 0;
+  bool started = false;
+  std::atomic<uint32_t> dropped{0};  // bumped by every bus task
+  SemaphoreHandle_t lock = NULL;
+  QueueHandle_t completions = NULL;
+
+  void take() { if (lock) xSemaphoreTake(lock, portMAX_DELAY); }
+  void give() { if (lock) xSemaphoreGive(lock); }
+
+  int addStream(uint8_t bus, uint8_t addr, uint8_t reg, uint8_t len,
+                uint32_t period_us, I2CJob job, I2CCallback callback) {
+    if (started || bus >= I2C_MAX_BUSES || buses[bus].wire == NULL) return -1;
+    if (stream_count >= I2C_MAX_STREAMS || period_us == 0) return -1;
+    I2CStream& s = streams[stream_count];
+    s.active = true;
+    s.bus = bus;
+    s.addr = addr;
+    s.reg = reg;
+    s.len = len;
+    s.period_us = period_us;
+    s.job = job;
+    s.callback = callback;
+    return stream_count++;
+  }
+
+  // Earliest-deadline-first pick among the due streams of one bus.
+  // Returns -1 and the time until the next release if nothing is due.
+  int pickNext(uint8_t bus, uint32_t now, uint32_t* wait_us) {
+    int best = -1;
+    uint32_t best_deadline = 0;
+    uint32_t next_wait = 0xFFFFFFFF;
+
+    for (int i = 0; i < stream_count; i++) {
+      I2CStream& s = streams[i];
+      if (!s.active || s.bus != bus) continue;
+      int32_t until_release = (int32_t)(s.next_release_us - now);
+      if (until_release > 0) {
+        if ((uint32_t)until_release < next_wait) next_wait = until_release;
+        continue;
+      }
+      uint32_t deadline = s.next_release_us + s.period_us;
+      if (best < 0 || (int32_t)(deadline - best_deadline) < 0) {
+        best = i;
+        best_deadline = deadline;
+      }
+    }
+    *wait_us = next_wait;
+    return best;
+  }
+
+  bool readRegisters(TwoWire& wire, I2CTransaction& t) {
+    wire.beginTransmission(t.addr);
+    wire.write(t.reg);
+    if (wire.endTransmission(false) != 0) return false;
+    if (wire.requestFrom(t.addr, (size_t)t.len) != t.len) return false;
+    for (uint8_t i = 0; i < t.len; i++) t.data[i] = wire.read();
+    return true;
+  }
+
+  void runBus(Bus& bus) {
+    for (;;) {
+      uint32_t wait_us;
+      I2CTransaction t;
+
+      take();
+      int i = pickNext(bus.index, micros(), &wait_us);
+      if (i >= 0) {
+        I2CStream& s = streams[i];
+        t.stream = i;
+        t.bus = s.bus;
+        t.addr = s.addr;
+        t.reg = s.reg;
+        t.len = s.len;
+        t.release_us = s.next_release_us;
+        t.deadline_us = s.next_release_us + s.period_us;
+      }
+      give();
+
+      if (i < 0) {
+        // Nothing due: sleep until the next release (at least one tick)
+        uint32_t wait_ms = wait_us == 0xFFFFFFFF ? 10 : wait_us / 1000;
+        vTaskDelay(pdMS_TO_TICKS(wait_ms > 0 ? wait_ms : 1));
+        continue;
+      }
+
+      I2CJob job = streams[i].job;
+      t.ok = job ? job(*bus.wire, t) : readRegisters(*bus.wire, t);
+      t.done_us = micros();
+
+      take();
+      I2CStream& s = streams[i];
+      s.runs++;
+      if (!t.ok) s.errors++;
+      int32_t late = (int32_t)(t.done_us - t.deadline_us);
+      if (late > 0) {
+        s.deadline_misses++;
+        if ((uint32_t)late > s.worst_lateness_us) s.worst_lateness_us = late;
+      }
+      // Next release one period on; if we fell more than a period behind,
+      // resynchronise instead of bursting to catch up.
+      s.next_release_us += s.period_us;
+      if ((int32_t)(t.done_us - s.next_release_us) > (int32_t)s.period_us) {
+        s.next_release_us = t.done_us;
+      }
+      give();
+
+      if (xQueueSend(completions, &t, 0) != pdTRUE) dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  static void busTask(void* arg) {
+    Bus* bus = (Bus*)arg;
+    bus->owner->runBus(*bus);
+  }
+};
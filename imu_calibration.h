@@ -0,0 +1,392 @@
+#pragma once
+// Automatic MPU6050 calibration: gyro bias, accel offset and scale.
+//
+// The bus task passes every raw FIFO block to observe() and then corrects it
+// in place with apply(), before any features are computed. observe() cuts the
+// stream into windows of IMU_CAL_WINDOW samples and keeps the ones in which
+// the sensor was still: low variance on every axis, no tilt between the two
+// halves of the window, and an accel norm near 1 g.
+//
+// - Gyro bias is the mean rate over a still window. The first one sets it;
+//   later ones move it by 1/2^IMU_CAL_GYRO_SHIFT of the difference, which
+//   follows slow thermal drift. A run of still windows that all disagree by
+//   more than IMU_CAL_GYRO_RESET_DPS replaces it outright (stale NVS data, a
+//   swapped sensor).
+// - Accel offset and scale come from an axis-aligned ellipsoid fitted to the
+//   mean gravity vectors of still windows in different orientations. The fit
+//   is a 6-parameter linear least-squares problem, redone whenever the set of
+//   orientations changes, and only used once the orientations span every
+//   axis and the result is plausible for the part.
+//
+// Corrections are integers (offsets in LSB, scales in Q14), so apply() costs
+// a subtract, a multiply and a shift per value. The current calibration is
+// published through a SeqLock for other tasks. The sketch keeps it in NVS and
+// hands it back to begin() at boot, so a warm boot corrects from the first
+// sample instead of waiting for a still window. A stored calibration measured
+// at other ranges is ignored.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "imu_kernels.h"
+#include "seqlock.h"
+
+#ifdef ARDUINO
+#include <Preferences.h>
+#endif
+
+#define IMU_CAL_MAGIC              0x4C41434D // "MCAL"
+#define IMU_CAL_VERSION            1
+#define IMU_CAL_WINDOW             100     // samples, 1 s at 100 Hz
+#define IMU_CAL_STILL_GYRO_DPS     0.5f    // per-axis standard deviation in a still window
+#define IMU_CAL_STILL_ACCEL_G      0.01f
+#define IMU_CAL_STILL_TILT_G       0.004f  // accel mean change between the window halves
+#define IMU_CAL_GRAVITY_TOL_G      0.15f   // raw accel norm vs 1 g
+#define IMU_CAL_MAX_GYRO_BIAS_DPS  20.0f   // MPU6050 zero-rate tolerance
+#define IMU_CAL_GYRO_SHIFT         3
+#define IMU_CAL_GYRO_RESET_DPS     3.0f
+#define IMU_CAL_GYRO_RESET_WINDOWS 3
+#define IMU_CAL_ORIENTATIONS       12
+#define IMU_CAL_MIN_ORIENTATIONS   7
+#define IMU_CAL_SAME_ORIENTATION   0.94f   // cos 20 deg
+#define IMU_CAL_MIN_SPAN_G         1.0f    // per axis, across the stored orientations
+#define IMU_CAL_MAX_OFFSET_G       0.25f
+#define IMU_CAL_MIN_SCALE          0.9f
+#define IMU_CAL_MAX_SCALE          1.1f
+#define IMU_CAL_MAX_RESIDUAL_G     0.02f
+#define IMU_CAL_SCALE_SHIFT        14
+#define IMU_CAL_SCALE_ONE          (1 << IMU_CAL_SCALE_SHIFT)
+
+// Changes smaller than these are not worth a flash write
+#define IMU_CAL_SAVE_GYRO_DPS      0.05f
+#define IMU_CAL_SAVE_OFFSET_G      0.003f
+#define IMU_CAL_SAVE_SCALE         0.002f
+
+enum ImuCalFlags {
+  IMU_CAL_GYRO_VALID = 0x01,
+  IMU_CAL_ACCEL_VALID = 0x02
+};
+
+struct ImuCalibration {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t flags;              // ImuCalFlags
+  float lsb_per_g;             // ranges it was measured at
+  float lsb_per_dps;
+  int32_t gyro_bias_q8[3];     // LSB * 256
+  int32_t accel_offset_q8[3];  // LSB * 256
+  int32_t accel_scale_q14[3];  // IMU_CAL_SCALE_ONE = 1.0
+  float accel_residual_g;      // RMS norm error over the last accepted fit
+  uint32_t still_windows;      // counted across boots
+  uint32_t accel_fits;
+};
+
+class ImuCalibrator {
+public:
+  // Bus task, before the first observe(). `stored` (may be NULL) is applied
+  // right away when it was measured at the same ranges.
+  void begin(float lsb_per_g, float lsb_per_dps, const ImuCalibration* stored) {
+    memset(&cal, 0, sizeof(cal));
+    cal.magic = IMU_CAL_MAGIC;
+    cal.version = IMU_CAL_VERSION;
+    cal.lsb_per_g = lsb_per_g;
+    cal.lsb_per_dps = lsb_per_dps;
+    for (int k = 0; k < 3; k++) cal.accel_scale_q14[k] = IMU_CAL_SCALE_ONE;
+    warm = stored && stored->magic == IMU_CAL_MAGIC && stored->version == IMU_CAL_VERSION &&
+           stored->lsb_per_g == lsb_per_g && stored->lsb_per_dps == lsb_per_dps;
+    if (warm) cal = *stored;
+
+    still_gyro_lsb = IMU_CAL_STILL_GYRO_DPS * lsb_per_dps;
+    still_accel_lsb = IMU_CAL_STILL_ACCEL_G * lsb_per_g;
+    still_tilt_lsb = IMU_CAL_STILL_TILT_G * lsb_per_g;
+    max_bias_lsb = IMU_CAL_MAX_GYRO_BIAS_DPS * lsb_per_dps;
+    reset_q8 = (int32_t)(IMU_CAL_GYRO_RESET_DPS * lsb_per_dps * 256);
+
+    resetWindow();
+    point_count = 0;
+    point_clock = 0;
+    disagree = 0;
+    publish();
+  }
+
+  // Bus task: raw samples, before apply()
+  void observe(const ImuRawSample* s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      for (int k = 0; k < IMU_AXES; k++) {
+        int32_t v = s[i].v[k];
+        sum[k] += v;
+        sum_sq[k] += (int64_t)v * v;
+      }
+      if (++count == IMU_CAL_WINDOW / 2) memcpy(half, sum, sizeof(half));
+      if (count == IMU_CAL_WINDOW) {
+        endWindow();
+        resetWindow();
+      }
+    }
+  }
+
+  // Bus task: correct a block in place
+  void apply(ImuRawSample* s, size_t n) const {
+    const int32_t round = 1 << (IMU_CAL_SCALE_SHIFT - 1);
+    for (size_t i = 0; i < n; i++) {
+      int16_t* v = s[i].v;
+      for (int k = 0; k < 3; k++) {
+        v[k] = clamp16(((v[k] - accel_off[k]) * accel_scale[k] + round) >> IMU_CAL_SCALE_SHIFT);
+        v[3 + k] = clamp16(v[3 + k] - gyro_off[k]);
+      }
+    }
+  }
+
+  // Bus task
+  const ImuCalibration& current() const { return cal; }
+  bool warmStart() const { return warm; }
+
+  // Any task; returns the version read
+  uint32_t read(ImuCalibration& out) const { return published.read(out); }
+  uint32_t version() const { return published.version(); }
+
+  // Whether `b` moved far enough from `a` to be written to flash
+  static bool differs(const ImuCalibration& a, const ImuCalibration& b) {
+    if (a.magic != b.magic || a.flags != b.flags || a.lsb_per_g != b.lsb_per_g) return true;
+    int32_t gyro_q8 = (int32_t)(IMU_CAL_SAVE_GYRO_DPS * b.lsb_per_dps * 256);
+    int32_t offset_q8 = (int32_t)(IMU_CAL_SAVE_OFFSET_G * b.lsb_per_g * 256);
+    int32_t scale_q14 = (int32_t)(IMU_CAL_SAVE_SCALE * IMU_CAL_SCALE_ONE);
+    for (int k = 0; k < 3; k++) {
+      if (abs(a.gyro_bias_q8[k] - b.gyro_bias_q8[k]) > gyro_q8 ||
+          abs(a.accel_offset_q8[k] - b.accel_offset_q8[k]) > offset_q8 ||
+          abs(a.accel_scale_q14[k] - b.accel_scale_q14[k]) > scale_q14) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+#ifdef ARDUINO
+  static bool load(ImuCalibration& out) {
+    Preferences prefs;
+    bool ok = false;
+    if (prefs.begin("imucal", true)) {
+      ok = prefs.getBytes("cal", &out, sizeof(out)) == sizeof(out) && out.magic == IMU_CAL_MAGIC;
+      prefs.end();
+    }
+    return ok;
+  }
+
+  static bool save(const ImuCalibration& cal) {
+    Preferences prefs;
+    bool ok = false;
+    if (prefs.begin("imucal", false)) {
+      ok = prefs.putBytes("cal", &cal, sizeof(cal)) == sizeof(cal);
+      prefs.end();
+    }
+    return ok;
+  }
+#endif
+
+private:
+  ImuCalibration cal;
+  SeqLock<ImuCalibration> published;
+  bool warm = false;
+
+  // Integer corrections apply() uses, derived from cal
+  int32_t gyro_off[3] = {0, 0, 0};
+  int32_t accel_off[3] = {0, 0, 0};
+  int32_t accel_scale[3] = {IMU_CAL_SCALE_ONE, IMU_CAL_SCALE_ONE, IMU_CAL_SCALE_ONE};
+
+  // Current window
+  uint32_t count;
+  int32_t sum[IMU_AXES];
+  int64_t sum_sq[IMU_AXES];
+  int32_t half[IMU_AXES];  // sum after the first half
+
+  // Thresholds in LSB
+  float still_gyro_lsb, still_accel_lsb, still_tilt_lsb, max_bias_lsb;
+  int32_t reset_q8;
+  int disagree;
+
+  // Mean raw gravity vectors (g) of still windows in distinct orientations
+  float points[IMU_CAL_ORIENTATIONS][3];
+  uint32_t point_stamp[IMU_CAL_ORIENTATIONS];
+  int point_count;
+  uint32_t point_clock;
+
+  static int16_t clamp16(int32_t v) { return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)v; }
+
+  static int32_t roundQ8(float v) { return (int32_t)lrintf(v * 256); }
+
+  void resetWindow() {
+    count = 0;
+    memset(sum, 0, sizeof(sum));
+    memset(sum_sq, 0, sizeof(sum_sq));
+    memset(half, 0, sizeof(half));
+  }
+
+  void endWindow() {
+    const float n = IMU_CAL_WINDOW;
+    float mean[IMU_AXES];
+    for (int k = 0; k < IMU_AXES; k++) {
+      mean[k] = sum[k] / n;
+      float var = (float)(IMU_CAL_WINDOW * sum_sq[k] - (int64_t)sum[k] * sum[k]) / (n * n);
+      float limit = k < 3 ? still_accel_lsb : still_gyro_lsb;
+      if (var > limit * limit) return;
+      if (k >= 3 && fabsf(mean[k]) > max_bias_lsb) return;  // turning steadily
+    }
+    for (int k = 0; k < 3; k++) {
+      float tilt = (sum[k] - 2.0f * half[k]) / (n / 2);
+      if (fabsf(tilt) > still_tilt_lsb) return;
+    }
+    float g[3] = {mean[0] / cal.lsb_per_g, mean[1] / cal.lsb_per_g, mean[2] / cal.lsb_per_g};
+    float norm = sqrtf(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+    if (fabsf(norm - 1.0f) > IMU_CAL_GRAVITY_TOL_G) return;
+
+    cal.still_windows++;
+    updateGyro(mean + 3);
+    addOrientation(g, norm);
+    publish();
+  }
+
+  void updateGyro(const float* mean) {
+    int32_t m[3];
+    bool far = false;
+    for (int k = 0; k < 3; k++) {
+      m[k] = roundQ8(mean[k]);
+      if (abs(m[k] - cal.gyro_bias_q8[k]) > reset_q8) far = true;
+    }
+    if (!(cal.flags & IMU_CAL_GYRO_VALID) || (far && ++disagree >= IMU_CAL_GYRO_RESET_WINDOWS)) {
+      memcpy(cal.gyro_bias_q8, m, sizeof(m));
+      cal.flags |= IMU_CAL_GYRO_VALID;
+      disagree = 0;
+      return;
+    }
+    if (far) return;
+    disagree = 0;
+    for (int k = 0; k < 3; k++) cal.gyro_bias_q8[k] += (m[k] - cal.gyro_bias_q8[k]) / (1 << IMU_CAL_GYRO_SHIFT);
+  }
+
+  // A still window close to a stored orientation replaces it, so the set
+  // follows drift; a new one takes a free slot or the oldest
+  void addOrientation(const float* g, float norm) {
+    int slot = -1;
+    float best = IMU_CAL_SAME_ORIENTATION;
+    for (int i = 0; i < point_count; i++) {
+      const float* p = points[i];
+      float c = (g[0] * p[0] + g[1] * p[1] + g[2] * p[2]) / (norm * sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]));
+      if (c >= best) {
+        best = c;
+        slot = i;
+      }
+    }
+    if (slot < 0) {
+      if (point_count < IMU_CAL_ORIENTATIONS) {
+        slot = point_count++;
+      } else {
+        slot = 0;
+        for (int i = 1; i < point_count; i++) {
+          if (point_stamp[i] < point_stamp[slot]) slot = i;
+        }
+      }
+    }
+    memcpy(points[slot], g, sizeof(points[slot]));
+    point_stamp[slot] = ++point_clock;
+    fitAccel();
+  }
+
+  // Fits A x^2 + B y^2 + C z^2 + D x + E y + F z = 1, which is
+  // sum_k ((p_k - o_k) s_k)^2 = 1 with o = -D / 2A and s = sqrt(A / G)
+  void fitAccel() {
+    if (point_count < IMU_CAL_MIN_ORIENTATIONS) return;
+    for (int k = 0; k < 3; k++) {
+      float lo = points[0][k], hi = points[0][k];
+      for (int i = 1; i < point_count; i++) {
+        lo = fminf(lo, points[i][k]);
+        hi = fmaxf(hi, points[i][k]);
+      }
+      if (hi - lo < IMU_CAL_MIN_SPAN_G) return;
+    }
+
+    // Normal equations, augmented with the right-hand side
+    float m[6][7];
+    memset(m, 0, sizeof(m));
+    for (int i = 0; i < point_count; i++) {
+      const float* p = points[i];
+      float r[6] = {p[0] * p[0], p[1] * p[1], p[2] * p[2], p[0], p[1], p[2]};
+      for (int a = 0; a < 6; a++) {
+        for (int b = 0; b < 6; b++) m[a][b] += r[a] * r[b];
+        m[a][6] += r[a];
+      }
+    }
+    float x[6];
+    if (!solve6(m, x)) return;
+
+    float offset[3], scale[3];
+    float gain = 1.0f;
+    for (int k = 0; k < 3; k++) {
+      if (x[k] <= 0) return;
+      offset[k] = -x[3 + k] / (2 * x[k]);
+      gain += x[k] * offset[k] * offset[k];
+    }
+    for (int k = 0; k < 3; k++) {
+      scale[k] = sqrtf(x[k] / gain);
+      if (fabsf(offset[k]) > IMU_CAL_MAX_OFFSET_G || scale[k] < IMU_CAL_MIN_SCALE || scale[k] > IMU_CAL_MAX_SCALE) {
+        return;
+      }
+    }
+
+    float err_sq = 0;
+    for (int i = 0; i < point_count; i++) {
+      float c[3];
+      for (int k = 0; k < 3; k++) c[k] = (points[i][k] - offset[k]) * scale[k];
+      float e = sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]) - 1.0f;
+      err_sq += e * e;
+    }
+    float residual = sqrtf(err_sq / point_count);
+    if (residual > IMU_CAL_MAX_RESIDUAL_G) return;
+
+    for (int k = 0; k < 3; k++) {
+      cal.accel_offset_q8[k] = roundQ8(offset[k] * cal.lsb_per_g);
+      cal.accel_scale_q14[k] = (int32_t)lrintf(scale[k] * IMU_CAL_SCALE_ONE);
+    }
+    cal.accel_residual_g = residual;
+    cal.flags |= IMU_CAL_ACCEL_VALID;
+    cal.accel_fits++;
+  }
+
+  // Gaussian elimination with partial pivoting; false if (nearly) singular
+  static bool solve6(float m[6][7], float* x) {
+    for (int c = 0; c < 6; c++) {
+      int pivot = c;
+      for (int r = c + 1; r < 6; r++) {
+        if (fabsf(m[r][c]) > fabsf(m[pivot][c])) pivot = r;
+      }
+      if (fabsf(m[pivot][c]) < 1e-6f) return false;
+      if (pivot != c) {
+        for (int k = 0; k < 7; k++) {
+          float t = m[c][k];
+          m[c][k] = m[pivot][k];
+          m[pivot][k] = t;
+        }
+      }
+      for (int r = c + 1; r < 6; r++) {
+        float f = m[r][c] / m[c][c];
+        for (int k = c; k < 7; k++) m[r][k] -= f * m[c][k];
+      }
+    }
+    for (int c = 5; c >= 0; c--) {
+      float s = m[c][6];
+      for (int k = c + 1; k < 6; k++) s -= m[c][k] * x[k];
+      x[c] = s / m[c][c];
+    }
+    return true;
+  }
+
+  void publish() {
+    for (int k = 0; k < 3; k++) {
+      gyro_off[k] = (cal.gyro_bias_q8[k] + 128) >> 8;
+      accel_off[k] = (cal.accel_offset_q8[k] + 128) >> 8;
+      accel_scale[k] = cal.accel_scale_q14[k];
+    }
+    published.write(cal);
+  }
+};
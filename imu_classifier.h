@@ -0,0 +1,282 @@
+#pragma once
+// Int8 1D-CNN over sliding IMU windows: normal / fall / seizure.
+//
+// Network (fixed shape, weights from a blob in flash):
+//
+//   input   64 samples x 6 channels (accel g, gyro deg/s), int8
+//   conv1   8 filters, kernel 5, stride 2, ReLU   -> 30 x 8
+//   conv2   16 filters, kernel 3, stride 2, ReLU  -> 14 x 16
+//   mean    over time                             -> 16
+//   dense   3 logits (int32)
+//
+// All arithmetic is integer: int8 x int8 products summed in int32, then
+// requantized to int8 by a fixed-point multiply and rounding shift. Samples
+// and activations are stored [time][channel], so every output value is one
+// dot product over a contiguous run of inputs and a contiguous filter row;
+// only that dot product has scalar and SIMD versions, and integer sums make
+// them bit-identical. The ESP32 build uses the scalar one.
+//
+// Blob layout (little-endian): ImuModelHeader, then conv1 weights
+// [8][5*6] int8, conv1 bias [8] int32, conv2 weights [16][3*8], conv2 bias
+// [16], dense weights [3][16], dense bias [3]. imu_classifier_weights.h holds
+// the blob, which tools/imu_classifier_train produces from labelled traces;
+// tools/imu_classifier_bench checks and times it on the host.
+//
+// No heap: the sample ring and all activations live in the object (about
+// 1.5 KB), and a decision is made every IMU_CLS_HOP samples.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IMU_CLS_AVX2 1
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define IMU_CLS_SSE41 1
+#endif
+
+#define IMU_CLS_MAGIC    0x314D4842 // "BHM1"
+#define IMU_CLS_WINDOW   64
+#define IMU_CLS_CHANNELS 6
+#define IMU_CLS_HOP      16
+#define IMU_CLS_C1       8
+#define IMU_CLS_K1       5
+#define IMU_CLS_S1       2
+#define IMU_CLS_L1       ((IMU_CLS_WINDOW - IMU_CLS_K1) / IMU_CLS_S1 + 1)
+#define IMU_CLS_C2       16
+#define IMU_CLS_K2       3
+#define IMU_CLS_S2       2
+#define IMU_CLS_L2       ((IMU_CLS_L1 - IMU_CLS_K2) / IMU_CLS_S2 + 1)
+#define IMU_CLS_CLASSES  3
+
+// Multiply-accumulates per inference
+#define IMU_CLS_MACS (IMU_CLS_L1 * IMU_CLS_C1 * IMU_CLS_K1 * IMU_CLS_CHANNELS + \
+                      IMU_CLS_L2 * IMU_CLS_C2 * IMU_CLS_K2 * IMU_CLS_C1 + IMU_CLS_CLASSES * IMU_CLS_C2)
+
+enum ImuClass {
+  IMU_CLASS_NORMAL = 0,
+  IMU_CLASS_FALL,
+  IMU_CLASS_SEIZURE
+};
+
+inline const char* imuClassName(int c) {
+  static const char* names[IMU_CLS_CLASSES] = {"normal", "fall", "seizure"};
+  return (c >= 0 && c < IMU_CLS_CLASSES) ? names[c] : "?";
+}
+
+// x -> round(x * mult / 2^shift)
+struct ImuRequant {
+  int32_t mult;
+  int32_t shift;   // 1..62
+};
+
+struct ImuModelHeader {
+  uint32_t magic;
+  uint8_t window, channels, hop, classes;
+  uint8_t c1_out, c1_kernel, c1_stride, c2_out;
+  uint8_t c2_kernel, c2_stride;
+  uint8_t trained;          // 0 = placeholder weights
+  uint8_t sample_hz;        // rate the model was trained at, 0 = unknown
+  float input_scale[IMU_CLS_CHANNELS];  // int8 counts per g / per deg/s
+  ImuRequant conv1, conv2, pool;
+};
+
+#define IMU_CLS_BLOB_BYTES (sizeof(ImuModelHeader) + \
+    IMU_CLS_C1 * IMU_CLS_K1 * IMU_CLS_CHANNELS + IMU_CLS_C1 * 4 + \
+    IMU_CLS_C2 * IMU_CLS_K2 * IMU_CLS_C1 + IMU_CLS_C2 * 4 + \
+    IMU_CLS_CLASSES * IMU_CLS_C2 + IMU_CLS_CLASSES * 4)
+
+typedef int32_t (*ImuDotFn)(const int8_t* a, const int8_t* b, int n);
+
+static inline int32_t imuDotS8Scalar(const int8_t* a, const int8_t* b, int n) {
+  int32_t acc = 0;
+  for (int i = 0; i < n; i++) acc += (int32_t)a[i] * b[i];
+  return acc;
+}
+
+#if defined(IMU_CLS_AVX2) || defined(IMU_CLS_SSE41)
+// Sign-extend to int16 and pmaddwd (pairwise int32 products and sums):
+// exact, as int8 products and these short sums stay far inside int32
+static inline int32_t imuDotS8Simd(const int8_t* a, const int8_t* b, int n) {
+  int i = 0;
+  int32_t acc = 0;
+#if defined(IMU_CLS_AVX2)
+  __m256i sum = _mm256_setzero_si256();
+  for (; i + 16 <= n; i += 16) {
+    __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+    __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(va, vb));
+  }
+  __m128i s4 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+#else
+  __m128i s4 = _mm_setzero_si128();
+#endif
+  for (; i + 8 <= n; i += 8) {
+    __m128i va = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(a + i)));
+    __m128i vb = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(b + i)));
+    s4 = _mm_add_epi32(s4, _mm_madd_epi16(va, vb));
+  }
+  s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(1, 0, 3, 2)));
+  s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(2, 3, 0, 1)));
+  acc = _mm_cvtsi128_si32(s4);
+  for (; i < n; i++) acc += (int32_t)a[i] * b[i];
+  return acc;
+}
+#endif
+
+// Best implementation for the target
+static inline int32_t imuDotS8(const int8_t* a, const int8_t* b, int n) {
+#if defined(IMU_CLS_AVX2) || defined(IMU_CLS_SSE41)
+  return imuDotS8Simd(a, b, n);
+#else
+  return imuDotS8Scalar(a, b, n);
+#endif
+}
+
+static inline const char* imuDotName() {
+#if defined(IMU_CLS_AVX2)
+  return "avx2";
+#elif defined(IMU_CLS_SSE41)
+  return "sse4.1";
+#else
+  return "scalar";
+#endif
+}
+
+static inline int8_t imuRequantRelu(int32_t acc, const ImuRequant& q) {
+  int64_t v = ((int64_t)acc * q.mult + ((int64_t)1 << (q.shift - 1))) >> q.shift;
+  return (int8_t)(v < 0 ? 0 : v > 127 ? 127 : v);
+}
+
+class ImuClassifier {
+public:
+  // `blob` must stay valid (flash); returns false if it does not match the
+  // network shape
+  bool begin(const uint8_t* blob, size_t len, ImuDotFn dot = imuDotS8) {
+    hdr = NULL;
+    if (len < IMU_CLS_BLOB_BYTES || ((uintptr_t)blob & 3)) return false;
+    const ImuModelHeader* h = (const ImuModelHeader*)blob;
+    if (h->magic != IMU_CLS_MAGIC || h->window != IMU_CLS_WINDOW || h->channels != IMU_CLS_CHANNELS ||
+        h->hop == 0 || h->classes != IMU_CLS_CLASSES || h->c1_out != IMU_CLS_C1 || h->c1_kernel != IMU_CLS_K1 ||
+        h->c1_stride != IMU_CLS_S1 || h->c2_out != IMU_CLS_C2 || h->c2_kernel != IMU_CLS_K2 ||
+        h->c2_stride != IMU_CLS_S2) {
+      return false;
+    }
+    const ImuRequant* q[3] = {&h->conv1, &h->conv2, &h->pool};
+    for (const ImuRequant* r : q) {
+      if (r->shift < 1 || r->shift > 62) return false;
+    }
+
+    const uint8_t* p = blob + sizeof(ImuModelHeader);
+    c1_w = (const int8_t*)p;  p += IMU_CLS_C1 * IMU_CLS_K1 * IMU_CLS_CHANNELS;
+    c1_b = (const int32_t*)p; p += IMU_CLS_C1 * 4;
+    c2_w = (const int8_t*)p;  p += IMU_CLS_C2 * IMU_CLS_K2 * IMU_CLS_C1;
+    c2_b = (const int32_t*)p; p += IMU_CLS_C2 * 4;
+    fc_w = (const int8_t*)p;  p += IMU_CLS_CLASSES * IMU_CLS_C2;
+    fc_b = (const int32_t*)p;
+    hdr = h;
+    this->dot = dot;
+    reset();
+    return true;
+  }
+
+  void reset() {
+    head = 0;
+    filled = 0;
+    since = 0;
+    best = IMU_CLASS_NORMAL;
+    memset(logit, 0, sizeof(logit));
+  }
+
+  // One sample: accel x/y/z in g, gyro x/y/z in deg/s. Returns true when a
+  // new decision is ready (every hop samples once the window is full).
+  bool push(const float* sample) {
+    if (!hdr) return false;
+    for (int c = 0; c < IMU_CLS_CHANNELS; c++) {
+      float v = sample[c] * hdr->input_scale[c];
+      v = v > 127 ? 127 : v < -127 ? -127 : v == v ? v : 0;
+      ring[head][c] = (int8_t)lrintf(v);
+    }
+    head = (head + 1) % IMU_CLS_WINDOW;
+    if (filled < IMU_CLS_WINDOW) filled++;
+    if (filled < IMU_CLS_WINDOW || ++since < hdr->hop) return false;
+    since = 0;
+
+    // Oldest sample first
+    size_t tail = (IMU_CLS_WINDOW - head) * IMU_CLS_CHANNELS;
+    memcpy(window, ring[head], tail);
+    memcpy(window + tail, ring[0], head * IMU_CLS_CHANNELS);
+    infer(window, logit);
+
+    best = IMU_CLASS_NORMAL;
+    for (int c = 1; c < IMU_CLS_CLASSES; c++) {
+      if (logit[c] > logit[best]) best = (ImuClass)c;
+    }
+    return true;
+  }
+
+  // The network on a linear window [IMU_CLS_WINDOW][IMU_CLS_CHANNELS]
+  void infer(const int8_t* in, int32_t* out) {
+    for (int t = 0; t < IMU_CLS_L1; t++) {
+      const int8_t* x = in + t * IMU_CLS_S1 * IMU_CLS_CHANNELS;
+      for (int f = 0; f < IMU_CLS_C1; f++) {
+        int32_t acc = c1_b[f] + dot(x, c1_w + f * IMU_CLS_K1 * IMU_CLS_CHANNELS, IMU_CLS_K1 * IMU_CLS_CHANNELS);
+        act1[t * IMU_CLS_C1 + f] = imuRequantRelu(acc, hdr->conv1);
+      }
+    }
+    for (int t = 0; t < IMU_CLS_L2; t++) {
+      const int8_t* x = act1 + t * IMU_CLS_S2 * IMU_CLS_C1;
+      for (int f = 0; f < IMU_CLS_C2; f++) {
+        int32_t acc = c2_b[f] + dot(x, c2_w + f * IMU_CLS_K2 * IMU_CLS_C1, IMU_CLS_K2 * IMU_CLS_C1);
+        act2[t * IMU_CLS_C2 + f] = imuRequantRelu(acc, hdr->conv2);
+      }
+    }
+    for (int f = 0; f < IMU_CLS_C2; f++) {
+      int32_t sum = 0;
+      for (int t = 0; t < IMU_CLS_L2; t++) sum += act2[t * IMU_CLS_C2 + f];
+      pooled[f] = imuRequantRelu(sum, hdr->pool);
+    }
+    for (int c = 0; c < IMU_CLS_CLASSES; c++) {
+      out[c] = fc_b[c] + dot(pooled, fc_w + c * IMU_CLS_C2, IMU_CLS_C2);
+    }
+  }
+
+  bool ready() const { return hdr != NULL; }
+  bool trained() const { return hdr && hdr->trained; }
+  uint32_t sampleHz() const { return hdr ? hdr->sample_hz : 0; }
+  ImuClass label() const { return best; }
+  const int32_t* logits() const { return logit; }
+
+  // Distance of the winning logit to the runner-up
+  int32_t margin() const {
+    int32_t second = INT32_MIN;
+    for (int c = 0; c < IMU_CLS_CLASSES; c++) {
+      if (c != best && logit[c] > second) second = logit[c];
+    }
+    return logit[best] - second;
+  }
+
+private:
+  const ImuModelHeader* hdr = NULL;
+  const int8_t* c1_w = NULL;
+  const int32_t* c1_b = NULL;
+  const int8_t* c2_w = NULL;
+  const int32_t* c2_b = NULL;
+  const int8_t* fc_w = NULL;
+  const int32_t* fc_b = NULL;
+  ImuDotFn dot = imuDotS8;
+
+  int8_t ring[IMU_CLS_WINDOW][IMU_CLS_CHANNELS];
+  int8_t window[IMU_CLS_WINDOW * IMU_CLS_CHANNELS];
+  int8_t act1[IMU_CLS_L1 * IMU_CLS_C1];
+  int8_t act2[IMU_CLS_L2 * IMU_CLS_C2];
+  int8_t pooled[IMU_CLS_C2];
+  uint16_t head = 0;
+  uint16_t filled = 0;
+  uint16_t since = 0;
+  ImuClass best = IMU_CLASS_NORMAL;
+  int32_t logit[IMU_CLS_CLASSES] = {};
+};
@@ -0,0 +1,69 @@
+#pragma once
+// Weight blob for imu_classifier.h, written by tools/imu_classifier_train
+// (seed 1) from traces.bha, a synthetic archive from tools/threshold_sweep gen.
+// Trained for 10 Hz sampling. On the held-out patients the int8 model found
+// 100.0 % of seizure windows and 100.0 % of fall windows, and called 0.00 % of
+// normal windows a seizure (gyro RMS threshold: 99.6 % / 0.29 %).
+//
+// Reference model for the synthetic traces; retrain on recorded, labelled
+// patient traces before relying on it.
+
+#include <stdint.h>
+#include <stddef.h>
+
+alignas(4) static const uint8_t IMU_MODEL_BLOB[] = {
+  0x42, 0x48, 0x4d, 0x31, 0x40, 0x06, 0x10, 0x03, 0x08, 0x05, 0x02, 0x10, 0x03, 0x02, 0x01, 0x0a,
+  0x00, 0x00, 0x00, 0x42, 0x00, 0x00, 0x00, 0x42, 0x00, 0x00, 0x00, 0x42, 0x00, 0x00, 0x00, 0x3f,
+  0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x00, 0x3f, 0x8f, 0xc4, 0x29, 0x2a, 0x24, 0x00, 0x00, 0x00,
+  0x15, 0x76, 0xe3, 0x25, 0x25, 0x00, 0x00, 0x00, 0xd5, 0x95, 0xf3, 0x2d, 0x21, 0x00, 0x00, 0x00,
+  0x02, 0x01, 0xfc, 0x4c, 0x58, 0x81, 0xfd, 0xf7, 0x10, 0x0b, 0x7f, 0xba, 0x08, 0x01, 0xf9, 0xdd,
+  0xca, 0x4d, 0xfe, 0xf6, 0x02, 0xcf, 0x01, 0xe7, 0x04, 0x02, 0xfb, 0xbc, 0xac, 0xd5, 0x04, 0xfb,
+  0xfc, 0x1d, 0xf2, 0x27, 0x01, 0x0e, 0x02, 0x1f, 0x17, 0x02, 0x0d, 0xfa, 0x01, 0x2b, 0xee, 0xf8,
+  0xf8, 0x07, 0xf8, 0x0c, 0x00, 0xfe, 0xfe, 0x08, 0xf1, 0x41, 0x0a, 0x03, 0xfd, 0xf4, 0x02, 0x13,
+  0xef, 0x18, 0x04, 0xfe, 0x05, 0xfc, 0x54, 0xd1, 0x04, 0x02, 0x03, 0xe3, 0x00, 0x44, 0x01, 0xfc,
+  0x15, 0x21, 0xce, 0xe7, 0xf9, 0x05, 0x0c, 0xe4, 0xfa, 0x32, 0x00, 0x0e, 0x08, 0xf0, 0xf9, 0x34,
+  0xfa, 0x03, 0x0b, 0x0a, 0x55, 0xd6, 0x01, 0x06, 0x00, 0xf8, 0xe6, 0x41, 0x06, 0xf0, 0x04, 0x1a,
+  0x15, 0xe0, 0x06, 0xf3, 0x08, 0xe8, 0xe9, 0x3a, 0x02, 0x05, 0x16, 0x0b, 0xc8, 0x04, 0x09, 0xfb,
+  0xf5, 0x04, 0x17, 0xeb, 0x07, 0xff, 0xfb, 0x15, 0xd7, 0xeb, 0x02, 0xfe, 0xec, 0x0b, 0x32, 0xfb,
+  0xf4, 0xf7, 0x0b, 0x03, 0x0e, 0x02, 0xf4, 0x05, 0xea, 0x2b, 0xfa, 0x20, 0xfe, 0x00, 0x01, 0x23,
+  0x03, 0xfd, 0x01, 0x02, 0xfe, 0x37, 0xfd, 0xfe, 0xff, 0xf7, 0xff, 0x0c, 0xf1, 0x00, 0x00, 0x0c,
+  0xde, 0x3c, 0x1c, 0x0b, 0x00, 0xff, 0xef, 0x24, 0x02, 0x22, 0xfd, 0xfe, 0xf9, 0x27, 0xf1, 0x06,
+  0x03, 0x00, 0xfd, 0x25, 0x05, 0xf2, 0xfd, 0xfe, 0x05, 0x08, 0xef, 0xf6, 0xf2, 0x07, 0xd9, 0x34,
+  0x15, 0xfe, 0x03, 0x09, 0xf1, 0x0f, 0x04, 0x1b, 0xfd, 0x0b, 0xe4, 0x2e, 0xea, 0x02, 0x02, 0xfe,
+  0x02, 0x1a, 0x2b, 0xf0, 0xff, 0xfd, 0xff, 0x07, 0xd2, 0xfb, 0xfb, 0xfd, 0xdf, 0x31, 0x17, 0x01,
+  0x0a, 0x01, 0x00, 0x00, 0xc0, 0xff, 0xff, 0xff, 0x32, 0x02, 0x00, 0x00, 0x63, 0x00, 0x00, 0x00,
+  0xef, 0xff, 0xff, 0xff, 0xb8, 0xff, 0xff, 0xff, 0xde, 0xfe, 0xff, 0xff, 0xd7, 0xff, 0xff, 0xff,
+  0x13, 0x12, 0xe7, 0xd7, 0x3d, 0xf5, 0x16, 0x24, 0x29, 0x12, 0xff, 0xe4, 0x47, 0x1f, 0x0e, 0x41,
+  0x0d, 0x1f, 0xe1, 0xed, 0x4f, 0x06, 0x1b, 0x44, 0xec, 0x0a, 0xf9, 0x0d, 0xf5, 0x20, 0x13, 0x08,
+  0xf0, 0x01, 0xf7, 0xfa, 0xee, 0x2f, 0x1b, 0xfd, 0xdb, 0x0e, 0xf0, 0x00, 0x0c, 0x39, 0x27, 0x07,
+  0x0b, 0x0b, 0xec, 0xe5, 0x29, 0x12, 0x16, 0x24, 0x1c, 0x19, 0xfe, 0xf9, 0x0a, 0x30, 0x2e, 0x16,
+  0xfe, 0x26, 0xde, 0xf1, 0x23, 0x4b, 0x47, 0x3a, 0xd7, 0x1e, 0xe6, 0xf5, 0x03, 0x33, 0x1b, 0x3c,
+  0x00, 0x32, 0x0f, 0xf8, 0xe3, 0x32, 0x35, 0x14, 0xd1, 0x45, 0xd6, 0xe2, 0x1b, 0x5a, 0x49, 0x36,
+  0xea, 0xe7, 0xf7, 0x0d, 0xbf, 0xf2, 0xfa, 0x00, 0x1f, 0xf2, 0xfc, 0x04, 0xdb, 0xec, 0xe9, 0xff,
+  0xe6, 0x1f, 0xab, 0xcd, 0x08, 0x5c, 0x44, 0x59, 0xdf, 0x1f, 0xea, 0xed, 0x0b, 0x31, 0x1e, 0x17,
+  0x12, 0x27, 0x00, 0xf9, 0xe7, 0x48, 0x2a, 0x27, 0xcc, 0x25, 0xd3, 0x05, 0x1e, 0x5a, 0x3e, 0x4a,
+  0x1e, 0x20, 0x07, 0x0c, 0xd8, 0x0e, 0xe8, 0xff, 0xe4, 0x08, 0x1b, 0x0e, 0x1b, 0xe3, 0xed, 0xec,
+  0x25, 0x0d, 0x02, 0xfe, 0xee, 0xf9, 0xc9, 0xd2, 0xdd, 0x24, 0xf3, 0x00, 0x03, 0x17, 0x28, 0x1f,
+  0x0e, 0x30, 0xf1, 0x02, 0xe6, 0x3e, 0x3b, 0x2a, 0xd2, 0x32, 0xd8, 0xec, 0x0e, 0x45, 0x4c, 0x49,
+  0xee, 0x30, 0xee, 0xe5, 0x11, 0x32, 0x31, 0x1f, 0x03, 0x26, 0xf9, 0xfa, 0xc2, 0x43, 0x28, 0x28,
+  0xdb, 0x38, 0xe1, 0xd8, 0x30, 0x43, 0x48, 0x46, 0x12, 0x09, 0xf5, 0xec, 0x36, 0x22, 0x0e, 0x1f,
+  0x22, 0x10, 0x04, 0xee, 0x24, 0x19, 0x2d, 0x1b, 0x05, 0x2c, 0xd3, 0xe1, 0x3c, 0x53, 0x42, 0x41,
+  0x11, 0x17, 0xea, 0xda, 0x27, 0x15, 0x11, 0x28, 0x29, 0x11, 0xff, 0xe5, 0x0c, 0x34, 0x3e, 0x36,
+  0xff, 0x31, 0xe3, 0xe1, 0x3e, 0x4d, 0x48, 0x40, 0xf9, 0x17, 0xe4, 0xf2, 0x09, 0x38, 0x15, 0x15,
+  0x11, 0x0b, 0x00, 0x03, 0xdf, 0x21, 0x1f, 0x1d, 0xe2, 0x23, 0xe4, 0xfc, 0x13, 0x4a, 0x48, 0x36,
+  0x0a, 0x0b, 0xe5, 0x01, 0x38, 0x06, 0x0c, 0x11, 0x11, 0x12, 0xf1, 0xeb, 0x20, 0x09, 0x26, 0x2b,
+  0x0c, 0x1a, 0xe9, 0xf9, 0x47, 0x29, 0x31, 0x36, 0x1d, 0x14, 0x0d, 0x10, 0xd5, 0x10, 0xf1, 0xf8,
+  0xef, 0x1a, 0x17, 0x08, 0x14, 0xe3, 0xf3, 0xe6, 0x1f, 0xff, 0x10, 0xfc, 0xfa, 0xe2, 0xee, 0xd2,
+  0x3a, 0x1b, 0xfc, 0x12, 0x21, 0x00, 0x06, 0x36, 0x39, 0xef, 0xf4, 0x05, 0x58, 0xc1, 0xca, 0x30,
+  0x7f, 0x0a, 0x14, 0xef, 0x5b, 0xf2, 0xee, 0x1f, 0x1a, 0x27, 0x17, 0x01, 0xef, 0x06, 0xfc, 0xee,
+  0xeb, 0x1a, 0x0b, 0x0c, 0x1e, 0xc8, 0xf5, 0xf8, 0x4c, 0x0b, 0x02, 0x0c, 0xf4, 0xe8, 0xe3, 0xd6,
+  0xc7, 0xfd, 0xff, 0xff, 0x4d, 0xff, 0xff, 0xff, 0xe6, 0xfe, 0xff, 0xff, 0xe4, 0xff, 0xff, 0xff,
+  0x6b, 0xff, 0xff, 0xff, 0x7d, 0xff, 0xff, 0xff, 0x75, 0x01, 0x00, 0x00, 0x76, 0x00, 0x00, 0x00,
+  0x9c, 0xff, 0xff, 0xff, 0x92, 0xfe, 0xff, 0xff, 0x8f, 0xfe, 0xff, 0xff, 0x3c, 0xff, 0xff, 0xff,
+  0xc5, 0xfe, 0xff, 0xff, 0x6e, 0x01, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0xaf, 0x01, 0x00, 0x00,
+  0xc7, 0x02, 0x94, 0x81, 0xd0, 0xa5, 0x1a, 0x88, 0x9f, 0x95, 0x81, 0xc5, 0xe4, 0x10, 0x00, 0x22,
+  0xea, 0x27, 0x3c, 0x7b, 0x40, 0x42, 0xf1, 0x6d, 0x68, 0x29, 0x3d, 0x3d, 0x0e, 0xeb, 0xe4, 0xea,
+  0x57, 0xc9, 0x5a, 0xcd, 0xfe, 0xf6, 0x86, 0xe0, 0x16, 0x49, 0x44, 0xff, 0x58, 0x8a, 0x49, 0xb0,
+  0x7d, 0x00, 0x00, 0x00, 0x87, 0xff, 0xff, 0xff, 0xf2, 0xfe, 0xff, 0xff,
+};
+static const size_t IMU_MODEL_BLOB_LEN = sizeof(IMU_MODEL_BLOB);
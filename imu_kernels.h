@@ -0,0 +1,273 @@
+#pragma once
+// Block kernels for IMU feature extraction.
+//
+// Input is a block of raw int16 samples as they come out of the MPU6050 FIFO
+// (accel x/y/z, gyro x/y/z, already byte-swapped). One pass produces, per
+// sample, the squared accel/gyro norms (exact, in LSB^2), the magnitudes
+// scaled to physical units, and a free-fall bit (accel norm below a
+// threshold); and per block the largest |value| on every axis and the sums of
+// the squared norms (for RMS).
+//
+// There is one scalar implementation and SSE4.1 / AVX2 ones for the host,
+// chosen at compile time. All of them give bit-identical results: the squared
+// norms are integer arithmetic, and the only floating-point steps
+// (u32 -> float, sqrt, one multiply) are single correctly rounded IEEE
+// operations done in the same order everywhere. The ESP32 builds use the
+// scalar path.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IMU_KERNEL_AVX2 1
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define IMU_KERNEL_SSE41 1
+#endif
+
+enum ImuAxis { IMU_AX = 0, IMU_AY, IMU_AZ, IMU_GX, IMU_GY, IMU_GZ, IMU_AXES };
+
+struct ImuRawSample {
+  int16_t v[IMU_AXES];
+};
+
+struct ImuBlockFeatures {
+  // Per sample, caller-provided arrays of at least n entries (any may be NULL
+  // except accel_sq and gyro_sq)
+  uint32_t* accel_sq;      // ax^2 + ay^2 + az^2, LSB^2
+  uint32_t* gyro_sq;
+  float* accel_mag;        // sqrt(accel_sq) * accel_scale
+  float* gyro_mag;
+  uint32_t* freefall;      // bit i set when accel_sq[i] < freefall_sq, (n + 31) / 32 words
+
+  // Per block
+  uint16_t max_abs[IMU_AXES];
+  uint64_t accel_sq_sum;
+  uint64_t gyro_sq_sum;
+  uint32_t freefall_count;
+};
+
+// u32 -> float in two exact halves and one rounding, so every path agrees
+static inline float imuU32ToFloat(uint32_t x) {
+  return (float)(int32_t)(x >> 16) * 65536.0f + (float)(int32_t)(x & 0xFFFF);
+}
+
+static inline uint16_t imuAbs16(int16_t x) {
+  return (uint16_t)(x < 0 ? -(int32_t)x : x);
+}
+
+// Samples [begin, n) one at a time
+static inline void imuBlockScalarRange(const ImuRawSample* s, size_t begin, size_t n, uint32_t freefall_sq,
+                                       float accel_scale, float gyro_scale, ImuBlockFeatures& out) {
+  for (size_t i = begin; i < n; i++) {
+    const int16_t* v = s[i].v;
+    uint32_t a = (uint32_t)((int32_t)v[0] * v[0]) + (uint32_t)((int32_t)v[1] * v[1]) + (uint32_t)((int32_t)v[2] * v[2]);
+    uint32_t g = (uint32_t)((int32_t)v[3] * v[3]) + (uint32_t)((int32_t)v[4] * v[4]) + (uint32_t)((int32_t)v[5] * v[5]);
+    out.accel_sq[i] = a;
+    out.gyro_sq[i] = g;
+    if (out.accel_mag) out.accel_mag[i] = sqrtf(imuU32ToFloat(a)) * accel_scale;
+    if (out.gyro_mag) out.gyro_mag[i] = sqrtf(imuU32ToFloat(g)) * gyro_scale;
+    if (a < freefall_sq) {
+      if (out.freefall) out.freefall[i / 32] |= 1u << (i % 32);
+      out.freefall_count++;
+    }
+    for (int k = 0; k < IMU_AXES; k++) {
+      uint16_t m = imuAbs16(v[k]);
+      if (m > out.max_abs[k]) out.max_abs[k] = m;
+    }
+    out.accel_sq_sum += a;
+    out.gyro_sq_sum += g;
+  }
+}
+
+static inline void imuBlockResetOutputs(size_t n, ImuBlockFeatures& out) {
+  memset(out.max_abs, 0, sizeof(out.max_abs));
+  out.accel_sq_sum = out.gyro_sq_sum = 0;
+  out.freefall_count = 0;
+  if (out.freefall) memset(out.freefall, 0, ((n + 31) / 32) * sizeof(uint32_t));
+}
+
+static inline void imuBlockScalar(const ImuRawSample* s, size_t n, uint32_t freefall_sq,
+                                  float accel_scale, float gyro_scale, ImuBlockFeatures& out) {
+  imuBlockResetOutputs(n, out);
+  imuBlockScalarRange(s, 0, n, freefall_sq, accel_scale, gyro_scale, out);
+}
+
+#if defined(IMU_KERNEL_AVX2) || defined(IMU_KERNEL_SSE41)
+// Byte shuffle of one 12-byte sample into [ax ay az 0 gx gy gz 0] so that
+// pmaddwd leaves [ax^2+ay^2, az^2, gx^2+gy^2, gz^2]. The 32-bit products wrap
+// exactly like the scalar uint32 arithmetic.
+#define IMU_SPLIT_SHUFFLE 0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1
+#endif
+
+#if defined(IMU_KERNEL_AVX2)
+
+static inline __m256 imuU32ToFloat8(__m256i x) {
+  __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(x, 16));
+  __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(x, _mm256_set1_epi32(0xFFFF)));
+  return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo);
+}
+
+static inline __m256i imuSumU32ToU64(__m256i acc, __m256i x) {
+  acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(x)));
+  return _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(x, 1)));
+}
+
+// 8 samples per iteration: sample i in the low lane, i + 4 in the high lane
+static inline void imuBlockAVX2(const ImuRawSample* s, size_t n, uint32_t freefall_sq,
+                                float accel_scale, float gyro_scale, ImuBlockFeatures& out) {
+  imuBlockResetOutputs(n, out);
+  const __m256i split = _mm256_setr_epi8(IMU_SPLIT_SHUFFLE, IMU_SPLIT_SHUFFLE);
+  const __m256i bias = _mm256_set1_epi32((int)0x80000000u);
+  const __m256i ff = _mm256_xor_si256(_mm256_set1_epi32((int)freefall_sq), bias);
+  const __m256 ascale = _mm256_set1_ps(accel_scale);
+  const __m256 gscale = _mm256_set1_ps(gyro_scale);
+  __m256i max_abs = _mm256_setzero_si256();
+  __m256i asum = _mm256_setzero_si256();
+  __m256i gsum = _mm256_setzero_si256();
+
+  // Each 16-byte load reads 4 bytes into the next sample, so keep one spare
+  size_t i = 0;
+  for (; i + 8 < n; i += 8) {
+    __m256i r[4];
+    for (int k = 0; k < 4; k++) {
+      __m128i lo = _mm_loadu_si128((const __m128i*)&s[i + k]);
+      __m128i hi = _mm_loadu_si128((const __m128i*)&s[i + k + 4]);
+      __m256i v = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), split);
+      max_abs = _mm256_max_epu16(max_abs, _mm256_abs_epi16(v));
+      r[k] = _mm256_madd_epi16(v, v);
+    }
+    // [a_i, g_i, a_i+1, g_i+1 | a_i+4, ...] then de-interleave
+    __m256 h0 = _mm256_castsi256_ps(_mm256_hadd_epi32(r[0], r[1]));
+    __m256 h1 = _mm256_castsi256_ps(_mm256_hadd_epi32(r[2], r[3]));
+    __m256i a = _mm256_castps_si256(_mm256_shuffle_ps(h0, h1, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256i g = _mm256_castps_si256(_mm256_shuffle_ps(h0, h1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+    _mm256_storeu_si256((__m256i*)&out.accel_sq[i], a);
+    _mm256_storeu_si256((__m256i*)&out.gyro_sq[i], g);
+    if (out.accel_mag) _mm256_storeu_ps(&out.accel_mag[i], _mm256_mul_ps(_mm256_sqrt_ps(imuU32ToFloat8(a)), ascale));
+    if (out.gyro_mag) _mm256_storeu_ps(&out.gyro_mag[i], _mm256_mul_ps(_mm256_sqrt_ps(imuU32ToFloat8(g)), gscale));
+
+    // Unsigned a < freefall_sq via the signed compare on biased values
+    __m256i below = _mm256_cmpgt_epi32(ff, _mm256_xor_si256(a, bias));
+    uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(below));
+    if (out.freefall) out.freefall[i / 32] |= mask << (i % 32);
+    out.freefall_count += __builtin_popcount(mask);
+
+    asum = imuSumU32ToU64(asum, a);
+    gsum = imuSumU32ToU64(gsum, g);
+  }
+
+  // Fold lanes: positions 0-2 are accel, 4-6 gyro
+  uint16_t m[16];
+  uint64_t sums[8];
+  _mm256_storeu_si256((__m256i*)m, max_abs);
+  _mm256_storeu_si256((__m256i*)sums, asum);
+  _mm256_storeu_si256((__m256i*)(sums + 4), gsum);
+  static const int lane_axis[8] = {IMU_AX, IMU_AY, IMU_AZ, -1, IMU_GX, IMU_GY, IMU_GZ, -1};
+  for (int k = 0; k < 16; k++) {
+    int axis = lane_axis[k % 8];
+    if (axis >= 0 && m[k] > out.max_abs[axis]) out.max_abs[axis] = m[k];
+  }
+  out.accel_sq_sum = sums[0] + sums[1] + sums[2] + sums[3];
+  out.gyro_sq_sum = sums[4] + sums[5] + sums[6] + sums[7];
+
+  imuBlockScalarRange(s, i, n, freefall_sq, accel_scale, gyro_scale, out);
+}
+
+#elif defined(IMU_KERNEL_SSE41)
+
+static inline __m128 imuU32ToFloat4(__m128i x) {
+  __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(x, 16));
+  __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(x, _mm_set1_epi32(0xFFFF)));
+  return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+}
+
+static inline __m128i imuSumU32ToU64(__m128i acc, __m128i x) {
+  acc = _mm_add_epi64(acc, _mm_cvtepu32_epi64(x));
+  return _mm_add_epi64(acc, _mm_cvtepu32_epi64(_mm_srli_si128(x, 8)));
+}
+
+// 4 samples per iteration
+static inline void imuBlockSSE41(const ImuRawSample* s, size_t n, uint32_t freefall_sq,
+                                 float accel_scale, float gyro_scale, ImuBlockFeatures& out) {
+  imuBlockResetOutputs(n, out);
+  const __m128i split = _mm_setr_epi8(IMU_SPLIT_SHUFFLE);
+  const __m128i bias = _mm_set1_epi32((int)0x80000000u);
+  const __m128i ff = _mm_xor_si128(_mm_set1_epi32((int)freefall_sq), bias);
+  const __m128 ascale = _mm_set1_ps(accel_scale);
+  const __m128 gscale = _mm_set1_ps(gyro_scale);
+  __m128i max_abs = _mm_setzero_si128();
+  __m128i asum = _mm_setzero_si128();
+  __m128i gsum = _mm_setzero_si128();
+
+  // Each 16-byte load reads 4 bytes into the next sample, so keep one spare
+  size_t i = 0;
+  for (; i + 4 < n; i += 4) {
+    __m128i r[4];
+    for (int k = 0; k < 4; k++) {
+      __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&s[i + k]), split);
+      max_abs = _mm_max_epu16(max_abs, _mm_abs_epi16(v));
+      r[k] = _mm_madd_epi16(v, v);
+    }
+    __m128 h0 = _mm_castsi128_ps(_mm_hadd_epi32(r[0], r[1]));
+    __m128 h1 = _mm_castsi128_ps(_mm_hadd_epi32(r[2], r[3]));
+    __m128i a = _mm_castps_si128(_mm_shuffle_ps(h0, h1, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i g = _mm_castps_si128(_mm_shuffle_ps(h0, h1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+    _mm_storeu_si128((__m128i*)&out.accel_sq[i], a);
+    _mm_storeu_si128((__m128i*)&out.gyro_sq[i], g);
+    if (out.accel_mag) _mm_storeu_ps(&out.accel_mag[i], _mm_mul_ps(_mm_sqrt_ps(imuU32ToFloat4(a)), ascale));
+    if (out.gyro_mag) _mm_storeu_ps(&out.gyro_mag[i], _mm_mul_ps(_mm_sqrt_ps(imuU32ToFloat4(g)), gscale));
+
+    __m128i below = _mm_cmpgt_epi32(ff, _mm_xor_si128(a, bias));
+    uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(below));
+    if (out.freefall) out.freefall[i / 32] |= mask << (i % 32);
+    out.freefall_count += __builtin_popcount(mask);
+
+    asum = imuSumU32ToU64(asum, a);
+    gsum = imuSumU32ToU64(gsum, g);
+  }
+
+  uint16_t m[8];
+  uint64_t sums[4];
+  _mm_storeu_si128((__m128i*)m, max_abs);
+  _mm_storeu_si128((__m128i*)sums, asum);
+  _mm_storeu_si128((__m128i*)(sums + 2), gsum);
+  static const int lane_axis[8] = {IMU_AX, IMU_AY, IMU_AZ, -1, IMU_GX, IMU_GY, IMU_GZ, -1};
+  for (int k = 0; k < 8; k++) {
+    int axis = lane_axis[k];
+    if (axis >= 0 && m[k] > out.max_abs[axis]) out.max_abs[axis] = m[k];
+  }
+  out.accel_sq_sum = sums[0] + sums[1];
+  out.gyro_sq_sum = sums[2] + sums[3];
+
+  imuBlockScalarRange(s, i, n, freefall_sq, accel_scale, gyro_scale, out);
+}
+
+#endif
+
+// Best implementation for the target
+static inline void imuBlockFeatures(const ImuRawSample* s, size_t n, uint32_t freefall_sq,
+                                    float accel_scale, float gyro_scale, ImuBlockFeatures& out) {
+#if defined(IMU_KERNEL_AVX2)
+  imuBlockAVX2(s, n, freefall_sq, accel_scale, gyro_scale, out);
+#elif defined(IMU_KERNEL_SSE41)
+  imuBlockSSE41(s, n, freefall_sq, accel_scale, gyro_scale, out);
+#else
+  imuBlockScalar(s, n, freefall_sq, accel_scale, gyro_scale, out);
+#endif
+}
+
+static inline const char* imuKernelName() {
+#if defined(IMU_KERNEL_AVX2)
+  return "avx2";
+#elif defined(IMU_KERNEL_SSE41)
+  return "sse4.1";
+#else
+  return "scalar";
+#endif
+}
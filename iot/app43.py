@@ -6,6 +6,7 @@ import time
 import os
 import pandas as pd
 import numpy as np
+import math
 import random
 from gtts import gTTS
 import pygame
@@ -76,29 +77,70 @@ YOGA_ANGLES = {
     "left-leg":             [23, 25, 27]
 }
 
+# The same table as arrays for the per-frame evaluation
+ANGLE_NAMES = list(YOGA_ANGLES.keys())
+ANGLE_JOINTS = np.array(list(YOGA_ANGLES.values()), dtype=np.int32)
+VISIBILITY_MIN = 0.5
+
+# Status codes returned per angle (shared with yoga_kernel.cpp)
+ANGLE_OK, ANGLE_TOO_SMALL, ANGLE_TOO_LARGE, ANGLE_HIDDEN, ANGLE_NO_REFERENCE = range(5)
+
+def pose_bounds(pose_ref):
+    """median ± iqr per angle in ANGLE_NAMES order, NaN where there is no reference"""
+    lower = np.full(len(ANGLE_NAMES), np.nan)
+    upper = np.full(len(ANGLE_NAMES), np.nan)
+    for i, angle_name in enumerate(ANGLE_NAMES):
+        ref_data = pose_ref.get(angle_name.replace('-', '_'))
+        if ref_data:
+            lower[i] = ref_data['median'] - ref_data['iqr']
+            upper[i] = ref_data['median'] + ref_data['iqr']
+    return lower, upper
+
+POSE_BOUNDS = {name: pose_bounds(ref) for name, ref in POSE_REFERENCE.items()}
+NO_BOUNDS = pose_bounds({})
+
 # ── Helper Functions ─────────────────────────────────────────────────────────────────────────────────
-def calculate_angle(a, b, c):
-    a = np.array(a)
-    b = np.array(b)
-    c = np.array(c)
-    radians = np.arctan2(c[1]-b[1], c[0]-b[0]) - np.arctan2(a[1]-b[1], a[0]-b[0])
-    angle = abs(radians * 180.0 / np.pi)
-    if angle > 180.0:
-        angle = 360.0 - angle
-    return round(angle, 2)
-
-def calc_yoga_angles(landmarks):
-    ang = {}
-    for name, (p1, p2, p3) in YOGA_ANGLES.items():
-        vis = [landmarks[i]["visibility"] for i in (p1, p2, p3)]
-        if min(vis) < 0.5:
-            ang[name] = None
+def evaluate_pose_python(landmarks, joints, lower, upper):
+    """All joint angles of a frame and their status.
+
+    Same contract as yoga_kernel.evaluate: landmarks is (n, 3) x/y/visibility,
+    joints is (k, 3) landmark indices, lower/upper are NaN where the pose has no
+    reference. Returns (angles, statuses); hidden angles are NaN. With eight
+    angles per frame a plain loop over Python floats beats vectorising: NumPy's
+    per-call overhead would cost more than the arithmetic.
+    """
+    lm = landmarks.tolist()
+    lo = lower.tolist()
+    hi = upper.tolist()
+    k = len(lo)
+    angles = [math.nan] * k
+    statuses = [ANGLE_HIDDEN] * k
+    for j, (ia, ib, ic) in enumerate(joints.tolist()):
+        a, b, c = lm[ia], lm[ib], lm[ic]
+        if a[2] < VISIBILITY_MIN or b[2] < VISIBILITY_MIN or c[2] < VISIBILITY_MIN:
+            continue
+        radians = math.atan2(c[1] - b[1], c[0] - b[0]) - math.atan2(a[1] - b[1], a[0] - b[0])
+        angle = abs(radians * 180.0 / math.pi)
+        if angle > 180.0:
+            angle = 360.0 - angle
+        angle = round(angle, 2)
+        angles[j] = angle
+        if math.isnan(lo[j]) or math.isnan(hi[j]):
+            statuses[j] = ANGLE_NO_REFERENCE
+        elif angle < lo[j]:
+            statuses[j] = ANGLE_TOO_SMALL
+        elif angle > hi[j]:
+            statuses[j] = ANGLE_TOO_LARGE
         else:
-            a = (landmarks[p1]['x'], landmarks[p1]['y'])
-            b = (landmarks[p2]['x'], landmarks[p2]['y'])
-            c = (landmarks[p3]['x'], landmarks[p3]['y'])
-            ang[name] = calculate_angle(a, b, c)
-    return ang
+            statuses[j] = ANGLE_OK
+    return np.array(angles), np.array(statuses, dtype=np.int8)
+
+# Native kernel (yoga_kernel.cpp) when built; it also releases the GIL while it runs
+try:
+    from yoga_kernel import evaluate as evaluate_pose
+except ImportError:
+    print("yoga_kernel not built, using Python angle evaluation")
+    evaluate_pose = evaluate_pose_python
 
 def check_individual_angles_and_feedback(current_angles, current_pose):
     """Optimized combined function that checks angles and generates feedback in a single pass
@@ -296,6 +338,15 @@ def capture_loop():
         frame = cv2.flip(frame, 1)
         rgb = cv2.cvtColor(frame, cv2.COLOR_BGR2RGB)
         results = pose.process(rgb)
+        
+        # Angles and their checks outside the lock, so the Flask handlers are not held up
+        if results.pose_landmarks:
+            landmark_array = np.array(
+                [(lm.x, lm.y, lm.visibility) for lm in results.pose_landmarks.landmark], dtype=np.float64)
+            pose_name = current_pose
+            lower, upper = POSE_BOUNDS.get(pose_name, NO_BOUNDS)
+            angles, statuses = evaluate_pose(landmark_array, ANGLE_JOINTS, lower, upper)
+        
         with lock:
             latest_frame = frame.copy()
             if results.pose_landmarks:
@@ -303,12 +354,17 @@ def capture_loop():
                     {"id": idx, "x": lm.x, "y": lm.y, "visibility": lm.visibility}
                     for idx, lm in enumerate(results.pose_landmarks.landmark)
                 ]
-                current_angles = calc_yoga_angles(latest_landmarks)
+                current_angles = {
+                    name: None if np.isnan(angle) else float(angle)
+                    for name, angle in zip(ANGLE_NAMES, angles)
+                }
                 
             # Check individual angle statuses and overall correctness
-                if current_pose:
-                    angle_statuses, _ = check_individual_angles_and_feedback(current_angles, current_pose)
-                    all_angles_correct = all(status for status in angle_statuses.values())
+                if pose_name and pose_name == current_pose:
+                    angle_statuses = {
+                        name: bool(status == ANGLE_OK) for name, status in zip(ANGLE_NAMES, statuses)
+                    }
+                    all_angles_correct = all(angle_statuses.values())
                 
                 # Draw landmarks
                 mp_drawing.draw_landmarks(
@@ -0,0 +1,110 @@
+"""Per-frame angle evaluation: frames per second before and after yoga_kernel.
+
+Compares the old per-angle Python path (dicts, np.array per joint), the
+fallback in app43.py and the native kernel on random landmark frames, and
+checks that all three agree. Run from this directory after building
+yoga_kernel (see yoga_kernel.cpp); app43.py itself is not imported since it
+opens the webcam on import.
+"""
+import ast
+import math
+import time
+import numpy as np
+
+FRAMES = 2000
+REPEATS = 5
+
+# Pull the angle table and the fallback out of app43.py without running it
+with open('app43.py') as f:
+    source = f.read()
+wanted = {'YOGA_ANGLES', 'ANGLE_NAMES', 'ANGLE_JOINTS', 'VISIBILITY_MIN', 'pose_bounds', 'evaluate_pose_python'}
+app = {'np': np, 'math': math}
+for node in ast.parse(source).body:
+    names = set()
+    if isinstance(node, ast.Assign):
+        for target in node.targets:
+            names |= {t.id for t in ast.walk(target) if isinstance(t, ast.Name)}
+    elif isinstance(node, ast.FunctionDef):
+        names.add(node.name)
+    if names & wanted or 'ANGLE_OK' in names:
+        exec(compile(ast.Module([node], []), 'app43.py', 'exec'), app)
+
+try:
+    import yoga_kernel
+except ImportError:
+    yoga_kernel = None
+    print("yoga_kernel not built, benchmarking the Python paths only")
+
+
+# The per-frame path app43.py used before the kernel
+def calculate_angle(a, b, c):
+    a = np.array(a)
+    b = np.array(b)
+    c = np.array(c)
+    radians = np.arctan2(c[1]-b[1], c[0]-b[0]) - np.arctan2(a[1]-b[1], a[0]-b[0])
+    angle = abs(radians * 180.0 / np.pi)
+    if angle > 180.0:
+        angle = 360.0 - angle
+    return round(angle, 2)
+
+
+def legacy_frame(frame, pose_ref):
+    landmarks = [{"id": i, "x": r[0], "y": r[1], "visibility": r[2]} for i, r in enumerate(frame)]
+    angles = {}
+    for name, (p1, p2, p3) in app['YOGA_ANGLES'].items():
+        if min(landmarks[i]["visibility"] for i in (p1, p2, p3)) < 0.5:
+            angles[name] = None
+        else:
+            angles[name] = calculate_angle((landmarks[p1]['x'], landmarks[p1]['y']),
+                                           (landmarks[p2]['x'], landmarks[p2]['y']),
+                                           (landmarks[p3]['x'], landmarks[p3]['y']))
+    statuses = {}
+    for name, value in angles.items():
+        ref = pose_ref.get(name.replace('-', '_'))
+        statuses[name] = value is not None and ref is not None and \
+            ref['median'] - ref['iqr'] <= value <= ref['median'] + ref['iqr']
+    return angles, statuses
+
+
+def bench(label, fn, frames):
+    start = time.perf_counter()
+    for _ in range(REPEATS):
+        for frame in frames:
+            fn(frame)
+    elapsed = time.perf_counter() - start
+    n = REPEATS * len(frames)
+    print(f"{label:20s} {n / elapsed:10.0f} frames/s  {elapsed / n * 1e6:8.1f} us/frame")
+
+
+def main():
+    rng = np.random.default_rng(1)
+    frames = [rng.random((33, 3)) for _ in range(FRAMES)]
+    pose_ref = {name.replace('-', '_'): {'median': 60.0 + 10 * i, 'iqr': 25.0}
+                for i, name in enumerate(app['ANGLE_NAMES'])}
+    lower, upper = app['pose_bounds'](pose_ref)
+    joints = app['ANGLE_JOINTS']
+
+    paths = [("python fallback", app['evaluate_pose_python'])]
+    if yoga_kernel:
+        paths.append(("yoga_kernel", yoga_kernel.evaluate))
+
+    # Same angles and the same verdicts on every frame
+    for frame in frames:
+        angles, statuses = legacy_frame(frame, pose_ref)
+        for label, evaluate in paths:
+            new_angles, new_statuses = evaluate(frame, joints, lower, upper)
+            for k, name in enumerate(app['ANGLE_NAMES']):
+                if angles[name] is None:
+                    assert np.isnan(new_angles[k]), (label, name)
+                else:
+                    assert abs(new_angles[k] - angles[name]) < 1e-9, (label, name)
+                assert (new_statuses[k] == app['ANGLE_OK']) == statuses[name], (label, name)
+    print(f"all paths agree on {FRAMES} frames")
+
+    bench("python (before)", lambda f: legacy_frame(f, pose_ref), frames)
+    for label, evaluate in paths:
+        bench(label, lambda f, e=evaluate: e(f, joints, lower, upper), frames)
+
+
+if __name__ == '__main__':
+    main()
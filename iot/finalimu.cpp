@@ -1,6 +1,7 @@
 #include <Wire.h>
 #include <Adafruit_MPU6050.h>
 #include <Adafruit_Sensor.h>
+#include "../trace_format.h"
 
 // Create MPU6050 instance
 Adafruit_MPU6050 mpu;
@@ -15,6 +16,20 @@ const unsigned long FLAG_MS     = 5000;
 const int SAMPLE_HZ      = 100;
 const unsigned long INT_MS = 1000 / SAMPLE_HZ;
 
+// 1 = stream the samples as a binary trace (trace_format.h) instead of the
+// debug lines; cut it out of a Serial capture with `trace_tool extract`
+#define TRACE_SERIAL 0
+#define TRACE_BAUD   921600
+
+// Counts per unit at the ranges set in setup()
+const float ACCEL_LSB_PER_G   = 16384; // +-2 g
+const float GYRO_LSB_PER_DPS  = 131;   // +-250 deg/s
+
+#if TRACE_SERIAL
+PrintTraceSink traceSink(Serial);
+TraceStreamWriter traceWriter;
+#endif
+
 // Buffers for gyro RMS
 float gyroBuffer[100];
 int   bufIndex = 0;
@@ -25,8 +40,33 @@ bool inFreefall             = false;
 int  fallFlag               = 0;
 int  seizureFlag            = 0;
 
+int16_t toCounts(float value, float lsb_per_unit) {
+  float c = roundf(value * lsb_per_unit);
+  return (int16_t)(c > 32767 ? 32767 : c < -32768 ? -32768 : c);
+}
+
+void beginTrace() {
+#if TRACE_SERIAL
+  TraceFileHeader h;
+  traceInitHeader(h, SAMPLE_HZ, 0, true);
+  traceAddChannel(h, "ax", 1 / ACCEL_LSB_PER_G);
+  traceAddChannel(h, "ay", 1 / ACCEL_LSB_PER_G);
+  traceAddChannel(h, "az", 1 / ACCEL_LSB_PER_G);
+  traceAddChannel(h, "gx", 1 / GYRO_LSB_PER_DPS);
+  traceAddChannel(h, "gy", 1 / GYRO_LSB_PER_DPS);
+  traceAddChannel(h, "gz", 1 / GYRO_LSB_PER_DPS);
+  traceWriter.begin(traceSink, h);
+#endif
+}
+
 void setup() {
+#if TRACE_SERIAL
+  // A chunk is ~3 KB; a TX buffer that holds it keeps loop() from blocking
+  Serial.setTxBufferSize(4096);
+  Serial.begin(TRACE_BAUD);
+#else
   Serial.begin(115200);
+#endif
 
   // Initialize I2C with custom pins SDA = 22, SCL = 21
   Wire.begin(22, 21);
@@ -39,6 +79,8 @@ void setup() {
   mpu.setAccelerometerRange(MPU6050_RANGE_2_G);
   mpu.setGyroRange(MPU6050_RANGE_250_DEG);
   mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
+
+  beginTrace();
 }
 
 void loop() {
@@ -88,6 +130,13 @@ void loop() {
     seizureFlag = (rms > SEIZURE_RMS_THR) ? 1 : 0;
   }
 
+#if TRACE_SERIAL
+  int16_t raw[6] = {
+    toCounts(ax, ACCEL_LSB_PER_G), toCounts(ay, ACCEL_LSB_PER_G), toCounts(az, ACCEL_LSB_PER_G),
+    toCounts(wx, GYRO_LSB_PER_DPS), toCounts(wy, GYRO_LSB_PER_DPS), toCounts(wz, GYRO_LSB_PER_DPS)
+  };
+  traceWriter.add(raw, now);
+#else
   // Debug output
   Serial.print("FallFlag=");
   Serial.print(fallFlag);
@@ -98,6 +147,7 @@ void loop() {
   Serial.print(" W_deg/s=");
   Serial.print(wmag, 1);
   Serial.println();
+#endif
 
   delay(INT_MS);
 }
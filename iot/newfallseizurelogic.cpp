@@ -2,7 +2,17 @@
 #include <Adafruit_MPU6050.h>
 #include <Adafruit_Sensor.h>
 #include <WiFi.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include "../wifi_manager.h"
+#include "../http_snapshot.h"
+#include "../detector_web.h"
+#include "../seqlock.h"
+#include "../detectors.h"
+#include "../stall_watchdog.h"
+#include "../i2c_recovery.h"
+#include "../imu_classifier.h"
+#include "../imu_classifier_weights.h"
 #include <HTTPClient.h>  // Add this with other includes
 
 // Telegram config (add with other constants)
@@ -15,7 +25,12 @@ const char* password = "0072512B";
 
 // MPU6050 and WebServer instances
 Adafruit_MPU6050 mpu;
-WebServer server(80);
+AsyncWebServer server(80); // Requests are served on the async TCP task, not in loop()
+WiFiManager wifi;
+
+// /data is serialised once per change; resets are queued for the detection task
+SnapshotPublisher dataSnapshot;
+CommandMailbox commands;
 
 // Thresholds (g, °/s)
 const float FREEFALL_G = 0.5;          // Freefall detection threshold (0.5g)
@@ -25,72 +40,222 @@ const unsigned long DEBOUNCE_MS = 100; // Debounce time for fall detection
 const unsigned long SAMPLE_DELAY_MS = 100; // Sampling interval (100ms)
 const unsigned long SEIZURE_ALERT_MS = 13000; // 7 seconds for severe alert
 
-// Buffers and status variables
-float gyroBuffer[100];
-int bufIndex = 0;
-bool inFreefall = false;
-unsigned long freefallStart = 0;
-unsigned long seizureStart = 0;
-int fallFlag = 0;      // Manual reset only
-int seizureFlag = 0;   // 1 = detected (yellow, auto-reset), 2 = severe (red, manual reset)
+// Detection runs on its own task; everything below is owned by it
+const uint32_t DETECTION_TASK_PRIORITY = 2;
+const BaseType_t DETECTION_TASK_CORE = 1;
+const uint32_t DETECTION_TASK_STACK = 4096;
+
+// The supervisor preempts the detection task on its core to check that it
+// still samples; stall reports survive the reset it triggers (see /stalls)
+const uint32_t SUPERVISOR_TASK_PRIORITY = 3;
+const unsigned long STALL_CHECK_MS = 50;
+const unsigned long STALL_DEADLINE_MS = 500;   // 5 missed samples
+const unsigned long STALL_RESTART_MS = 30000;  // then reset the board
+RTC_NOINIT_ATTR StallLog stallLog;
+StallWatchdog sampleWatch(stallLog, STALL_DEADLINE_MS, STALL_RESTART_MS);
+
+// Detectors (see detectors.h)
+// Fall flag: manual reset only
+// Seizure flag: 1 = detected (yellow, auto-reset), 2 = severe (red, manual reset)
+FallDetector fallDetector({FREEFALL_G, GYRO_FALL_DEG_S, DEBOUNCE_MS, 0});
+SeizureDetector seizureDetector({SEIZURE_RMS_THR, 100, SEIZURE_ALERT_MS}); // RMS over 100 samples
 bool mpuConnected = false;
-bool wasSeizureDetected = false; // Track if we're in a seizure condition
+
+// I2C faults: bus unstick, register re-sync, then reinit with backoff, one
+// step per sample at most (i2c_recovery.h). Counters are served on /i2c.
+const int I2C_SDA = 22;
+const int I2C_SCL = 21;
+const uint32_t I2C_CLOCK_HZ = 100000;
+const uint32_t MPU_REINIT_MIN_MS = 500;
+const uint32_t MPU_REINIT_MAX_MS = 10000;
+I2CRecovery mpuRecovery;
+
+// What initializeMPU() configures, rewritten by the re-sync
+const uint8_t MPU_RESYNC_REGS[][2] = {
+  {MPU6050_PWR_MGMT_1, 0x01},    // awake, clock from the X gyro PLL
+  {MPU6050_ACCEL_CONFIG, 0x00},  // MPU6050_RANGE_2_G
+  {MPU6050_GYRO_CONFIG, 0x00},   // MPU6050_RANGE_250_DEG
+  {MPU6050_CONFIG, 0x04},        // MPU6050_BAND_21_HZ
+};
+
+// Seizure windows are decided by the int8 classifier (imu_classifier.h)
+// instead of the gyro RMS threshold when wanted here or over
+// "/classifier?on=1", but only with a blob that loads, is trained and was
+// trained at this sketch's sample rate. Otherwise the RMS path stays.
+bool classifierWanted = true;
+bool classifierActive = false;
+const uint32_t CLASSIFIER_BUDGET_US = 2000;  // per inference, next to sampling
+ImuClassifier classifier;
+uint32_t classifierMaxUs = 0;
+
+// What other tasks (HTTP, alerts, logging) see: one consistent version of the
+// detector state, published by the detection task after every sample
+struct DetectorState {
+  int32_t fallFlag;
+  int32_t seizureFlag;
+  uint32_t seizureStart;
+  uint8_t wasSeizureDetected;
+  uint8_t mpuConnected;
+  uint32_t updatedAt;
+  I2CRecoveryStats mpuRecovery;
+};
+SeqLock<DetectorState> detectorState;
 
 void setup() {
   Serial.begin(115200);
-  Wire.begin(22, 21);  // SDA=22, SCL=21
-  Wire.setClock(100000);
+  Wire.begin(I2C_SDA, I2C_SCL);  // SDA=22, SCL=21
+  Wire.setClock(I2C_CLOCK_HZ);
   
-  initializeMPU();
+  // Not there yet: the detection task keeps retrying with backoff
+  mpuRecovery.begin({unstickMPUBus, resyncMPU, initializeMPU}, MPU_REINIT_MIN_MS, MPU_REINIT_MAX_MS);
+  if (!initializeMPU()) mpuRecovery.readFailed(millis());
+  mpuConnected = mpuRecovery.healthy();
+  setClassifier(classifierWanted);
+  publishState();
+  sampleWatch.begin(millis());
+  if (sampleWatch.total()) {
+    Serial.printf("%u stall reports kept from earlier boots, see /stalls\n", sampleWatch.total());
+  }
+  TaskHandle_t detectionHandle = NULL;
+  xTaskCreatePinnedToCore(detectionTask, "detection", DETECTION_TASK_STACK, NULL, DETECTION_TASK_PRIORITY,
+                          &detectionHandle, DETECTION_TASK_CORE);
+  sampleWatch.watchTask(detectionHandle, DETECTION_TASK_STACK);
+  xTaskCreatePinnedToCore(supervisorTask, "supervisor", 3072, NULL, SUPERVISOR_TASK_PRIORITY, NULL,
+                          DETECTION_TASK_CORE);
   connectToWiFi();
   
   // Server routes
-  server.on("/", handleRoot);
-  server.on("/data", handleData);
-  server.on("/resetFall", []() { fallFlag = 0; server.send(200, "text/plain", "OK"); });
-  server.on("/resetSeizure", []() { seizureFlag = 0; seizureStart = 0; wasSeizureDetected = false; server.send(200, "text/plain", "OK"); });
-  server.onNotFound(handleNotFound);
-  server.enableCORS(true);
+  publishData(detectorState.read());
+  server.on("/stalls", HTTP_GET, handleStalls);
+  server.on("/i2c", HTTP_GET, handleI2CRecovery);
+  addDetectorRoutes(server, dataSnapshot, commands);  // "/", "/data", resets, "/classifier", 404, CORS
   server.begin();
 }
 
 void loop() {
-  server.handleClient();  // Handle client requests
+  wifi.loop(millis());    // Keep WiFi connected
+  
+  // Alerts, /data and logging work from snapshots, so a slow Telegram call
+  // never holds up sampling
+  static uint32_t seenVersion = 0;
+  uint32_t version = detectorState.version();
+  if (version != seenVersion) {
+    DetectorState state;
+    seenVersion = detectorState.read(state);
+    onStateChanged(state);
+  }
+  delay(10);
+}
+
+void onStateChanged(const DetectorState& state) {
   static int prevFallFlag = 0;
   static int prevSeizureFlag = 0;
 
-// Trigger alerts on state changes
-  if (fallFlag == 1 && prevFallFlag == 0) {
+  // Trigger alerts on state changes
+  if (state.fallFlag == 1 && prevFallFlag == 0) {
     sendTelegramAlert("🚨 FALL DETECTED! Check patient immediately!");
   }
-  if (seizureFlag == 2 && prevSeizureFlag != 2) {
+  if (state.seizureFlag == 2 && prevSeizureFlag != 2) {
     sendTelegramAlert("⚠️ SEVERE SEIZURE (13s+ detected)! Emergency!");
   }
+  
+  // New /data body only when the flags changed
+  if (state.fallFlag != prevFallFlag || state.seizureFlag != prevSeizureFlag) {
+    publishData(state);
+  }
+
+  prevFallFlag = state.fallFlag;
+  prevSeizureFlag = state.seizureFlag;
+  Serial.printf("Fall: %d | Seizure: %d\n", state.fallFlag, state.seizureFlag);
+}
+
+void detectionTask(void* arg) {
+  for (;;) {
+    sampleWatch.beat(millis());
+    sampleWatch.stage("commands");
+    applyCommands();        // Resets requested over HTTP
+    
+    // A failed read starts recovery; the steps never sleep, so sampling
+    // keeps its period while the sensor is away
+    if (mpuRecovery.healthy()) {
+      sampleWatch.stage("mpu-read");
+      if (readSensorData()) {
+        if (mpuRecovery.readOk(millis())) {
+          Serial.printf("MPU6050 back, %u ms blind\n", mpuRecovery.stats(millis()).last_blind_ms);
+        }
+      } else {
+        mpuRecovery.readFailed(millis());
+      }
+    }
+    if (!mpuRecovery.healthy()) {
+      sampleWatch.stage("mpu-recover");
+      mpuRecovery.step(millis());
+    }
+    mpuConnected = mpuRecovery.healthy();
+    
+    sampleWatch.stage("publish");
+    publishState();
+    sampleWatch.stage("sleep");
+    delay(SAMPLE_DELAY_MS);
+  }
+}
 
-  prevFallFlag = fallFlag;
-  prevSeizureFlag = seizureFlag;
-  // Handle seizure flag state
-  if (seizureFlag == 1) {
-    // Check if seizure condition is still active
-    if (!wasSeizureDetected) {
-      // If seizure condition ended before 7 seconds, auto-reset
-      seizureFlag = 0;
-      seizureStart = 0;
-    } 
-    else if (millis() - seizureStart >= SEIZURE_ALERT_MS) {
-      // If seizure continues for 7+ seconds, upgrade to type 2
-      seizureFlag = 2;
+void supervisorTask(void* arg) {
+  for (;;) {
+    StallAction action = sampleWatch.check(millis());
+    if (action == STALL_DETECTED) {
+      Serial.println("Sampling stalled, see /stalls");
+    } else if (action == STALL_RESTART) {
+      Serial.printf("Sampling stalled for %lu ms, restarting\n", STALL_RESTART_MS);
+      delay(100);
+      esp_restart();
     }
+    delay(STALL_CHECK_MS);
   }
-  // Only read sensor if MPU is connected
-  if (mpuConnected) {
-    if (!readSensorData()) {
-      // If reading fails, attempt to reinitialize MPU
-      delay(1000);
-      initializeMPU();
+}
+
+void publishState() {
+  DetectorState state;
+  state.fallFlag = fallDetector.flag();
+  state.seizureFlag = seizureDetector.flag();
+  state.seizureStart = seizureDetector.startedAt();
+  state.wasSeizureDetected = seizureDetector.detected();
+  state.mpuConnected = mpuConnected;
+  state.updatedAt = millis();
+  state.mpuRecovery = mpuRecovery.stats(state.updatedAt);
+  detectorState.write(state);
+}
+
+void applyCommands() {
+  uint32_t pending = commands.take();
+  if (pending & CMD_RESET_FALL) {
+    fallDetector.reset();
+  }
+  if (pending & CMD_RESET_SEIZURE) {
+    seizureDetector.reset();
+  }
+  if (pending & (CMD_CLASSIFIER_ON | CMD_CLASSIFIER_OFF)) {
+    setClassifier(pending & CMD_CLASSIFIER_ON);
+  }
+}
+
+// begin() empties the classifier's window. The seizure flag carries over, so
+// switching never clears an alarm; the other path's next verdict decides.
+void setClassifier(bool on) {
+  classifierActive = false;
+  if (on) {
+    if (!classifier.begin(IMU_MODEL_BLOB, IMU_MODEL_BLOB_LEN)) {
+      Serial.println("Classifier blob rejected, using the RMS threshold");
+    } else if (!classifier.trained()) {
+      Serial.println("Classifier blob is untrained, using the RMS threshold");
+    } else if (classifier.sampleHz() != 1000 / SAMPLE_DELAY_MS) {
+      Serial.printf("Classifier trained at %u Hz, sampling at %lu Hz: using the RMS threshold\n",
+                    classifier.sampleHz(), 1000 / SAMPLE_DELAY_MS);
+    } else {
+      classifierActive = true;
     }
   }
-  delay(SAMPLE_DELAY_MS);
+  Serial.println(classifierActive ? "Seizure windows: int8 classifier" : "Seizure windows: gyro RMS threshold");
 }
 
 bool readSensorData() {
@@ -98,174 +263,71 @@ bool readSensorData() {
   if (!mpu.getAccelerometerSensor()->getEvent(&accel) || !mpu.getGyroSensor()->getEvent(&gyro)) 
     return false;
 
-  // Fall detection (unchanged)
+  // Fall detection
   float ax = accel.acceleration.x / 9.80665;
   float ay = accel.acceleration.y / 9.80665;
   float az = accel.acceleration.z / 9.80665;
-  float amag = sqrt(ax*ax + ay*ay + az*az);
-
-  if (amag < FREEFALL_G) {
-    if (!inFreefall) {
-      inFreefall = true;
-      freefallStart = millis();
-    } 
-    else if ((millis() - freefallStart >= DEBOUNCE_MS) && 
-             (abs(gyro.gyro.x*57.2958) > GYRO_FALL_DEG_S || 
-              abs(gyro.gyro.y*57.2958) > GYRO_FALL_DEG_S || 
-              abs(gyro.gyro.z*57.2958) > GYRO_FALL_DEG_S)) {
-      fallFlag = 1;
-    }
-  } else {
-    inFreefall = false;
-  }
+  float amag = sqrtf(ax*ax + ay*ay + az*az);
+  float wx = gyro.gyro.x * 57.2958f;  // rad/s → deg/s, in single precision
+  float wy = gyro.gyro.y * 57.2958f;
+  float wz = gyro.gyro.z * 57.2958f;
+  uint32_t now = millis();
+  fallDetector.update(now, amag, wx, wy, wz);
 
   // Seizure detection
-  float wmag = sqrt(pow(gyro.gyro.x*57.2958, 2) + pow(gyro.gyro.y*57.2958, 2) + pow(gyro.gyro.z*57.2958, 2));
-  gyroBuffer[bufIndex++] = wmag;
-  
-  if (bufIndex >= 100) {
-    bufIndex = 0;
-    float sumSq = 0;
-    for (int i=0; i<100; i++) sumSq += gyroBuffer[i] * gyroBuffer[i];
-    float rms = sqrt(sumSq/100);
-    
-    wasSeizureDetected = (rms > SEIZURE_RMS_THR);
-    
-    if (wasSeizureDetected) {
-      if (seizureFlag == 0) {
-        // New seizure detected
-        seizureFlag = 1;
-        seizureStart = millis();
-      }
-    } else if (seizureFlag == 1) {
-      // Seizure condition ended before reaching 7 seconds
-      // Let the loop() handle the auto-reset
-    }
+  if (classifierActive) {
+    classifySample(now, ax, ay, az, wx, wy, wz);
+    return true;
   }
+  float wmag = sqrtf(wx*wx + wy*wy + wz*wz);
+  seizureDetector.update(now, wmag);
 
-  Serial.printf("Fall: %d | Seizure: %d\n", fallFlag, seizureFlag);
   return true;
 }
 
-void handleRoot() {
-  server.send(200, "text/html", 
-  R"=====(
-  <!DOCTYPE html>
-  <html>
-  <head>
-    <title>ESP32 Fall/Seizure Detector</title>
-    <meta name="viewport" content="width=device-width, initial-scale=1">
-    <style>
-      body { font-family: Arial, sans-serif; text-align: center; margin: 20px; }
-      .flag { font-size: 2em; font-weight: bold; margin: 10px; }
-      .status { padding: 15px; border-radius: 10px; margin: 20px; }
-      .normal { background-color: #d4edda; color: #155724; }
-      .warning { background-color: #fff3cd; color: #856404; }
-      .alert { background-color: #f8d7da; color: #721c24; }
-      button { 
-        background-color: #dc3545; color: white; border: none; 
-        padding: 10px 20px; border-radius: 5px; cursor: pointer;
-        margin-top: 10px; font-size: 1em;
-      }
-    </style>
-  </head>
-  <body>
-    <h1>ESP32 Health Monitor</h1>
-    
-    <div id="fallStatus" class="status normal">
-      <h2>Fall Detection</h2>
-      <p class="flag" id="fallFlag">0</p>
-      <button id="resetFallButton" style="display:none;">Reset Fall Alert</button>
-    </div>
-    
-    <div id="seizureStatus" class="status normal">
-      <h2>Seizure Detection</h2>
-      <p class="flag" id="seizureFlag">0</p>
-      <button id="resetSeizureButton" style="display:none;">Reset Severe Seizure</button>
-    </div>
-    
-    <script>
-      function getStatusClass(flagValue) {
-        if (flagValue == 2) return 'alert';
-        if (flagValue == 1) return 'warning';
-        return 'normal';
-      }
-      
-      function updateData() {
-        fetch('/data')
-          .then(r => r.json())
-          .then(data => {
-            document.getElementById('fallFlag').textContent = data.fallFlag;
-            document.getElementById('seizureFlag').textContent = data.seizureFlag;
-            
-            // Update UI
-            document.getElementById('fallStatus').className = 
-              `status ${data.fallFlag ? 'alert' : 'normal'}`;
-            document.getElementById('seizureStatus').className = 
-              `status ${getStatusClass(data.seizureFlag)}`;
-              
-            // Show/hide buttons
-            document.getElementById('resetFallButton').style.display = 
-              data.fallFlag ? 'inline-block' : 'none';
-            document.getElementById('resetSeizureButton').style.display = 
-              data.seizureFlag == 2 ? 'inline-block' : 'none';
-          });
-      }
-      
-      // Button handlers
-      document.getElementById('resetFallButton').addEventListener('click', () => {
-        fetch('/resetFall').then(updateData);
-      });
-      document.getElementById('resetSeizureButton').addEventListener('click', () => {
-        fetch('/resetSeizure').then(updateData);
-      });
-      
-      // Update every second
-      setInterval(updateData, 1000);
-      updateData();
-    </script>
-  </body>
-  </html>
-  )=====");
+// The classifier decides every IMU_CLS_HOP samples; the detector keeps
+// handling flag escalation in between
+void classifySample(uint32_t now, float ax, float ay, float az, float wx, float wy, float wz) {
+  float sample[IMU_CLS_CHANNELS] = {ax, ay, az, wx, wy, wz};
+  uint32_t start = micros();
+  if (classifier.push(sample)) {
+    uint32_t took = micros() - start;
+    if (took > classifierMaxUs) {
+      classifierMaxUs = took;
+      if (took > CLASSIFIER_BUDGET_US) Serial.printf("Classifier took %u us (budget %u us)\n", took, CLASSIFIER_BUDGET_US);
+    }
+    seizureDetector.verdict(now, classifier.label() == IMU_CLASS_SEIZURE);
+  }
+  seizureDetector.tick(now);
 }
 
+// One attempt; retries are paced by mpuRecovery
 bool initializeMPU() {
   Serial.println("Initializing MPU6050...");
-  mpuConnected = false;
-  
-  for (int i = 0; i < 5; i++) {  // Retry up to 5 times
-    if (mpu.begin()) {
-      mpu.setAccelerometerRange(MPU6050_RANGE_2_G);
-      mpu.setGyroRange(MPU6050_RANGE_250_DEG);
-      mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
-      mpuConnected = true;
-      Serial.println("MPU6050 initialized successfully");
-      return true;
-    }
-    delay(500);
-    Serial.print(".");
+  if (!mpu.begin()) {
+    Serial.println("Failed to initialize MPU6050");
+    return false;
   }
-  Serial.println("\nFailed to initialize MPU6050");
-  return false;
+  mpu.setAccelerometerRange(MPU6050_RANGE_2_G);
+  mpu.setGyroRange(MPU6050_RANGE_250_DEG);
+  mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
+  Serial.println("MPU6050 initialized successfully");
+  return true;
+}
+
+bool unstickMPUBus() {
+  return i2cUnstickBus(Wire, I2C_SDA, I2C_SCL, I2C_CLOCK_HZ, MPU6050_I2CADDR_DEFAULT);
+}
+
+bool resyncMPU() {
+  return i2cResync(Wire, MPU6050_I2CADDR_DEFAULT, MPU6050_WHO_AM_I, MPU6050_DEVICE_ID, MPU_RESYNC_REGS,
+                   sizeof(MPU_RESYNC_REGS) / sizeof(MPU_RESYNC_REGS[0]));
 }
 
 void connectToWiFi() {
-  Serial.print("Connecting to WiFi");
-  WiFi.begin(ssid, password);
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
-  }
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("\nFailed to connect to WiFi");
-    // Continue anyway - AP might connect later
-  }
+  // Connects (and reconnects) in the background, see wifi.loop()
+  Serial.println("Connecting to WiFi in the background");
+  wifi.begin(ssid, password);
 }
 
 void sendTelegramAlert(String message) {
@@ -290,24 +352,18 @@ void sendTelegramAlert(String message) {
     http.end();
   }
 
-void handleData() {
-  String json = String("{\"fallFlag\":") + fallFlag + ",\"seizureFlag\":" + seizureFlag + "}";
-  server.send(200, "application/json", json);
+void publishData(const DetectorState& state) {
+  dataSnapshot.publish(detectorDataJson(state.fallFlag, state.seizureFlag));
 }
 
-void handleNotFound() {
-  String message = "File Not Found\n\n";
-  message += "URI: "; 
-  message += server.uri();
-  message += "\nMethod: ";
-  message += (server.method() == HTTP_GET) ? "GET" : "POST";
-  message += "\nArguments: ";
-  message += server.args();
-  message += "\n";
-  
-  for (uint8_t i = 0; i < server.args(); i++) {
-    message += " " + server.argName(i) + ": " + server.arg(i) + "\n";
-  }
-  
-  server.send(404, "text/plain", message);
+void handleI2CRecovery(AsyncWebServerRequest* request) {
+  char json[320];
+  i2cRecoveryJson(detectorState.read().mpuRecovery, json, sizeof(json));
+  request->send(200, "application/json", json);
+}
+
+void handleStalls(AsyncWebServerRequest* request) {
+  char json[2048];
+  sampleWatch.toJson(json, sizeof(json));
+  request->send(200, "application/json", json);
 }
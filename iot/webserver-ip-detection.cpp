@@ -2,7 +2,11 @@
 #include <Adafruit_MPU6050.h>
 #include <Adafruit_Sensor.h>
 #include <WiFi.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include "../wifi_manager.h"
+#include "../http_snapshot.h"
+#include "../i2c_recovery.h"
 
 // WiFi credentials - REPLACE WITH YOUR NETWORK INFO
 const char* ssid = "OnePlus Nord CE3 5G";
@@ -11,8 +15,13 @@ const char* password = "0072512B";
 // Create MPU6050 instance
 Adafruit_MPU6050 mpu;
 
-// Create WebServer instance on port 80
-WebServer server(80);
+// Create WebServer instance on port 80; requests are served on the async TCP task
+AsyncWebServer server(80);
+WiFiManager wifi;
+
+// /data is serialised once per change and shared by all clients
+SnapshotPublisher dataSnapshot;
+SnapshotPublisher i2cSnapshot;  // /i2c, on every recovery step and good read after one
 
 // Thresholds (g, °/s, ms)
 const float FREEFALL_G = 0.5;
@@ -36,29 +45,55 @@ int fallFlag = 0;
 int seizureFlag = 0;
 bool mpuConnected = false;
 
+// I2C faults: bus unstick, register re-sync, then reinit with backoff, at
+// most one step per pass of loop() (i2c_recovery.h)
+const int I2C_SDA = 22;
+const int I2C_SCL = 21;
+const uint32_t I2C_CLOCK_HZ = 100000;
+const uint32_t MPU_REINIT_MIN_MS = 500;
+const uint32_t MPU_REINIT_MAX_MS = 10000;
+I2CRecovery mpuRecovery;
+
+// What initializeMPU() configures, rewritten by the re-sync
+const uint8_t MPU_RESYNC_REGS[][2] = {
+  {MPU6050_PWR_MGMT_1, 0x01},    // awake, clock from the X gyro PLL
+  {MPU6050_ACCEL_CONFIG, 0x00},  // MPU6050_RANGE_2_G
+  {MPU6050_GYRO_CONFIG, 0x00},   // MPU6050_RANGE_250_DEG
+  {MPU6050_CONFIG, 0x04},        // MPU6050_BAND_21_HZ
+};
+
 void setup() {
-  Serial.begin(115200);
-  while (!Serial) delay(10);
+  Serial.begin(115200);  // No wait for a monitor: an unattended boot must not stall here
 
   Serial.println("\nESP32 MPU6050 Sensor with Web Server");
 
   // Initialize I2C with custom pins and slower clock speed
-  Wire.begin(22, 21);  // SDA=22, SCL=21
-  Wire.setClock(100000);  // Reduced to 100kHz for reliability
+  Wire.begin(I2C_SDA, I2C_SCL);  // SDA=22, SCL=21
+  Wire.setClock(I2C_CLOCK_HZ);  // Reduced to 100kHz for reliability
 
-  // Initialize MPU6050 with retry logic
-  initializeMPU();
+  // Not there yet: loop() keeps retrying with backoff
+  mpuRecovery.begin({unstickMPUBus, resyncMPU, initializeMPU}, MPU_REINIT_MIN_MS, MPU_REINIT_MAX_MS);
+  if (!initializeMPU()) mpuRecovery.readFailed(millis());
+  mpuConnected = mpuRecovery.healthy();
 
   // Connect to WiFi
   connectToWiFi();
 
   // Set up server routes
-  server.on("/", handleRoot);
-  server.on("/data", handleData);
+  publishData();
+  publishI2CRecovery();
+  server.on("/", HTTP_GET, handleRoot);
+  server.on("/data", HTTP_GET, handleData);
+  server.on("/i2c", HTTP_GET, [](AsyncWebServerRequest* request) {
+    i2cSnapshot.serve(request, "application/json");
+  });
   server.onNotFound(handleNotFound);
 
-  // Enable CORS for all routes
-  server.enableCORS(true);
+  // Enable CORS for all routes, as WebServer::enableCORS(true) did; preflight
+  // OPTIONS requests are answered in handleNotFound()
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "*");
+  DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "*");
 
   // Start server
   server.begin();
@@ -66,60 +101,68 @@ void setup() {
 }
 
 void loop() {
-  server.handleClient();  // Handle client requests
-
-  // Only read sensor if MPU is connected
-  if (mpuConnected) {
-    if (!readSensorData()) {
-      // If reading fails, attempt to reinitialize MPU
-      delay(1000);
-      initializeMPU();
+  wifi.loop(millis());    // Keep WiFi connected
+
+  // A failed read starts recovery; the steps never sleep, so loop() and
+  // its sample period carry on while the sensor is away
+  if (mpuRecovery.healthy()) {
+    if (readSensorData()) {
+      if (mpuRecovery.readOk(millis())) publishI2CRecovery();
+    } else {
+      mpuRecovery.readFailed(millis());
     }
   }
+  if (!mpuRecovery.healthy()) {
+    mpuRecovery.step(millis());
+    publishI2CRecovery();
+  }
+  mpuConnected = mpuRecovery.healthy();
+
+  // New /data body only when the flags changed
+  static int publishedFallFlag = 0;
+  static int publishedSeizureFlag = 0;
+  if (fallFlag != publishedFallFlag || seizureFlag != publishedSeizureFlag) {
+    publishData();
+    publishedFallFlag = fallFlag;
+    publishedSeizureFlag = seizureFlag;
+  }
 
   delay(INT_MS);
 }
 
+// One attempt; retries are paced by mpuRecovery
 bool initializeMPU() {
   Serial.println("Initializing MPU6050...");
-  mpuConnected = false;
-  
-  for (int i = 0; i < 5; i++) {  // Retry up to 5 times
-    if (mpu.begin()) {
-      mpu.setAccelerometerRange(MPU6050_RANGE_2_G);
-      mpu.setGyroRange(MPU6050_RANGE_250_DEG);
-      mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
-      mpuConnected = true;
-      Serial.println("MPU6050 initialized successfully");
-      return true;
-    }
-    delay(500);
-    Serial.print(".");
+  if (!mpu.begin()) {
+    Serial.println("Failed to initialize MPU6050");
+    return false;
   }
+  mpu.setAccelerometerRange(MPU6050_RANGE_2_G);
+  mpu.setGyroRange(MPU6050_RANGE_250_DEG);
+  mpu.setFilterBandwidth(MPU6050_BAND_21_HZ);
+  Serial.println("MPU6050 initialized successfully");
+  return true;
+}
 
-  Serial.println("\nFailed to initialize MPU6050");
-  return false;
+bool unstickMPUBus() {
+  return i2cUnstickBus(Wire, I2C_SDA, I2C_SCL, I2C_CLOCK_HZ, MPU6050_I2CADDR_DEFAULT);
 }
 
-void connectToWiFi() {
-  Serial.print("Connecting to WiFi");
-  WiFi.begin(ssid, password);
-
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
-  }
+bool resyncMPU() {
+  return i2cResync(Wire, MPU6050_I2CADDR_DEFAULT, MPU6050_WHO_AM_I, MPU6050_DEVICE_ID, MPU_RESYNC_REGS,
+                   sizeof(MPU_RESYNC_REGS) / sizeof(MPU_RESYNC_REGS[0]));
+}
 
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-  } else {
-    Serial.println("\nFailed to connect to WiFi");
-    // Continue anyway - AP might connect later
-  }
+void publishI2CRecovery() {
+  char json[320];
+  i2cRecoveryJson(mpuRecovery.stats(millis()), json, sizeof(json));
+  i2cSnapshot.publish(json);
+}
+
+void connectToWiFi() {
+  // Connects (and reconnects) in the background, see wifi.loop()
+  Serial.println("Connecting to WiFi in the background");
+  wifi.begin(ssid, password);
 }
 
 bool readSensorData() {
@@ -197,8 +240,7 @@ bool readSensorData() {
   return true;
 }
 
-void handleRoot() {
-  String html = R"=====(
+const char INDEX_HTML[] PROGMEM = R"=====(
 <!DOCTYPE html>
 <html>
 <head>
@@ -254,33 +296,44 @@ void handleRoot() {
 </html>
 )=====";
 
-  server.send(200, "text/html", html);
+void handleRoot(AsyncWebServerRequest* request) {
+  request->send_P(200, "text/html", INDEX_HTML);
 }
 
-void handleData() {
+void publishData() {
   // Create JSON response
   String json = "{";
   json += "\"fallFlag\":" + String(fallFlag) + ",";
   json += "\"seizureFlag\":" + String(seizureFlag);
   json += "}";
   
-  // Send with CORS headers
-  server.send(200, "application/json", json);
+  dataSnapshot.publish(json);
+}
+
+void handleData(AsyncWebServerRequest* request) {
+  // Shared body with ETag; 304 when the client is up to date
+  dataSnapshot.serve(request, "application/json");
 }
 
-void handleNotFound() {
+void handleNotFound(AsyncWebServerRequest* request) {
+  // CORS preflight: the default headers carry the answer
+  if (request->method() == HTTP_OPTIONS) {
+    request->send(200);
+    return;
+  }
+
   String message = "File Not Found\n\n";
   message += "URI: ";
-  message += server.uri();
+  message += request->url();
   message += "\nMethod: ";
-  message += (server.method() == HTTP_GET) ? "GET" : "POST";
+  message += request->methodToString();
   message += "\nArguments: ";
-  message += server.args();
+  message += request->args();
   message += "\n";
   
-  for (uint8_t i = 0; i < server.args(); i++) {
-    message += " " + server.argName(i) + ": " + server.arg(i) + "\n";
+  for (size_t i = 0; i < request->args(); i++) {
+    message += " " + request->argName(i) + ": " + request->arg(i) + "\n";
   }
   
-  server.send(404, "text/plain", message);
+  request->send(404, "text/plain", message);
 }
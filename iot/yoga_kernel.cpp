@@ -0,0 +1,151 @@
+// Native kernel for app43.py: every joint angle of a frame and its check
+// against the pose thresholds in one pass over the landmark array.
+//
+// Written against the CPython and NumPy C APIs, so it needs nothing beyond
+// the numpy app43.py already uses. Build (next to app43.py):
+//   c++ -O3 -shared -std=c++17 -fPIC $(python3-config --includes)
+//       -I$(python3 -c "import numpy; print(numpy.get_include())")
+//       yoga_kernel.cpp -o yoga_kernel$(python3-config --extension-suffix)
+//
+// app43.py falls back to its Python code when the module is not built.
+
+#define PY_SSIZE_T_CLEAN
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <Python.h>
+#include <numpy/arrayobject.h>
+#include <cmath>
+
+// Per-angle result codes, shared with app43.py
+enum AngleStatus : int8_t {
+  ANGLE_OK = 0,
+  ANGLE_TOO_SMALL = 1,  // below median - iqr: "extend"
+  ANGLE_TOO_LARGE = 2,  // above median + iqr: "contract"
+  ANGLE_HIDDEN = 3,     // a landmark below the visibility cutoff
+  ANGLE_NO_REFERENCE = 4
+};
+
+static const double VISIBILITY_MIN = 0.5;
+
+// Angle at b between a and c in degrees (0..180), rounded to 2 decimals like
+// calculate_angle() in app43.py
+static inline double jointAngle(const double* a, const double* b, const double* c) {
+  double radians = std::atan2(c[1] - b[1], c[0] - b[0]) - std::atan2(a[1] - b[1], a[0] - b[0]);
+  double angle = std::fabs(radians * 180.0 / M_PI);
+  if (angle > 180.0) angle = 360.0 - angle;
+  return std::nearbyint(angle * 100.0) / 100.0;
+}
+
+// C-contiguous array of `type` (converted if needed), or NULL with an error set
+static PyArrayObject* asArray(PyObject* obj, int type) {
+  return (PyArrayObject*)PyArray_FROMANY(obj, type, 0, 0, NPY_ARRAY_IN_ARRAY);
+}
+
+// landmarks: (n, 3) float64 rows of x, y, visibility
+// joints:    (k, 3) int32 landmark indices, angle measured at the middle one
+// lower, upper: (k,) float64 bounds, NaN where the pose has no reference
+// Returns (angles, statuses); hidden angles are NaN.
+static PyObject* evaluate(PyObject*, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"landmarks", "joints", "lower", "upper", NULL};
+  PyObject *landmarks_obj, *joints_obj, *lower_obj, *upper_obj;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOO:evaluate", (char**)keywords, &landmarks_obj, &joints_obj,
+                                   &lower_obj, &upper_obj)) {
+    return NULL;
+  }
+
+  PyArrayObject* landmarks = asArray(landmarks_obj, NPY_FLOAT64);
+  PyArrayObject* joints = asArray(joints_obj, NPY_INT32);
+  PyArrayObject* lower = asArray(lower_obj, NPY_FLOAT64);
+  PyArrayObject* upper = asArray(upper_obj, NPY_FLOAT64);
+  PyArrayObject* angles = NULL;
+  PyArrayObject* statuses = NULL;
+  PyObject* result = NULL;
+  npy_intp n = 0, k = 0;
+
+  if (!landmarks || !joints || !lower || !upper) goto done;
+  if (PyArray_NDIM(landmarks) != 2 || PyArray_DIM(landmarks, 1) != 3) {
+    PyErr_SetString(PyExc_ValueError, "landmarks must be (n, 3)");
+    goto done;
+  }
+  if (PyArray_NDIM(joints) != 2 || PyArray_DIM(joints, 1) != 3) {
+    PyErr_SetString(PyExc_ValueError, "joints must be (k, 3)");
+    goto done;
+  }
+  n = PyArray_DIM(landmarks, 0);
+  k = PyArray_DIM(joints, 0);
+  if (PyArray_SIZE(lower) != k || PyArray_SIZE(upper) != k) {
+    PyErr_SetString(PyExc_ValueError, "bounds must have one entry per joint");
+    goto done;
+  }
+  {
+    const int32_t* idx = (const int32_t*)PyArray_DATA(joints);
+    for (npy_intp i = 0; i < 3 * k; i++) {
+      if (idx[i] < 0 || idx[i] >= n) {
+        PyErr_SetString(PyExc_IndexError, "joint index outside the landmark array");
+        goto done;
+      }
+    }
+
+    angles = (PyArrayObject*)PyArray_SimpleNew(1, &k, NPY_FLOAT64);
+    statuses = (PyArrayObject*)PyArray_SimpleNew(1, &k, NPY_INT8);
+    if (!angles || !statuses) goto done;
+    const double* lm = (const double*)PyArray_DATA(landmarks);
+    const double* lo = (const double*)PyArray_DATA(lower);
+    const double* hi = (const double*)PyArray_DATA(upper);
+    double* out_angle = (double*)PyArray_DATA(angles);
+    int8_t* out_status = (int8_t*)PyArray_DATA(statuses);
+
+    // Pure arithmetic on buffers we hold references to: let the capture thread
+    // and the Flask handlers run meanwhile
+    Py_BEGIN_ALLOW_THREADS
+    for (npy_intp j = 0; j < k; j++) {
+      const double* a = lm + 3 * idx[3 * j];
+      const double* b = lm + 3 * idx[3 * j + 1];
+      const double* c = lm + 3 * idx[3 * j + 2];
+      if (a[2] < VISIBILITY_MIN || b[2] < VISIBILITY_MIN || c[2] < VISIBILITY_MIN) {
+        out_angle[j] = NAN;
+        out_status[j] = ANGLE_HIDDEN;
+        continue;
+      }
+      double angle = jointAngle(a, b, c);
+      out_angle[j] = angle;
+      if (std::isnan(lo[j]) || std::isnan(hi[j])) out_status[j] = ANGLE_NO_REFERENCE;
+      else if (angle < lo[j]) out_status[j] = ANGLE_TOO_SMALL;
+      else if (angle > hi[j]) out_status[j] = ANGLE_TOO_LARGE;
+      else out_status[j] = ANGLE_OK;
+    }
+    Py_END_ALLOW_THREADS
+  }
+  result = PyTuple_Pack(2, (PyObject*)angles, (PyObject*)statuses);
+
+done:
+  Py_XDECREF(landmarks);
+  Py_XDECREF(joints);
+  Py_XDECREF(lower);
+  Py_XDECREF(upper);
+  Py_XDECREF(angles);
+  Py_XDECREF(statuses);
+  return result;
+}
+
+static PyMethodDef methods[] = {
+  {"evaluate", (PyCFunction)(void (*)(void))evaluate, METH_VARARGS | METH_KEYWORDS,
+   "evaluate(landmarks, joints, lower, upper) -> (angles, statuses)"},
+  {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef module = {
+  PyModuleDef_HEAD_INIT, "yoga_kernel", "Joint angles and threshold checks for the yoga pose guide", -1, methods,
+  NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_yoga_kernel(void) {
+  import_array();
+  PyObject* m = PyModule_Create(&module);
+  if (!m) return NULL;
+  PyModule_AddIntConstant(m, "OK", ANGLE_OK);
+  PyModule_AddIntConstant(m, "TOO_SMALL", ANGLE_TOO_SMALL);
+  PyModule_AddIntConstant(m, "TOO_LARGE", ANGLE_TOO_LARGE);
+  PyModule_AddIntConstant(m, "HIDDEN", ANGLE_HIDDEN);
+  PyModule_AddIntConstant(m, "NO_REFERENCE", ANGLE_NO_REFERENCE);
+  return m;
+}
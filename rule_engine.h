@@ -0,0 +1,333 @@
+#pragma once
+// Clinical rule engine.
+//
+// Rules are plain text, one per line:
+//
+//   <SEVERITY> <cooldown_ms> <for_ms> <label>: <metric> <op> <value> [& ...]
+//
+//   CRITICAL 60000 0 Extreme Tachycardia: hr > 140
+//   SEIZURE 180000 0 Prolonged Motion: motion_ms > 10000
+//   SEPSIS 300000 60000 Hypoxemia: spo2 < 95 & spo2 > 0
+//   SEPSIS 1800000 0 HR Drift: hr_dev > 15 & hr_cusum > 150
+//   SEIZURE 180000 0 Desaturation After Shaking: spo2_min20 < 90 & spo2_min20 > 0 & gyro_rms_peak > 60
+//
+// A rule is active once all of its conditions have held for for_ms, and it
+// alerts at most once per cooldown_ms. Lines starting with '#' are comments.
+//
+// Text is compiled into a flat decision table: every condition becomes one bit
+// of a 64-bit word and every rule a mask over that word, so evaluating a sample
+// is a fixed pass over at most RULE_MAX_CONDITIONS comparisons and
+// RULE_MAX_RULES mask tests, without branching on the rule contents.
+//
+// A new rule set is compiled on the side and swapped in by the evaluating task
+// before its next sample, so rules can be replaced while sampling continues.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <atomic>
+#include "alert_scheduler.h"
+
+#define RULE_MAX_RULES      32
+#define RULE_MAX_CONDITIONS 64
+#define RULE_LABEL_LEN      32
+#define RULE_ERROR_LEN      64
+
+// Inputs a rule can test. Keep the name table in step.
+enum RuleMetric {
+  METRIC_HR = 0,     // BPM
+  METRIC_SPO2,       // %
+  METRIC_ACCEL,      // g
+  METRIC_GYRO,       // deg/s
+  METRIC_MOTION_MS,  // duration of the current motion episode, 0 when still
+  // Trends from vitals_stats.h; all 0 until there is data for them
+  METRIC_HR_AVG,     // 5 min EWMA
+  METRIC_HR_P50,     // 30 min median
+  METRIC_HR_BASE,    // patient baseline over hours
+  METRIC_HR_DEV,     // hr_p50 - hr_base
+  METRIC_HR_CUSUM,   // BPM-minutes above baseline + allowance
+  METRIC_SPO2_AVG,
+  METRIC_SPO2_P50,
+  METRIC_SPO2_BASE,
+  METRIC_SPO2_DEV,
+  METRIC_SPO2_CUSUM, // %-minutes below baseline - allowance
+  // Beat-to-beat, from hrv.h; 0 until there are enough clean beats
+  METRIC_HR_BEAT,    // BPM from the median of the last 5 RR intervals
+  METRIC_HRV_RMSSD,  // ms, 5 min window
+  METRIC_HRV_SDNN,   // ms, 5 min window
+  // Sliding windows from window_ops.h over the raw streams; 0 while empty
+  METRIC_HR_MIN_20S,     // lowest HR of the last 20 s
+  METRIC_HR_MAX_20S,
+  METRIC_SPO2_MIN_20S,
+  METRIC_ACCEL_MAX_10S,  // g, highest block peak of the last 10 s
+  METRIC_GYRO_RMS_10S,   // deg/s, RMS over all samples of the last 10 s
+  METRIC_GYRO_RMS_PEAK,  // highest gyro_rms10 seen in the last 10 s
+  METRIC_MOTION_AGO_MS,  // since motion was last detected, 0 during it, 4.3e9 if never
+  METRIC_COUNT
+};
+
+inline const char* ruleMetricName(int m) {
+  static const char* names[METRIC_COUNT] = {"hr", "spo2", "accel", "gyro", "motion_ms",
+                                            "hr_avg", "hr_p50", "hr_base", "hr_dev", "hr_cusum",
+                                            "spo2_avg", "spo2_p50", "spo2_base", "spo2_dev", "spo2_cusum",
+                                            "hr_beat", "hrv_rmssd", "hrv_sdnn",
+                                            "hr_min20", "hr_max20", "spo2_min20", "accel_max10",
+                                            "gyro_rms10", "gyro_rms_peak", "motion_ago_ms"};
+  return (m >= 0 && m < METRIC_COUNT) ? names[m] : "?";
+}
+
+// Comparison results as bits: 1 = greater, 2 = less, 4 = equal.
+// An operator is the set of outcomes it accepts.
+enum RuleOp {
+  RULE_GT = 1,
+  RULE_LT = 2,
+  RULE_GE = 1 | 4,
+  RULE_LE = 2 | 4
+};
+
+struct RuleCondition {
+  uint8_t metric;
+  uint8_t accept;  // RuleOp
+  float threshold;
+};
+
+struct Rule {
+  uint64_t mask;   // conditions that must all hold
+  uint8_t severity; // AlertPriority
+  uint32_t cooldown_ms;
+  uint32_t for_ms;
+  char label[RULE_LABEL_LEN];
+};
+
+struct RuleSet {
+  RuleCondition conditions[RULE_MAX_CONDITIONS];
+  Rule rules[RULE_MAX_RULES];
+  uint8_t condition_count;
+  uint8_t rule_count;
+  uint32_t version;
+};
+
+struct RuleState {
+  uint32_t since_ms;      // when the conditions started holding
+  uint32_t last_alert_ms;
+  bool holding;
+  bool alerted;           // has alerted at least once
+};
+
+struct RuleResult {
+  int top_severity;       // most severe active rule, -1 if none
+  uint32_t active;        // rules whose conditions have held for for_ms
+  uint32_t alerts;        // active rules of top_severity past their cooldown
+};
+
+// Compile rule text into `out`. On failure returns false and describes the
+// first problem in `error`.
+inline bool compileRules(const char* text, RuleSet& out, char* error, size_t error_len) {
+  memset(&out, 0, sizeof(out));
+  int line_no = 0;
+  const char* p = text;
+
+  while (*p) {
+    const char* eol = strchr(p, '\n');
+    size_t len = eol ? (size_t)(eol - p) : strlen(p);
+    char line[160];
+    line_no++;
+    if (len >= sizeof(line)) {
+      snprintf(error, error_len, "line %d: too long", line_no);
+      return false;
+    }
+    memcpy(line, p, len);
+    line[len] = '\0';
+    p += len + (eol ? 1 : 0);
+
+    char* s = line;
+    while (isspace((unsigned char)*s)) s++;
+    if (*s == '\0' || *s == '#') continue;
+
+    if (out.rule_count >= RULE_MAX_RULES) {
+      snprintf(error, error_len, "line %d: more than %d rules", line_no, RULE_MAX_RULES);
+      return false;
+    }
+    Rule& r = out.rules[out.rule_count];
+
+    // Severity, cooldown and hold time
+    char severity[12];
+    unsigned long cooldown, hold;
+    int used = 0;
+    if (sscanf(s, "%11s %lu %lu %n", severity, &cooldown, &hold, &used) != 3) {
+      snprintf(error, error_len, "line %d: expected SEVERITY COOLDOWN_MS FOR_MS", line_no);
+      return false;
+    }
+    int sev = -1;
+    for (int i = 0; i < ALERT_PRIORITY_COUNT; i++) {
+      if (strcmp(severity, alertPriorityName(i)) == 0) sev = i;
+    }
+    if (sev < 0) {
+      snprintf(error, error_len, "line %d: unknown severity '%s'", line_no, severity);
+      return false;
+    }
+    r.severity = sev;
+    r.cooldown_ms = cooldown;
+    r.for_ms = hold;
+    s += used;
+
+    // Label up to ':'
+    char* colon = strchr(s, ':');
+    if (colon == NULL || colon == s) {
+      snprintf(error, error_len, "line %d: expected '<label>:'", line_no);
+      return false;
+    }
+    char* end = colon;
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    size_t label_len = end - s < RULE_LABEL_LEN - 1 ? end - s : RULE_LABEL_LEN - 1;
+    memcpy(r.label, s, label_len);
+    r.label[label_len] = '\0';
+
+    // Conditions joined by '&'
+    char* save = NULL;
+    for (char* cond = strtok_r(colon + 1, "&", &save); cond; cond = strtok_r(NULL, "&", &save)) {
+      if (out.condition_count >= RULE_MAX_CONDITIONS) {
+        snprintf(error, error_len, "line %d: more than %d conditions", line_no, RULE_MAX_CONDITIONS);
+        return false;
+      }
+      char metric[16], op[3];
+      float value;
+      if (sscanf(cond, " %15[a-z_0-9] %2[<>=] %f", metric, op, &value) != 3) {
+        snprintf(error, error_len, "line %d: bad condition '%s'", line_no, cond);
+        return false;
+      }
+      int m = -1;
+      for (int i = 0; i < METRIC_COUNT; i++) {
+        if (strcmp(metric, ruleMetricName(i)) == 0) m = i;
+      }
+      if (m < 0) {
+        snprintf(error, error_len, "line %d: unknown metric '%s'", line_no, metric);
+        return false;
+      }
+      uint8_t accept;
+      if (strcmp(op, ">") == 0) accept = RULE_GT;
+      else if (strcmp(op, "<") == 0) accept = RULE_LT;
+      else if (strcmp(op, ">=") == 0) accept = RULE_GE;
+      else if (strcmp(op, "<=") == 0) accept = RULE_LE;
+      else {
+        snprintf(error, error_len, "line %d: unknown operator '%s'", line_no, op);
+        return false;
+      }
+
+      RuleCondition& c = out.conditions[out.condition_count];
+      c.metric = m;
+      c.accept = accept;
+      c.threshold = value;
+      r.mask |= 1ULL << out.condition_count;
+      out.condition_count++;
+    }
+    if (r.mask == 0) {
+      snprintf(error, error_len, "line %d: rule has no conditions", line_no);
+      return false;
+    }
+    out.rule_count++;
+  }
+
+  // Version is a hash of the text, handy for checking what a device runs
+  uint32_t h = 2166136261u;
+  for (const char* c = text; *c; c++) h = (h ^ (uint8_t)*c) * 16777619u;
+  out.version = h;
+  if (error_len) error[0] = '\0';
+  return true;
+}
+
+class RuleEngine {
+public:
+  // Compile and stage a new rule set; the evaluating task picks it up before
+  // its next sample. Safe to call from another task. Returns false on a
+  // compile error or while a previous rule set is still waiting to be adopted.
+  bool load(const char* text, char* error, size_t error_len) {
+    int expected = SWAP_IDLE;
+    if (!swap.compare_exchange_strong(expected, SWAP_WRITING)) {
+      snprintf(error, error_len, "previous rule set not yet applied");
+      return false;
+    }
+    int staging = active.load() ^ 1;
+    if (!compileRules(text, sets[staging], error, error_len)) {
+      swap.store(SWAP_IDLE);
+      return false;
+    }
+    swap.store(SWAP_READY);
+    return true;
+  }
+
+  // Evaluate one sample. Must always be called from the same task.
+  RuleResult evaluate(const float* metrics, uint32_t now_ms) {
+    if (swap.load() == SWAP_READY) adopt();
+
+    const RuleSet& set = sets[active.load()];
+    RuleResult result = {-1, 0, 0};
+
+    // All conditions into one bit word
+    uint64_t bits = 0;
+    for (int i = 0; i < set.condition_count; i++) {
+      const RuleCondition& c = set.conditions[i];
+      float v = metrics[c.metric];
+      uint8_t outcome = (v > c.threshold) | ((v < c.threshold) << 1) | ((v == c.threshold) << 2);
+      bits |= (uint64_t)((outcome & c.accept) != 0) << i;
+    }
+
+    // Rule masks against the word, then hold times
+    for (int i = 0; i < set.rule_count; i++) {
+      const Rule& r = set.rules[i];
+      RuleState& st = state[i];
+      bool holds = (bits & r.mask) == r.mask;
+      if (holds && !st.holding) st.since_ms = now_ms;
+      st.holding = holds;
+      if (holds && now_ms - st.since_ms >= r.for_ms) {
+        result.active |= 1UL << i;
+        if (result.top_severity < 0 || r.severity < result.top_severity) result.top_severity = r.severity;
+      }
+    }
+
+    // Alerts only for the top severity, as the status is a single level
+    for (int i = 0; i < set.rule_count; i++) {
+      const Rule& r = set.rules[i];
+      RuleState& st = state[i];
+      if (!(result.active & (1UL << i)) || r.severity != result.top_severity) continue;
+      if (st.alerted && now_ms - st.last_alert_ms <= r.cooldown_ms) continue;
+      st.alerted = true;
+      st.last_alert_ms = now_ms;
+      result.alerts |= 1UL << i;
+    }
+    return result;
+  }
+
+  const RuleSet& rules() const { return sets[active.load()]; }
+  uint32_t version() const { return sets[active.load()].version; }
+
+private:
+  enum { SWAP_IDLE, SWAP_WRITING, SWAP_READY };
+
+  RuleSet sets[2] = {};
+  RuleState state[RULE_MAX_RULES] = {};
+  std::atomic<int> active{0};
+  std::atomic<int> swap{SWAP_IDLE};
+
+  // Switch to the staged set. Rules that keep their label keep their hold and
+  // cooldown timers so a reload does not re-send alerts that just went out.
+  void adopt() {
+    int old_index = active.load();
+    const RuleSet& old_set = sets[old_index];
+    const RuleSet& new_set = sets[old_index ^ 1];
+    RuleState carried[RULE_MAX_RULES] = {};
+    for (int i = 0; i < new_set.rule_count; i++) {
+      for (int j = 0; j < old_set.rule_count; j++) {
+        if (strcmp(new_set.rules[i].label, old_set.rules[j].label) == 0) {
+          carried[i] = state[j];
+          break;
+        }
+      }
+    }
+    memcpy(state, carried, sizeof(state));
+    active.store(old_index ^ 1);
+    swap.store(SWAP_IDLE);
+  }
+};
@@ -0,0 +1,90 @@
+#pragma once
+// Sequence lock for publishing a small state struct from one writer task to
+// any number of readers.
+//
+// The writer bumps the sequence to odd, stores the struct and bumps it to even
+// again; it never waits. A reader copies the struct between two reads of the
+// sequence and retries if the writer was active meanwhile, so it always gets
+// one consistent version and never sees half of an update. The payload lives
+// in relaxed atomic words, which keeps the concurrent copy well defined.
+//
+// A reader that keeps colliding with the writer backs off (sleeps for a tick
+// on the device) so a higher-priority reader on the writer's core cannot
+// starve the writer it is waiting for.
+//
+// T must be trivially copyable. Only one task may write.
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <thread>
+#endif
+
+#define SEQLOCK_SPIN_TRIES 16
+
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock payload must be trivially copyable");
+
+public:
+  SeqLock() {
+    for (size_t i = 0; i < WORDS; i++) words[i].store(0, std::memory_order_relaxed);
+  }
+
+  // Writer task only
+  void write(const T& value) {
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint32_t buffer[WORDS] = {};
+    memcpy(buffer, &value, sizeof(T));
+    for (size_t i = 0; i < WORDS; i++) words[i].store(buffer[i], std::memory_order_relaxed);
+
+    seq.store(s + 2, std::memory_order_release);
+  }
+
+  // Any task; returns the version read (even, increases by 2 per write)
+  uint32_t read(T& out) const {
+    uint32_t buffer[WORDS];
+    for (uint32_t attempt = 0;; attempt++) {
+      uint32_t before = seq.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        for (size_t i = 0; i < WORDS; i++) buffer[i] = words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == before) {
+          memcpy(&out, buffer, sizeof(T));
+          return before;
+        }
+      }
+      if (attempt >= SEQLOCK_SPIN_TRIES) backoff();
+    }
+  }
+
+  T read() const {
+    T out;
+    read(out);
+    return out;
+  }
+
+  // Cheap check for "anything new since version v"
+  uint32_t version() const { return seq.load(std::memory_order_acquire) & ~1u; }
+
+private:
+  static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+  std::atomic<uint32_t> seq{0};
+  std::atomic<uint32_t> words[WORDS];
+
+  static void backoff() {
+#ifdef ARDUINO
+    vTaskDelay(1);
+#else
+    std::this_thread::yield();
+#endif
+  }
+};
@@ -0,0 +1,241 @@
+#pragma once
+// Stall watchdog for the sampling task.
+//
+// The sampling task calls beat() once per sample and stage() before each step
+// that may block ("mpu-read", "publish", ...). A supervisor task calls check()
+// periodically; when no beat arrived within deadline_ms it records a stall
+// report: the stage the task was in, where it was, and for how long it
+// blocked. The report stays open until the next beat closes it with the final
+// duration. A stall longer than restart_ms makes check() return
+// STALL_RESTART, and the caller resets the board.
+//
+// Reports go to a small ring in a StallLog the sketch keeps in RTC memory
+// (RTC_NOINIT_ATTR), so the stall that forced a reset can still be read after
+// it over /stalls.
+//
+// On the ESP32 a stall also captures the blocked task's saved PC and the
+// code addresses found near the top of its stack, for addr2line. These come
+// from the task's last context switch: a task that is spinning on another
+// core shows where it was last switched out. On the host those fields stay 0
+// so tools/stall_watchdog_sim can drive the same logic with injected stalls.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <mutex>
+#endif
+
+#define STALL_LOG_MAGIC        0x4C415453 // "STAL"
+#define STALL_MAX_REPORTS      8
+#define STALL_BACKTRACE_DEPTH  8
+#define STALL_STACK_SCAN_WORDS 128
+#define STALL_STAGE_LEN        16
+
+enum StallAction {
+  STALL_NONE = 0,
+  STALL_DETECTED,   // a new stall started
+  STALL_RESTART     // the current stall passed restart_ms
+};
+
+struct StallReport {
+  uint32_t start_ms;     // last beat before the stall
+  uint32_t duration_ms;  // so far while ongoing
+  uint32_t pc;
+  uint32_t backtrace[STALL_BACKTRACE_DEPTH];
+  uint8_t depth;
+  uint8_t ongoing;
+  uint8_t restarted;     // the board was reset during this stall
+  uint8_t reserved;
+  uint16_t boot;         // StallLog::boot_count when it happened
+  char stage[STALL_STAGE_LEN];
+};
+
+struct StallLog {
+  uint32_t magic;
+  uint16_t boot_count;
+  uint16_t next;         // slot for the next report
+  uint32_t total;        // reports ever written
+  StallReport reports[STALL_MAX_REPORTS];
+};
+
+class StallWatchdog {
+public:
+  StallWatchdog(StallLog& log, uint32_t deadline_ms, uint32_t restart_ms)
+      : log(log), deadline_ms(deadline_ms), restart_ms(restart_ms) {}
+
+  // Call once at boot, before the sampling task starts. Keeps reports from
+  // before a reset; a stall that was still open then is marked restarted.
+  void begin(uint32_t now_ms) {
+    lock();
+    if (log.magic != STALL_LOG_MAGIC || log.next >= STALL_MAX_REPORTS) {
+      memset(&log, 0, sizeof(log));
+      log.magic = STALL_LOG_MAGIC;
+    } else {
+      log.boot_count++;
+      for (int i = 0; i < STALL_MAX_REPORTS; i++) {
+        if (log.reports[i].ongoing) {
+          log.reports[i].ongoing = 0;
+          log.reports[i].restarted = 1;
+        }
+      }
+    }
+    unlock();
+    current = -1;
+    last_beat_ms.store(now_ms);
+    beats.store(0);
+  }
+
+#ifdef ARDUINO
+  // The task whose context is captured on a stall; stack_bytes as passed to
+  // xTaskCreate
+  void watchTask(TaskHandle_t task, uint32_t stack_bytes) {
+    this->task = task;
+    this->stack_bytes = stack_bytes;
+  }
+#endif
+
+  // Sampling task
+  void beat(uint32_t now_ms) {
+    last_beat_ms.store(now_ms, std::memory_order_relaxed);
+    beats.fetch_add(1, std::memory_order_release);
+  }
+
+  // Sampling task; `tag` must be a string literal
+  void stage(const char* tag) { current_stage.store(tag, std::memory_order_relaxed); }
+
+  // Supervisor task
+  StallAction check(uint32_t now_ms) {
+    uint32_t seen = beats.load(std::memory_order_acquire);
+    uint32_t last = last_beat_ms.load(std::memory_order_relaxed);
+
+    if (current >= 0) {
+      StallReport& r = log.reports[current];
+      if (seen != stall_beats) {
+        // Beat again: close the report with how long the task was gone
+        lock();
+        r.duration_ms = last - r.start_ms;
+        r.ongoing = 0;
+        unlock();
+        current = -1;
+        return STALL_NONE;
+      }
+      lock();
+      r.duration_ms = now_ms - r.start_ms;
+      bool restart = restart_ms && r.duration_ms >= restart_ms;
+      if (restart) r.restarted = 1;
+      unlock();
+      return restart ? STALL_RESTART : STALL_NONE;
+    }
+
+    if (now_ms - last <= deadline_ms) return STALL_NONE;
+
+    StallReport r = {};
+    r.start_ms = last;
+    r.duration_ms = now_ms - last;
+    r.ongoing = 1;
+    r.boot = log.boot_count;
+    const char* tag = current_stage.load(std::memory_order_relaxed);
+    strncpy(r.stage, tag ? tag : "?", sizeof(r.stage) - 1);
+    captureContext(r);
+
+    lock();
+    current = log.next;
+    log.reports[current] = r;
+    log.next = (log.next + 1) % STALL_MAX_REPORTS;
+    log.total++;
+    unlock();
+    stall_beats = seen;
+    return STALL_DETECTED;
+  }
+
+  bool stalled() const { return current >= 0; }
+  uint32_t total() const { return log.total; }
+
+  // Reports oldest first; returns how many were copied
+  int reports(StallReport* out) {
+    lock();
+    int n = log.total < STALL_MAX_REPORTS ? log.total : STALL_MAX_REPORTS;
+    int first = (log.next + STALL_MAX_REPORTS - n) % STALL_MAX_REPORTS;
+    for (int i = 0; i < n; i++) out[i] = log.reports[(first + i) % STALL_MAX_REPORTS];
+    unlock();
+    return n;
+  }
+
+  // JSON for /stalls into `buf`; returns the length (truncated to len - 1)
+  size_t toJson(char* buf, size_t len) {
+    StallReport copy[STALL_MAX_REPORTS];
+    int n = reports(copy);
+    size_t used = 0;
+    auto add = [&](const char* fmt, auto... args) {
+      if (used < len) used += snprintf(buf + used, len - used, fmt, args...);
+    };
+    add("{\"boot\":%u,\"total\":%u,\"deadline_ms\":%u,\"restart_ms\":%u,\"stalls\":[", log.boot_count,
+        (unsigned)log.total, (unsigned)deadline_ms, (unsigned)restart_ms);
+    for (int i = 0; i < n; i++) {
+      const StallReport& r = copy[i];
+      add("%s{\"boot\":%u,\"start\":%u,\"duration\":%u,\"stage\":\"%s\",\"ongoing\":%s,\"restarted\":%s,"
+          "\"pc\":\"0x%08x\",\"backtrace\":[",
+          i ? "," : "", r.boot, (unsigned)r.start_ms, (unsigned)r.duration_ms, r.stage, r.ongoing ? "true" : "false",
+          r.restarted ? "true" : "false", (unsigned)r.pc);
+      for (int k = 0; k < r.depth; k++) add("%s\"0x%08x\"", k ? "," : "", (unsigned)r.backtrace[k]);
+      add("]}");
+    }
+    add("]}");
+    return used < len ? used : (len ? len - 1 : 0);
+  }
+
+private:
+  StallLog& log;
+  uint32_t deadline_ms;
+  uint32_t restart_ms;
+  std::atomic<uint32_t> last_beat_ms{0};
+  std::atomic<uint32_t> beats{0};
+  std::atomic<const char*> current_stage{nullptr};
+  int current = -1;           // open report, supervisor only
+  uint32_t stall_beats = 0;   // beat count when it opened
+
+#ifdef ARDUINO
+  TaskHandle_t task = NULL;
+  uint32_t stack_bytes = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  void lock() { portENTER_CRITICAL(&mux); }
+  void unlock() { portEXIT_CRITICAL(&mux); }
+#else
+  std::mutex mux;
+  void lock() { mux.lock(); }
+  void unlock() { mux.unlock(); }
+#endif
+
+  static bool isCode(uint32_t addr) {
+    return (addr >= 0x40080000 && addr < 0x400A0000) ||  // IRAM
+           (addr >= 0x400D0000 && addr < 0x40400000);    // flash
+  }
+
+  void captureContext(StallReport& r) {
+#if defined(ARDUINO) && defined(__XTENSA__)
+    if (!task) return;
+    // The TCB starts with the saved stack pointer; the frame there (solicited
+    // or interrupt) holds the PC in its second word
+    const uint32_t* sp = *(const uint32_t* const*)task;
+    const uint8_t* stack_start = pxTaskGetStackStart(task);
+    const uint32_t* stack_end = (const uint32_t*)(stack_start + stack_bytes);
+    if ((const uint8_t*)sp < stack_start || sp + 2 > stack_end) return;
+    r.pc = sp[1];
+    // Windowed calls keep the call size in the top two bits of a0
+    for (const uint32_t* p = sp + 2; p < stack_end && p < sp + STALL_STACK_SCAN_WORDS; p++) {
+      uint32_t addr = (*p & 0x3FFFFFFF) | 0x40000000;
+      if ((*p >> 30) && isCode(addr)) {
+        r.backtrace[r.depth++] = addr;
+        if (r.depth == STALL_BACKTRACE_DEPTH) break;
+      }
+    }
+#else
+    (void)r;
+#endif
+  }
+};
@@ -0,0 +1,125 @@
+#pragma once
+// Telemetry frame format and framing, shared by telemetry_uplink.h and the
+// host tools (tools/fleet_sim.cpp).
+//
+// TelemetryFramer reduces state updates, at whatever rate they come, to one
+// TelemetryFrame per UPLINK_FRAME_MS: means and maxima of the motion over the
+// frame, the latest vitals and condition flags. A change of flags closes the
+// open frame early, so every frame has a single set of flags, and marks the
+// batch as urgent.
+//
+// Everything here is plain C++ and runs the same on the host.
+
+#include <stdint.h>
+#include <string.h>
+
+#define UPLINK_FRAME_MS        1000
+#define UPLINK_BATCH_MS        10000
+#define UPLINK_BATCH_FRAMES    32
+#define UPLINK_RAM_FRAMES      128
+#define UPLINK_SPILL_FRAMES    64     // moved to flash in one write
+#define UPLINK_FLASH_FRAMES    8192   // up to 192 KB, a bit over 2 h at 1 frame/s
+#define UPLINK_ACK_TIMEOUT_MS  30000
+#define UPLINK_FORMAT_VERSION  1
+
+// Condition flags carried in every frame
+enum UplinkFlags {
+  UPLINK_MOTION   = 1 << 0,
+  UPLINK_SEPSIS   = 1 << 1,
+  UPLINK_SEIZURE  = 1 << 2,
+  UPLINK_CRITICAL = 1 << 3,
+  UPLINK_FALL     = 1 << 4
+};
+
+struct __attribute__((packed)) TelemetryFrame {
+  uint32_t seq;
+  uint32_t t_ms;             // millis() at the end of the frame
+  uint16_t hr_x10;           // latest, BPM * 10
+  uint16_t spo2_x10;         // latest, % * 10
+  uint16_t accel_mg;         // mean over the frame
+  uint16_t accel_max_mg;
+  uint16_t gyro_dps_x10;     // mean over the frame
+  uint16_t gyro_max_dps_x10;
+  uint8_t flags;             // UplinkFlags
+  uint8_t samples;           // state updates folded into the frame (saturates)
+  uint16_t motion_s;         // length of the current motion episode
+};
+
+// Batch payload: this header followed by `count` frames
+struct __attribute__((packed)) TelemetryBatchHeader {
+  uint8_t version;
+  uint8_t count;
+  uint16_t frame_bytes;
+};
+
+struct UplinkState {
+  float hr;
+  float spo2;
+  float accel_g;
+  float gyro_dps;
+  uint8_t flags;
+  uint32_t motion_ms;
+};
+
+class TelemetryFramer {
+public:
+  // Fold the current state into the open frame. Returns the number of frames
+  // this closed (0 to 2) in `out`; `urgent` is set when the flags changed.
+  int sample(const UplinkState& s, uint32_t now, TelemetryFrame out[2], bool& urgent) {
+    int closed = 0;
+    urgent = false;
+    if (frame_samples == 0) frame_start_ms = now;
+    bool flags_changed = frame_samples > 0 && s.flags != last_flags;
+    if (flags_changed) {
+      closed += close(now, &out[closed]);
+      urgent = true;
+      frame_start_ms = now;
+    }
+
+    latest = s;
+    last_flags = s.flags;
+    accel_sum += s.accel_g;
+    gyro_sum += s.gyro_dps;
+    if (frame_samples == 0 || s.accel_g > accel_max) accel_max = s.accel_g;
+    if (frame_samples == 0 || s.gyro_dps > gyro_max) gyro_max = s.gyro_dps;
+    frame_samples++;
+
+    if (now - frame_start_ms >= UPLINK_FRAME_MS) closed += close(now, &out[closed]);
+    return closed;
+  }
+
+  // Sequence number of the next frame
+  uint32_t nextSeq() const { return next_seq; }
+
+private:
+  UplinkState latest;
+  uint32_t frame_start_ms = 0;
+  uint32_t frame_samples = 0;
+  float accel_sum = 0, gyro_sum = 0, accel_max = 0, gyro_max = 0;
+  uint8_t last_flags = 0;
+  uint32_t next_seq = 0;
+
+  static uint16_t clampU16(float v) {
+    if (v <= 0) return 0;
+    return v >= 65535.0f ? 65535 : (uint16_t)(v + 0.5f);
+  }
+
+  int close(uint32_t now, TelemetryFrame* f) {
+    if (frame_samples == 0) return 0;
+    f->seq = next_seq++;
+    f->t_ms = now;
+    f->hr_x10 = clampU16(latest.hr * 10);
+    f->spo2_x10 = clampU16(latest.spo2 * 10);
+    f->accel_mg = clampU16(accel_sum / frame_samples * 1000);
+    f->accel_max_mg = clampU16(accel_max * 1000);
+    f->gyro_dps_x10 = clampU16(gyro_sum / frame_samples * 10);
+    f->gyro_max_dps_x10 = clampU16(gyro_max * 10);
+    f->flags = latest.flags;
+    f->samples = frame_samples > 255 ? 255 : frame_samples;
+    f->motion_s = clampU16(latest.motion_ms / 1000.0f);
+
+    frame_samples = 0;
+    accel_sum = gyro_sum = 0;
+    return 1;
+  }
+};
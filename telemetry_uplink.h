@@ -0,0 +1,273 @@
+#pragma once
+// Batched telemetry uplink over MQTT.
+//
+// The sampling code hands over its current state as often as it likes; that is
+// reduced to one compact TelemetryFrame per second (means and maxima over the
+// second, latest vitals and condition flags; see telemetry_frame.h). Frames
+// are published in batches every UPLINK_BATCH_MS, or straight away when the
+// flags change, over one persistent MQTT connection with QoS 1. A batch is
+// only dropped from the queue once the broker has acknowledged it, and only
+// one batch is in flight at a time, so frames arrive in order (at least once;
+// `seq` identifies repeats).
+//
+// Frames wait in a RAM ring. While the broker is unreachable the oldest
+// frames are moved to a bounded ring file in flash (the oldest are overwritten
+// once that is full) and replayed from there first on reconnect.
+
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include <mqtt_client.h>
+#include <atomic>
+
+#include "telemetry_frame.h"
+
+// Fixed-slot ring of frames in a flash file, header rewritten per operation.
+// The file starts as just the header and grows a slot at a time as frames
+// are first spilled, so nothing is written until the broker is unreachable.
+class FlashFrameRing {
+public:
+  bool begin(fs::FS& fs, const char* path, uint32_t capacity) {
+    this->capacity = capacity;
+    file = fs.open(path, "r+");
+    if (file && file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+        header.magic == MAGIC && header.capacity == capacity && header.slots <= capacity &&
+        file.size() >= slotOffset(header.slots)) {
+      return true;
+    }
+    if (file) file.close();
+
+    // New (or incompatible) ring: header only
+    file = fs.open(path, "w+");
+    if (!file) return false;
+    header = Header{MAGIC, capacity, 0, 0, 0, 0, 0};
+    writeHeader();
+    return true;
+  }
+
+  uint32_t size() const { return header.count; }
+  uint32_t dropped() const { return header.dropped; }
+  uint32_t fileBytes() const { return slotOffset(header.slots); }
+
+  // Append, overwriting the oldest frames once full
+  void push(const TelemetryFrame* frames, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+      // The head only ever moves one slot past the end of the file
+      file.seek(slotOffset(header.head));
+      file.write((const uint8_t*)&frames[i], sizeof(TelemetryFrame));
+      if (header.head == header.slots) header.slots++;
+      header.head = (header.head + 1) % capacity;
+      if (header.count == capacity) {
+        header.tail = (header.tail + 1) % capacity;
+        header.dropped++;
+      } else {
+        header.count++;
+      }
+    }
+    writeHeader();
+  }
+
+  uint32_t peek(TelemetryFrame* out, uint32_t max) {
+    uint32_t n = max < header.count ? max : header.count;
+    for (uint32_t i = 0; i < n; i++) {
+      file.seek(slotOffset((header.tail + i) % capacity));
+      file.read((uint8_t*)&out[i], sizeof(TelemetryFrame));
+    }
+    return n;
+  }
+
+  void pop(uint32_t n) {
+    if (n > header.count) n = header.count;
+    header.tail = (header.tail + n) % capacity;
+    header.count -= n;
+    writeHeader();
+  }
+
+private:
+  static const uint32_t MAGIC = 0x55504C32; // "UPL2"
+  struct Header {
+    uint32_t magic;
+    uint32_t capacity;
+    uint32_t slots;  // slots present in the file
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+    uint32_t dropped;
+  };
+
+  File file;
+  Header header = {};
+  uint32_t capacity = 0;
+
+  uint32_t slotOffset(uint32_t slot) const { return sizeof(Header) + slot * sizeof(TelemetryFrame); }
+
+  void writeHeader() {
+    file.seek(0);
+    file.write((const uint8_t*)&header, sizeof(header));
+    file.flush();
+  }
+};
+
+class TelemetryUplink {
+public:
+  bool begin(const char* broker_uri, const char* client_id, const char* topic) {
+    this->topic = topic;
+    if (!LittleFS.begin(true) || !flash.begin(LittleFS, "/uplink.ring", UPLINK_FLASH_FRAMES)) {
+      Serial.println("Telemetry uplink: flash buffer unavailable, RAM only");
+      flash_ok = false;
+    }
+
+    esp_mqtt_client_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+#if ESP_IDF_VERSION_MAJOR >= 5
+    cfg.broker.address.uri = broker_uri;
+    cfg.credentials.client_id = client_id;
+    cfg.session.keepalive = 60;
+#else
+    cfg.uri = broker_uri;
+    cfg.client_id = client_id;
+    cfg.keepalive = 60;
+#endif
+    client = esp_mqtt_client_init(&cfg);
+    if (client == NULL) return false;
+    esp_mqtt_client_register_event(client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, onMqttEvent, this);
+    return esp_mqtt_client_start(client) == ESP_OK;
+  }
+
+  // Fold the current state into the open frame. Call at any rate.
+  void sample(const UplinkState& s, uint32_t now) {
+    TelemetryFrame closed[2];
+    bool flags_changed;
+    int n = framer.sample(s, now, closed, flags_changed);
+    if (flags_changed) urgent = true;
+    for (int i = 0; i < n; i++) ramPush(closed[i]);
+  }
+
+  void loop(uint32_t now) {
+    // Broker acknowledged the batch in flight: drop it from its queue
+    int acked = acked_msg_id.exchange(-1);
+    if (in_flight_frames && acked == in_flight_msg_id) {
+      if (in_flight_from_flash) flash.pop(in_flight_frames);
+      else ramPop(in_flight_frames);
+      if (in_flight_from_flash) frames_replayed += in_flight_frames;
+      frames_sent += in_flight_frames;
+      in_flight_frames = 0;
+    }
+    if (in_flight_frames && (!connected.load() || now - last_publish_ms >= UPLINK_ACK_TIMEOUT_MS)) {
+      // Unacknowledged; it goes out again (after reconnecting)
+      in_flight_frames = 0;
+    }
+
+    // Keep room in RAM by moving the oldest frames to flash
+    if (ram_count > UPLINK_RAM_FRAMES - UPLINK_SPILL_FRAMES / 2 && in_flight_frames == 0) spill();
+
+    if (!connected.load() || in_flight_frames) return;
+    bool backlog = (flash_ok && flash.size() > 0) || ram_count >= UPLINK_BATCH_FRAMES;
+    bool due = ram_count > 0 && (urgent || now - last_publish_ms >= UPLINK_BATCH_MS);
+    if (backlog || due) publish(now);
+  }
+
+  bool isConnected() const { return connected.load(); }
+  uint32_t queued() const { return ram_count + (flash_ok ? flash.size() : 0); }
+  uint32_t droppedFrames() const { return ram_dropped + (flash_ok ? flash.dropped() : 0); }
+
+  // Statistics
+  uint32_t frames_sent = 0;
+  uint32_t frames_replayed = 0;
+  uint32_t publishes = 0;      // each one wakes the radio
+  uint32_t bytes_published = 0;
+
+private:
+  esp_mqtt_client_handle_t client = NULL;
+  const char* topic = "";
+  std::atomic<bool> connected{false};
+  std::atomic<int> acked_msg_id{-1};
+
+  // Open frame
+  TelemetryFramer framer;
+  bool urgent = false;
+
+  // Queues
+  TelemetryFrame ram[UPLINK_RAM_FRAMES];
+  uint32_t ram_head = 0, ram_count = 0, ram_dropped = 0;
+  FlashFrameRing flash;
+  bool flash_ok = true;
+
+  // Batch in flight
+  int in_flight_msg_id = -1;
+  uint32_t in_flight_frames = 0;
+  bool in_flight_from_flash = false;
+  uint32_t last_publish_ms = 0;
+
+  void ramPush(const TelemetryFrame& f) {
+    if (ram_count == UPLINK_RAM_FRAMES) {
+      // Only reachable without flash (or while a RAM batch is in flight)
+      ramPop(1);
+      ram_dropped++;
+      if (in_flight_frames && !in_flight_from_flash) in_flight_frames = 0;
+    }
+    ram[(ram_head + ram_count) % UPLINK_RAM_FRAMES] = f;
+    ram_count++;
+  }
+
+  void ramPop(uint32_t n) {
+    if (n > ram_count) n = ram_count;
+    ram_head = (ram_head + n) % UPLINK_RAM_FRAMES;
+    ram_count -= n;
+  }
+
+  uint32_t ramPeek(TelemetryFrame* out, uint32_t max) {
+    uint32_t n = max < ram_count ? max : ram_count;
+    for (uint32_t i = 0; i < n; i++) out[i] = ram[(ram_head + i) % UPLINK_RAM_FRAMES];
+    return n;
+  }
+
+  void spill() {
+    if (!flash_ok) return;
+    TelemetryFrame batch[UPLINK_SPILL_FRAMES];
+    uint32_t n = ramPeek(batch, UPLINK_SPILL_FRAMES);
+    flash.push(batch, n);
+    ramPop(n);
+  }
+
+  void publish(uint32_t now) {
+    // Oldest first: whatever was spilled to flash precedes the RAM ring
+    uint8_t payload[sizeof(TelemetryBatchHeader) + UPLINK_BATCH_FRAMES * sizeof(TelemetryFrame)];
+    TelemetryFrame* frames = (TelemetryFrame*)(payload + sizeof(TelemetryBatchHeader));
+    bool from_flash = flash_ok && flash.size() > 0;
+    uint32_t n = from_flash ? flash.peek(frames, UPLINK_BATCH_FRAMES) : ramPeek(frames, UPLINK_BATCH_FRAMES);
+    if (n == 0) return;
+
+    TelemetryBatchHeader header = {UPLINK_FORMAT_VERSION, (uint8_t)n, sizeof(TelemetryFrame)};
+    memcpy(payload, &header, sizeof(header));
+    size_t len = sizeof(header) + n * sizeof(TelemetryFrame);
+
+    int msg_id = esp_mqtt_client_publish(client, topic, (const char*)payload, len, 1, 0);
+    if (msg_id < 0) return;
+    in_flight_msg_id = msg_id;
+    in_flight_frames = n;
+    in_flight_from_flash = from_flash;
+    last_publish_ms = now;
+    urgent = false;
+    publishes++;
+    bytes_published += len;
+  }
+
+  static void onMqttEvent(void* arg, esp_event_base_t /*base*/, int32_t event_id, void* data) {
+    TelemetryUplink* self = (TelemetryUplink*)arg;
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)data;
+    switch ((esp_mqtt_event_id_t)event_id) {
+      case MQTT_EVENT_CONNECTED:
+        self->connected.store(true);
+        break;
+      case MQTT_EVENT_DISCONNECTED:
+        self->connected.store(false);
+        break;
+      case MQTT_EVENT_PUBLISHED:
+        self->acked_msg_id.store(event->msg_id);
+        break;
+      default:
+        break;
+    }
+  }
+};
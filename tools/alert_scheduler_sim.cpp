@@ -0,0 +1,431 @@
+// Host simulation of alert_scheduler.h: time-to-delivery per severity.
+//
+// The scheduler runs unchanged against a scripted alert stream and a mock
+// SMS transport on a 1 ms virtual clock. Each lane behaves like alertTask()
+// in combinedsense.cpp: it polls next() every 50 ms while idle, waits 1 s
+// after a deferred send, and its send checks abortRequested() before it
+// connects and again before the POST goes out. A send takes 400-900 ms to
+// connect and 0.8-2.5 s for the POST; a failed one takes as long. The
+// channel is configured like the sketch's (burst of 4, 60 per hour).
+//
+//   quiet        2 h, a SEPSIS alert every 10 min and one CRITICAL
+//   preempt      CRITICAL while a SEPSIS send is connecting, then while one
+//                is already posting
+//   burst        a minute of SEIZURE every 3 s, SEPSIS every 5 s and two
+//                CRITICAL alerts in the middle
+//   outage       WiFi down for 5 min while alerts of every class arrive
+//   storm        every class every 2 s for 30 min (a misfiring rule)
+//   flaky        one send in five fails, alerts every 20 s for 30 min
+//
+// A last run has the two lanes call next() with times a few ms apart in
+// either order, as the tasks do when the one that read millis() first gets
+// the lock second.
+//
+// Latency is measured per submission, from submit() to the completion of
+// the send that carried it, by following each message's (xN) and "| NAME xN"
+// tags. The same stream is also pushed through a model of the old sendSMS()
+// path for comparison: one request per alert, sent in order by one blocking
+// sender, with no retry and nothing sent while WiFi is down.
+//
+//   g++ -O2 -std=c++17 -o alert_scheduler_sim tools/alert_scheduler_sim.cpp
+//   ./alert_scheduler_sim
+//
+// The normal lane never takes the bucket's last token, so a lone CRITICAL
+// goes out within one send of arriving even after a burst has drained the
+// bucket. A second CRITICAL right behind it (burst, storm) waits for the
+// next refill, one minute at 60 per hour.
+//
+// Exit status is non-zero if the SMS count exceeds the token bucket in any
+// run, including the out-of-order one, an alert is lost to an outage, a
+// CRITICAL alert takes longer than one send plus a poll (plus one refill in
+// burst and storm), or the scheduler's own delivery counters disagree with
+// what the simulation saw.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include "../alert_scheduler.h"
+
+static const float SMS_BURST = 4;
+static const float SMS_PER_HOUR = 60;
+static const uint32_t POLL_MS = 50;
+static const uint32_t DEFER_MS = 1000;
+static const uint32_t DRAIN_LIMIT_MS = 3600000;
+
+struct Submission {
+  uint32_t at_ms;
+  AlertPriority priority;
+};
+
+struct Scenario {
+  const char* name;
+  uint32_t duration_ms;
+  std::vector<Submission> stream;
+  uint32_t outage_from_ms = 0, outage_to_ms = 0;
+  uint32_t fail_one_in = 0;
+  // Longest a CRITICAL alert may wait for a token on top of one send and a
+  // poll; NO_BOUND where the network is the limit
+  uint32_t critical_wait_ms = 0;
+};
+
+static const uint32_t NO_BOUND = UINT32_MAX;
+static const uint32_t TOKEN_MS = (uint32_t)(3600000 / SMS_PER_HOUR);
+
+static uint32_t rng_state = 1;
+static uint32_t rng(uint32_t lo, uint32_t hi) {
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return lo + (rng_state >> 8) % (hi - lo + 1);
+}
+
+static void every(Scenario& s, AlertPriority p, uint32_t from_ms, uint32_t to_ms, uint32_t period_ms) {
+  for (uint32_t t = from_ms; t < to_ms; t += period_ms) s.stream.push_back({t, p});
+}
+
+static std::vector<Scenario> scenarios() {
+  std::vector<Scenario> all;
+
+  Scenario quiet;
+  quiet.name = "quiet";
+  quiet.duration_ms = 7200000;
+  quiet.stream.push_back({0, ALERT_SYSTEM});
+  every(quiet, ALERT_SEPSIS, 600000, quiet.duration_ms, 600000);
+  quiet.stream.push_back({2820000, ALERT_CRITICAL});
+  all.push_back(quiet);
+
+  Scenario preempt;
+  preempt.name = "preempt";
+  preempt.duration_ms = 60000;
+  preempt.stream = {{0, ALERT_SEPSIS}, {200, ALERT_CRITICAL}, {20000, ALERT_SEPSIS}, {21500, ALERT_CRITICAL}};
+  all.push_back(preempt);
+
+  Scenario burst;
+  burst.name = "burst";
+  burst.duration_ms = 600000;
+  every(burst, ALERT_SEPSIS, 0, 180000, 5000);
+  every(burst, ALERT_SEIZURE, 60000, 120000, 3000);
+  burst.stream.push_back({75300, ALERT_CRITICAL});
+  burst.stream.push_back({80000, ALERT_CRITICAL});
+  burst.critical_wait_ms = TOKEN_MS;
+  all.push_back(burst);
+
+  Scenario outage;
+  outage.name = "outage";
+  outage.duration_ms = 900000;
+  outage.outage_from_ms = 120000;
+  outage.outage_to_ms = 420000;
+  every(outage, ALERT_SEPSIS, 100000, 400000, 30000);
+  every(outage, ALERT_SEIZURE, 150000, 300000, 40000);
+  every(outage, ALERT_SYSTEM, 110000, 410000, 100000);
+  outage.stream.push_back({250000, ALERT_CRITICAL});
+  outage.critical_wait_ms = NO_BOUND;
+  all.push_back(outage);
+
+  Scenario storm;
+  storm.name = "storm";
+  storm.duration_ms = 1800000;
+  for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+    every(storm, (AlertPriority)p, 500 * p, storm.duration_ms, 2000);
+  }
+  storm.critical_wait_ms = TOKEN_MS;
+  all.push_back(storm);
+
+  Scenario flaky;
+  flaky.name = "flaky";
+  flaky.duration_ms = 1800000;
+  flaky.fail_one_in = 5;
+  every(flaky, ALERT_SEPSIS, 0, flaky.duration_ms, 20000);
+  every(flaky, ALERT_SEIZURE, 7000, flaky.duration_ms, 60000);
+  every(flaky, ALERT_CRITICAL, 13000, flaky.duration_ms, 300000);
+  flaky.critical_wait_ms = NO_BOUND;
+  all.push_back(flaky);
+
+  for (Scenario& s : all) {
+    std::stable_sort(s.stream.begin(), s.stream.end(),
+                     [](const Submission& a, const Submission& b) { return a.at_ms < b.at_ms; });
+  }
+  return all;
+}
+
+struct ClassResult {
+  uint32_t submitted = 0;
+  uint32_t dropped = 0;
+  std::vector<uint32_t> latency_ms;
+};
+
+struct RunResult {
+  ClassResult cls[ALERT_PRIORITY_COUNT];
+  uint32_t sms = 0;
+  uint32_t worst_send_ms = 0;
+  uint32_t end_ms = 0;
+};
+
+static bool wifiUp(const Scenario& s, uint32_t t) {
+  return !(t >= s.outage_from_ms && t < s.outage_to_ms);
+}
+
+// How many submissions of each class a message carries, from its tags
+static void parseCounts(const char* message, AlertPriority top, uint32_t counts[ALERT_PRIORITY_COUNT]) {
+  for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) counts[p] = 0;
+  std::string m(message);
+  size_t bar = m.find(" | ");
+  std::string head = m.substr(0, bar);
+  size_t x = head.rfind(" (x");
+  counts[top] = x == std::string::npos ? 1 : (uint32_t)atoi(head.c_str() + x + 3);
+  while (bar != std::string::npos) {
+    size_t start = bar + 3;
+    bar = m.find(" | ", start);
+    std::string tag = m.substr(start, bar == std::string::npos ? std::string::npos : bar - start);
+    size_t space = tag.find(' ');
+    std::string name = tag.substr(0, space);
+    for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+      if (name == alertPriorityName(p)) counts[p] = space == std::string::npos ? 1 : (uint32_t)atoi(tag.c_str() + space + 2);
+    }
+  }
+}
+
+struct LaneSim {
+  enum { IDLE, CONNECTING, POSTING } state = IDLE;
+  uint32_t wake_ms = 0;
+  uint32_t started_ms = 0;
+  uint32_t post_ms = 0, done_ms = 0;
+  bool fails = false;
+  std::vector<uint32_t> carried[ALERT_PRIORITY_COUNT];  // submit times
+};
+
+static void giveBack(std::deque<uint32_t>& outstanding, std::vector<uint32_t>& carried) {
+  outstanding.insert(outstanding.end(), carried.begin(), carried.end());
+  std::sort(outstanding.begin(), outstanding.end());
+  carried.clear();
+}
+
+static bool runScheduler(const Scenario& s, RunResult& r) {
+  AlertScheduler alerts;
+  int ch = alerts.addChannel("SMS", 0xFF, SMS_BURST, SMS_PER_HOUR, 0);
+  std::deque<uint32_t> outstanding[ALERT_PRIORITY_COUNT];
+  LaneSim lanes[ALERT_LANE_COUNT];
+  size_t next_sub = 0;
+  bool ok = true;
+
+  auto finish = [&](AlertLane lane, AlertResult result, uint32_t t) {
+    LaneSim& l = lanes[lane];
+    uint32_t dropped_before[ALERT_PRIORITY_COUNT];
+    for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) dropped_before[p] = alerts.deliveryStats((AlertPriority)p).dropped;
+    alerts.complete(ch, lane, result, t);
+    if (result == ALERT_SENT || result == ALERT_FAILED) {
+      r.sms++;
+      r.worst_send_ms = std::max(r.worst_send_ms, t - l.started_ms);
+    }
+    for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+      if (result == ALERT_SENT) {
+        for (uint32_t at : l.carried[p]) r.cls[p].latency_ms.push_back(t - at);
+        l.carried[p].clear();
+      } else if (alerts.deliveryStats((AlertPriority)p).dropped != dropped_before[p]) {
+        r.cls[p].dropped += l.carried[p].size();
+        l.carried[p].clear();
+      } else {
+        giveBack(outstanding[p], l.carried[p]);
+      }
+    }
+    l.state = LaneSim::IDLE;
+    l.wake_ms = result == ALERT_DEFERRED ? t + DEFER_MS : t;
+  };
+
+  uint32_t t = 0;
+  for (; t < s.duration_ms + DRAIN_LIMIT_MS; t++) {
+    while (next_sub < s.stream.size() && s.stream[next_sub].at_ms == t) {
+      const Submission& sub = s.stream[next_sub++];
+      char text[32];
+      snprintf(text, sizeof(text), "%s #%u", alertPriorityName(sub.priority), r.cls[sub.priority].submitted);
+      alerts.submit(sub.priority, text, t);
+      r.cls[sub.priority].submitted++;
+      outstanding[sub.priority].push_back(t);
+    }
+
+    // The urgent lane's task has the higher priority, so it looks first
+    for (int li = 0; li < ALERT_LANE_COUNT; li++) {
+      AlertLane lane = (AlertLane)li;
+      LaneSim& l = lanes[li];
+      if (l.state == LaneSim::IDLE && t >= l.wake_ms) {
+        char message[ALERT_MESSAGE_LEN];
+        AlertPriority top;
+        if (!alerts.next(ch, lane, t, message, sizeof(message), &top)) {
+          l.wake_ms = t + POLL_MS;
+          continue;
+        }
+        uint32_t counts[ALERT_PRIORITY_COUNT];
+        parseCounts(message, top, counts);
+        for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+          if (counts[p] > outstanding[p].size()) {
+            printf("  %s: message \"%s\" carries more %s alerts than are pending\n", s.name, message,
+                   alertPriorityName(p));
+            ok = false;
+            counts[p] = outstanding[p].size();
+          }
+          l.carried[p].assign(outstanding[p].begin(), outstanding[p].begin() + counts[p]);
+          outstanding[p].erase(outstanding[p].begin(), outstanding[p].begin() + counts[p]);
+        }
+        l.started_ms = t;
+        if (!wifiUp(s, t)) {
+          finish(lane, ALERT_DEFERRED, t);
+          continue;
+        }
+        l.state = LaneSim::CONNECTING;
+        l.post_ms = t + rng(400, 900);
+        l.done_ms = l.post_ms + rng(800, 2500);
+        l.fails = s.fail_one_in && rng(1, s.fail_one_in) == 1;
+        if (alerts.abortRequested(ch, lane)) finish(lane, ALERT_ABORTED, t);
+      } else if (l.state == LaneSim::CONNECTING && t >= l.post_ms) {
+        if (alerts.abortRequested(ch, lane)) {
+          finish(lane, ALERT_ABORTED, t);
+        } else {
+          l.state = LaneSim::POSTING;
+        }
+      } else if (l.state == LaneSim::POSTING && t >= l.done_ms) {
+        finish(lane, l.fails ? ALERT_FAILED : ALERT_SENT, t);
+      }
+    }
+
+    if (t >= s.duration_ms && next_sub == s.stream.size() && alerts.idle(ch)) break;
+  }
+  r.end_ms = t;
+
+  for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+    const AlertDeliveryStats& st = alerts.deliveryStats((AlertPriority)p);
+    ClassResult& c = r.cls[p];
+    uint32_t worst = c.latency_ms.empty() ? 0 : *std::max_element(c.latency_ms.begin(), c.latency_ms.end());
+    if (st.submitted != c.submitted || st.delivered != c.latency_ms.size() || st.dropped != c.dropped ||
+        st.max_delivery_ms != worst || !outstanding[p].empty()) {
+      printf("  %s %s: scheduler counts %u/%u/%u max %u ms, simulation %u/%zu/%u max %u ms, %zu left\n", s.name,
+             alertPriorityName(p), st.submitted, st.delivered, st.dropped, st.max_delivery_ms, c.submitted,
+             c.latency_ms.size(), c.dropped, worst, outstanding[p].size());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// The old path: every alert is its own request, sent one after another
+static void runBaseline(const Scenario& s, RunResult& r) {
+  uint32_t free_ms = 0;
+  for (const Submission& sub : s.stream) {
+    ClassResult& c = r.cls[sub.priority];
+    c.submitted++;
+    uint32_t start = std::max(free_ms, sub.at_ms);
+    if (!wifiUp(s, start)) {
+      c.dropped++;
+      continue;
+    }
+    uint32_t done = start + rng(400, 900) + rng(800, 2500);
+    bool fails = s.fail_one_in && rng(1, s.fail_one_in) == 1;
+    r.sms++;
+    r.worst_send_ms = std::max(r.worst_send_ms, done - start);
+    free_ms = done;
+    if (fails) {
+      c.dropped++;
+    } else {
+      c.latency_ms.push_back(done - sub.at_ms);
+    }
+  }
+  r.end_ms = free_ms;
+}
+
+static double percentileS(std::vector<uint32_t> v, double q) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(q * (v.size() - 1) + 0.5)] / 1000.0;
+}
+
+static void printClass(const char* label, const ClassResult& c) {
+  printf(" %s %5zu %5u %7.1f %7.1f %7.1f", label, c.latency_ms.size(), c.dropped, percentileS(c.latency_ms, 0.5),
+         percentileS(c.latency_ms, 0.99), percentileS(c.latency_ms, 1.0));
+}
+
+// Both lane tasks read millis() before they take the scheduler's lock, so
+// the one that gets it second can pass the older time. For 10 min both lanes
+// poll every 50 ms with times a few ms apart, in either order, while every
+// class is submitted each second and each send completes at once. The SMS
+// count must stay within the token bucket.
+static bool runSkewedClocks() {
+  AlertScheduler alerts;
+  int ch = alerts.addChannel("SMS", 0xFF, SMS_BURST, SMS_PER_HOUR, 0);
+  const uint32_t duration_ms = 600000;
+  uint32_t sms = 0;
+  for (uint32_t t = 1000; t < duration_ms; t += POLL_MS) {
+    if (t % 1000 == 0) {
+      for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) alerts.submit((AlertPriority)p, "skew", t);
+    }
+    uint32_t skew = rng(1, 20);
+    bool urgent_late = rng(0, 1);
+    for (int i = 0; i < ALERT_LANE_COUNT; i++) {
+      AlertLane lane = (AlertLane)(urgent_late ? i : ALERT_LANE_COUNT - 1 - i);
+      uint32_t now = i == 0 ? t : t - skew;  // the second to lock read millis() first
+      char message[ALERT_MESSAGE_LEN];
+      AlertPriority top;
+      if (!alerts.next(ch, lane, now, message, sizeof(message), &top)) continue;
+      alerts.complete(ch, lane, ALERT_SENT, t);
+      sms++;
+    }
+  }
+  float allowed = SMS_BURST + SMS_PER_HOUR * duration_ms / 3600000.0f;
+  printf("skewed clocks: %u SMS in %.0f s with lanes locking out of order, the token bucket allows %.1f\n", sms,
+         duration_ms / 1000.0, allowed);
+  return sms <= allowed;
+}
+
+int main() {
+  bool ok = true;
+  for (const Scenario& s : scenarios()) {
+    rng_state = 1;
+    RunResult sched;
+    bool counters = runScheduler(s, sched);
+    rng_state = 1;
+    RunResult base;
+    runBaseline(s, base);
+
+    printf("%s: %u alerts in %.0f s, %u SMS (old path %u)\n", s.name, (unsigned)s.stream.size(),
+           s.duration_ms / 1000.0, sched.sms, base.sms);
+    printf("  %-8s %5s | %5s %5s %7s %7s %7s | %5s %5s %7s %7s %7s\n", "class", "sent", "deliv", "lost", "p50 s",
+           "p99 s", "max s", "deliv", "lost", "p50 s", "p99 s", "max s");
+    for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+      if (!sched.cls[p].submitted) continue;
+      printf("  %-8s %5u |", alertPriorityName(p), sched.cls[p].submitted);
+      printClass("", sched.cls[p]);
+      printf(" |");
+      printClass("", base.cls[p]);
+      printf("\n");
+    }
+    if (!counters) ok = false;
+
+    // Never more sends than the bucket allows over the whole run
+    float allowed = SMS_BURST + SMS_PER_HOUR * sched.end_ms / 3600000.0f;
+    if (sched.sms > allowed) {
+      printf("  %u SMS sent, the token bucket allows %.1f\n", sched.sms, allowed);
+      ok = false;
+    }
+
+    for (int p = 0; p < ALERT_PRIORITY_COUNT; p++) {
+      if (s.fail_one_in == 0 && sched.cls[p].dropped) {
+        printf("  %u %s alerts lost without a transport failure\n", sched.cls[p].dropped, alertPriorityName(p));
+        ok = false;
+      }
+    }
+
+    const ClassResult& critical = sched.cls[ALERT_CRITICAL];
+    uint32_t bound = s.critical_wait_ms + sched.worst_send_ms + POLL_MS;
+    if (s.critical_wait_ms != NO_BOUND && critical.submitted &&
+        (critical.latency_ms.size() != critical.submitted || percentileS(critical.latency_ms, 1.0) * 1000 > bound)) {
+      printf("  CRITICAL took %.1f s, the bound is %.1f s\n", percentileS(critical.latency_ms, 1.0), bound / 1000.0);
+      ok = false;
+    }
+  }
+
+  rng_state = 1;
+  if (!runSkewedClocks()) ok = false;
+
+  printf(ok ? "all checks passed\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+// Accuracy check and benchmark for fast_math.h, on the host or on the ESP32.
+//
+// Accuracy: every kernel against libm in double precision, over its whole
+// input range. The float rsqrt/sqrt kernels depend only on the mantissa and
+// the exponent's parity, so every float in [1, 4) covers all normal floats
+// (spot-checked across the full exponent range as well). atan2 is swept
+// around the circle at several radii plus random pairs, sin/cos over
+// [-100, 100]. fastSqrtQ16 is checked exhaustively below 2^24, on both sides
+// of every result step, and on random inputs; fastAtan2Q15 over every y for
+// a set of x (and the other way round) plus random pairs; fastSinQ15 and
+// fastCosQ15 on all 65536 angles. The largest error of each must stay within
+// the bound the header documents. Fixed-point errors are against the exact
+// value, in LSB.
+//
+// Speed: ns per call over 1024 varied inputs, next to the libm function it
+// replaces (sqrtf, 1/sqrtf, atan2f, sinf, cosf; for the fixed-point kernels
+// the float round trip through libm).
+//
+//   g++ -O2 -std=c++17 -o fast_math_bench tools/fast_math_bench.cpp
+//   ./fast_math_bench
+//
+// Exit status is non-zero when a bound is exceeded.
+//
+// On the ESP32, make a sketch folder fast_math_bench/ with an empty
+// fast_math_bench.ino and copies of this file and fast_math.h, flash it and
+// open the serial monitor at 115200. It runs once from setup(). The accuracy
+// sweeps are thinned out 256 times there, since libm's double precision is
+// emulated in software.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include "fast_math.h"
+#define OUT(...) Serial.printf(__VA_ARGS__)
+static const int SWEEP_SHIFT = 8;
+static const uint32_t TIME_US = 200000;
+static uint32_t nowUs() { return micros(); }
+#else
+#include <chrono>
+#include "../fast_math.h"
+#define OUT(...) printf(__VA_ARGS__)
+static const int SWEEP_SHIFT = 0;
+static const uint32_t TIME_US = 300000;
+static uint32_t nowUs() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+#endif
+
+static uint32_t rng_state = 0x9E3779B9u;
+
+static uint32_t rnd() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static float rndUniform(float lo, float hi) { return lo + (hi - lo) * (float)(rnd() >> 8) * (1.0f / 16777216.0f); }
+
+static int failures = 0;
+
+static void report(const char* kernel, double worst, double bound, const char* unit) {
+  bool ok = worst <= bound;
+  if (!ok) failures++;
+  OUT("  %-18s max error %10.3g   bound %10.3g %-4s %s\n", kernel, worst, bound, unit, ok ? "" : "EXCEEDED");
+}
+
+static double angleDiff(double a, double b) {
+  double d = fmod(a - b, 2 * FAST_MATH_PI);
+  if (d > FAST_MATH_PI) d -= 2 * FAST_MATH_PI;
+  if (d < -FAST_MATH_PI) d += 2 * FAST_MATH_PI;
+  return fabs(d);
+}
+
+static double unitDiff(double a, double b) {  // units of pi/32768, mod 65536
+  double d = fmod(a - b, 65536.0);
+  if (d > 32768) d -= 65536;
+  if (d < -32768) d += 65536;
+  return fabs(d);
+}
+
+// ---- accuracy ----
+
+struct SqrtErrors {
+  double rsqrt, sqrt, rsqrt_coarse, sqrt_coarse;
+};
+
+static void sqrtPoint(float x, SqrtErrors& e) {
+  double root = sqrt((double)x), inv = 1 / root;
+  e.rsqrt = fmax(e.rsqrt, fabs(fastRsqrt(x) - inv) / inv);
+  e.sqrt = fmax(e.sqrt, fabs(fastSqrt(x) - root) / root);
+  e.rsqrt_coarse = fmax(e.rsqrt_coarse, fabs(fastRsqrtCoarse(x) - inv) / inv);
+  e.sqrt_coarse = fmax(e.sqrt_coarse, fabs(fastSqrtCoarse(x) - root) / root);
+}
+
+static void checkSqrt() {
+  SqrtErrors e = {0, 0, 0, 0};
+  for (uint32_t b = 0x3F800000u; b < 0x40800000u; b += 1u << SWEEP_SHIFT) sqrtPoint(fastMathFloat(b), e);
+  for (uint32_t i = 0; i < (1u << (20 - SWEEP_SHIFT)); i++) {
+    uint32_t b = (rnd() % 0x7F000000u) + 0x00800000u;  // any positive normal float
+    sqrtPoint(fastMathFloat(b), e);
+  }
+  report("fastRsqrt", e.rsqrt, FAST_RSQRT_REL_ERROR, "rel");
+  report("fastSqrt", e.sqrt, FAST_SQRT_REL_ERROR, "rel");
+  report("fastRsqrtCoarse", e.rsqrt_coarse, FAST_RSQRT_COARSE_REL_ERROR, "rel");
+  report("fastSqrtCoarse", e.sqrt_coarse, FAST_SQRT_COARSE_REL_ERROR, "rel");
+
+  bool zeros = fastSqrt(0) == 0 && fastSqrt(-1) == 0 && fastSqrt(1e-40f) == 0 && fastSqrtCoarse(0) == 0;
+  if (!zeros) failures++;
+  OUT("  %-18s %s\n", "sqrt of 0/neg/den", zeros ? "0" : "NOT 0");
+}
+
+static void checkAtan2() {
+  double worst = 0, worst_coarse = 0;
+  const float radii[] = {1e-30f, 1e-3f, 1, 37, 1e4f, 1e30f};
+  for (float r : radii) {
+    for (uint32_t i = 0; i < (1u << (20 - SWEEP_SHIFT)); i++) {
+      double t = 2 * FAST_MATH_PI * i / (1u << (20 - SWEEP_SHIFT));
+      float y = (float)(r * sin(t)), x = (float)(r * cos(t));
+      double ref = atan2((double)y, (double)x);
+      worst = fmax(worst, angleDiff(fastAtan2(y, x), ref));
+      worst_coarse = fmax(worst_coarse, angleDiff(fastAtan2Coarse(y, x), ref));
+    }
+  }
+  for (uint32_t i = 0; i < (1u << (22 - SWEEP_SHIFT)); i++) {
+    float y = rndUniform(-1000, 1000), x = rndUniform(-1000, 1000);
+    if (i & 1) y *= 1e-3f;  // near the axes
+    double ref = atan2((double)y, (double)x);
+    worst = fmax(worst, angleDiff(fastAtan2(y, x), ref));
+    worst_coarse = fmax(worst_coarse, angleDiff(fastAtan2Coarse(y, x), ref));
+  }
+  report("fastAtan2", worst, FAST_ATAN2_ERROR, "rad");
+  report("fastAtan2Coarse", worst_coarse, FAST_ATAN2_COARSE_ERROR, "rad");
+
+  bool origin = fastAtan2(0, 0) == 0 && fastAtan2Coarse(0, 0) == 0;
+  if (!origin) failures++;
+  OUT("  %-18s %s\n", "atan2(0, 0)", origin ? "0" : "NOT 0");
+}
+
+static void checkSinCos() {
+  double worst = 0;
+  uint32_t steps = 1u << (23 - SWEEP_SHIFT);
+  for (uint32_t i = 0; i <= steps; i++) {
+    float x = (float)(-100 + 200.0 * i / steps);
+    worst = fmax(worst, fabs(fastSin(x) - sin((double)x)));
+    worst = fmax(worst, fabs(fastCos(x) - cos((double)x)));
+  }
+  report("fastSin/fastCos", worst, FAST_SIN_ERROR, "abs");
+}
+
+// floor(sqrt(x * 2^16)), exactly
+static uint32_t refSqrtQ16(uint32_t x) {
+  uint64_t n = (uint64_t)x << 16;
+  uint64_t r = (uint64_t)sqrt((double)n);
+  while (r * r > n) r--;
+  while ((r + 1) * (r + 1) <= n) r++;
+  return (uint32_t)r;
+}
+
+static void checkSqrtQ16() {
+  uint32_t wrong = 0, checked = 0, first_wrong = 0;
+  auto check = [&](uint32_t x) {
+    checked++;
+    if (fastSqrtQ16(x) != refSqrtQ16(x) && wrong++ == 0) first_wrong = x;
+  };
+  for (uint32_t x = 0; x < (1u << 24); x += 1u << SWEEP_SHIFT) check(x);
+  // Both sides of the inputs where the result steps: x * 2^16 = m^2
+  for (uint64_t m = 1u << 12; m < (1u << 24); m += 1 + ((uint64_t)rnd() & ((1u << SWEEP_SHIFT) - 1))) {
+    uint32_t x = (uint32_t)((m * m) >> 16);
+    check(x - 1);
+    check(x);
+    check(x + 1);
+  }
+  for (uint32_t i = 0; i < (1u << (24 - SWEEP_SHIFT)); i++) check(rnd());
+  check(0xFFFFFFFFu);
+  if (wrong) {
+    failures++;
+    OUT("  %-18s %u of %u wrong, first at %u\n", "fastSqrtQ16", (unsigned)wrong, (unsigned)checked,
+        (unsigned)first_wrong);
+  } else {
+    OUT("  %-18s exact on %u inputs\n", "fastSqrtQ16", (unsigned)checked);
+  }
+}
+
+static void checkAtan2Q15() {
+  double worst = 0;
+  auto check = [&](int16_t y, int16_t x) {
+    if (x == 0 && y == 0) return;
+    worst = fmax(worst, unitDiff(fastAtan2Q15(y, x), atan2((double)y, (double)x) * (32768 / FAST_MATH_PI)));
+  };
+  const int16_t fixed[] = {-32768, -32767, -20000, -1000, -1, 1, 7, 300, 16384, 32767};
+  for (int16_t f : fixed) {
+    for (int32_t v = -32768; v < 32768; v += 1 << SWEEP_SHIFT) {
+      check((int16_t)v, f);
+      check(f, (int16_t)v);
+    }
+  }
+  for (uint32_t i = 0; i < (1u << (24 - SWEEP_SHIFT)); i++) {
+    uint32_t r = rnd();
+    check((int16_t)(r >> 16), (int16_t)r);
+  }
+  report("fastAtan2Q15", worst, FAST_ATAN2_Q15_ERROR, "LSB");
+}
+
+static void checkSinQ15() {
+  double worst = 0;
+  for (int32_t a = -32768; a < 32768; a++) {
+    double t = a * (FAST_MATH_PI / 32768);
+    worst = fmax(worst, fabs(fastSinQ15((int16_t)a) - fmin(sin(t) * 32768, 32767)));
+    worst = fmax(worst, fabs(fastCosQ15((int16_t)a) - fmin(cos(t) * 32768, 32767)));
+  }
+  report("fastSinQ15/CosQ15", worst, FAST_SIN_Q15_ERROR, "LSB");
+}
+
+// ---- speed ----
+
+static const int N = 1024;
+static float in_a[N], in_b[N];
+static uint32_t in_u[N];
+static int16_t in_y[N], in_x[N];
+static volatile float float_sink;
+static volatile uint32_t int_sink;
+
+template <class F>
+static double nsPerCall(F f) {
+  float acc = 0;
+  uint32_t calls = 0, start = nowUs(), elapsed;
+  do {
+    for (int i = 0; i < N; i++) acc += f(i);
+    calls += N;
+    elapsed = nowUs() - start;
+  } while (elapsed < TIME_US);
+  float_sink = acc;
+  return elapsed * 1000.0 / calls;
+}
+
+template <class F>
+static double nsPerCallInt(F f) {
+  uint32_t acc = 0, calls = 0, start = nowUs(), elapsed;
+  do {
+    for (int i = 0; i < N; i++) acc += (uint32_t)f(i);
+    calls += N;
+    elapsed = nowUs() - start;
+  } while (elapsed < TIME_US);
+  int_sink = acc;
+  return elapsed * 1000.0 / calls;
+}
+
+static void row(const char* kernel, double ns, const char* libm, double libm_ns) {
+  OUT("  %-18s %7.2f ns   %-22s %7.2f ns   x%.1f\n", kernel, ns, libm, libm_ns, libm_ns / ns);
+}
+
+static void benchmark() {
+  for (int i = 0; i < N; i++) {
+    in_a[i] = expf(rndUniform(-7, 7));  // 1e-3 .. 1e3
+    in_b[i] = rndUniform(-10, 10);
+    in_u[i] = rnd() >> (rnd() & 15);
+    in_y[i] = (int16_t)rnd();
+    in_x[i] = (int16_t)rnd();
+  }
+  double libm;
+  libm = nsPerCall([](int i) { return sqrtf(in_a[i]); });
+  row("fastSqrt", nsPerCall([](int i) { return fastSqrt(in_a[i]); }), "sqrtf", libm);
+  row("fastSqrtCoarse", nsPerCall([](int i) { return fastSqrtCoarse(in_a[i]); }), "sqrtf", libm);
+  libm = nsPerCall([](int i) { return 1 / sqrtf(in_a[i]); });
+  row("fastRsqrt", nsPerCall([](int i) { return fastRsqrt(in_a[i]); }), "1/sqrtf", libm);
+  row("fastRsqrtCoarse", nsPerCall([](int i) { return fastRsqrtCoarse(in_a[i]); }), "1/sqrtf", libm);
+  libm = nsPerCall([](int i) { return atan2f(in_b[i], in_b[(i + 1) & (N - 1)]); });
+  row("fastAtan2", nsPerCall([](int i) { return fastAtan2(in_b[i], in_b[(i + 1) & (N - 1)]); }), "atan2f", libm);
+  row("fastAtan2Coarse", nsPerCall([](int i) { return fastAtan2Coarse(in_b[i], in_b[(i + 1) & (N - 1)]); }),
+      "atan2f", libm);
+  libm = nsPerCall([](int i) { return sinf(in_b[i]); });
+  row("fastSin", nsPerCall([](int i) { return fastSin(in_b[i]); }), "sinf", libm);
+  libm = nsPerCall([](int i) { return cosf(in_b[i]); });
+  row("fastCos", nsPerCall([](int i) { return fastCos(in_b[i]); }), "cosf", libm);
+  libm = nsPerCallInt([](int i) { return (uint32_t)(sqrtf(in_u[i] * (1.0f / 65536)) * 65536); });
+  row("fastSqrtQ16", nsPerCallInt([](int i) { return fastSqrtQ16(in_u[i]); }), "sqrtf round trip", libm);
+  libm = nsPerCallInt([](int i) { return (int16_t)(atan2f(in_y[i], in_x[i]) * (float)(32768 / FAST_MATH_PI)); });
+  row("fastAtan2Q15", nsPerCallInt([](int i) { return fastAtan2Q15(in_y[i], in_x[i]); }), "atan2f round trip", libm);
+  libm = nsPerCallInt([](int i) { return (int16_t)(sinf(in_y[i] * (float)(FAST_MATH_PI / 32768)) * 32767); });
+  row("fastSinQ15", nsPerCallInt([](int i) { return fastSinQ15(in_y[i]); }), "sinf round trip", libm);
+}
+
+static int run() {
+  OUT("accuracy, against libm in double precision\n");
+  checkSqrt();
+  checkAtan2();
+  checkSinCos();
+  checkSqrtQ16();
+  checkAtan2Q15();
+  checkSinQ15();
+  OUT("speed, ns per call\n");
+  benchmark();
+  OUT("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
+
+#if defined(ARDUINO)
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  run();
+}
+
+void loop() { delay(1000); }
+#else
+int main() { return run(); }
+#endif
@@ -0,0 +1,1196 @@
+// Virtual wearable fleet for scale testing the monitoring stack (Linux).
+//
+// Runs N devices in one process. Half behave like iot/newfallseizurelogic.cpp
+// and half like combinedsense.cpp, and each runs the firmware's own code:
+//
+//   fall devices    FallDetector and SeizureDetector (detectors.h) at 10 Hz,
+//                   with the sketch's thresholds. A Telegram POST goes out on
+//                   a fall and when a seizure escalates to flag 2 after
+//                   SEIZURE_ALERT_MS; a carer clears the latched flags later.
+//   vitals devices  combinedsense's default rules in a RuleEngine, fed by
+//                   VitalsStats trends. Alerts go through an AlertScheduler SMS
+//                   channel with its two lanes. Telemetry is framed by
+//                   TelemetryFramer and batched as TelemetryUplink does:
+//                   one batch in flight, 10 s or urgent, replay after outages.
+//
+// Patients are synthetic, in the style of threshold_sweep's generator. They
+// have falls, seizures of 20-90 s, tachycardia, desaturation, slow sepsis
+// drifts, and look-alikes (sitting down hard, brisk walking). Devices lose
+// WiFi now and then and reboot now and then; a reboot restarts millis(),
+// clears the detectors and loses the RAM part of the telemetry queue.
+//
+// Devices are split into shards, one thread per shard. A shard owns its
+// devices, a timer wheel of their next wake-ups (1 ms slots) and one
+// pipelined keep-alive HTTP connection; no shard writes anything another
+// reads. Virtual time runs at --speed times wall time (0: as fast as the
+// shard can go).
+//
+// Traffic is HTTP POST to --endpoint host:port, on the real services' paths:
+//
+//   /bot<token>/sendMessage                     Telegram alerts, 200 = sent
+//   /2010-04-01/Accounts/<sid>/Messages.json    SMS alerts, 201 = sent
+//   /telemetry/byteheal-<id>                    TelemetryBatchHeader + frames,
+//                                               2xx = acknowledged
+//
+// Telemetry goes over HTTP with the MQTT payload unchanged, as there is no
+// MQTT client here. Without --endpoint a built-in sink on loopback answers
+// and checks every payload. With --no-net nothing goes on the wire and every
+// request succeeds at once, which measures the simulation alone.
+//
+//   g++ -O2 -std=c++17 -pthread -o fleet_sim tools/fleet_sim.cpp
+//   ./fleet_sim [--devices N] [--seconds S] [--speed X] [--threads N]
+//               [--endpoint HOST:PORT | --no-net] [--events-per-hour E]
+//               [--wifi-mtbf-s S] [--reboot-mtbf-s S] [--seed S]
+//
+// The report gives simulator throughput in device-seconds per wall-second. Exit
+// status is non-zero if the built-in sink saw a malformed request, if its
+// counts differ from what the devices were answered, or if fewer than 90 % of
+// the falls and long seizures on devices that stayed up were alerted.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../detectors.h"
+#include "../rule_engine.h"
+#include "../vitals_stats.h"
+#include "../alert_scheduler.h"
+#include "../telemetry_frame.h"
+
+// As in iot/newfallseizurelogic.cpp
+static const float FREEFALL_G = 0.5;
+static const float GYRO_FALL_DEG_S = 100;
+static const float SEIZURE_RMS_THR = 80;
+static const uint32_t DEBOUNCE_MS = 100;
+static const uint32_t SAMPLE_DELAY_MS = 100;
+static const uint32_t SEIZURE_ALERT_MS = 13000;
+
+// As in combinedsense.cpp (the loop runs every 10 ms there, every 100 ms here)
+static const float ACCEL_MOTION_G = 3.0f;
+static const float GYRO_MOTION_DPS = 50.0f;
+static const float SMS_BURST = 4;
+static const float SMS_PER_HOUR = 60;
+static const uint32_t SMS_HTTP_TIMEOUT_MS = 8000;
+
+// defaultRules() with the default MedicalThresholds
+static const char* DEFAULT_RULES =
+    "CRITICAL 60000 0 Extreme Tachycardia: hr > 140\n"
+    "CRITICAL 60000 0 Extreme Bradycardia: hr < 50\n"
+    "CRITICAL 60000 0 Severe Hypoxemia: spo2 < 85\n"
+    "CRITICAL 60000 0 Violent Motion: accel > 5\n"
+    "CRITICAL 60000 0 Violent Rotation: gyro > 100\n"
+    "CRITICAL 60000 0 Prolonged Seizure Activity: motion_ms > 30000\n"
+    "SEIZURE 180000 0 High HR: hr > 120\n"
+    "SEIZURE 180000 0 Low SpO2: spo2 < 90\n"
+    "SEIZURE 180000 0 Prolonged Motion: motion_ms > 10000\n"
+    "SEPSIS 300000 0 Tachycardia: hr_p50 > 100\n"
+    "SEPSIS 300000 0 Bradycardia: hr_p50 < 60 & hr_p50 > 0\n"
+    "SEPSIS 300000 0 Hypoxemia: spo2_p50 < 95 & spo2_p50 > 0\n"
+    "SEPSIS 300000 0 HR Above Baseline: hr_dev > 15 & hr_cusum > 150\n"
+    "SEPSIS 300000 0 SpO2 Below Baseline: spo2_dev < -3 & spo2_cusum > 30\n";
+
+static const uint32_t BOOT_MS = 3000;          // reset to first sample
+static const uint32_t WIFI_CONNECT_MS = 4000;  // after boot
+static const uint32_t WHEEL_SLOTS = 1024;      // 1 ms each
+static const size_t PIPELINE_DEPTH = 256;      // requests in flight per shard
+
+struct Options {
+  uint32_t devices = 2000;
+  double seconds = 3600;
+  double speed = 0;
+  int threads = 0;
+  std::string host = "127.0.0.1";
+  int port = 0;  // 0: built-in sink
+  bool no_net = false;
+  double events_per_hour = 2;
+  double wifi_mtbf_s = 1800;
+  double reboot_mtbf_s = 6 * 3600;
+  uint32_t seed = 1;
+};
+
+// ---- Random numbers ----
+
+static inline uint32_t xorshift(uint32_t& s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+static inline float uniform(uint32_t& s) { return (xorshift(s) >> 8) * (1.0f / 16777216.0f); }
+
+// Roughly N(0, 1): four uniforms
+static inline float gauss(uint32_t& s) {
+  return (uniform(s) + uniform(s) + uniform(s) + uniform(s) - 2.0f) * 1.7320508f;
+}
+
+static inline uint64_t exponentialMs(uint32_t& s, double mean_s) {
+  return (uint64_t)(-log(1.0 - uniform(s)) * mean_s * 1000) + 1;
+}
+
+// ---- Synthetic patient ----
+
+enum EventType { EV_NONE, EV_FALL, EV_SEIZURE, EV_TACHY, EV_DESAT, EV_SEPSIS, EV_SIT, EV_WALK };
+
+struct Patient {
+  float hr_base, spo2_base;
+  EventType event;
+  uint64_t event_start, event_end;  // virtual ms
+  float amp;
+  uint64_t next_event;
+};
+
+struct Sample {
+  float amag_g, wx, wy, wz;  // IMU
+  float hr, spo2;
+};
+
+static void patientBegin(Patient& p, uint32_t& rng, const Options& o) {
+  p.hr_base = 64 + 16 * uniform(rng);
+  p.spo2_base = 96.5f + 2 * uniform(rng);
+  p.event = EV_NONE;
+  p.event_start = p.event_end = 0;
+  p.next_event = exponentialMs(rng, 3600 / o.events_per_hour);
+}
+
+// Starts the next event when due; returns the one just started, if any
+static EventType patientStep(Patient& p, uint32_t& rng, const Options& o, uint64_t t) {
+  if (p.event != EV_NONE && t >= p.event_end) p.event = EV_NONE;
+  if (p.event != EV_NONE || t < p.next_event) return EV_NONE;
+  float r = uniform(rng);
+  uint32_t len_ms;
+  if (r < 0.2f) {
+    p.event = EV_FALL;
+    len_ms = 250 + (uint32_t)(150 * uniform(rng));
+    p.amp = 120 + 120 * uniform(rng);  // spin while tumbling
+  } else if (r < 0.35f) {
+    p.event = EV_SEIZURE;
+    len_ms = 20000 + (uint32_t)(70000 * uniform(rng));
+    p.amp = 140 + 120 * uniform(rng);
+  } else if (r < 0.45f) {
+    p.event = EV_TACHY;
+    len_ms = 60000 + (uint32_t)(240000 * uniform(rng));
+    p.amp = 55 + 30 * uniform(rng);
+  } else if (r < 0.55f) {
+    p.event = EV_DESAT;
+    len_ms = 30000 + (uint32_t)(120000 * uniform(rng));
+    p.amp = 6 + 10 * uniform(rng);
+  } else if (r < 0.6f) {
+    p.event = EV_SEPSIS;
+    len_ms = 1800000 + (uint32_t)(1800000 * uniform(rng));
+    p.amp = 35;
+  } else if (r < 0.8f) {
+    p.event = EV_SIT;
+    len_ms = 120 + (uint32_t)(100 * uniform(rng));
+    p.amp = 60 + 60 * uniform(rng);
+  } else {
+    p.event = EV_WALK;
+    len_ms = 30000 + (uint32_t)(90000 * uniform(rng));
+    p.amp = 30 + 40 * uniform(rng);
+  }
+  p.event_start = t;
+  p.event_end = t + len_ms;
+  p.next_event = p.event_end + exponentialMs(rng, 3600 / o.events_per_hour);
+  return p.event;
+}
+
+static Sample patientSample(const Patient& p, uint32_t& rng, uint64_t t) {
+  Sample s;
+  s.amag_g = 1.0f + 0.03f * gauss(rng);
+  s.wx = 3 * gauss(rng);
+  s.wy = 3 * gauss(rng);
+  s.wz = 3 * gauss(rng);
+  s.hr = p.hr_base + 1.5f * gauss(rng);
+  s.spo2 = p.spo2_base + 0.4f * gauss(rng);
+  float since = (float)(t - p.event_start);
+  switch (p.event) {
+    case EV_FALL:
+      s.amag_g = 0.15f + 0.2f * uniform(rng);
+      s.wx = p.amp;
+      break;
+    case EV_SEIZURE:
+      // 4 Hz shaking, sampled at 10 Hz
+      s.wy += p.amp * sinf(2 * (float)M_PI * 4 * since / 1000 + 0.3f);
+      s.amag_g += 0.8f * fabsf(sinf(2 * (float)M_PI * 4 * since / 1000));
+      s.hr += 30;
+      break;
+    case EV_TACHY: s.hr += p.amp; break;
+    case EV_DESAT: s.spo2 -= p.amp; break;
+    case EV_SEPSIS:
+      s.hr += p.amp * fminf(1.0f, since / 1800000);
+      s.spo2 -= 4 * fminf(1.0f, since / 1800000);
+      break;
+    case EV_SIT:
+      s.amag_g = 0.45f + 0.3f * uniform(rng);
+      s.wz = p.amp;
+      break;
+    case EV_WALK: s.wx += p.amp * sinf(2 * (float)M_PI * 2 * since / 1000); break;
+    default: break;
+  }
+  if (s.spo2 > 100) s.spo2 = 100;
+  return s;
+}
+
+// ---- Devices ----
+
+enum DeviceKind : uint8_t { KIND_FALL, KIND_VITALS };
+enum RequestKind : uint8_t { REQ_TELEGRAM, REQ_SMS, REQ_TELEMETRY };
+
+struct FallState {
+  FallDetector fall{{FREEFALL_G, GYRO_FALL_DEG_S, DEBOUNCE_MS, 0}};
+  SeizureDetector seizure{{SEIZURE_RMS_THR, 100, SEIZURE_ALERT_MS}};
+  int prev_fall = 0;
+  int prev_seizure = 0;
+  uint64_t fall_reset_at = 0;      // carer presses reset, 0 = nothing latched
+  uint64_t seizure_reset_at = 0;
+  // Scoring: the event currently being looked for
+  uint64_t fall_window_end = 0;
+  uint64_t seizure_window_end = 0;
+};
+
+struct VitalsState {
+  RuleEngine rules;
+  VitalsStats stats;
+  AlertScheduler alerts;
+  int sms = -1;
+  TelemetryFramer framer;
+  float trend[METRIC_COUNT];
+  float hr = 0, spo2 = 0;
+  uint32_t last_vitals_ms = 0;
+  bool motion = false;
+  uint32_t motion_start = 0;
+  bool critical = false, seizure = false, sepsis = false;
+  // SMS lanes
+  bool lane_busy[ALERT_LANE_COUNT] = {};
+  uint32_t lane_sent_ms[ALERT_LANE_COUNT] = {};
+  uint32_t lane_retry_ms[ALERT_LANE_COUNT] = {};
+  uint32_t lane_gen[ALERT_LANE_COUNT] = {};
+  // Uplink queue, oldest first (RAM ring and flash ring together)
+  std::deque<TelemetryFrame> queue;
+  uint32_t in_flight = 0;
+  uint32_t in_flight_gen = 0;
+  uint32_t last_publish_ms = 0;
+  bool urgent = false;
+};
+
+struct Device {
+  uint32_t id;
+  DeviceKind kind;
+  uint32_t rng;
+  Patient patient;
+  uint64_t boot_at;        // virtual ms of the last reset; millis() counts from here
+  uint64_t up_at;          // first sample after the reset
+  uint64_t wifi_at;        // connected from here, unless down
+  uint64_t wifi_change;    // next dropout or recovery
+  bool wifi_down;
+  uint64_t next_reboot;
+  uint32_t gen;            // bumped by resets and dropouts: stale answers are ignored
+  uint64_t last_reboot;
+  std::unique_ptr<FallState> f;
+  std::unique_ptr<VitalsState> v;
+
+  uint32_t millisAt(uint64_t t) const { return (uint32_t)(t - boot_at); }
+  bool online(uint64_t t) const { return !wifi_down && t >= wifi_at; }
+};
+
+struct alignas(64) ShardStats {
+  uint64_t wakes = 0;
+  uint64_t device_ms = 0;          // virtual time simulated, summed over devices
+  uint64_t reboots = 0, dropouts = 0;
+  uint64_t events[8] = {};
+  // Fall devices
+  uint64_t falls_scored = 0, falls_alerted = 0;
+  uint64_t seizures_scored = 0, seizures_escalated = 0;
+  uint64_t telegram_sent = 0, telegram_skipped = 0, telegram_failed = 0;
+  // Vitals devices
+  uint64_t rule_alerts = 0;
+  uint64_t sms_sent = 0, sms_failed = 0, sms_deferred = 0, sms_timeouts = 0;
+  uint64_t frames = 0, frames_acked = 0, frames_dropped = 0, frames_lost_reboot = 0;
+  uint64_t batches = 0;
+  // Requests that were answered, by kind, and the frames in answered batches
+  uint64_t answered[3] = {};
+  uint64_t answered_frames = 0;
+  uint64_t http_errors = 0;
+  uint64_t bytes = 0;
+  std::vector<uint32_t> latency_us;
+};
+
+// ---- Pipelined HTTP/1.1 client, one connection per shard ----
+
+struct PendingRequest {
+  uint32_t device;  // index in the shard
+  RequestKind kind;
+  uint8_t lane;
+  uint16_t frames;
+  uint32_t gen;
+  std::chrono::steady_clock::time_point sent;
+};
+
+class HttpPipe {
+public:
+  void begin(const std::string& host, int port, bool dry) {
+    this->host = host;
+    this->port = port;
+    this->dry = dry;
+  }
+
+  ~HttpPipe() {
+    if (fd >= 0) close(fd);
+  }
+
+  size_t inFlight() const { return pending.size(); }
+
+  // Queue a POST; it is written on the next poll()
+  void post(const std::string& path, const char* type, const void* body, size_t len, const PendingRequest& p,
+            ShardStats& stats) {
+    char head[320];
+    int n = snprintf(head, sizeof(head),
+                     "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                     "Connection: keep-alive\r\n\r\n",
+                     path.c_str(), host.c_str(), type, len);
+    stats.bytes += n + len;
+    pending.push_back(p);
+    if (dry) return;
+    out.append(head, n);
+    out.append((const char*)body, len);
+  }
+
+  // Write what is queued, read what came back; `answer(request, status)` for
+  // each response, status -1 when the connection failed under it
+  template <typename F>
+  void poll(int timeout_ms, F answer) {
+    if (dry) {
+      while (!pending.empty()) {
+        PendingRequest p = pending.front();
+        pending.pop_front();
+        answer(p, p.kind == REQ_SMS ? 201 : 200);
+      }
+      return;
+    }
+    if (fd < 0 && !pending.empty() && !connect()) {
+      fail(answer);
+      return;
+    }
+    if (fd < 0) {
+      if (timeout_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+      return;
+    }
+    struct pollfd pfd = {fd, (short)(POLLIN | (out.empty() ? 0 : POLLOUT)), 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0) return;
+    if (pfd.revents & POLLOUT) {
+      ssize_t w = send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+      if (w > 0) out.erase(0, w);
+      else if (w < 0 && errno != EAGAIN) {
+        fail(answer);
+        return;
+      }
+    }
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+      char buf[65536];
+      ssize_t r = recv(fd, buf, sizeof(buf), 0);
+      if (r <= 0 && !(r < 0 && errno == EAGAIN)) {
+        fail(answer);
+        return;
+      }
+      if (r > 0) in.append(buf, r);
+      parse(answer);
+    }
+  }
+
+private:
+  std::string host;
+  int port = 0;
+  bool dry = false;
+  int fd = -1;
+  std::string out, in;
+  std::deque<PendingRequest> pending;
+
+  bool connect() {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return true;
+  }
+
+  template <typename F>
+  void fail(F& answer) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+    out.clear();
+    in.clear();
+    while (!pending.empty()) {
+      PendingRequest p = pending.front();
+      pending.pop_front();
+      answer(p, -1);
+    }
+  }
+
+  template <typename F>
+  void parse(F& answer) {
+    for (;;) {
+      size_t end = in.find("\r\n\r\n");
+      if (end == std::string::npos) return;
+      int status = 0;
+      sscanf(in.c_str(), "HTTP/1.%*d %d", &status);
+      size_t body = 0;
+      const char* cl = strcasestr(in.c_str(), "\r\nContent-Length:");
+      if (cl && (size_t)(cl - in.c_str()) < end) body = strtoul(cl + 17, NULL, 10);
+      if (in.size() < end + 4 + body) return;
+      in.erase(0, end + 4 + body);
+      if (pending.empty()) continue;
+      PendingRequest p = pending.front();
+      pending.pop_front();
+      answer(p, status);
+    }
+  }
+};
+
+// ---- Timer wheel: next wake-up per device ----
+
+class TimerWheel {
+public:
+  void begin(size_t devices) {
+    head.assign(WHEEL_SLOTS, -1);
+    next.assign(devices, -1);
+    due.assign(devices, 0);
+  }
+
+  void schedule(int device, uint64_t at) {
+    due[device] = at;
+    int32_t& slot = head[at % WHEEL_SLOTS];
+    next[device] = slot;
+    slot = device;
+  }
+
+  // Devices due at `t` into `out`; the ones due in a later turn stay
+  void expire(uint64_t t, std::vector<int>& out) {
+    int32_t d = head[t % WHEEL_SLOTS];
+    head[t % WHEEL_SLOTS] = -1;
+    while (d >= 0) {
+      int32_t n = next[d];
+      if (due[d] == t) out.push_back(d);
+      else schedule(d, due[d]);
+      d = n;
+    }
+  }
+
+private:
+  std::vector<int32_t> head;
+  std::vector<int32_t> next;
+  std::vector<uint64_t> due;
+};
+
+// ---- One shard ----
+
+class Shard {
+public:
+  ShardStats stats;
+
+  void begin(const Options& o, uint32_t first, uint32_t count) {
+    opt = o;
+    devices.resize(count);
+    wheel.begin(count);
+    pipe.begin(o.host, o.port, o.no_net);
+    for (uint32_t i = 0; i < count; i++) {
+      Device& d = devices[i];
+      d.id = first + i;
+      d.kind = d.id % 2 ? KIND_VITALS : KIND_FALL;
+      d.rng = (o.seed * 2654435761u) ^ (0x9E3779B9u * (d.id + 1));
+      xorshift(d.rng);
+      patientBegin(d.patient, d.rng, o);
+      d.wifi_down = false;
+      d.wifi_change = exponentialMs(d.rng, o.wifi_mtbf_s);
+      d.next_reboot = exponentialMs(d.rng, o.reboot_mtbf_s);
+      d.gen = 0;
+      d.last_reboot = 0;
+      // Devices come up over the first 10 s
+      reset(d, (uint64_t)(10000 * uniform(d.rng)));
+      wheel.schedule(i, d.up_at);
+    }
+  }
+
+  void run(uint64_t end_ms) {
+    auto wall0 = std::chrono::steady_clock::now();
+    std::vector<int> due;
+    auto answer = [this](const PendingRequest& p, int status) { onAnswer(p, status); };
+    while (now < end_ms) {
+      uint64_t target = end_ms;
+      if (opt.speed > 0) {
+        double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall0).count();
+        target = std::min(end_ms, (uint64_t)(wall_ms * opt.speed));
+      }
+      while (now < target && pipe.inFlight() < PIPELINE_DEPTH) {
+        due.clear();
+        wheel.expire(now, due);
+        for (int i : due) wake(i);
+        now++;
+        if (now % 16 == 0) pipe.poll(0, answer);
+      }
+      int wait = pipe.inFlight() >= PIPELINE_DEPTH ? 5 : (opt.speed > 0 && now >= target ? 1 : 0);
+      pipe.poll(wait, answer);
+    }
+    // Let the last requests come back
+    auto drain = std::chrono::steady_clock::now();
+    while (pipe.inFlight() && std::chrono::steady_clock::now() - drain < std::chrono::seconds(5)) pipe.poll(10, answer);
+    stats.device_ms = (uint64_t)devices.size() * end_ms;
+  }
+
+private:
+  Options opt;
+  std::vector<Device> devices;
+  TimerWheel wheel;
+  HttpPipe pipe;
+  uint64_t now = 0;
+
+  // Power-on or watchdog reset at `t`: millis() restarts, RAM state is gone
+  void reset(Device& d, uint64_t t) {
+    d.boot_at = t;
+    d.up_at = t + BOOT_MS;
+    d.wifi_at = t + WIFI_CONNECT_MS;
+    d.gen++;
+    if (d.kind == KIND_FALL) {
+      d.f.reset(new FallState);
+      return;
+    }
+    std::deque<TelemetryFrame> kept;
+    if (d.v) {
+      // The RAM ring is lost; what was spilled to flash survives
+      size_t ram = std::min(d.v->queue.size(), (size_t)(UPLINK_RAM_FRAMES - UPLINK_SPILL_FRAMES / 2));
+      stats.frames_lost_reboot += ram;
+      d.v->queue.resize(d.v->queue.size() - ram);
+      kept.swap(d.v->queue);
+    }
+    d.v.reset(new VitalsState);
+    VitalsState& v = *d.v;
+    v.queue.swap(kept);
+    char error[RULE_ERROR_LEN];
+    v.rules.load(DEFAULT_RULES, error, sizeof(error));
+    v.stats.begin();
+    v.sms = v.alerts.addChannel("SMS", 0xFF, SMS_BURST, SMS_PER_HOUR, 0);
+    for (int k = 0; k < METRIC_COUNT; k++) v.trend[k] = 0;
+    v.alerts.submit(ALERT_SYSTEM, "Medical Alert System Online", 0);
+  }
+
+  void wake(int i) {
+    Device& d = devices[i];
+    uint64_t t = now;
+    stats.wakes++;
+
+    if (t >= d.next_reboot) {
+      stats.reboots++;
+      d.last_reboot = t;
+      d.next_reboot = t + exponentialMs(d.rng, opt.reboot_mtbf_s);
+      reset(d, t);
+      wheel.schedule(i, d.up_at);
+      return;
+    }
+    if (t >= d.wifi_change) {
+      d.wifi_down = !d.wifi_down;
+      if (d.wifi_down) {
+        stats.dropouts++;
+        d.gen++;
+        d.wifi_change = t + 5000 + (uint64_t)(115000 * uniform(d.rng));
+      } else {
+        d.wifi_change = t + exponentialMs(d.rng, opt.wifi_mtbf_s);
+      }
+    }
+
+    EventType started = patientStep(d.patient, d.rng, opt, t);
+    if (started != EV_NONE) {
+      stats.events[started]++;
+      if (d.kind == KIND_FALL) score(d, started, t);
+    }
+    Sample s = patientSample(d.patient, d.rng, t);
+    if (d.kind == KIND_FALL) wakeFall(i, d, s, t);
+    else wakeVitals(i, d, s, t);
+    wheel.schedule(i, t + SAMPLE_DELAY_MS);
+  }
+
+  // A fall or long seizure counts if nothing is latched when it starts and
+  // the device stays up through it
+  void score(Device& d, EventType e, uint64_t t) {
+    FallState& f = *d.f;
+    if (e == EV_FALL && f.prev_fall == 0 && t + 2000 < d.next_reboot) {
+      f.fall_window_end = d.patient.event_end + 1000;
+      stats.falls_scored++;
+    }
+    if (e == EV_SEIZURE && d.patient.event_end - t >= 40000 && f.prev_seizure == 0 && f.seizure.flag() == 0 &&
+        d.patient.event_end + 1000 < d.next_reboot) {
+      f.seizure_window_end = d.patient.event_end + 1000;
+      stats.seizures_scored++;
+    }
+  }
+
+  void wakeFall(int i, Device& d, const Sample& s, uint64_t t) {
+    FallState& f = *d.f;
+    uint32_t ms = d.millisAt(t);
+    int fall = f.fall.update(ms, s.amag_g, s.wx, s.wy, s.wz);
+    float wmag = sqrtf(s.wx * s.wx + s.wy * s.wy + s.wz * s.wz);
+    int seizure = f.seizure.update(ms, wmag);
+
+    if (fall == 1 && f.prev_fall == 0) {
+      if (f.fall_window_end && t <= f.fall_window_end) stats.falls_alerted++;
+      f.fall_window_end = 0;
+      f.fall_reset_at = t + 30000 + (uint64_t)(270000 * uniform(d.rng));
+      telegram(i, d, t, "🚨 FALL DETECTED! Check patient immediately!");
+    }
+    if (seizure == 2 && f.prev_seizure != 2) {
+      if (f.seizure_window_end && t <= f.seizure_window_end) stats.seizures_escalated++;
+      f.seizure_window_end = 0;
+      f.seizure_reset_at = t + 30000 + (uint64_t)(270000 * uniform(d.rng));
+      telegram(i, d, t, "⚠️ SEVERE SEIZURE (13s+ detected)! Emergency!");
+    }
+    if (f.fall_window_end && t > f.fall_window_end) f.fall_window_end = 0;
+    if (f.seizure_window_end && t > f.seizure_window_end) f.seizure_window_end = 0;
+    f.prev_fall = fall;
+    f.prev_seizure = seizure;
+
+    // The carer's reset buttons
+    if (f.fall_reset_at && t >= f.fall_reset_at) {
+      f.fall.reset();
+      f.fall_reset_at = 0;
+      f.prev_fall = 0;
+    }
+    if (f.seizure_reset_at && t >= f.seizure_reset_at) {
+      f.seizure.reset();
+      f.seizure_reset_at = 0;
+      f.prev_seizure = 0;
+    }
+  }
+
+  void telegram(int i, Device& d, uint64_t t, const char* message) {
+    if (!d.online(t)) {
+      stats.telegram_skipped++;
+      return;
+    }
+    std::string body = std::string("chat_id=5550100&text=") + message + "&disable_notification=false";
+    PendingRequest p = {(uint32_t)i, REQ_TELEGRAM, 0, 0, d.gen, std::chrono::steady_clock::now()};
+    pipe.post("/botFLEETSIM/sendMessage", "application/x-www-form-urlencoded", body.data(), body.size(), p, stats);
+  }
+
+  void wakeVitals(int i, Device& d, const Sample& s, uint64_t t) {
+    VitalsState& v = *d.v;
+    uint32_t ms = d.millisAt(t);
+
+    // Pulse oximeter once a second, trends with it
+    if (ms - v.last_vitals_ms >= VITALS_SAMPLE_MS) {
+      v.last_vitals_ms = ms;
+      v.hr = s.hr;
+      v.spo2 = s.spo2;
+      v.stats.add(ms, v.hr, v.spo2);
+      VitalTrendSnapshot hr = v.stats.hr.snapshot(ms);
+      VitalTrendSnapshot spo2 = v.stats.spo2.snapshot(ms);
+      v.trend[METRIC_HR_AVG] = hr.fast;
+      v.trend[METRIC_HR_P50] = hr.p50;
+      v.trend[METRIC_HR_BASE] = hr.baseline;
+      v.trend[METRIC_HR_DEV] = hr.deviation;
+      v.trend[METRIC_HR_CUSUM] = hr.cusum;
+      v.trend[METRIC_SPO2_AVG] = spo2.fast;
+      v.trend[METRIC_SPO2_P50] = spo2.p50;
+      v.trend[METRIC_SPO2_BASE] = spo2.baseline;
+      v.trend[METRIC_SPO2_DEV] = spo2.deviation;
+      v.trend[METRIC_SPO2_CUSUM] = spo2.cusum;
+    }
+
+    // updateSensorReadings(): FIFO maxima over the pass
+    float accel = s.amag_g;
+    float gyro = sqrtf(s.wx * s.wx + s.wy * s.wy + s.wz * s.wz);
+    if (accel > ACCEL_MOTION_G || gyro > GYRO_MOTION_DPS) {
+      if (!v.motion) v.motion_start = ms;
+      v.motion = true;
+    } else {
+      v.motion = false;
+    }
+
+    // checkMedicalConditions()
+    float metrics[METRIC_COUNT];
+    memcpy(metrics, v.trend, sizeof(metrics));
+    metrics[METRIC_HR] = v.hr;
+    metrics[METRIC_SPO2] = v.spo2;
+    metrics[METRIC_ACCEL] = accel;
+    metrics[METRIC_GYRO] = gyro;
+    metrics[METRIC_MOTION_MS] = v.motion ? (float)(ms - v.motion_start) : 0;
+    RuleResult result = v.rules.evaluate(metrics, ms);
+    v.critical = result.top_severity == ALERT_CRITICAL;
+    v.seizure = result.top_severity == ALERT_SEIZURE;
+    v.sepsis = result.top_severity == ALERT_SEPSIS;
+    if (result.alerts) {
+      stats.rule_alerts++;
+      const RuleSet& set = v.rules.rules();
+      std::string message = std::string(alertPriorityName(result.top_severity)) + " ALERT! ";
+      for (int r = 0; r < set.rule_count; r++) {
+        if (result.alerts & (1UL << r)) message += std::string(set.rules[r].label) + " ";
+      }
+      char vitals[48];
+      snprintf(vitals, sizeof(vitals), "HR:%.2f SpO2:%.2f", v.hr, v.spo2);
+      message += vitals;
+      v.alerts.submit((AlertPriority)result.top_severity, message.c_str(), ms);
+    }
+
+    // updateUplink()
+    UplinkState state;
+    state.hr = v.hr;
+    state.spo2 = v.spo2;
+    state.accel_g = accel;
+    state.gyro_dps = gyro;
+    state.flags = (v.motion ? UPLINK_MOTION : 0) | (v.sepsis ? UPLINK_SEPSIS : 0) |
+                  (v.seizure ? UPLINK_SEIZURE : 0) | (v.critical ? UPLINK_CRITICAL : 0);
+    state.motion_ms = v.motion ? ms - v.motion_start : 0;
+    TelemetryFrame closed[2];
+    bool urgent;
+    int n = v.framer.sample(state, ms, closed, urgent);
+    if (urgent) v.urgent = true;
+    for (int k = 0; k < n; k++) {
+      stats.frames++;
+      if (v.queue.size() == UPLINK_RAM_FRAMES + UPLINK_FLASH_FRAMES) {
+        v.queue.pop_front();
+        stats.frames_dropped++;
+      }
+      v.queue.push_back(closed[k]);
+    }
+    uplinkLoop(i, d, t, ms);
+    smsLanes(i, d, t, ms);
+  }
+
+  // TelemetryUplink::loop(), with the HTTP answer as the broker's ack
+  void uplinkLoop(int i, Device& d, uint64_t t, uint32_t ms) {
+    VitalsState& v = *d.v;
+    bool online = d.online(t);
+    if (v.in_flight && (!online || ms - v.last_publish_ms >= UPLINK_ACK_TIMEOUT_MS)) {
+      v.in_flight = 0;
+      v.in_flight_gen++;
+    }
+    if (!online || v.in_flight) return;
+    bool backlog = v.queue.size() >= UPLINK_BATCH_FRAMES;
+    bool due = !v.queue.empty() && (v.urgent || ms - v.last_publish_ms >= UPLINK_BATCH_MS);
+    if (!backlog && !due) return;
+
+    uint8_t payload[sizeof(TelemetryBatchHeader) + UPLINK_BATCH_FRAMES * sizeof(TelemetryFrame)];
+    uint32_t n = std::min((uint32_t)v.queue.size(), (uint32_t)UPLINK_BATCH_FRAMES);
+    TelemetryBatchHeader header = {UPLINK_FORMAT_VERSION, (uint8_t)n, sizeof(TelemetryFrame)};
+    memcpy(payload, &header, sizeof(header));
+    for (uint32_t k = 0; k < n; k++) {
+      memcpy(payload + sizeof(header) + k * sizeof(TelemetryFrame), &v.queue[k], sizeof(TelemetryFrame));
+    }
+    char path[48];
+    snprintf(path, sizeof(path), "/telemetry/byteheal-%06x", d.id);
+    PendingRequest p = {(uint32_t)i, REQ_TELEMETRY, 0, (uint16_t)n, ++v.in_flight_gen, std::chrono::steady_clock::now()};
+    pipe.post(path, "application/octet-stream", payload, sizeof(header) + n * sizeof(TelemetryFrame), p, stats);
+    v.in_flight = n;
+    v.last_publish_ms = ms;
+    v.urgent = false;
+    stats.batches++;
+  }
+
+  // alertTask() for both lanes
+  void smsLanes(int i, Device& d, uint64_t t, uint32_t ms) {
+    VitalsState& v = *d.v;
+    for (int lane = 0; lane < ALERT_LANE_COUNT; lane++) {
+      if (v.lane_busy[lane]) {
+        if (ms - v.lane_sent_ms[lane] < SMS_HTTP_TIMEOUT_MS) continue;
+        stats.sms_timeouts++;
+        v.lane_busy[lane] = false;
+        v.lane_gen[lane]++;
+        v.alerts.complete(v.sms, (AlertLane)lane, ALERT_FAILED, ms);
+      }
+      if ((int32_t)(ms - v.lane_retry_ms[lane]) < 0) continue;
+      char message[ALERT_MESSAGE_LEN];
+      AlertPriority priority;
+      if (!v.alerts.next(v.sms, (AlertLane)lane, ms, message, sizeof(message), &priority)) continue;
+      if (!d.online(t)) {
+        stats.sms_deferred++;
+        v.alerts.complete(v.sms, (AlertLane)lane, ALERT_DEFERRED, ms);
+        v.lane_retry_ms[lane] = ms + 1000;
+        continue;
+      }
+      std::string body = std::string("To=+15550100&From=+15550199&Body=") + message;
+      PendingRequest p = {(uint32_t)i, REQ_SMS, (uint8_t)lane, 0, ++v.lane_gen[lane], std::chrono::steady_clock::now()};
+      pipe.post("/2010-04-01/Accounts/ACFLEETSIM/Messages.json", "application/x-www-form-urlencoded", body.data(),
+                body.size(), p, stats);
+      v.lane_busy[lane] = true;
+      v.lane_sent_ms[lane] = ms;
+    }
+  }
+
+  void onAnswer(const PendingRequest& p, int status) {
+    if (status > 0) {
+      stats.answered[p.kind]++;
+      if (p.kind == REQ_TELEMETRY) stats.answered_frames += p.frames;
+      stats.latency_us.push_back(
+          (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - p.sent)
+              .count());
+    } else {
+      stats.http_errors++;
+    }
+    Device& d = devices[p.device];
+    bool ok = status >= 200 && status < 300;
+    switch (p.kind) {
+      case REQ_TELEGRAM:
+        if (ok) stats.telegram_sent++;
+        else stats.telegram_failed++;
+        break;
+      case REQ_SMS: {
+        if (!d.v) break;
+        VitalsState& v = *d.v;
+        if (!v.lane_busy[p.lane] || v.lane_gen[p.lane] != p.gen) break;
+        v.lane_busy[p.lane] = false;
+        bool sent = status == 201;
+        if (sent) stats.sms_sent++;
+        else stats.sms_failed++;
+        v.alerts.complete(v.sms, (AlertLane)p.lane, sent ? ALERT_SENT : ALERT_FAILED, d.millisAt(now));
+        break;
+      }
+      case REQ_TELEMETRY: {
+        if (!d.v) break;
+        VitalsState& v = *d.v;
+        if (!v.in_flight || v.in_flight_gen != p.gen) break;
+        if (ok) {
+          uint32_t n = std::min((uint32_t)v.queue.size(), v.in_flight);
+          v.queue.erase(v.queue.begin(), v.queue.begin() + n);
+          stats.frames_acked += n;
+        }
+        v.in_flight = 0;
+        break;
+      }
+    }
+  }
+};
+
+// ---- Built-in sink ----
+
+struct SinkStats {
+  uint64_t requests = 0, telegram = 0, sms = 0, batches = 0, frames = 0, bad = 0, bytes = 0;
+};
+
+class Sink {
+public:
+  SinkStats stats;
+
+  int begin() {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 256) != 0) return -1;
+    socklen_t len = sizeof(addr);
+    getsockname(listener, (sockaddr*)&addr, &len);
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    thread = std::thread([this] { serve(); });
+    return ntohs(addr.sin_port);
+  }
+
+  void stop() {
+    quit = true;
+    if (thread.joinable()) thread.join();
+    for (Client& c : clients) close(c.fd);
+    close(listener);
+  }
+
+private:
+  struct Client {
+    int fd;
+    std::string in, out;
+  };
+
+  int listener = -1;
+  std::vector<Client> clients;
+  std::thread thread;
+  std::atomic<bool> quit{false};
+
+  void serve() {
+    while (!quit) {
+      std::vector<pollfd> fds;
+      fds.push_back({listener, POLLIN, 0});
+      for (Client& c : clients) fds.push_back({c.fd, (short)(POLLIN | (c.out.empty() ? 0 : POLLOUT)), 0});
+      if (::poll(fds.data(), fds.size(), 20) <= 0) continue;
+      if (fds[0].revents & POLLIN) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd >= 0) {
+          fcntl(fd, F_SETFL, O_NONBLOCK);
+          int one = 1;
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          clients.push_back({fd, "", ""});
+        }
+      }
+      for (size_t k = 1; k < fds.size() && k - 1 < clients.size(); k++) {
+        Client& c = clients[k - 1];
+        if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+          char buf[65536];
+          ssize_t r = recv(c.fd, buf, sizeof(buf), 0);
+          if (r <= 0 && !(r < 0 && errno == EAGAIN)) {
+            close(c.fd);
+            c.fd = -1;
+            continue;
+          }
+          if (r > 0) c.in.append(buf, r);
+          handle(c);
+        }
+        if (c.fd >= 0 && !c.out.empty()) {
+          ssize_t w = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+          if (w > 0) c.out.erase(0, w);
+        }
+      }
+      clients.erase(std::remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.fd < 0; }),
+                    clients.end());
+    }
+  }
+
+  void handle(Client& c) {
+    for (;;) {
+      size_t end = c.in.find("\r\n\r\n");
+      if (end == std::string::npos) return;
+      size_t body_len = 0;
+      const char* cl = strcasestr(c.in.c_str(), "\r\nContent-Length:");
+      if (cl && (size_t)(cl - c.in.c_str()) < end) body_len = strtoul(cl + 17, NULL, 10);
+      if (c.in.size() < end + 4 + body_len) return;
+      char method[8] = "", path[128] = "";
+      sscanf(c.in.c_str(), "%7s %127s", method, path);
+      const uint8_t* body = (const uint8_t*)c.in.data() + end + 4;
+      stats.requests++;
+      stats.bytes += end + 4 + body_len;
+
+      int status = 200;
+      const char* reply = "";
+      if (strcmp(method, "POST") != 0) {
+        status = 405;
+      } else if (strncmp(path, "/bot", 4) == 0 && strstr(path, "/sendMessage")) {
+        stats.telegram++;
+        if (body_len < 8 || memcmp(body, "chat_id=", 8) != 0) status = 400;
+        reply = "{\"ok\":true}";
+      } else if (strncmp(path, "/2010-04-01/Accounts/", 21) == 0) {
+        stats.sms++;
+        if (body_len < 3 || memcmp(body, "To=", 3) != 0) status = 400;
+        else status = 201;
+        reply = "{\"status\":\"queued\"}";
+      } else if (strncmp(path, "/telemetry/byteheal-", 20) == 0) {
+        TelemetryBatchHeader h;
+        if (body_len < sizeof(h)) {
+          status = 400;
+        } else {
+          memcpy(&h, body, sizeof(h));
+          if (h.version != UPLINK_FORMAT_VERSION || h.frame_bytes != sizeof(TelemetryFrame) || h.count == 0 ||
+              h.count > UPLINK_BATCH_FRAMES || body_len != sizeof(h) + h.count * sizeof(TelemetryFrame)) {
+            status = 400;
+          } else {
+            stats.batches++;
+            stats.frames += h.count;
+          }
+        }
+      } else {
+        status = 404;
+      }
+      if (status >= 400) stats.bad++;
+
+      char head[160];
+      int n = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\nConnection: keep-alive\r\n\r\n",
+                       status, status < 300 ? "OK" : "Error", strlen(reply));
+      c.out.append(head, n);
+      c.out.append(reply);
+      c.in.erase(0, end + 4 + body_len);
+    }
+  }
+};
+
+// ---- Main ----
+
+static void usage() {
+  fprintf(stderr,
+          "usage: fleet_sim [--devices N] [--seconds S] [--speed X] [--threads N]\n"
+          "                 [--endpoint HOST:PORT | --no-net] [--events-per-hour E]\n"
+          "                 [--wifi-mtbf-s S] [--reboot-mtbf-s S] [--seed S]\n");
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(a, "--no-net") == 0) {
+      o.no_net = true;
+      continue;
+    }
+    if (!v) {
+      usage();
+      return 2;
+    }
+    if (strcmp(a, "--devices") == 0) o.devices = strtoul(v, NULL, 10);
+    else if (strcmp(a, "--seconds") == 0) o.seconds = atof(v);
+    else if (strcmp(a, "--speed") == 0) o.speed = atof(v);
+    else if (strcmp(a, "--threads") == 0) o.threads = atoi(v);
+    else if (strcmp(a, "--events-per-hour") == 0) o.events_per_hour = atof(v);
+    else if (strcmp(a, "--wifi-mtbf-s") == 0) o.wifi_mtbf_s = atof(v);
+    else if (strcmp(a, "--reboot-mtbf-s") == 0) o.reboot_mtbf_s = atof(v);
+    else if (strcmp(a, "--seed") == 0) o.seed = strtoul(v, NULL, 10);
+    else if (strcmp(a, "--endpoint") == 0) {
+      const char* colon = strrchr(v, ':');
+      if (!colon) {
+        usage();
+        return 2;
+      }
+      o.host = std::string(v, colon - v);
+      o.port = atoi(colon + 1);
+    } else {
+      usage();
+      return 2;
+    }
+    i++;
+  }
+  if (o.threads <= 0) o.threads = std::max(1u, std::thread::hardware_concurrency());
+  if ((uint32_t)o.threads > o.devices) o.threads = std::max(1u, o.devices);
+
+  Sink sink;
+  bool own_sink = !o.no_net && o.port == 0;
+  if (own_sink) {
+    o.port = sink.begin();
+    if (o.port <= 0) {
+      fprintf(stderr, "cannot start the built-in sink\n");
+      return 1;
+    }
+  }
+
+  uint64_t end_ms = (uint64_t)(o.seconds * 1000);
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::vector<std::thread> threads;
+  auto wall0 = std::chrono::steady_clock::now();
+  for (int s = 0; s < o.threads; s++) {
+    uint32_t first = (uint64_t)o.devices * s / o.threads;
+    uint32_t last = (uint64_t)o.devices * (s + 1) / o.threads;
+    shards.emplace_back(new Shard);
+    Shard* shard = shards.back().get();
+    // Each shard builds its devices on its own thread
+    threads.emplace_back([shard, &o, first, last, end_ms] {
+      shard->begin(o, first, last - first);
+      shard->run(end_ms);
+    });
+  }
+  for (std::thread& t : threads) t.join();
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+  if (own_sink) sink.stop();
+
+  ShardStats total;
+  for (auto& s : shards) {
+    const ShardStats& x = s->stats;
+    total.wakes += x.wakes;
+    total.device_ms += x.device_ms;
+    total.reboots += x.reboots;
+    total.dropouts += x.dropouts;
+    for (int k = 0; k < 8; k++) total.events[k] += x.events[k];
+    total.falls_scored += x.falls_scored;
+    total.falls_alerted += x.falls_alerted;
+    total.seizures_scored += x.seizures_scored;
+    total.seizures_escalated += x.seizures_escalated;
+    total.telegram_sent += x.telegram_sent;
+    total.telegram_skipped += x.telegram_skipped;
+    total.telegram_failed += x.telegram_failed;
+    total.rule_alerts += x.rule_alerts;
+    total.sms_sent += x.sms_sent;
+    total.sms_failed += x.sms_failed;
+    total.sms_deferred += x.sms_deferred;
+    total.sms_timeouts += x.sms_timeouts;
+    total.frames += x.frames;
+    total.frames_acked += x.frames_acked;
+    total.frames_dropped += x.frames_dropped;
+    total.frames_lost_reboot += x.frames_lost_reboot;
+    total.batches += x.batches;
+    for (int k = 0; k < 3; k++) total.answered[k] += x.answered[k];
+    total.answered_frames += x.answered_frames;
+    total.http_errors += x.http_errors;
+    total.bytes += x.bytes;
+    total.latency_us.insert(total.latency_us.end(), x.latency_us.begin(), x.latency_us.end());
+  }
+
+  double device_s = total.device_ms / 1000.0;
+  printf("fleet: %u devices (%u fall, %u vitals) in %d shard(s), %.0f s virtual at %s, %s\n", o.devices,
+         (o.devices + 1) / 2, o.devices / 2, o.threads, o.seconds,
+         o.speed > 0 ? (std::to_string((int)o.speed) + "x").c_str() : "full speed",
+         o.no_net ? "no network" : own_sink ? "built-in sink" : (o.host + ":" + std::to_string(o.port)).c_str());
+  printf("throughput: %.0f device-seconds per wall-second (%.2f s wall, %.1f M wakes)\n", device_s / wall_s, wall_s,
+         total.wakes / 1e6);
+  printf("events: %llu falls, %llu seizures, %llu tachycardia, %llu desaturation, %llu sepsis drifts, %llu sit-downs, "
+         "%llu walks; %llu WiFi dropouts, %llu reboots\n",
+         (unsigned long long)total.events[EV_FALL], (unsigned long long)total.events[EV_SEIZURE],
+         (unsigned long long)total.events[EV_TACHY], (unsigned long long)total.events[EV_DESAT],
+         (unsigned long long)total.events[EV_SEPSIS], (unsigned long long)total.events[EV_SIT],
+         (unsigned long long)total.events[EV_WALK], (unsigned long long)total.dropouts,
+         (unsigned long long)total.reboots);
+  printf("fall devices: %llu/%llu falls alerted, %llu/%llu seizures of 40 s+ escalated to 2; Telegram %llu sent, "
+         "%llu skipped offline, %llu failed\n",
+         (unsigned long long)total.falls_alerted, (unsigned long long)total.falls_scored,
+         (unsigned long long)total.seizures_escalated, (unsigned long long)total.seizures_scored,
+         (unsigned long long)total.telegram_sent, (unsigned long long)total.telegram_skipped,
+         (unsigned long long)total.telegram_failed);
+  printf("vitals devices: %llu rule alerts; SMS %llu sent, %llu failed, %llu deferred offline, %llu timed out\n",
+         (unsigned long long)total.rule_alerts, (unsigned long long)total.sms_sent,
+         (unsigned long long)total.sms_failed, (unsigned long long)total.sms_deferred,
+         (unsigned long long)total.sms_timeouts);
+  printf("telemetry: %llu frames, %llu batches, %llu frames acknowledged, %llu dropped (queue full), %llu lost to "
+         "reboots\n",
+         (unsigned long long)total.frames, (unsigned long long)total.batches, (unsigned long long)total.frames_acked,
+         (unsigned long long)total.frames_dropped, (unsigned long long)total.frames_lost_reboot);
+  uint64_t requests = total.answered[0] + total.answered[1] + total.answered[2];
+  printf("http: %llu requests answered (%.0f/s wall, %.1f MB), %llu failed", (unsigned long long)requests,
+         requests / wall_s, total.bytes / 1e6, (unsigned long long)total.http_errors);
+  if (!total.latency_us.empty() && !o.no_net) {
+    std::sort(total.latency_us.begin(), total.latency_us.end());
+    printf(", latency p50 %u us, p99 %u us", total.latency_us[total.latency_us.size() / 2],
+           total.latency_us[total.latency_us.size() * 99 / 100]);
+  }
+  printf("\n");
+
+  int failures = 0;
+  if (own_sink) {
+    printf("sink: %llu requests (%llu Telegram, %llu SMS, %llu batches of %llu frames), %llu malformed\n",
+           (unsigned long long)sink.stats.requests, (unsigned long long)sink.stats.telegram,
+           (unsigned long long)sink.stats.sms, (unsigned long long)sink.stats.batches,
+           (unsigned long long)sink.stats.frames, (unsigned long long)sink.stats.bad);
+    if (sink.stats.bad) {
+      printf("FAIL: malformed requests at the sink\n");
+      failures++;
+    }
+    if (sink.stats.telegram != total.answered[REQ_TELEGRAM] || sink.stats.sms != total.answered[REQ_SMS] ||
+        sink.stats.frames != total.answered_frames) {
+      printf("FAIL: the sink's counts differ from the answers the devices got\n");
+      failures++;
+    }
+  }
+  if (total.falls_scored && total.falls_alerted < 0.9 * total.falls_scored) {
+    printf("FAIL: only %llu of %llu falls alerted\n", (unsigned long long)total.falls_alerted,
+           (unsigned long long)total.falls_scored);
+    failures++;
+  }
+  if (total.seizures_scored && total.seizures_escalated < 0.9 * total.seizures_scored) {
+    printf("FAIL: only %llu of %llu long seizures escalated\n", (unsigned long long)total.seizures_escalated,
+           (unsigned long long)total.seizures_scored);
+    failures++;
+  }
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
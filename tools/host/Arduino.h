@@ -0,0 +1,120 @@
+#pragma once
+// Host stand-in for the few Arduino core pieces the shared headers use
+// (String, Serial, millis(), delay(), esp_random(), PROGMEM), so they build
+// with plain g++ for the tools. Not a port of the core: only what is used.
+//
+// ARDUINO is deliberately left undefined, so portable headers (seqlock.h,
+// ...) take their host branches.
+//
+// millis() and delay() run on a virtual clock that can go faster than real
+// time: hostClockSpeed(10) makes delay(100) sleep 10 ms while millis()
+// advances by 100. A simulation that keeps its own time instead hands it to
+// hostClockDriver(), and then millis(), micros() and delay() use that.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+
+#define PROGMEM
+typedef const char* PGM_P;
+
+class String {
+public:
+  String() {}
+  String(const char* s) : s(s ? s : "") {}
+  String(const std::string& s) : s(s) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned int v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+
+  size_t length() const { return s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  const std::string& str() const { return s; }
+
+  String& operator+=(const String& other) {
+    s += other.s;
+    return *this;
+  }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+  friend bool operator==(const String& a, const String& b) { return a.s == b.s; }
+  friend bool operator!=(const String& a, const String& b) { return a.s != b.s; }
+
+private:
+  std::string s;
+};
+
+// Serial output goes to stdout
+struct HostSerial {
+  void print(const char* s) { fputs(s, stdout); }
+  void print(const String& s) { fputs(s.c_str(), stdout); }
+  void println(const char* s = "") { puts(s); }
+  void println(const String& s) { puts(s.c_str()); }
+};
+
+inline HostSerial Serial;
+
+inline std::chrono::steady_clock::time_point& hostClockStart() {
+  static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return start;
+}
+
+inline double& hostClockSpeedFactor() {
+  static double speed = 1.0;
+  return speed;
+}
+
+// Set before any thread uses the clock
+inline void hostClockSpeed(double speed) {
+  hostClockStart();
+  hostClockSpeedFactor() = speed;
+}
+
+struct HostClockDriver {
+  uint64_t (*now_us)();
+  void (*sleep_us)(uint64_t us);
+};
+
+inline HostClockDriver& hostClockDriverRef() {
+  static HostClockDriver driver = {NULL, NULL};
+  return driver;
+}
+
+// Set before any thread uses the clock
+inline void hostClockDriver(uint64_t (*now_us)(), void (*sleep_us)(uint64_t us)) {
+  hostClockDriverRef().now_us = now_us;
+  hostClockDriverRef().sleep_us = sleep_us;
+}
+
+// Virtual milliseconds since the start, fractional
+inline double hostMillis() {
+  if (hostClockDriverRef().now_us) return hostClockDriverRef().now_us() / 1000.0;
+  std::chrono::duration<double, std::milli> real = std::chrono::steady_clock::now() - hostClockStart();
+  return real.count() * hostClockSpeedFactor();
+}
+
+inline uint32_t millis() {
+  if (hostClockDriverRef().now_us) return (uint32_t)(hostClockDriverRef().now_us() / 1000);
+  return (uint32_t)hostMillis();
+}
+
+inline uint32_t micros() {
+  if (hostClockDriverRef().now_us) return (uint32_t)hostClockDriverRef().now_us();
+  return (uint32_t)(hostMillis() * 1000);
+}
+
+inline void delay(uint32_t ms) {
+  if (hostClockDriverRef().sleep_us) return hostClockDriverRef().sleep_us((uint64_t)ms * 1000);
+  std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms / hostClockSpeedFactor()));
+}
+
+inline uint32_t esp_random() {
+  static thread_local std::mt19937 rng(std::random_device{}());
+  return rng();
+}
@@ -0,0 +1,481 @@
+#pragma once
+// Host stand-in for the part of ESPAsyncWebServer the shared route headers
+// use (http_snapshot.h, detector_web.h), on POSIX sockets.
+//
+// As with AsyncTCP, one thread owns every connection and runs every handler,
+// so one slow handler holds up all clients. Requests are HTTP/1.1 (bodies
+// are read and ignored). Like the library, which serves one request per
+// connection, every response carries Connection: close; setKeepAlive(true)
+// keeps connections open instead, to see what keep-alive would buy. At most
+// setMaxConnections() clients
+// are held at once and further ones are reset, as lwIP does when it runs out
+// of PCBs.
+//
+// Differences from the library: a filler response is drained into the send
+// buffer at once instead of as the socket drains, and URL arguments are not
+// percent-decoded.
+
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+enum WebRequestMethod : uint8_t {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+};
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebHeader {
+public:
+  AsyncWebHeader(const String& name, const String& value) : header_name(name), header_value(value) {}
+  const String& name() const { return header_name; }
+  const String& value() const { return header_value; }
+
+private:
+  String header_name;
+  String header_value;
+};
+
+typedef std::function<size_t(uint8_t* buffer, size_t max_len, size_t index)> AwsResponseFiller;
+
+class AsyncWebServerResponse {
+public:
+  void addHeader(const String& name, const String& value) { headers.emplace_back(name, value); }
+
+private:
+  friend class AsyncWebServerRequest;
+  friend class AsyncWebServer;
+  int code = 200;
+  String content_type;
+  std::string body;
+  std::vector<AsyncWebHeader> headers;
+};
+
+class DefaultHeaders {
+public:
+  static DefaultHeaders& Instance() {
+    static DefaultHeaders instance;
+    return instance;
+  }
+  void addHeader(const String& name, const String& value) { headers.emplace_back(name, value); }
+  const std::vector<AsyncWebHeader>& all() const { return headers; }
+
+private:
+  std::vector<AsyncWebHeader> headers;
+};
+
+class AsyncWebServerRequest {
+public:
+  const String& url() const { return path; }
+  WebRequestMethod method() const { return request_method; }
+  const char* methodToString() const {
+    switch (request_method) {
+      case HTTP_GET: return "GET";
+      case HTTP_POST: return "POST";
+      case HTTP_DELETE: return "DELETE";
+      case HTTP_PUT: return "PUT";
+      case HTTP_PATCH: return "PATCH";
+      case HTTP_HEAD: return "HEAD";
+      case HTTP_OPTIONS: return "OPTIONS";
+      default: return "UNKNOWN";
+    }
+  }
+
+  bool hasHeader(const String& name) const { return getHeader(name) != nullptr; }
+  AsyncWebHeader* getHeader(const String& name) const {
+    for (const AsyncWebHeader& h : headers) {
+      if (strcasecmp(h.name().c_str(), name.c_str()) == 0) return const_cast<AsyncWebHeader*>(&h);
+    }
+    return nullptr;
+  }
+
+  size_t args() const { return arg_names.size(); }
+  const String& argName(size_t i) const { return arg_names[i]; }
+  const String& arg(size_t i) const { return arg_values[i]; }
+  bool hasArg(const char* name) const {
+    for (const String& n : arg_names) {
+      if (n == String(name)) return true;
+    }
+    return false;
+  }
+  const String& arg(const String& name) const {
+    static const String none;
+    for (size_t i = 0; i < arg_names.size(); i++) {
+      if (arg_names[i] == name) return arg_values[i];
+    }
+    return none;
+  }
+
+  AsyncWebServerResponse* beginResponse(int code, const String& content_type = String(),
+                                        const String& content = String()) {
+    AsyncWebServerResponse* response = new AsyncWebServerResponse();
+    response->code = code;
+    response->content_type = content_type;
+    response->body = content.str();
+    return response;
+  }
+
+  AsyncWebServerResponse* beginResponse(const String& content_type, size_t len, AwsResponseFiller filler) {
+    AsyncWebServerResponse* response = beginResponse(200, content_type);
+    response->body.resize(len);
+    size_t index = 0;
+    while (index < len) {
+      size_t n = filler((uint8_t*)&response->body[index], len - index < 1436 ? len - index : 1436, index);
+      if (n == 0) break;
+      index += n;
+    }
+    response->body.resize(index);
+    return response;
+  }
+
+  // Takes ownership, as the library does
+  void send(AsyncWebServerResponse* response) {
+    if (!this->response) this->response.reset(response);
+    else delete response;
+  }
+
+  void send(int code, const String& content_type = String(), const String& content = String()) {
+    send(beginResponse(code, content_type, content));
+  }
+
+  void send_P(int code, const String& content_type, PGM_P content) { send(code, content_type, String(content)); }
+
+private:
+  friend class AsyncWebServer;
+  WebRequestMethod request_method = HTTP_GET;
+  String path;
+  std::vector<AsyncWebHeader> headers;
+  std::vector<String> arg_names;
+  std::vector<String> arg_values;
+  std::unique_ptr<AsyncWebServerResponse> response;
+};
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+
+class AsyncWebServer {
+public:
+  struct Stats {
+    uint64_t requests;
+    uint64_t accepted;
+    uint64_t refused;     // over setMaxConnections()
+    uint32_t max_open;
+    double busy_ms;       // time spent handling and writing, real
+  };
+
+  // Port 0 picks a free port; see port() after begin()
+  explicit AsyncWebServer(uint16_t port) : listen_port(port) {}
+  ~AsyncWebServer() { end(); }
+
+  void on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction handler) {
+    routes.push_back({String(uri), method, handler});
+  }
+
+  void onNotFound(ArRequestHandlerFunction handler) { not_found = handler; }
+
+  void begin() {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(listen_port);
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 128) < 0) {
+      perror("AsyncWebServer");
+      close(listen_fd);
+      listen_fd = -1;
+      return;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr*)&addr, &len);
+    listen_port = ntohs(addr.sin_port);
+    fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+    running = true;
+    worker = std::thread([this] { run(); });
+  }
+
+  void end() {
+    if (!running) return;
+    running = false;
+    worker.join();
+    for (Connection& c : connections) close(c.fd);
+    connections.clear();
+    close(listen_fd);
+    listen_fd = -1;
+  }
+
+  // ---- Host only ----
+
+  uint16_t port() const { return listen_port; }
+  void setMaxConnections(size_t n) { max_connections = n; }
+  void setKeepAlive(bool on) { keep_alive = on; }
+
+  // Busy time added to every request on the server thread, for the work a
+  // PC does much faster than the ESP32 (lwIP, the handler, the copy)
+  void setServiceCost(uint32_t us) { service_cost_us = us; }
+
+  // Runs on the server thread right after it starts (e.g. CPU pinning)
+  void onStart(std::function<void()> hook) { start_hook = hook; }
+
+  Stats stats() const {
+    Stats s;
+    s.requests = requests.load();
+    s.accepted = accepted.load();
+    s.refused = refused.load();
+    s.max_open = max_open.load();
+    s.busy_ms = busy_us.load() / 1000.0;
+    return s;
+  }
+
+private:
+  struct Route {
+    String uri;
+    WebRequestMethodComposite method;
+    ArRequestHandlerFunction handler;
+  };
+
+  struct Connection {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t sent;
+    bool closing;
+  };
+
+  uint16_t listen_port;
+  int listen_fd = -1;
+  std::vector<Route> routes;
+  ArRequestHandlerFunction not_found;
+  std::vector<Connection> connections;
+  size_t max_connections = 16;
+  bool keep_alive = false;
+  uint32_t service_cost_us = 0;
+  std::function<void()> start_hook;
+  std::atomic<bool> running{false};
+  std::thread worker;
+  std::atomic<uint64_t> requests{0}, accepted{0}, refused{0}, busy_us{0};
+  std::atomic<uint32_t> max_open{0};
+
+  void run() {
+    if (start_hook) start_hook();
+    std::vector<pollfd> fds;
+    while (running) {
+      fds.clear();
+      fds.push_back({listen_fd, POLLIN, 0});
+      for (const Connection& c : connections) {
+        fds.push_back({c.fd, (short)(c.sent < c.out.size() ? POLLIN | POLLOUT : POLLIN), 0});
+      }
+      if (poll(fds.data(), fds.size(), 20) <= 0) continue;
+
+      // Connections first: accepting may append to the list
+      for (size_t i = connections.size(); i-- > 0;) {
+        short ev = fds[i + 1].revents;
+        if (!ev) continue;
+        Connection& c = connections[i];
+        bool alive = true;
+        if (ev & (POLLIN | POLLHUP | POLLERR)) alive = receive(c);
+        if (alive && c.sent < c.out.size()) alive = flush(c);
+        if (!alive || (c.closing && c.sent == c.out.size())) {
+          close(c.fd);
+          connections.erase(connections.begin() + i);
+        }
+      }
+      if (fds[0].revents & POLLIN) acceptAll();
+    }
+  }
+
+  void acceptAll() {
+    for (;;) {
+      int fd = accept(listen_fd, nullptr, nullptr);
+      if (fd < 0) return;
+      if (connections.size() >= max_connections) {
+        linger reset = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        close(fd);
+        refused++;
+        continue;
+      }
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      connections.push_back({fd, std::string(), std::string(), 0, false});
+      accepted++;
+      if (connections.size() > max_open) max_open = connections.size();
+    }
+  }
+
+  // False when the connection is gone
+  bool receive(Connection& c) {
+    char buffer[2048];
+    for (;;) {
+      ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+      if (n > 0) {
+        c.in.append(buffer, n);
+        continue;
+      }
+      if (n == 0) return false;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return false;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    while (!c.closing) {
+      size_t head_end = c.in.find("\r\n\r\n");
+      if (head_end == std::string::npos) break;
+      size_t body_len = 0;
+      AsyncWebServerRequest request;
+      bool close_after = !keep_alive;
+      if (!parse(c.in.substr(0, head_end), request, body_len, close_after)) {
+        c.out += "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        c.closing = true;
+        break;
+      }
+      if (c.in.size() < head_end + 4 + body_len) break;
+      c.in.erase(0, head_end + 4 + body_len);
+      handle(request);
+      respond(c, *request.response, close_after);
+      c.closing = close_after;
+      requests++;
+    }
+    bool alive = flush(c);
+    busy_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    return alive;
+  }
+
+  bool flush(Connection& c) {
+    while (c.sent < c.out.size()) {
+      ssize_t n = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+      if (n > 0) {
+        c.sent += n;
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+      } else {
+        return false;
+      }
+    }
+    c.out.clear();
+    c.sent = 0;
+    return true;
+  }
+
+  static bool parse(const std::string& head, AsyncWebServerRequest& request, size_t& body_len, bool& close_after) {
+    size_t line_end = head.find("\r\n");
+    std::string line = head.substr(0, line_end);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1) return false;
+    std::string method = line.substr(0, sp1);
+    std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::string version = line.substr(sp2 + 1);
+    static const struct {
+      const char* name;
+      WebRequestMethod method;
+    } methods[] = {{"GET", HTTP_GET}, {"POST", HTTP_POST}, {"DELETE", HTTP_DELETE}, {"PUT", HTTP_PUT},
+                   {"PATCH", HTTP_PATCH}, {"HEAD", HTTP_HEAD}, {"OPTIONS", HTTP_OPTIONS}};
+    bool known = false;
+    for (const auto& m : methods) {
+      if (method == m.name) {
+        request.request_method = m.method;
+        known = true;
+      }
+    }
+    if (!known || version.compare(0, 5, "HTTP/") != 0) return false;
+    if (version == "HTTP/1.0") close_after = true;
+
+    size_t query = target.find('?');
+    request.path = String(target.substr(0, query));
+    while (query != std::string::npos) {
+      size_t next = target.find('&', query + 1);
+      std::string pair = target.substr(query + 1, next == std::string::npos ? std::string::npos : next - query - 1);
+      size_t eq = pair.find('=');
+      request.arg_names.push_back(String(pair.substr(0, eq)));
+      request.arg_values.push_back(String(eq == std::string::npos ? std::string() : pair.substr(eq + 1)));
+      query = next;
+    }
+
+    size_t pos = line_end;
+    while (pos != std::string::npos && pos + 2 < head.size()) {
+      size_t end = head.find("\r\n", pos + 2);
+      std::string field = head.substr(pos + 2, end == std::string::npos ? std::string::npos : end - pos - 2);
+      pos = end;
+      size_t colon = field.find(':');
+      if (colon == std::string::npos) return false;
+      std::string name = field.substr(0, colon);
+      size_t start = field.find_first_not_of(' ', colon + 1);
+      std::string value = start == std::string::npos ? std::string() : field.substr(start);
+      if (strcasecmp(name.c_str(), "Content-Length") == 0) body_len = strtoul(value.c_str(), nullptr, 10);
+      if (strcasecmp(name.c_str(), "Connection") == 0) {
+        if (strcasecmp(value.c_str(), "close") == 0) close_after = true;
+        if (strcasecmp(value.c_str(), "keep-alive") == 0 && version == "HTTP/1.0") close_after = false;
+      }
+      request.headers.emplace_back(String(name), String(value));
+    }
+    return true;
+  }
+
+  void handle(AsyncWebServerRequest& request) {
+    if (service_cost_us) {
+      auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(service_cost_us);
+      while (std::chrono::steady_clock::now() < until) {
+      }
+    }
+    for (const Route& route : routes) {
+      if ((route.method & request.method()) && route.uri == request.url()) {
+        route.handler(&request);
+        break;
+      }
+    }
+    if (!request.response) {
+      if (not_found) not_found(&request);
+      else request.send(404);
+    }
+    if (!request.response) request.send(500, "text/plain", "Handler sent no response");
+  }
+
+  static const char* reason(int code) {
+    switch (code) {
+      case 200: return "OK";
+      case 304: return "Not Modified";
+      case 400: return "Bad Request";
+      case 404: return "Not Found";
+      case 503: return "Service Unavailable";
+      default: return code >= 500 ? "Internal Server Error" : "";
+    }
+  }
+
+  void respond(Connection& c, const AsyncWebServerResponse& response, bool close_after) {
+    char line[64];
+    snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", response.code, reason(response.code));
+    c.out += line;
+    if (response.content_type.length() && response.code != 304) {
+      c.out += "Content-Type: ";
+      c.out += response.content_type.str();
+      c.out += "\r\n";
+    }
+    snprintf(line, sizeof(line), "Content-Length: %zu\r\n", response.body.size());
+    c.out += line;
+    for (const std::vector<AsyncWebHeader>* list : {&response.headers, &DefaultHeaders::Instance().all()}) {
+      for (const AsyncWebHeader& h : *list) {
+        c.out += h.name().str() + ": " + h.value().str() + "\r\n";
+      }
+    }
+    c.out += close_after ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+    c.out += response.body;
+  }
+};
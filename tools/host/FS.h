@@ -0,0 +1,82 @@
+#pragma once
+// Host stand-in for the Arduino FS File API the uplink uses, on in-memory
+// files. Seeking past the end fails (the code is expected to append, not to
+// leave holes), and the file system counts the bytes written so a tool can
+// report flash wear.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs {
+
+class File {
+public:
+  File() {}
+  File(std::shared_ptr<std::vector<uint8_t>> data, uint64_t* written) : data(data), written(written) {}
+
+  explicit operator bool() const { return data != nullptr; }
+  size_t size() const { return data ? data->size() : 0; }
+  size_t position() const { return pos; }
+
+  bool seek(uint32_t offset) {
+    if (!data || offset > data->size()) return false;
+    pos = offset;
+    return true;
+  }
+
+  size_t read(uint8_t* buf, size_t len) {
+    if (!data) return 0;
+    size_t n = pos < data->size() ? std::min(len, data->size() - pos) : 0;
+    memcpy(buf, data->data() + pos, n);
+    pos += n;
+    return n;
+  }
+
+  size_t write(const uint8_t* buf, size_t len) {
+    if (!data) return 0;
+    if (pos + len > data->size()) data->resize(pos + len);
+    memcpy(data->data() + pos, buf, len);
+    pos += len;
+    *written += len;
+    return len;
+  }
+
+  void flush() {}
+  void close() { data.reset(); }
+
+private:
+  std::shared_ptr<std::vector<uint8_t>> data;
+  uint64_t* written = nullptr;
+  size_t pos = 0;
+};
+
+class FS {
+public:
+  // "r" and "r+" need an existing file; "w", "w+" create or truncate
+  File open(const char* path, const char* mode) {
+    auto it = files.find(path);
+    if (mode[0] == 'r') return it == files.end() ? File() : File(it->second, &bytes_written);
+    if (it == files.end()) it = files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+    it->second->clear();
+    return File(it->second, &bytes_written);
+  }
+
+  bool exists(const char* path) const { return files.count(path) != 0; }
+  bool remove(const char* path) { return files.erase(path) != 0; }
+
+  uint64_t bytes_written = 0;
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,11 @@
+#pragma once
+// Host stand-in for the LittleFS instance: an in-memory fs::FS.
+
+#include <FS.h>
+
+class LittleFSFS : public fs::FS {
+public:
+  bool begin(bool /*format_if_failed*/ = false) { return true; }
+};
+
+inline LittleFSFS LittleFS;
@@ -0,0 +1,19 @@
+#pragma once
+// Host stand-in for the TwoWire calls the sensor code makes. The calls are
+// virtual so a simulation can put a mock bus behind them; this base class is
+// a bus with nothing on it (every address NACKs).
+
+#include <stdint.h>
+#include <stddef.h>
+
+class TwoWire {
+public:
+  virtual ~TwoWire() {}
+  virtual bool begin(int /*sda*/ = -1, int /*scl*/ = -1, uint32_t /*frequency*/ = 0) { return true; }
+  virtual void beginTransmission(uint8_t /*addr*/) {}
+  virtual size_t write(uint8_t /*value*/) { return 1; }
+  virtual uint8_t endTransmission(bool /*stop*/ = true) { return 2; }  // address NACK
+  virtual size_t requestFrom(uint8_t /*addr*/, size_t /*len*/, bool /*stop*/ = true) { return 0; }
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+};
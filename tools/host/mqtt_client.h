@@ -0,0 +1,83 @@
+#pragma once
+// Host stand-in for the esp-mqtt client calls telemetry_uplink.h makes.
+// Nothing goes on the wire: publish() hands the message to a hook set by the
+// tool, which plays the broker and reports back through hostMqttEvent().
+// Only the pre-5.0 (flat) config layout is provided.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+typedef const char* esp_event_base_t;
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_EVENT_ANY_ID -1
+
+typedef enum {
+  MQTT_EVENT_ERROR = 0,
+  MQTT_EVENT_CONNECTED,
+  MQTT_EVENT_DISCONNECTED,
+  MQTT_EVENT_SUBSCRIBED,
+  MQTT_EVENT_UNSUBSCRIBED,
+  MQTT_EVENT_PUBLISHED,
+  MQTT_EVENT_DATA,
+} esp_mqtt_event_id_t;
+
+typedef struct {
+  const char* uri;
+  const char* client_id;
+  int keepalive;
+} esp_mqtt_client_config_t;
+
+typedef struct {
+  int msg_id;
+} esp_mqtt_event_t;
+typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
+
+typedef void (*esp_event_handler_t)(void* arg, esp_event_base_t base, int32_t event_id, void* data);
+
+struct esp_mqtt_client {
+  esp_event_handler_t handler = nullptr;
+  void* handler_arg = nullptr;
+  int next_msg_id = 1;
+};
+typedef esp_mqtt_client* esp_mqtt_client_handle_t;
+
+struct HostMqtt {
+  esp_mqtt_client client;
+  // Returns false to refuse the publish (as the client does when its outbox is full)
+  std::function<bool(int msg_id, const char* topic, const char* data, int len, int qos)> on_publish;
+};
+
+inline HostMqtt& hostMqtt() {
+  static HostMqtt mqtt;
+  return mqtt;
+}
+
+// Deliver an event to the registered handler, as the client's task would
+inline void hostMqttEvent(esp_mqtt_event_id_t id, int msg_id = 0) {
+  HostMqtt& m = hostMqtt();
+  esp_mqtt_event_t event = {msg_id};
+  if (m.client.handler) m.client.handler(m.client.handler_arg, "MQTT_EVENTS", id, &event);
+}
+
+inline esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* /*config*/) {
+  return &hostMqtt().client;
+}
+
+inline esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t /*event*/,
+                                                esp_event_handler_t handler, void* arg) {
+  client->handler = handler;
+  client->handler_arg = arg;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t /*client*/) { return ESP_OK; }
+
+inline int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len,
+                                   int qos, int /*retain*/) {
+  int msg_id = client->next_msg_id++;
+  HostMqtt& m = hostMqtt();
+  if (m.on_publish && !m.on_publish(msg_id, topic, data, len, qos)) return -1;
+  return msg_id;
+}
@@ -0,0 +1,217 @@
+// Host replay of hrv.h against synthetic RR series with known HRV.
+//
+//   sine       RR = 800 + 40 sin(2 pi i / 10): RMSSD = sqrt(2) 40 sin(pi / 10),
+//              SDNN = 40 / sqrt(2)
+//   alternate  RR = 800 +- 30: RMSSD = 60, SDNN = 30, pNN50 = 1
+//   gaussian   RR ~ N(850, 30) white: RMSSD ~ sqrt(2) 30, SDNN ~ 30; also
+//              checked beat by beat against a batch recompute of the window
+//   artifacts  the sine series with missed, extra and displaced beats: must
+//              stay within 5 % of the clean values
+//   step       60 -> 90 BPM: the reference must follow within 10 beats
+//   ring       beats pushed by a producer thread through BeatRing, compared
+//              with the direct run; overflow is counted
+//
+// Then memory and the cost of addBeat() / snapshot().
+//
+//   g++ -O2 -std=c++17 -pthread -o hrv_replay tools/hrv_replay.cpp
+//   ./hrv_replay
+//
+// Exit status is non-zero if a check fails.
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../hrv.h"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+static bool near(float got, float want, float rel) { return fabsf(got - want) <= rel * fabsf(want) + 1e-3f; }
+
+// Beat times (us) from RR intervals (ms), starting at 1 s
+static std::vector<uint64_t> beatsFrom(const std::vector<double>& rr) {
+  std::vector<uint64_t> beats;
+  double t = 1e6;
+  beats.push_back((uint64_t)t);
+  for (double r : rr) {
+    t += r * 1000;
+    beats.push_back((uint64_t)llround(t));
+  }
+  return beats;
+}
+
+static HrvSnapshot replay(HrvEngine& hrv, const std::vector<uint64_t>& beats) {
+  hrv.begin();
+  for (uint64_t b : beats) hrv.addBeat(b);
+  return hrv.snapshot((uint32_t)(beats.back() / 1000));
+}
+
+static void print(const char* name, const HrvSnapshot& s) {
+  printf("%-10s RMSSD %6.2f ms  SDNN %6.2f ms  pNN50 %4.2f  HR %5.1f BPM  %3u intervals, %u artifacts\n", name,
+         s.rmssd_ms, s.sdnn_ms, s.pnn50, s.hr_bpm, s.intervals, (unsigned)s.artifacts);
+}
+
+static std::vector<double> sineSeries(size_t n) {
+  std::vector<double> rr(n);
+  for (size_t i = 0; i < n; i++) rr[i] = 800 + 40 * sin(2 * M_PI * i / 10);
+  return rr;
+}
+
+int main() {
+  static HrvEngine hrv;
+
+  // Sine: 300 s of beats at 800 ms is 375 intervals, whole periods
+  std::vector<double> sine = sineSeries(500);
+  HrvSnapshot s = replay(hrv, beatsFrom(sine));
+  print("sine", s);
+  float rmssd_sine = (float)(sqrt(2.0) * 40 * sin(M_PI / 10));
+  float sdnn_sine = (float)(40 / sqrt(2.0));
+  check(near(s.rmssd_ms, rmssd_sine, 0.01f), "sine RMSSD");
+  check(near(s.sdnn_ms, sdnn_sine, 0.01f), "sine SDNN");
+  check(near(s.hr_bpm, 75, 0.05f), "sine HR");
+  check(s.artifacts == 0, "sine artifacts");
+  HrvSnapshot clean = s;
+
+  // Alternating
+  std::vector<double> alt(500);
+  for (size_t i = 0; i < alt.size(); i++) alt[i] = i % 2 ? 830 : 770;
+  s = replay(hrv, beatsFrom(alt));
+  print("alternate", s);
+  check(near(s.rmssd_ms, 60, 0.005f) && near(s.sdnn_ms, 30, 0.005f) && s.pnn50 == 1.0f, "alternate RMSSD / SDNN / pNN50");
+
+  // Gaussian white noise, checked against a batch recompute as it streams
+  std::mt19937 rng(43);
+  std::normal_distribution<double> noise(850, 30);
+  std::vector<double> white(1500);
+  for (double& r : white) r = noise(rng);
+  std::vector<uint64_t> beats = beatsFrom(white);
+  hrv.begin();
+  float worst = 0;
+  for (size_t i = 0; i < beats.size(); i++) {
+    hrv.addBeat(beats[i]);
+    if (i < HRV_MIN_BEATS + 1 || i % 25) continue;
+    uint32_t now_ms = (uint32_t)(beats[i] / 1000);
+    s = hrv.snapshot(now_ms);
+    // Batch: intervals ending inside the window, at most HRV_MAX_BEATS
+    std::vector<double> rr;
+    for (size_t k = i; k >= 1 && rr.size() < HRV_MAX_BEATS; k--) {
+      if (now_ms - (uint32_t)(beats[k] / 1000) > HRV_WINDOW_MS) break;
+      rr.insert(rr.begin(), (double)(uint32_t)((beats[k] - beats[k - 1] + 500) / 1000));
+    }
+    double mean = 0, var = 0, d2 = 0;
+    for (double r : rr) mean += r;
+    mean /= rr.size();
+    for (double r : rr) var += (r - mean) * (r - mean);
+    for (size_t k = 1; k < rr.size(); k++) d2 += (rr[k] - rr[k - 1]) * (rr[k] - rr[k - 1]);
+    float sdnn = (float)sqrt(var / (rr.size() - 1));
+    float rmssd = (float)sqrt(d2 / (rr.size() - 1));
+    worst = fmaxf(worst, fmaxf(fabsf(s.sdnn_ms - sdnn) / sdnn, fabsf(s.rmssd_ms - rmssd) / rmssd));
+    check(s.intervals == rr.size(), "gaussian window size");
+  }
+  s = hrv.snapshot((uint32_t)(beats.back() / 1000));
+  print("gaussian", s);
+  printf("           streaming vs batch recompute: worst relative difference %.2g\n", worst);
+  check(worst < 1e-4f, "streaming sums differ from the batch recompute");
+  check(near(s.rmssd_ms, (float)(sqrt(2.0) * 30), 0.1f) && near(s.sdnn_ms, 30, 0.1f), "gaussian RMSSD / SDNN");
+
+  // Artifacts on the sine series: missed beats, extra beats, displaced beats
+  std::vector<uint64_t> clean_beats = beatsFrom(sine);
+  std::vector<uint64_t> dirty;
+  std::uniform_real_distribution<double> uniform(0, 1);
+  int missed = 0, extra = 0, moved = 0;
+  for (size_t i = 0; i < clean_beats.size(); i++) {
+    double u = uniform(rng);
+    if (i > 0 && i + 1 < clean_beats.size() && u < 0.03) {
+      missed++;
+      continue;
+    }
+    if (i > 0 && u > 0.98) {
+      dirty.push_back((clean_beats[i - 1] + clean_beats[i]) / 2);
+      extra++;
+    }
+    if (i > 0 && i + 1 < clean_beats.size() && u > 0.03 && u < 0.035) {
+      dirty.push_back(clean_beats[i] + (uniform(rng) < 0.5 ? -250000 : 250000));
+      moved++;
+      continue;
+    }
+    dirty.push_back(clean_beats[i]);
+  }
+  s = replay(hrv, dirty);
+  print("artifacts", s);
+  printf("           %d missed, %d extra, %d displaced beats\n", missed, extra, moved);
+  check(near(s.rmssd_ms, clean.rmssd_ms, 0.05f) && near(s.sdnn_ms, clean.sdnn_ms, 0.05f), "artifacts not rejected");
+  check(s.artifacts > 0, "artifacts not counted");
+
+  // Step in heart rate
+  std::vector<double> step(200);
+  for (size_t i = 0; i < step.size(); i++) step[i] = i < 100 ? 1000 : 667;
+  beats = beatsFrom(step);
+  hrv.begin();
+  int follow = -1;
+  for (size_t i = 0; i < beats.size(); i++) {
+    hrv.addBeat(beats[i]);
+    if (i > 101 && follow < 0 && near(hrv.snapshot((uint32_t)(beats[i] / 1000)).hr_bpm, 90, 0.02f)) follow = (int)i - 101;
+  }
+  printf("step       60 -> 90 BPM followed after %d beats\n", follow);
+  check(follow >= 0 && follow <= 10, "HR step not followed");
+
+  // Producer thread through the ring
+  beats = beatsFrom(white);
+  static BeatRing<64> ring;
+  std::atomic<bool> done{false};
+  std::thread producer([&] {
+    for (uint64_t b : beats) {
+      while (!ring.push(b)) std::this_thread::yield();
+    }
+    done = true;
+  });
+  static HrvEngine threaded;
+  threaded.begin();
+  uint64_t t;
+  for (;;) {
+    if (ring.pop(t)) {
+      threaded.addBeat(t);
+    } else if (done) {
+      while (ring.pop(t)) threaded.addBeat(t);
+      break;
+    }
+  }
+  producer.join();
+  HrvSnapshot direct = replay(hrv, beats);
+  HrvSnapshot via_ring = threaded.snapshot((uint32_t)(beats.back() / 1000));
+  check(memcmp(&direct, &via_ring, sizeof(direct)) == 0, "ring replay differs from the direct run");
+  static BeatRing<64> full;
+  for (int i = 0; i < 100; i++) full.push(i);
+  check(full.dropped() == 36, "ring overflow not counted");
+  printf("ring       %zu beats through a 64-slot ring: %s; overflow drops %u of 100\n", beats.size(),
+         memcmp(&direct, &via_ring, sizeof(direct)) == 0 ? "identical" : "DIFFERENT", (unsigned)full.dropped());
+
+  // Cost
+  std::vector<double> long_rr(200000);
+  for (double& r : long_rr) r = noise(rng);
+  beats = beatsFrom(long_rr);
+  hrv.begin();
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint64_t b : beats) hrv.addBeat(b);
+  auto t1 = std::chrono::steady_clock::now();
+  float sink = 0;
+  uint32_t end_ms = (uint32_t)(beats.back() / 1000);
+  for (uint32_t k = 0; k < 200000; k++) sink += hrv.snapshot(end_ms).rmssd_ms;
+  auto t2 = std::chrono::steady_clock::now();
+  printf("memory: HrvEngine %zu B, BeatRing<64> %zu B\n", sizeof(HrvEngine), sizeof(BeatRing<64>));
+  printf("cost: addBeat %.1f ns, snapshot %.1f ns (checksum %.0f)\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / beats.size(),
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / 200000, fmodf(sink, 1000));
+
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
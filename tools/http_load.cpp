@@ -0,0 +1,558 @@
+// Host load test of the fall/seizure monitor's web routes.
+//
+// detector_web.h ("/", "/data", "/resetFall", "/resetSeizure") is served by
+// the socket-backed AsyncWebServer stand-in in tools/host. Next to it run
+// stand-ins for the sketch's detection task and loop(). The detection task
+// runs detectors.h on a synthetic IMU and samples every SAMPLE_DELAY_MS on
+// the virtual clock. loop() publishes /data whenever the flags change.
+// N clients of three kinds then run against it:
+//
+//   keepalive   If-None-Match on every poll, on one connection as long as
+//               the server keeps it open (a dashboard tab)
+//   poll        a new connection per request (a script polling /data)
+//   reconnect   "/" then --reload polls, then a new connection and "/"
+//               again (page reloads)
+//
+// For each client count the tool reports latency percentiles per kind.
+// Beside them it reports the detection task's achieved sample rate and its
+// largest gap between samples, so the cost of web load to sampling shows
+// next to the load. The synthetic wearer falls every 5 s and has a 30 s
+// seizure every 60 s (virtual). The first keepalive client acts as the
+// carer: it resets the flags it sees, so /data keeps changing and the reset
+// path is exercised end to end.
+//
+//   g++ -O2 -std=c++17 -pthread -Itools/host -o http_load tools/http_load.cpp
+//   ./http_load [--clients 1,8,32,128] [--seconds 10] [--interval-ms 100]
+//               [--reload 20] [--cost-us 0] [--max-conn 16] [--speed 1]
+//               [--keep-alive] [--one-core]
+//
+// --cost-us adds busy time to every request on the server thread, for the
+// work the ESP32 does far more slowly than a PC. The server closes every
+// connection after its response, as ESPAsyncWebServer does; --keep-alive
+// keeps them open instead, for comparison. --one-core puts the server, detection and
+// loop threads on CPU 0 with the device's priority order (SCHED_FIFO 3, 2
+// and 1 for async_tcp, detection and loop(), where permitted), the worst
+// case on the ESP32 where async_tcp may run on either core.
+//
+// Exit status is non-zero if a response is malformed or unexpected, a kind
+// of client gets no answers at all, the carer's resets never reach the
+// detectors, or a CORS preflight (OPTIONS /data) is not answered 200 with the
+// CORS headers. Slow answers and refused connections are results, not failures.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../detector_web.h"
+#include "../detectors.h"
+#include "../seqlock.h"
+
+// As iot/newfallseizurelogic.cpp
+const unsigned long SAMPLE_DELAY_MS = 100;
+const float FREEFALL_G = 0.5;
+const float GYRO_FALL_DEG_S = 100;
+const float SEIZURE_RMS_THR = 80;
+const unsigned long DEBOUNCE_MS = 100;
+const unsigned long SEIZURE_ALERT_MS = 13000;
+
+struct DetectorState {
+  int32_t fallFlag;
+  int32_t seizureFlag;
+  uint32_t updatedAt;
+};
+
+static SeqLock<DetectorState> detectorState;
+static SnapshotPublisher dataSnapshot;
+static CommandMailbox commands;
+static std::atomic<bool> running{true};
+static bool oneCore = false;
+
+// Resets the detection task applied while a flag was up
+static std::atomic<uint32_t> fallResets{0}, seizureResets{0};
+static std::atomic<uint32_t> fallsRaised{0};
+
+static std::atomic<bool> priorityRefused{false};
+
+// FreeRTOS priorities as on the device: async_tcp 3, detection 2, loop() 1
+static void pinToCpu0(int priority) {
+  if (!oneCore) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(0, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+  sched_param param = {};
+  param.sched_priority = priority;
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) priorityRefused = true;
+}
+
+// Clients go on the other CPUs, where there are any
+static void pinAwayFromCpu0() {
+  unsigned n = std::thread::hardware_concurrency();
+  if (!oneCore || n < 2) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned i = 1; i < n; i++) CPU_SET(i, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+}
+
+// ---- Detection task and loop() stand-ins ----
+
+struct SamplingStats {
+  uint64_t samples;
+  double first_ms;
+  double last_ms;
+  double max_gap_ms;
+  uint64_t late;  // gaps over 1.5 sample periods
+};
+
+static std::mutex samplingLock;
+static SamplingStats sampling;
+
+static void resetSampling() {
+  std::lock_guard<std::mutex> guard(samplingLock);
+  memset(&sampling, 0, sizeof(sampling));
+}
+
+static SamplingStats takeSampling() {
+  std::lock_guard<std::mutex> guard(samplingLock);
+  return sampling;
+}
+
+static void detectionTask() {
+  pinToCpu0(2);
+  FallDetector fallDetector({FREEFALL_G, GYRO_FALL_DEG_S, DEBOUNCE_MS, 0});
+  SeizureDetector seizureDetector({SEIZURE_RMS_THR, 100, SEIZURE_ALERT_MS});
+  std::mt19937 rng(44);
+  std::normal_distribution<float> noise(0, 1);
+
+  while (running) {
+    double now_ms = hostMillis();
+    {
+      std::lock_guard<std::mutex> guard(samplingLock);
+      if (sampling.samples) {
+        double gap = now_ms - sampling.last_ms;
+        if (gap > sampling.max_gap_ms) sampling.max_gap_ms = gap;
+        if (gap > 1.5 * SAMPLE_DELAY_MS) sampling.late++;
+      } else {
+        sampling.first_ms = now_ms;
+      }
+      sampling.last_ms = now_ms;
+      sampling.samples++;
+    }
+
+    uint32_t pending = commands.take();
+    if ((pending & CMD_RESET_FALL) && fallDetector.flag()) {
+      fallDetector.reset();
+      fallResets++;
+    }
+    if ((pending & CMD_RESET_SEIZURE) && seizureDetector.flag()) {
+      seizureDetector.reset();
+      seizureResets++;
+    }
+
+    // Still, with a 400 ms free fall and tumble every 5 s and 30 s of
+    // shaking every 60 s
+    uint32_t t = (uint32_t)now_ms;
+    float amag = 1.0f + 0.02f * noise(rng);
+    float wx = 3 * noise(rng), wy = 3 * noise(rng), wz = 3 * noise(rng);
+    if (t % 5000 >= 2000 && t % 5000 < 2400) {
+      amag = 0.2f;
+      wx += 150;
+    }
+    if (t % 60000 >= 20000 && t % 60000 < 50000) {
+      wx = 110 * noise(rng);
+      wy = 110 * noise(rng);
+      wz = 110 * noise(rng);
+    }
+    int before = fallDetector.flag();
+    if (fallDetector.update(t, amag, wx, wy, wz) && !before) fallsRaised++;
+    seizureDetector.update(t, sqrtf(wx * wx + wy * wy + wz * wz));
+
+    DetectorState state;
+    state.fallFlag = fallDetector.flag();
+    state.seizureFlag = seizureDetector.flag();
+    state.updatedAt = t;
+    detectorState.write(state);
+    delay(SAMPLE_DELAY_MS);
+  }
+}
+
+static void loopTask() {
+  pinToCpu0(1);
+  uint32_t seenVersion = 0;
+  int prevFallFlag = -1, prevSeizureFlag = -1;
+  while (running) {
+    if (detectorState.version() != seenVersion) {
+      DetectorState state;
+      seenVersion = detectorState.read(state);
+      if (state.fallFlag != prevFallFlag || state.seizureFlag != prevSeizureFlag) {
+        dataSnapshot.publish(detectorDataJson(state.fallFlag, state.seizureFlag));
+      }
+      prevFallFlag = state.fallFlag;
+      prevSeizureFlag = state.seizureFlag;
+    }
+    delay(10);
+  }
+}
+
+// ---- Clients ----
+
+enum ClientKind { KEEPALIVE, POLL, RECONNECT, KINDS };
+static const char* KIND_NAMES[KINDS] = {"keepalive", "poll", "reconnect"};
+
+struct Response {
+  int code;
+  std::string etag;
+  std::string allow_methods;  // CORS
+  std::string body;
+  bool close;
+};
+
+enum RequestResult { REQUEST_OK, REQUEST_REFUSED, REQUEST_FAILED, REQUEST_BAD };
+
+class HttpClient {
+public:
+  ~HttpClient() { disconnect(); }
+
+  bool connected() const { return fd >= 0; }
+
+  bool connectTo(uint16_t port) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout = {3, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+      disconnect();
+      return false;
+    }
+    fresh = true;
+    return true;
+  }
+
+  void disconnect() {
+    if (fd >= 0) close(fd);
+    fd = -1;
+    buffer.clear();
+  }
+
+  RequestResult get(const char* path, const std::string& etag, bool close_after, Response& response) {
+    return request("GET", path, etag, close_after, response);
+  }
+
+  RequestResult request(const char* method, const char* path, const std::string& etag, bool close_after,
+                        Response& response) {
+    std::string text = std::string(method) + " " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+    if (!etag.empty()) text += "If-None-Match: " + etag + "\r\n";
+    if (close_after) text += "Connection: close\r\n";
+    text += "\r\n";
+    bool first = fresh;
+    fresh = false;
+    if (send(fd, text.data(), text.size(), MSG_NOSIGNAL) != (ssize_t)text.size()) return fail(first);
+
+    size_t head_end;
+    while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (!receive()) return fail(first && buffer.empty());
+    }
+    std::string head = buffer.substr(0, head_end);
+    int code = 0;
+    if (sscanf(head.c_str(), "HTTP/1.1 %d", &code) != 1) return REQUEST_BAD;
+    response.code = code;
+    response.etag = header(head, "ETag");
+    response.allow_methods = header(head, "Access-Control-Allow-Methods");
+    response.close = header(head, "Connection") == "close";
+    size_t length = strtoul(header(head, "Content-Length").c_str(), nullptr, 10);
+    while (buffer.size() < head_end + 4 + length) {
+      if (!receive()) return fail(false);
+    }
+    response.body = buffer.substr(head_end + 4, length);
+    buffer.erase(0, head_end + 4 + length);
+    if (response.close) disconnect();
+    return REQUEST_OK;
+  }
+
+private:
+  int fd = -1;
+  bool fresh = false;
+  std::string buffer;
+
+  bool receive() {
+    char chunk[4096];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) return false;
+    buffer.append(chunk, n);
+    return true;
+  }
+
+  // Reset before anything came back on a new connection: the server was full
+  RequestResult fail(bool refused) {
+    disconnect();
+    return refused ? REQUEST_REFUSED : REQUEST_FAILED;
+  }
+
+  static std::string header(const std::string& head, const char* name) {
+    std::string key = std::string("\r\n") + name + ": ";
+    size_t at = head.find(key);
+    if (at == std::string::npos) return std::string();
+    size_t start = at + key.size();
+    return head.substr(start, head.find("\r\n", start) - start);
+  }
+};
+
+struct ClientStats {
+  std::vector<uint32_t> latency_us;
+  uint64_t not_modified = 0;
+  uint64_t failed = 0;
+  uint64_t refused = 0;
+  uint64_t bad = 0;
+  uint64_t connects = 0;
+
+  void merge(const ClientStats& other) {
+    latency_us.insert(latency_us.end(), other.latency_us.begin(), other.latency_us.end());
+    not_modified += other.not_modified;
+    failed += other.failed;
+    refused += other.refused;
+    bad += other.bad;
+    connects += other.connects;
+  }
+};
+
+struct LoadConfig {
+  uint16_t port;
+  uint32_t interval_ms;
+  uint32_t reload;
+};
+
+static std::atomic<bool> clientsRunning{false};
+static std::atomic<uint32_t> carerResetsSent{0};
+static std::atomic<uint32_t> carerResetsSeen{0};  // flag up, reset sent, flag seen down again
+
+static void clientTask(ClientKind kind, bool carer, uint32_t seed, const LoadConfig& config, ClientStats& stats) {
+  pinAwayFromCpu0();
+  typedef std::chrono::steady_clock Clock;
+  std::mt19937 rng(seed);
+  Clock::time_point next = Clock::now() + std::chrono::milliseconds(rng() % (config.interval_ms + 1));
+  HttpClient client;
+  std::string etag;
+  uint32_t since_load = 0;  // polls since the page was (re)loaded
+  bool reset_pending = false;
+
+  while (clientsRunning) {
+    std::this_thread::sleep_until(next);
+    next = std::max(next + std::chrono::milliseconds(config.interval_ms), Clock::now());
+    if (!clientsRunning) break;
+
+    Clock::time_point t0 = Clock::now();
+    if (!client.connected()) {
+      if (!client.connectTo(config.port)) {
+        stats.failed++;
+        continue;
+      }
+      stats.connects++;
+    }
+    const char* path = "/data";
+    if (kind == RECONNECT && since_load == 0) path = "/";
+    bool close_after = kind == POLL || (kind == RECONNECT && since_load == config.reload);
+    Response response;
+    RequestResult result = client.get(path, kind == KEEPALIVE ? etag : std::string(), close_after, response);
+    uint32_t us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+    since_load = kind == RECONNECT && close_after ? 0 : since_load + 1;
+    if (result == REQUEST_REFUSED) {
+      stats.refused++;
+      continue;
+    }
+    if (result == REQUEST_FAILED) {
+      stats.failed++;
+      continue;
+    }
+    if (result == REQUEST_BAD || (response.code != 200 && response.code != 304)) {
+      stats.bad++;
+      continue;
+    }
+    stats.latency_us.push_back(us);
+    if (response.code == 304) {
+      stats.not_modified++;
+      continue;
+    }
+    if (strcmp(path, "/data") != 0) continue;
+    etag = response.etag;
+
+    // The carer clears what it sees, as someone at the dashboard would
+    if (!carer) continue;
+    bool fall = response.body.find("\"fallFlag\":1") != std::string::npos;
+    bool severe = response.body.find("\"seizureFlag\":2") != std::string::npos;
+    if (reset_pending && !fall) {
+      carerResetsSeen++;
+      reset_pending = false;
+    }
+    if ((fall || severe) && (client.connected() || client.connectTo(config.port))) {
+      Response ignored;
+      RequestResult sent = client.get(fall ? "/resetFall" : "/resetSeizure", std::string(), false, ignored);
+      if (sent != REQUEST_OK || ignored.code != 200) {
+        stats.bad++;
+      } else if (fall) {
+        carerResetsSent++;
+        reset_pending = true;
+      }
+    }
+  }
+}
+
+// ---- Report ----
+
+static double percentileMs(const std::vector<uint32_t>& sorted, double q) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)ceil(q * sorted.size());
+  return sorted[i ? i - 1 : 0] / 1000.0;
+}
+
+static std::vector<uint32_t> parseList(const char* s) {
+  std::vector<uint32_t> out;
+  for (const char* p = s; *p;) {
+    out.push_back((uint32_t)strtoul(p, (char**)&p, 10));
+    if (*p == ',') p++;
+    else if (*p) break;
+  }
+  return out;
+}
+
+int main(int argc, char** argv) {
+  std::vector<uint32_t> levels = {1, 8, 32, 128};
+  double seconds = 10, speed = 1;
+  LoadConfig config = {0, 100, 20};
+  uint32_t cost_us = 0, max_conn = 16;
+  bool keep_alive = false;
+  for (int i = 1; i < argc; i++) {
+    bool more = i + 1 < argc;
+    if (!strcmp(argv[i], "--clients") && more) levels = parseList(argv[++i]);
+    else if (!strcmp(argv[i], "--seconds") && more) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--interval-ms") && more) config.interval_ms = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--reload") && more) config.reload = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--cost-us") && more) cost_us = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--max-conn") && more) max_conn = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--speed") && more) speed = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--keep-alive")) keep_alive = true;
+    else if (!strcmp(argv[i], "--one-core")) oneCore = true;
+    else {
+      fprintf(stderr, "usage: %s [--clients 1,8,32,128] [--seconds 10] [--interval-ms 100] [--reload 20]\n"
+                      "          [--cost-us 0] [--max-conn 16] [--speed 1] [--keep-alive] [--one-core]\n", argv[0]);
+      return 2;
+    }
+  }
+  hostClockSpeed(speed);
+
+  DetectorState initial = {0, 0, 0};
+  detectorState.write(initial);
+  dataSnapshot.publish(detectorDataJson(0, 0));
+  AsyncWebServer server(0);
+  server.setMaxConnections(max_conn);
+  server.setKeepAlive(keep_alive);
+  server.setServiceCost(cost_us);
+  server.onStart([] { pinToCpu0(3); });
+  addDetectorRoutes(server, dataSnapshot, commands);
+  server.begin();
+  if (!server.port()) return 1;
+  config.port = server.port();
+  std::thread detection(detectionTask);
+  std::thread loop(loopTask);
+
+  printf("server on 127.0.0.1:%u, %u connections max, %u us per request, %s; virtual clock x%g%s\n",
+         (unsigned)config.port, (unsigned)max_conn, (unsigned)cost_us, keep_alive ? "keep-alive" : "closes every connection",
+         speed, oneCore ? ", server / detection / loop on CPU 0" : "");
+  if (priorityRefused) printf("SCHED_FIFO not permitted: CPU 0 is shared without device priorities\n");
+  printf("clients poll every %u ms; reconnecting clients reload after %u polls\n\n", (unsigned)config.interval_ms,
+         (unsigned)config.reload);
+
+  int failures = 0;
+
+  // A browser on another origin sends a CORS preflight before its requests
+  {
+    HttpClient client;
+    Response preflight;
+    if (!client.connectTo(config.port) || client.request("OPTIONS", "/data", "", true, preflight) != REQUEST_OK ||
+        preflight.code != 200 || preflight.allow_methods.empty()) {
+      printf("FAIL: OPTIONS /data did not get a 200 with CORS headers\n");
+      failures++;
+    }
+  }
+
+  ClientStats totals[KINDS];
+  for (uint32_t n : levels) {
+    std::vector<ClientStats> stats(n);
+    std::vector<std::thread> clients;
+    AsyncWebServer::Stats s0 = server.stats();
+    resetSampling();
+    clientsRunning = true;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < n; i++) {
+      clients.emplace_back(clientTask, (ClientKind)(i % KINDS), i == 0, 1000 + i, std::cref(config), std::ref(stats[i]));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    SamplingStats sampled = takeSampling();
+    clientsRunning = false;
+    for (std::thread& t : clients) t.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    AsyncWebServer::Stats s1 = server.stats();
+
+    printf("%u clients: %.0f req/s, server busy %.1f %%, %u connections open at most\n", (unsigned)n,
+           (s1.requests - s0.requests) / elapsed, 100 * (s1.busy_ms - s0.busy_ms) / (1000 * elapsed),
+           (unsigned)s1.max_open);
+    printf("  %-10s %8s %8s %8s %8s %8s %6s %7s %7s %6s\n", "kind", "requests", "p50 ms", "p90 ms", "p99 ms", "max ms",
+           "304 %", "failed", "refused", "bad");
+    for (int k = 0; k < KINDS; k++) {
+      ClientStats kind;
+      for (uint32_t i = k; i < n; i += KINDS) kind.merge(stats[i]);
+      if (k >= (int)n) continue;
+      std::sort(kind.latency_us.begin(), kind.latency_us.end());
+      size_t answered = kind.latency_us.size();
+      printf("  %-10s %8zu %8.2f %8.2f %8.2f %8.2f %6.1f %7llu %7llu %6llu\n", KIND_NAMES[k], answered,
+             percentileMs(kind.latency_us, 0.5), percentileMs(kind.latency_us, 0.9),
+             percentileMs(kind.latency_us, 0.99), answered ? kind.latency_us.back() / 1000.0 : 0,
+             answered ? 100.0 * kind.not_modified / answered : 0, (unsigned long long)kind.failed,
+             (unsigned long long)kind.refused, (unsigned long long)kind.bad);
+      if (!answered) {
+        printf("FAIL: no %s client got an answer\n", KIND_NAMES[k]);
+        failures++;
+      }
+      totals[k].merge(kind);
+    }
+    double span_ms = sampled.last_ms - sampled.first_ms;
+    double rate = span_ms > 0 ? (sampled.samples - 1) * 1000.0 / span_ms : 0;
+    printf("  sampling   %.2f Hz (nominal %.1f), largest gap %.1f ms, %llu gaps over %.0f ms\n\n", rate,
+           1000.0 / SAMPLE_DELAY_MS, sampled.max_gap_ms, (unsigned long long)sampled.late, 1.5 * SAMPLE_DELAY_MS);
+  }
+
+  running = false;
+  detection.join();
+  loop.join();
+  server.end();
+
+  uint64_t bad = 0;
+  for (const ClientStats& k : totals) bad += k.bad;
+  printf("falls raised %u; carer sent %u fall resets and saw %u falls cleared; applied: fall %u, seizure %u\n",
+         (unsigned)fallsRaised, (unsigned)carerResetsSent, (unsigned)carerResetsSeen, (unsigned)fallResets,
+         (unsigned)seizureResets);
+  if (bad) {
+    printf("FAIL: %llu malformed or unexpected responses\n", (unsigned long long)bad);
+    failures++;
+  }
+  if (carerResetsSent && !fallResets) {
+    printf("FAIL: fall resets did not reach the detector\n");
+    failures++;
+  }
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,283 @@
+// Host simulation of i2c_recovery.h against a fault-injecting mock MPU6050.
+//
+// The mock bus charges virtual time for every transfer (a sample read 1 ms,
+// unstick 0.1 ms, re-sync 1 ms, a full driver init 150 ms) and injects:
+//
+//   transient  one NACKed read, nothing wrong afterwards
+//   stuck-sda  the sensor holds SDA low until the bus is clocked free
+//   brownout   the sensor answers but lost its configuration (re-sync)
+//   wedged     no answer until the sensor is reset by a full init
+//   power-3s   the sensor is unpowered for 3 s, then comes back asleep
+//   flapping   stuck-sda every 300 ms for 3 s
+//
+// Each runs for 20 s on the 100 ms sampling loop of newfallseizurelogic.cpp.
+// It runs once with the recovery state machine and once with the old code
+// (delay(1000), then up to 5 driver inits 500 ms apart, then give up). The
+// table gives the time blind, the step that fixed it, and the longest single
+// pass of the loop.
+//
+//   g++ -O2 -std=c++17 -o i2c_recovery_sim tools/i2c_recovery_sim.cpp
+//   ./i2c_recovery_sim
+//
+// Exit status is non-zero if a fault is not recovered within its bound, a
+// pass blocks longer than one init, or the counters disagree with the sim.
+
+#include <stdio.h>
+#include <vector>
+#include "../i2c_recovery.h"
+
+static const double SAMPLE_DELAY_MS = 100;
+static const double READ_MS = 1.0;
+static const double UNSTICK_MS = 0.1;
+static const double RESYNC_MS = 1.0;
+static const double INIT_MS = 150;
+static const double RUN_MS = 20000;
+static const double FAULT_MS = 2000;
+
+enum Fault { TRANSIENT, STUCK_SDA, BROWNOUT, WEDGED, POWER_OFF, POWER_ON };
+
+struct Event {
+  double t_ms;
+  Fault fault;
+};
+
+// ---- Mock sensor and bus ----
+
+struct MockMpu {
+  bool powered;
+  bool stuck;    // SDA held low
+  bool asleep;   // configuration lost
+  bool wedged;   // needs a reset
+  int nacks;     // transient failures left
+};
+
+static MockMpu mpu;
+static double clock_ms;
+static std::vector<Event> events;
+static size_t next_event;
+
+static void applyEvents() {
+  while (next_event < events.size() && events[next_event].t_ms <= clock_ms) {
+    switch (events[next_event].fault) {
+      case TRANSIENT: mpu.nacks = 1; break;
+      case STUCK_SDA: mpu.stuck = true; break;
+      case BROWNOUT: mpu.asleep = true; break;
+      case WEDGED: mpu.wedged = true; break;
+      case POWER_OFF: mpu.powered = false; break;
+      case POWER_ON:
+        mpu.powered = true;
+        mpu.asleep = true;
+        break;
+    }
+    next_event++;
+  }
+}
+
+// Time passes, faults arrive
+static void spend(double ms) {
+  clock_ms += ms;
+  applyEvents();
+}
+
+static bool answers() { return mpu.powered && !mpu.stuck && !mpu.wedged; }
+
+static bool mockRead() {
+  spend(READ_MS);
+  if (!answers()) return false;
+  if (mpu.nacks) {
+    mpu.nacks--;
+    return false;
+  }
+  return !mpu.asleep;
+}
+
+static bool mockUnstick() {
+  spend(UNSTICK_MS);
+  mpu.stuck = false;
+  return answers();  // address probe
+}
+
+static bool mockResync() {
+  spend(RESYNC_MS);
+  if (!answers()) return false;
+  mpu.asleep = false;
+  return true;
+}
+
+static bool mockInit() {
+  spend(INIT_MS);
+  if (!mpu.powered || mpu.stuck) return false;
+  mpu.wedged = false;
+  mpu.asleep = false;
+  return true;
+}
+
+// ---- The two sampling loops ----
+
+struct Run {
+  double blind_ms;       // total, from a failed read to the next good one
+  double worst_blind_ms;
+  double longest_pass_ms;
+  bool lost;             // never read again
+};
+
+static void reset(const std::vector<Event>& scenario) {
+  mpu = {true, false, false, false, 0};
+  clock_ms = 0;
+  events = scenario;
+  next_event = 0;
+}
+
+// Outage bookkeeping shared by both loops
+struct Outages {
+  Run run = {0, 0, 0, false};
+  bool blind = false;
+  double since = 0;
+
+  void failed() {
+    if (!blind) since = clock_ms;
+    blind = true;
+  }
+  void good() {
+    if (!blind) return;
+    double outage = clock_ms - since;
+    run.blind_ms += outage;
+    if (outage > run.worst_blind_ms) run.worst_blind_ms = outage;
+    blind = false;
+  }
+  void pass(double started) {
+    if (clock_ms - started > run.longest_pass_ms) run.longest_pass_ms = clock_ms - started;
+  }
+  Run end() {
+    if (blind) {
+      run.lost = true;
+      run.blind_ms += clock_ms - since;
+      if (clock_ms - since > run.worst_blind_ms) run.worst_blind_ms = clock_ms - since;
+    }
+    return run;
+  }
+};
+
+static Run runRecovery(const std::vector<Event>& scenario, I2CRecoveryStats& stats) {
+  reset(scenario);
+  I2CRecovery recovery;
+  recovery.begin({mockUnstick, mockResync, mockInit}, 500, 10000);
+  Outages outages;
+  while (clock_ms < RUN_MS) {
+    double started = clock_ms;
+    if (recovery.healthy()) {
+      uint32_t now;
+      if (mockRead()) {
+        now = (uint32_t)clock_ms;
+        recovery.readOk(now);
+        outages.good();
+      } else {
+        now = (uint32_t)clock_ms;
+        recovery.readFailed(now);
+        outages.failed();
+      }
+    }
+    if (!recovery.healthy()) recovery.step((uint32_t)clock_ms);
+    outages.pass(started);
+    spend(SAMPLE_DELAY_MS);
+  }
+  stats = recovery.stats((uint32_t)clock_ms);
+  return outages.end();
+}
+
+static Run runOld(const std::vector<Event>& scenario) {
+  reset(scenario);
+  bool connected = true;
+  Outages outages;
+  while (clock_ms < RUN_MS) {
+    double started = clock_ms;
+    if (connected) {
+      if (mockRead()) {
+        outages.good();
+      } else {
+        outages.failed();
+        spend(1000);
+        connected = false;
+        for (int i = 0; i < 5 && !connected; i++) {
+          connected = mockInit();
+          if (!connected) spend(500);
+        }
+      }
+    }
+    outages.pass(started);
+    spend(SAMPLE_DELAY_MS);
+  }
+  return outages.end();
+}
+
+// ---- Scenarios ----
+
+struct Scenario {
+  const char* name;
+  std::vector<Event> events;
+  double bound_ms;  // recovery must be within this much blind time
+  I2CRecoveryStep fixed_by;
+};
+
+int main() {
+  std::vector<Event> flapping;
+  for (double t = FAULT_MS; t < FAULT_MS + 3000; t += 300) flapping.push_back({t, STUCK_SDA});
+
+  std::vector<Scenario> scenarios = {
+      {"transient", {{FAULT_MS, TRANSIENT}}, 2 * SAMPLE_DELAY_MS, I2C_STEP_UNSTICK},
+      {"stuck-sda", {{FAULT_MS, STUCK_SDA}}, 2 * SAMPLE_DELAY_MS, I2C_STEP_UNSTICK},
+      {"brownout", {{FAULT_MS, BROWNOUT}}, 3 * SAMPLE_DELAY_MS, I2C_STEP_RESYNC},
+      {"wedged", {{FAULT_MS, WEDGED}}, 2 * SAMPLE_DELAY_MS + INIT_MS, I2C_STEP_REINIT},
+      {"power-3s", {{FAULT_MS, POWER_OFF}, {FAULT_MS + 3000, POWER_ON}}, 3000 + 1000 + INIT_MS, I2C_STEP_REINIT},
+      {"flapping", flapping, 3000 + 4000, I2C_STEP_REINIT},
+  };
+
+  int failures = 0;
+  printf("%-10s | %9s %9s %8s %8s %8s %9s | %9s %9s\n", "", "blind ms", "worst ms", "unstick", "resync", "reinit",
+         "pass ms", "old blind", "old pass");
+  printf("%-10s | %9s %9s %8s %8s %8s %9s | %9s %9s\n", "scenario", "", "", "fix/try", "fix/try", "fix/try", "longest",
+         "ms", "longest");
+  for (const Scenario& sc : scenarios) {
+    I2CRecoveryStats s;
+    Run now = runRecovery(sc.events, s);
+    Run old = runOld(sc.events);
+    char unstick[16], resync[16], reinit[16];
+    snprintf(unstick, sizeof(unstick), "%u/%u", (unsigned)s.unstick_fixes, (unsigned)s.unstick_attempts);
+    snprintf(resync, sizeof(resync), "%u/%u", (unsigned)s.resync_fixes, (unsigned)s.resync_attempts);
+    snprintf(reinit, sizeof(reinit), "%u/%u", (unsigned)s.reinit_fixes, (unsigned)s.reinit_attempts);
+    char old_blind[16];
+    if (old.lost) snprintf(old_blind, sizeof(old_blind), "lost");
+    else snprintf(old_blind, sizeof(old_blind), "%.0f", old.blind_ms);
+    printf("%-10s | %9.0f %9.0f %8s %8s %8s %9.1f | %9s %9.0f\n", sc.name, now.blind_ms, now.worst_blind_ms, unstick,
+           resync, reinit, now.longest_pass_ms, old_blind, old.longest_pass_ms);
+
+    if (now.lost || now.worst_blind_ms > sc.bound_ms) {
+      printf("FAIL: %s not recovered within %.0f ms\n", sc.name, sc.bound_ms);
+      failures++;
+    }
+    uint32_t fixes[] = {0, s.unstick_fixes, s.resync_fixes, s.reinit_fixes};
+    if (!fixes[sc.fixed_by]) {
+      printf("FAIL: %s was expected to need the %s step\n", sc.name,
+             sc.fixed_by == I2C_STEP_UNSTICK ? "unstick" : sc.fixed_by == I2C_STEP_RESYNC ? "resync" : "reinit");
+      failures++;
+    }
+    if (now.longest_pass_ms > READ_MS + 2 * UNSTICK_MS + RESYNC_MS + INIT_MS + 1e-6) {
+      printf("FAIL: %s: a pass blocked for %.1f ms\n", sc.name, now.longest_pass_ms);
+      failures++;
+    }
+    // The state machine's own blind time, kept in whole ms per outage
+    if (!s.healthy || s.blind_now_ms || (double)s.blind_ms > now.blind_ms + 1 ||
+        (double)s.blind_ms < now.blind_ms - 1 - s.faults) {
+      printf("FAIL: %s: counters say %u ms blind, the sim %.1f ms\n", sc.name, (unsigned)s.blind_ms, now.blind_ms);
+      failures++;
+    }
+  }
+
+  char json[320];
+  I2CRecoveryStats s;
+  runRecovery(scenarios.back().events, s);
+  i2cRecoveryJson(s, json, sizeof(json));
+  printf("\n/i2c after flapping: %s\n", json);
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,470 @@
+// Host simulation of i2c_scheduler.h: deadline adherence under bus load.
+//
+// The scheduler runs unchanged on a small cooperative stand-in for FreeRTOS:
+// every task is a thread, but only one runs at a time and the virtual clock
+// only moves when the running one blocks (vTaskDelay on 1 ms ticks, or an
+// I2C transfer). Runs are therefore deterministic. Priorities are not
+// modelled: on the ESP32 the bus tasks sit above loop() on two cores, and
+// what delays them is the bus, not the CPU.
+//
+// The mock bus charges 9 bit times per byte plus 30 us per transaction, so
+// a 14-byte burst read takes ~0.4 ms at 400 kHz. Devices that are not there
+// NACK after the address byte. A transfer can be made to hang until the
+// driver's 50 ms timeout. The sketch's two jobs are modelled by the transfers
+// they make: the MPU6050 FIFO drain (count, then ~5 samples of 12 bytes) and
+// pox.update() (status, FIFO pointers, one 4-byte sample).
+//
+//   sketch      combinedsense.cpp as configured: MPU6050 job every 50 ms on
+//               bus 0, MAX30100 job every 10 ms on bus 1, 400 kHz
+//   loaded      bus 0 also carries four burst-read devices (2 to 10 ms),
+//               about 50 % busy
+//   saturated   the same devices on shorter periods, about 70 % busy
+//   overload    more than the bus can carry, about 110 %
+//   timeouts    sketch, with 1 % of bus 0 transfers hanging until the timeout
+//   loop-stall  sketch, with loop() not calling poll() for 300 ms every 5 s
+//
+// Each runs for 60 s of virtual time. The clock starts 5 s before micros()
+// wraps. For every stream the table shows how many of its releases ran, its
+// deadline misses (completion later than release + period), the worst and
+// 99th percentile response time (completion - release), and whether the
+// scheduler's own counters agree with what the simulation saw.
+//
+// Transfers are not preempted, so a stream can miss while the bus still has
+// room overall: in the saturated case the 2 ms streams sometimes wait behind
+// the 1.6 ms FIFO drain. Those misses are reported, not failed. Under
+// overload EDF keeps every stream running but late, including the 50 ms one.
+//
+//   g++ -O2 -std=c++17 -pthread -Itools/host -o i2c_scheduler_sim tools/i2c_scheduler_sim.cpp
+//   ./i2c_scheduler_sim
+//
+// Exit status is non-zero if a stream misses a deadline where the bus has
+// room for it (sketch, loaded, loop-stall, the healthy bus under timeouts),
+// a stream is starved under overload, or the scheduler's counters disagree
+// with the simulation.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include <Arduino.h>
+#include <Wire.h>
+
+// ---- Cooperative FreeRTOS stand-in on a virtual clock ----
+
+static const uint64_t TICK_US = 1000;
+
+struct Wake {
+  uint64_t t_us;
+  uint64_t seq;
+  int thread;
+  bool operator>(const Wake& o) const { return t_us != o.t_us ? t_us > o.t_us : seq > o.seq; }
+};
+
+static std::mutex k_lock;
+static std::condition_variable k_cv;
+static uint64_t k_now_us;
+static uint64_t k_seq;
+static int k_running;  // thread holding the (single) CPU
+static int k_threads;
+static std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake> > k_wakes;
+static thread_local int k_self;
+
+// The running thread blocks until t_us; the earliest waiting one runs next
+static void kSleepUntil(uint64_t t_us) {
+  std::unique_lock<std::mutex> l(k_lock);
+  k_wakes.push({t_us, k_seq++, k_self});
+  Wake next = k_wakes.top();
+  k_wakes.pop();
+  if (next.t_us > k_now_us) k_now_us = next.t_us;
+  k_running = next.thread;
+  k_cv.notify_all();
+  k_cv.wait(l, [] { return k_running == k_self; });
+}
+
+static uint64_t kNow() {
+  std::lock_guard<std::mutex> l(k_lock);
+  return k_now_us;
+}
+
+static void kSleep(uint64_t us) { kSleepUntil(kNow() + us); }
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef int* TaskHandle_t;
+typedef std::mutex* SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdPASS 1
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Wakes on the ticks-th tick boundary from now, like the real one
+static void vTaskDelay(TickType_t ticks) { kSleepUntil((kNow() / TICK_US + ticks) * TICK_US); }
+
+static BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char*, uint32_t, void* arg, UBaseType_t,
+                                          TaskHandle_t* handle, int) {
+  int id;
+  {
+    std::lock_guard<std::mutex> l(k_lock);
+    id = ++k_threads;
+    k_wakes.push({k_now_us, k_seq++, id});
+  }
+  std::thread([fn, arg, id] {
+    k_self = id;
+    {
+      std::unique_lock<std::mutex> l(k_lock);
+      k_cv.wait(l, [] { return k_running == k_self; });
+    }
+    fn(arg);
+  }).detach();
+  if (handle) *handle = NULL;
+  return pdPASS;
+}
+
+// Only one thread runs at a time and nothing blocks inside the scheduler's
+// critical sections, so the mutex can never be contended; check that it isn't
+static SemaphoreHandle_t xSemaphoreCreateMutex() { return new std::mutex; }
+
+static BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t) {
+  if (!m->try_lock()) {
+    fprintf(stderr, "scheduler mutex contended in a cooperative run\n");
+    _exit(2);
+  }
+  return pdTRUE;
+}
+
+static BaseType_t xSemaphoreGive(SemaphoreHandle_t m) {
+  m->unlock();
+  return pdTRUE;
+}
+
+struct SimQueue {
+  size_t item, capacity;
+  std::deque<std::vector<uint8_t> > items;
+};
+typedef SimQueue* QueueHandle_t;
+
+static QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item) { return new SimQueue{item, length, {}}; }
+
+static BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t) {
+  if (q->items.size() >= q->capacity) return pdFALSE;
+  q->items.emplace_back((const uint8_t*)item, (const uint8_t*)item + q->item);
+  return pdTRUE;
+}
+
+static BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t) {
+  if (q->items.empty()) return pdFALSE;
+  memcpy(item, q->items.front().data(), q->item);
+  q->items.pop_front();
+  return pdTRUE;
+}
+
+#include "../i2c_scheduler.h"
+
+// ---- Mock bus ----
+
+static const uint32_t TRANSACTION_US = 30;
+static const uint32_t TIMEOUT_US = 50000;  // Wire's default
+
+class MockBus : public TwoWire {
+public:
+  uint32_t khz = 400;
+  double hang_probability = 0;
+  std::vector<uint8_t> present;
+  uint64_t busy_us = 0;
+  uint32_t hangs = 0;
+  std::mt19937 rng;
+
+  void beginTransmission(uint8_t addr) override {
+    target = addr;
+    written = 0;
+  }
+
+  size_t write(uint8_t) override {
+    written++;
+    return 1;
+  }
+
+  uint8_t endTransmission(bool) override {
+    if (!transfer(written)) return 2;
+    return 0;
+  }
+
+  size_t requestFrom(uint8_t addr, size_t len, bool) override {
+    target = addr;
+    if (!transfer(len)) return 0;
+    pending = len;
+    return len;
+  }
+
+  int available() override { return (int)pending; }
+
+  int read() override {
+    if (!pending) return -1;
+    pending--;
+    return 0;
+  }
+
+private:
+  uint8_t target = 0;
+  size_t written = 0, pending = 0;
+
+  // Address byte plus `bytes`, 9 bit times each
+  bool transfer(size_t bytes) {
+    bool there = std::find(present.begin(), present.end(), target) != present.end();
+    uint64_t us = TRANSACTION_US + (uint64_t)(there ? bytes + 1 : 1) * 9 * 1000 / khz;
+    bool hang = there && std::uniform_real_distribution<double>(0, 1)(rng) < hang_probability;
+    if (hang) {
+      us = TIMEOUT_US;
+      hangs++;
+    }
+    busy_us += us;
+    kSleep(us);
+    return there && !hang;
+  }
+};
+
+// ---- Streams ----
+
+enum Kind { BURST, MPU_FIFO_JOB, POX_JOB };
+
+struct StreamSpec {
+  const char* name;
+  uint8_t bus;
+  Kind kind;
+  uint8_t addr;
+  uint8_t len;  // BURST only
+  uint32_t period_us;
+};
+
+struct Observed {
+  uint32_t completions;
+  uint32_t misses;
+  uint32_t errors;
+  std::vector<uint32_t> response_us;
+};
+
+static std::vector<StreamSpec> specs;
+static std::vector<Observed> observed;
+static std::mt19937 job_rng(7);
+
+static bool burst(TwoWire& bus, uint8_t addr, uint8_t reg, size_t len) {
+  bus.beginTransmission(addr);
+  bus.write(reg);
+  if (bus.endTransmission(false) != 0) return false;
+  if (bus.requestFrom(addr, len) != len) return false;
+  while (len--) bus.read();
+  return true;
+}
+
+// The transfers readMPU() makes: FIFO count, then the samples in bursts of 10
+static bool mpuFifoJob(TwoWire& bus, I2CTransaction& t) {
+  if (!burst(bus, 0x68, 0x72, 2)) return false;
+  int samples = 4 + job_rng() % 3;  // 100 Hz into a 50 ms drain, with jitter
+  while (samples > 0) {
+    int chunk = std::min(samples, 10);
+    if (!burst(bus, 0x68, 0x74, chunk * 12)) return false;
+    samples -= chunk;
+  }
+  t.len = 0;
+  return true;
+}
+
+// The transfers pox.update() makes for one sample
+static bool poxJob(TwoWire& bus, I2CTransaction& t) {
+  t.len = 0;
+  return burst(bus, 0x57, 0x00, 1) && burst(bus, 0x57, 0x02, 3) && burst(bus, 0x57, 0x05, 4);
+}
+
+// Bus time one run of a stream takes, from the same model as MockBus
+static double runCostUs(const StreamSpec& s, uint32_t khz) {
+  auto burstUs = [khz](double len) { return 2 * TRANSACTION_US + (2 + len + 1) * 9 * 1000.0 / khz; };
+  switch (s.kind) {
+    case BURST: return burstUs(s.len);
+    case MPU_FIFO_JOB: return burstUs(2) + burstUs(5 * 12);
+    case POX_JOB: return burstUs(1) + burstUs(3) + burstUs(4);
+  }
+  return 0;
+}
+
+static void onComplete(const I2CTransaction& t) {
+  Observed& o = observed[t.stream];
+  o.completions++;
+  if (!t.ok) o.errors++;
+  if ((int32_t)(t.done_us - t.deadline_us) > 0) o.misses++;
+  o.response_us.push_back(t.done_us - t.release_us);
+}
+
+// ---- Scenarios ----
+
+struct Scenario {
+  const char* name;
+  uint32_t khz[I2C_MAX_BUSES];
+  std::vector<StreamSpec> streams;
+  double hang_probability;      // bus 0
+  uint32_t stall_every_us;      // loop() stops polling ...
+  uint32_t stall_us;            // ... for this long
+  bool misses_allowed[I2C_MAX_BUSES];
+  bool overload;
+};
+
+static const uint64_t RUN_US = 60000000;
+static const uint64_t START_US = 0x100000000ull - 5000000;  // 5 s before micros() wraps
+
+static const StreamSpec MPU = {"mpu6050 fifo", 0, MPU_FIFO_JOB, 0x68, 0, 50000};
+static const StreamSpec POX = {"max30100", 1, POX_JOB, 0x57, 0, 10000};
+
+static int failures = 0;
+
+static uint32_t percentile(std::vector<uint32_t> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+static void run(const Scenario& sc) {
+  // A fresh scheduler and buses per scenario. The previous scenario's bus
+  // tasks stay parked for good (their wake-ups were dropped), still pointing
+  // at their own objects, so those are never freed.
+  I2CScheduler* i2c = new I2CScheduler();
+  MockBus* bus = new MockBus[I2C_MAX_BUSES];
+  {
+    std::lock_guard<std::mutex> l(k_lock);
+    k_now_us = START_US;
+  }
+  specs = sc.streams;
+  observed.assign(specs.size(), Observed());
+  for (int b = 0; b < I2C_MAX_BUSES; b++) {
+    bus[b].khz = sc.khz[b];
+    bus[b].rng.seed(100 + b);
+    bus[b].hang_probability = b == 0 ? sc.hang_probability : 0;
+    i2c->attachBus(b, &bus[b]);
+  }
+  for (const StreamSpec& s : specs) {
+    bus[s.bus].present.push_back(s.addr);
+    if (s.kind == BURST) i2c->addRead(s.bus, s.addr, 0x3B, s.len, s.period_us, onComplete);
+    else i2c->addJob(s.bus, s.kind == MPU_FIFO_JOB ? mpuFifoJob : poxJob, s.period_us, onComplete);
+  }
+  i2c->begin();
+
+  // loop(): poll every tick, with the stalls
+  uint64_t start = kNow(), next_stall = start + sc.stall_every_us;
+  while (kNow() - start < RUN_US) {
+    if (sc.stall_us && kNow() >= next_stall) {
+      kSleep(sc.stall_us);
+      next_stall += sc.stall_every_us;
+    }
+    i2c->poll();
+    vTaskDelay(1);
+  }
+  i2c->poll();
+  // Stop the bus tasks for good: drop their pending wake-ups
+  {
+    std::lock_guard<std::mutex> l(k_lock);
+    while (!k_wakes.empty()) k_wakes.pop();
+  }
+
+  printf("\n%s\n", sc.name);
+  for (int b = 0; b < I2C_MAX_BUSES; b++) {
+    double demand = 0;
+    for (const StreamSpec& s : specs)
+      if (s.bus == b) demand += runCostUs(s, sc.khz[b]) / s.period_us;
+    printf("  bus %d  %u kHz  demand %.0f %%  busy %.0f %%%s\n", b, sc.khz[b], 100 * demand,
+           100.0 * bus[b].busy_us / RUN_US,
+           bus[b].hangs ? (" (" + std::to_string(bus[b].hangs) + " timeouts)").c_str() : "");
+  }
+  printf("  %-14s %3s %7s %9s %7s %7s %9s %9s  %s\n", "stream", "bus", "period", "ran", "errors", "misses",
+         "p99 resp", "worst", "counters");
+  uint32_t delivered_total = 0, runs_total = 0;
+  for (size_t i = 0; i < specs.size(); i++) {
+    const StreamSpec& s = specs[i];
+    const I2CStream& st = i2c->stream(i);
+    Observed& o = observed[i];
+    delivered_total += o.completions;
+    runs_total += st.runs;
+    double nominal = (double)RUN_US / s.period_us;
+    // With nothing dropped the scheduler's counters must match the deliveries
+    // (while loop() stalls some are dropped unseen, and counted as dropped)
+    bool agree = sc.stall_us ? st.runs >= o.completions && st.deadline_misses >= o.misses
+                             : st.runs == o.completions && st.deadline_misses == o.misses && st.errors == o.errors;
+    printf("  %-14s %3u %5.1fms %8.1f%% %7u %7u %7.2fms %7.2fms  %s\n", s.name, s.bus, s.period_us / 1000.0,
+           100.0 * st.runs / nominal, st.errors, st.deadline_misses, percentile(o.response_us, 0.99) / 1000.0,
+           percentile(o.response_us, 1.0) / 1000.0,
+           agree ? "agree" : "DISAGREE");
+    if (!agree) failures++;
+    if (st.deadline_misses && !sc.misses_allowed[s.bus]) {
+      printf("    FAIL: misses on a bus with room for the stream\n");
+      failures++;
+    }
+    if (sc.overload && st.runs < nominal / 4) {
+      printf("    FAIL: starved under overload\n");
+      failures++;
+    }
+    if (!sc.overload && st.runs < nominal * 0.98) {
+      printf("    FAIL: ran less than its period allows\n");
+      failures++;
+    }
+  }
+  uint32_t lost = runs_total - delivered_total;
+  printf("  completions dropped while loop() stalled: %u (scheduler counted %u)\n", lost,
+         i2c->droppedCompletions());
+  if (i2c->droppedCompletions() != lost) {
+    printf("    FAIL: dropped completions miscounted\n");
+    failures++;
+  }
+}
+
+int main() {
+  hostClockDriver([] { return kNow(); }, [](uint64_t us) { kSleep(us); });
+  k_self = 0;
+  k_running = 0;
+
+  std::vector<Scenario> scenarios = {
+      {"sketch", {400, 400}, {MPU, POX}, 0, 0, 0, {false, false}, false},
+      {"loaded",
+       {400, 400},
+       {MPU,
+        {"accel 14B", 0, BURST, 0x19, 14, 5000},
+        {"mag 6B", 0, BURST, 0x1E, 6, 2000},
+        {"baro 24B", 0, BURST, 0x77, 24, 5000},
+        {"temp 32B", 0, BURST, 0x48, 32, 10000},
+        POX},
+       0, 0, 0, {false, false}, false},
+      {"saturated",
+       {400, 400},
+       {MPU,
+        {"accel 14B", 0, BURST, 0x19, 14, 2000},
+        {"mag 6B", 0, BURST, 0x1E, 6, 2000},
+        {"baro 24B", 0, BURST, 0x77, 24, 5000},
+        {"temp 32B", 0, BURST, 0x48, 32, 5000},
+        POX},
+       0, 0, 0, {true, false}, false},
+      {"overload",
+       {400, 400},
+       {MPU,
+        {"accel 14B", 0, BURST, 0x19, 14, 1000},
+        {"mag 6B", 0, BURST, 0x1E, 6, 2000},
+        {"baro 24B", 0, BURST, 0x77, 24, 2000},
+        {"temp 32B", 0, BURST, 0x48, 32, 5000},
+        POX},
+       0, 0, 0, {true, false}, true},
+      {"timeouts", {400, 400}, {MPU, POX}, 0.01, 0, 0, {true, false}, false},
+      {"loop-stall", {400, 400}, {MPU, POX}, 0, 5000000, 300000, {false, false}, false},
+  };
+  for (const Scenario& sc : scenarios) run(sc);
+
+  printf("\n%s\n", failures ? "FAILED" : "all checks passed");
+  fflush(stdout);
+  _exit(failures ? 1 : 0);  // the bus tasks never return
+}
@@ -0,0 +1,303 @@
+// Host run of imu_calibration.h on synthetic biased MPU6050 traces.
+//
+// A simulated unit has a gyro zero-rate offset that drifts with warm-up, and
+// accel offsets and scale errors within the datasheet tolerances. A wearer
+// alternates between resting in one of ten orientations (with some tremor)
+// and moving to the next. The trace is fed in 5-sample FIFO blocks at the
+// ranges combinedsense.cpp uses, and the calibration is compared with the
+// unit's true errors:
+//
+//   cold   no stored calibration: time until gyro and accel are within tolerance
+//   drift  10 min of warm-up drift: largest gyro error once tracking
+//   warm   begin() with the stored result: error at the first sample
+//   stale  stored result from another unit: time until the gyro bias is replaced
+//   ranges stored result measured at other ranges: must be ignored
+//   cost   ns per sample for observe() + apply(), and apply() alone
+//
+//   g++ -O2 -std=c++17 -o imu_calibration_sim tools/imu_calibration_sim.cpp
+//   ./imu_calibration_sim
+//
+// Exit status is non-zero if a check fails.
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../imu_calibration.h"
+
+static const float LSB_PER_G = 4096.0f;    // +-8 g
+static const float LSB_PER_DPS = 65.5f;    // +-500 deg/s
+static const float HZ = 100.0f;
+static const size_t BLOCK = 5;              // samples per FIFO drain at 20 Hz
+static const float ACCEL_NOISE_LSB = 8.0f;  // ~2 mg at 21 Hz bandwidth
+static const float GYRO_NOISE_LSB = 4.0f;
+
+static const float GYRO_TOL_DPS = 0.1f;
+static const float OFFSET_TOL_G = 0.005f;
+static const float SCALE_TOL = 0.005f;
+
+struct Unit {
+  float gyro_bias_dps[3];
+  float drift_dps_per_s[3];   // during warm-up
+  float warmup_s;
+  float accel_offset_g[3];
+  float accel_scale[3];       // raw = scale * true + offset
+};
+
+static const Unit UNIT_A = {{1.8f, -1.2f, 0.7f}, {0.002f, -0.0015f, 0.001f}, 600, {0.04f, -0.025f, 0.06f}, {1.02f, 0.97f, 1.03f}};
+static const Unit UNIT_B = {{-4.5f, 3.9f, -6.0f}, {0, 0, 0}, 0, {-0.05f, 0.03f, -0.04f}, {0.98f, 1.025f, 0.99f}};
+
+// Resting orientations: gravity in sensor axes
+static const float ORIENTATIONS[][3] = {
+    {0, 0, 1}, {1, 0, 0}, {0, 1, 0}, {0, 0, -1}, {-1, 0, 0}, {0, -1, 0},
+    {0.577f, 0.577f, 0.577f}, {-0.707f, 0, 0.707f}, {0, 0.707f, -0.707f}, {0.577f, -0.577f, -0.577f},
+};
+static const int ORIENTATION_COUNT = sizeof(ORIENTATIONS) / sizeof(ORIENTATIONS[0]);
+
+class Wearer {
+public:
+  Wearer(const Unit& unit, uint32_t seed, float rest_s, float move_s, int first = 0)
+      : unit(unit), rng(seed), rest_s(rest_s), move_s(move_s), from(first) {}
+
+  float t() const { return sample / HZ; }
+
+  float trueBias(int k) const {
+    float warm = unit.warmup_s > 0 ? fminf(t(), unit.warmup_s) : 0;
+    return unit.gyro_bias_dps[k] + unit.drift_dps_per_s[k] * warm;
+  }
+
+  void next(ImuRawSample* out, size_t n) {
+    for (size_t i = 0; i < n; i++) generate(out[i]);
+  }
+
+private:
+  Unit unit;
+  std::mt19937 rng;
+  std::normal_distribution<float> noise{0, 1};
+  float rest_s, move_s;
+  int from;
+  uint64_t sample = 0;
+  float phase[3] = {0, 1, 2};
+
+  static int16_t clamp(float v) { return (int16_t)fmaxf(-32768, fminf(32767, lrintf(v))); }
+
+  void generate(ImuRawSample& s) {
+    float t = this->t();
+    float period = rest_s + move_s;
+    int segment = (int)(t / period);
+    float into = t - segment * period;
+    int a = (from + segment) % ORIENTATION_COUNT;
+    int b = (a + 1) % ORIENTATION_COUNT;
+    float g[3], w[3];
+    if (into < rest_s) {
+      // Resting, every other rest with a 6 Hz tremor
+      float tremor = segment % 2 ? 0.3f : 0;
+      for (int k = 0; k < 3; k++) {
+        g[k] = ORIENTATIONS[a][k];
+        w[k] = tremor * sinf(2 * (float)M_PI * 6 * t + phase[k]);
+      }
+    } else {
+      // Moving to the next orientation
+      float f = (into - rest_s) / move_s;
+      float norm = 0;
+      for (int k = 0; k < 3; k++) {
+        g[k] = ORIENTATIONS[a][k] * (1 - f) + ORIENTATIONS[b][k] * f;
+        norm += g[k] * g[k];
+      }
+      norm = sqrtf(norm);
+      for (int k = 0; k < 3; k++) {
+        g[k] = g[k] / norm + 0.2f * noise(rng);
+        w[k] = 60 * sinf(2 * (float)M_PI * 1.5f * t + phase[k]);
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      float raw_g = unit.accel_scale[k] * g[k] + unit.accel_offset_g[k];
+      s.v[k] = clamp(raw_g * LSB_PER_G + ACCEL_NOISE_LSB * noise(rng));
+      s.v[3 + k] = clamp((w[k] + trueBias(k)) * LSB_PER_DPS + GYRO_NOISE_LSB * noise(rng));
+    }
+    sample++;
+  }
+};
+
+struct Errors {
+  float gyro_dps;
+  float offset_g;
+  float scale;
+};
+
+static Errors errors(const ImuCalibration& c, const Wearer& w, const Unit& unit) {
+  Errors e = {0, 0, 0};
+  for (int k = 0; k < 3; k++) {
+    e.gyro_dps = fmaxf(e.gyro_dps, fabsf(c.gyro_bias_q8[k] / 256.0f / LSB_PER_DPS - w.trueBias(k)));
+    e.offset_g = fmaxf(e.offset_g, fabsf(c.accel_offset_q8[k] / 256.0f / LSB_PER_G - unit.accel_offset_g[k]));
+    e.scale = fmaxf(e.scale, fabsf(c.accel_scale_q14[k] / (float)IMU_CAL_SCALE_ONE * unit.accel_scale[k] - 1));
+  }
+  return e;
+}
+
+static bool gyroOk(const ImuCalibration& c, const Errors& e) {
+  return (c.flags & IMU_CAL_GYRO_VALID) && e.gyro_dps <= GYRO_TOL_DPS;
+}
+
+static bool accelOk(const ImuCalibration& c, const Errors& e) {
+  return (c.flags & IMU_CAL_ACCEL_VALID) && e.offset_g <= OFFSET_TOL_G && e.scale <= SCALE_TOL;
+}
+
+static void printErrors(const char* label, const ImuCalibration& c, const Errors& e) {
+  printf("  %-22s gyro %.3f dps, accel offset %.1f mg, scale %.2f%%  [%s%s], %u still windows, %u fits\n", label,
+         e.gyro_dps, e.offset_g * 1000, e.scale * 100, c.flags & IMU_CAL_GYRO_VALID ? "gyro" : "-",
+         c.flags & IMU_CAL_ACCEL_VALID ? "+accel" : "", (unsigned)c.still_windows, (unsigned)c.accel_fits);
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// Runs until `seconds`; *gyro_at and *accel_at get the first times (s) each
+// was within tolerance, or -1
+static void run(ImuCalibrator& cal, Wearer& w, const Unit& unit, float seconds, float* gyro_at, float* accel_at,
+                float* worst_gyro_after = nullptr, float after_s = 0) {
+  ImuRawSample block[BLOCK];
+  if (gyro_at) *gyro_at = -1;
+  if (accel_at) *accel_at = -1;
+  while (w.t() < seconds) {
+    w.next(block, BLOCK);
+    cal.observe(block, BLOCK);
+    cal.apply(block, BLOCK);
+    const ImuCalibration& c = cal.current();
+    Errors e = errors(c, w, unit);
+    if (gyro_at && *gyro_at < 0 && gyroOk(c, e)) *gyro_at = w.t();
+    if (accel_at && *accel_at < 0 && accelOk(c, e)) *accel_at = w.t();
+    if (worst_gyro_after && w.t() >= after_s) *worst_gyro_after = fmaxf(*worst_gyro_after, e.gyro_dps);
+  }
+}
+
+// Worst error of the corrected accel norm, resting 2 s in each orientation
+static float correctedNormError(const ImuCalibrator& cal, const Unit& unit, uint32_t seed) {
+  double worst = 0;
+  for (int o = 0; o < ORIENTATION_COUNT; o++) {
+    Wearer still(unit, seed + o, 1e6f, 1, o);
+    ImuRawSample block[BLOCK];
+    double sum[3] = {0, 0, 0};
+    int n = 0;
+    for (int b = 0; b < 40; b++) {
+      still.next(block, BLOCK);
+      cal.apply(block, BLOCK);
+      for (size_t i = 0; i < BLOCK; i++, n++) {
+        for (int k = 0; k < 3; k++) sum[k] += block[i].v[k];
+      }
+    }
+    double norm = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]) / n / LSB_PER_G;
+    worst = fmax(worst, fabs(norm - 1));
+  }
+  return (float)worst;
+}
+
+int main() {
+  printf("ranges: %.0f LSB/g, %.1f LSB/(deg/s); %d-sample stillness windows at %.0f Hz\n", LSB_PER_G, LSB_PER_DPS,
+         IMU_CAL_WINDOW, HZ);
+
+  // Cold boot
+  printf("cold boot (rest 4 s, move 2 s, %d orientations)\n", ORIENTATION_COUNT);
+  ImuCalibrator cold;
+  cold.begin(LSB_PER_G, LSB_PER_DPS, nullptr);
+  check(!cold.warmStart(), "cold boot reported a warm start");
+  Wearer wearer(UNIT_A, 1, 4, 2);
+  float gyro_at, accel_at;
+  run(cold, wearer, UNIT_A, 120, &gyro_at, &accel_at);
+  printf("  gyro within %.2f dps after %.1f s, accel within %.0f mg / %.1f%% after %.1f s\n", GYRO_TOL_DPS, gyro_at,
+         OFFSET_TOL_G * 1000, SCALE_TOL * 100, accel_at);
+  printErrors("at 120 s", cold.current(), errors(cold.current(), wearer, UNIT_A));
+  check(gyro_at >= 0 && gyro_at < 10, "gyro bias did not converge within 10 s");
+  check(accel_at >= 0 && accel_at < 90, "accel did not converge within 90 s");
+
+  // Warm-up drift: the bias moves ~1 deg/s over 10 min
+  float worst_gyro = 0;
+  run(cold, wearer, UNIT_A, 720, nullptr, nullptr, &worst_gyro, 180);
+  printf("drift (%.2f deg/s over %.0f s of warm-up)\n", UNIT_A.drift_dps_per_s[0] * UNIT_A.warmup_s, UNIT_A.warmup_s);
+  printErrors("at 720 s", cold.current(), errors(cold.current(), wearer, UNIT_A));
+  printf("  worst gyro error while tracking: %.3f dps\n", worst_gyro);
+  check(worst_gyro <= GYRO_TOL_DPS, "gyro drift not tracked");
+
+  // Warm boot with what NVS would hold now
+  ImuCalibration stored;
+  uint32_t version = cold.read(stored);
+  check(version > 0 && version % 2 == 0, "published version");
+  check(accelOk(stored, errors(stored, wearer, UNIT_A)), "stored calibration not converged");
+
+  printf("warm boot\n");
+  Unit settled = UNIT_A;
+  for (int k = 0; k < 3; k++) {
+    settled.gyro_bias_dps[k] = wearer.trueBias(k);
+    settled.drift_dps_per_s[k] = 0;
+  }
+  ImuCalibrator warm;
+  warm.begin(LSB_PER_G, LSB_PER_DPS, &stored);
+  Wearer rewake(settled, 2, 4, 2);
+  Errors first = errors(warm.current(), rewake, settled);
+  printErrors("at the first sample", warm.current(), first);
+  check(warm.warmStart() && gyroOk(warm.current(), first) && accelOk(warm.current(), first),
+        "warm boot did not apply the stored calibration");
+  float norm_error = correctedNormError(warm, settled, 3);
+  printf("  corrected |a| at rest, worst orientation: %.1f mg from 1 g\n", norm_error * 1000);
+  check(norm_error < OFFSET_TOL_G, "corrected accel norm");
+  float unused;
+  worst_gyro = 0;
+  run(warm, rewake, settled, 60, &unused, &unused, &worst_gyro, 0);
+  printErrors("at 60 s", warm.current(), errors(warm.current(), rewake, settled));
+  check(worst_gyro <= GYRO_TOL_DPS, "warm boot gyro error");
+  check(!ImuCalibrator::differs(stored, warm.current()), "warm boot would rewrite NVS without a real change");
+
+  // Stored calibration from another unit: the gyro bias must be replaced
+  printf("stale calibration (sensor swapped)\n");
+  ImuCalibrator swapped;
+  swapped.begin(LSB_PER_G, LSB_PER_DPS, &stored);
+  Wearer other(UNIT_B, 4, 4, 2);
+  run(swapped, other, UNIT_B, 120, &gyro_at, &accel_at);
+  printf("  gyro replaced after %.1f s, accel after %.1f s\n", gyro_at, accel_at);
+  printErrors("at 120 s", swapped.current(), errors(swapped.current(), other, UNIT_B));
+  check(gyro_at >= 0 && gyro_at < 15, "stale gyro bias not replaced within 15 s");
+  check(accel_at >= 0, "stale accel calibration not replaced");
+  check(ImuCalibrator::differs(stored, swapped.current()), "new calibration not flagged for saving");
+
+  // Other ranges: the stored values do not apply
+  ImuCalibrator ranges;
+  ranges.begin(8192.0f, 32.8f, &stored);
+  check(!ranges.warmStart() && ranges.current().flags == 0, "calibration for other ranges was applied");
+  printf("ranges: stored calibration ignored at +-4 g / +-1000 deg/s: %s\n", ranges.warmStart() ? "no" : "yes");
+
+  // Cost
+  std::vector<ImuRawSample> trace(200000);
+  Wearer bench(UNIT_A, 5, 4, 2);
+  bench.next(trace.data(), trace.size());
+  std::vector<ImuRawSample> work(trace.size());
+  ImuCalibrator timed;
+  timed.begin(LSB_PER_G, LSB_PER_DPS, nullptr);
+  double both_ns = 0, apply_ns = 0;
+  uint64_t sink = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    work = trace;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i + BLOCK <= work.size(); i += BLOCK) {
+      timed.observe(&work[i], BLOCK);
+      timed.apply(&work[i], BLOCK);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i + BLOCK <= work.size(); i += BLOCK) timed.apply(&work[i], BLOCK);
+    auto t2 = std::chrono::steady_clock::now();
+    for (const ImuRawSample& s : work) sink += (uint16_t)s.v[0];
+    both_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / work.size();
+    apply_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / work.size();
+  }
+  printf("cost: observe + apply %.1f ns/sample, apply %.1f ns/sample (%u fits, checksum %llu)\n", both_ns, apply_ns,
+         (unsigned)timed.current().accel_fits, (unsigned long long)(sink & 0xFFFF));
+
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
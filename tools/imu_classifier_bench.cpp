@@ -0,0 +1,180 @@
+// Host check and budget report for imu_classifier.h.
+//
+// Loads the weight blob the firmware uses (imu_classifier_weights.h, or a raw
+// blob file), runs random and extreme windows through an independent
+// reference implementation and through the scalar and SIMD dot kernels,
+// requires identical logits, then reports latency, RAM and flash per
+// inference against the sample period the model was trained for.
+//
+//   g++ -O2 -mavx2 -o imu_classifier_bench tools/imu_classifier_bench.cpp
+//   ./imu_classifier_bench [--blob FILE] [--dump-blob FILE]
+//
+// The blob itself is produced by tools/imu_classifier_train.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../imu_classifier.h"
+#include "../imu_classifier_weights.h"
+
+static const double DEFAULT_SAMPLE_PERIOD_US = 10000;  // 100 Hz, for blobs without a rate
+
+// Straightforward nested loops over [time][channel] inputs, int64 sums
+static void reference(const uint8_t* blob, const int8_t* in, int32_t* out) {
+  const ImuModelHeader* h = (const ImuModelHeader*)blob;
+  const uint8_t* p = blob + sizeof(ImuModelHeader);
+  const int8_t* w1 = (const int8_t*)p;
+  p += IMU_CLS_C1 * IMU_CLS_K1 * IMU_CLS_CHANNELS;
+  int32_t b1[IMU_CLS_C1];
+  memcpy(b1, p, sizeof(b1));
+  p += sizeof(b1);
+  const int8_t* w2 = (const int8_t*)p;
+  p += IMU_CLS_C2 * IMU_CLS_K2 * IMU_CLS_C1;
+  int32_t b2[IMU_CLS_C2];
+  memcpy(b2, p, sizeof(b2));
+  p += sizeof(b2);
+  const int8_t* w3 = (const int8_t*)p;
+  p += IMU_CLS_CLASSES * IMU_CLS_C2;
+  int32_t b3[IMU_CLS_CLASSES];
+  memcpy(b3, p, sizeof(b3));
+
+  auto requant = [](int64_t acc, const ImuRequant& q) {
+    int64_t v = (acc * q.mult + ((int64_t)1 << (q.shift - 1))) >> q.shift;
+    return v < 0 ? 0 : v > 127 ? 127 : (int)v;
+  };
+
+  int a1[IMU_CLS_L1][IMU_CLS_C1];
+  for (int t = 0; t < IMU_CLS_L1; t++) {
+    for (int f = 0; f < IMU_CLS_C1; f++) {
+      int64_t acc = b1[f];
+      for (int k = 0; k < IMU_CLS_K1; k++) {
+        for (int c = 0; c < IMU_CLS_CHANNELS; c++) {
+          acc += (int64_t)in[(t * IMU_CLS_S1 + k) * IMU_CLS_CHANNELS + c] *
+                 w1[(f * IMU_CLS_K1 + k) * IMU_CLS_CHANNELS + c];
+        }
+      }
+      a1[t][f] = requant(acc, h->conv1);
+    }
+  }
+  int a2[IMU_CLS_L2][IMU_CLS_C2];
+  for (int t = 0; t < IMU_CLS_L2; t++) {
+    for (int f = 0; f < IMU_CLS_C2; f++) {
+      int64_t acc = b2[f];
+      for (int k = 0; k < IMU_CLS_K2; k++) {
+        for (int c = 0; c < IMU_CLS_C1; c++) acc += (int64_t)a1[t * IMU_CLS_S2 + k][c] * w2[(f * IMU_CLS_K2 + k) * IMU_CLS_C1 + c];
+      }
+      a2[t][f] = requant(acc, h->conv2);
+    }
+  }
+  int pooled[IMU_CLS_C2];
+  for (int f = 0; f < IMU_CLS_C2; f++) {
+    int64_t sum = 0;
+    for (int t = 0; t < IMU_CLS_L2; t++) sum += a2[t][f];
+    pooled[f] = requant(sum, h->pool);
+  }
+  for (int c = 0; c < IMU_CLS_CLASSES; c++) {
+    int64_t acc = b3[c];
+    for (int f = 0; f < IMU_CLS_C2; f++) acc += (int64_t)pooled[f] * w3[c * IMU_CLS_C2 + f];
+    out[c] = (int32_t)acc;
+  }
+}
+
+static void randomWindow(std::mt19937& rng, int8_t* w, int mode) {
+  std::uniform_int_distribution<int> any(-128, 127);
+  std::normal_distribution<float> small(0, 20);
+  for (int i = 0; i < IMU_CLS_WINDOW * IMU_CLS_CHANNELS; i++) {
+    if (mode == 0) w[i] = (int8_t)any(rng);
+    else if (mode == 1) w[i] = (int8_t)fmaxf(-127, fminf(127, small(rng)));
+    else w[i] = (i & 1) ? 127 : -128;
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* blob_path = NULL;
+  const char* dump_path = NULL;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--blob") == 0) blob_path = argv[i + 1];
+    else if (strcmp(argv[i], "--dump-blob") == 0) dump_path = argv[i + 1];
+  }
+
+  // Aligned copy, as the firmware's blob is
+  std::vector<uint32_t> storage((IMU_MODEL_BLOB_LEN + 3) / 4);
+  size_t len = IMU_MODEL_BLOB_LEN;
+  memcpy(storage.data(), IMU_MODEL_BLOB, len);
+  if (blob_path) {
+    FILE* f = fopen(blob_path, "rb");
+    if (!f) {
+      fprintf(stderr, "cannot read %s\n", blob_path);
+      return 1;
+    }
+    storage.assign(IMU_CLS_BLOB_BYTES / 4 + 1, 0);
+    len = fread(storage.data(), 1, storage.size() * 4, f);
+    fclose(f);
+  }
+  const uint8_t* blob = (const uint8_t*)storage.data();
+  if (dump_path) {
+    FILE* f = fopen(dump_path, "wb");
+    if (!f || fwrite(blob, 1, len, f) != len || fclose(f) != 0) return 1;
+  }
+
+  static ImuClassifier scalar, simd;
+  if (!scalar.begin(blob, len, imuDotS8Scalar) || !simd.begin(blob, len, imuDotS8)) {
+    fprintf(stderr, "blob does not match the network shape\n");
+    return 1;
+  }
+  printf("blob: %zu bytes, %s, %u Hz; kernel: %s\n", len, scalar.trained() ? "trained" : "PLACEHOLDER weights",
+         (unsigned)scalar.sampleHz(), imuDotName());
+  double sample_period_us = scalar.sampleHz() ? 1e6 / scalar.sampleHz() : DEFAULT_SAMPLE_PERIOD_US;
+
+  // Bit-exactness
+  std::mt19937 rng(1);
+  const int WINDOWS = 20000;
+  std::vector<int8_t> windows((size_t)WINDOWS * IMU_CLS_WINDOW * IMU_CLS_CHANNELS);
+  for (int i = 0; i < WINDOWS; i++) randomWindow(rng, &windows[(size_t)i * IMU_CLS_WINDOW * IMU_CLS_CHANNELS], i % 3);
+  int mismatches = 0;
+  int classes[IMU_CLS_CLASSES] = {};
+  for (int i = 0; i < WINDOWS; i++) {
+    const int8_t* w = &windows[(size_t)i * IMU_CLS_WINDOW * IMU_CLS_CHANNELS];
+    int32_t ref[IMU_CLS_CLASSES], a[IMU_CLS_CLASSES], b[IMU_CLS_CLASSES];
+    reference(blob, w, ref);
+    scalar.infer(w, a);
+    simd.infer(w, b);
+    if (memcmp(ref, a, sizeof(ref)) || memcmp(ref, b, sizeof(ref))) {
+      if (mismatches++ < 5) printf("window %d: ref %d %d %d scalar %d %d %d simd %d %d %d\n", i, ref[0], ref[1], ref[2], a[0], a[1], a[2], b[0], b[1], b[2]);
+    }
+    int best = 0;
+    for (int c = 1; c < IMU_CLS_CLASSES; c++) best = ref[c] > ref[best] ? c : best;
+    classes[best]++;
+  }
+  printf("bit-exact: %s (%d windows, %d mismatches); argmax spread %d/%d/%d\n", mismatches ? "NO" : "yes", WINDOWS,
+         mismatches, classes[0], classes[1], classes[2]);
+
+  // Latency
+  auto time = [&](ImuClassifier& model) {
+    int32_t out[IMU_CLS_CLASSES];
+    int32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < 5; r++) {
+      for (int i = 0; i < WINDOWS; i++) {
+        model.infer(&windows[(size_t)i * IMU_CLS_WINDOW * IMU_CLS_CHANNELS], out);
+        sink += out[0];
+      }
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if (sink == 42) printf(" ");
+    return us / (5.0 * WINDOWS);
+  };
+  double scalar_us = time(scalar);
+  double simd_us = time(simd);
+
+  printf("per inference: %d MACs, %.2f us scalar, %.2f us %s (host)\n", IMU_CLS_MACS, scalar_us, simd_us,
+         imuDotName());
+  printf("RAM: %zu bytes per classifier (ring, window, activations), no heap; flash: %zu byte blob\n",
+         sizeof(ImuClassifier), len);
+  printf("budget: one inference per %d samples; scalar uses %.3f%% of one %.0f us sample period on this host\n",
+         IMU_CLS_HOP, 100 * scalar_us / sample_period_us, sample_period_us);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,570 @@
+// Trains the imu_classifier.h network on a labelled trace archive and exports
+// the int8 weight blob the firmware compiles in (Linux).
+//
+// Traces (see trace_archive.h) are decimated to the rate the sketch samples
+// at and cut into 64-sample windows. A window is "seizure" if at least half
+// of it lies in a seizure label, "fall" if it holds a whole fall label, and
+// "normal" if it touches no label; windows that only clip an event are left
+// out. Patients whose id is 3 mod 4 are held out for testing.
+//
+// The float network has the firmware's exact shape and is trained with Adam
+// on class-balanced batches (softmax cross-entropy). It is then quantized
+// post-training: one weight scale per layer, activation scales from the
+// 99.9th percentile over training windows, and the per-channel input scales
+// folded into conv1. The test patients are replayed through ImuClassifier
+// itself, sample by sample and int8 all the way, and scored per window at
+// the firmware's hop against the gyro RMS threshold it replaces.
+//
+//   g++ -O2 -std=c++17 -pthread -o threshold_sweep tools/threshold_sweep.cpp
+//   g++ -O2 -std=c++17 -o imu_classifier_train tools/imu_classifier_train.cpp
+//   ./threshold_sweep gen traces.bha --patients 16 --hours 8 --seed 40
+//   ./imu_classifier_train traces.bha --write imu_classifier_weights.h
+//       [--hz 10] [--epochs 30] [--seed 1] [--blob FILE]
+//
+// Exit status is non-zero if the int8 model finds less than 90 % of the test
+// seizure windows, marks more than 2 % of the normal ones as seizure, or
+// disagrees with the float model on more than 2 % of windows. Nothing is
+// written then.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "trace_archive.h"
+#include "../imu_classifier.h"
+
+static const float INPUT_SCALE[IMU_CLS_CHANNELS] = {32, 32, 32, 0.5f, 0.5f, 0.5f};  // +-4 g, +-254 deg/s
+static const float INPUT_NORM = 64;       // float network input = int8 input / 64
+static const float SEIZURE_RMS_DPS = 80;  // SEIZURE_RMS_THR in iot/newfallseizurelogic.cpp
+static const int LABEL_SKIP = -1;
+
+// ---- Data ----
+
+struct Trace {
+  uint32_t patient;
+  uint32_t period_ms;
+  std::vector<float> raw;     // [sample][channel], g and deg/s
+  std::vector<int8_t> input;  // the same, quantized as ImuClassifier::push does
+  std::vector<TraceLabel> labels;
+};
+
+struct Example {
+  const Trace* trace;
+  uint32_t end;  // last sample of the window
+  int label;
+};
+
+static int8_t quantizeInput(float v, int c) {
+  v *= INPUT_SCALE[c];
+  v = v > 127 ? 127 : v < -127 ? -127 : v == v ? v : 0;
+  return (int8_t)lrintf(v);
+}
+
+static bool loadTraces(const char* path, uint32_t hz, std::vector<Trace>& out) {
+  ArchiveReader reader;
+  std::string error;
+  if (!reader.open(path, error)) {
+    fprintf(stderr, "%s: %s\n", path, error.c_str());
+    return false;
+  }
+  for (const TraceView& v : reader.all()) {
+    if (v.entry->sample_hz % hz) {
+      fprintf(stderr, "trace of patient %u at %u Hz cannot be decimated to %u Hz\n", v.entry->patient_id,
+              v.entry->sample_hz, hz);
+      return false;
+    }
+    uint32_t step = v.entry->sample_hz / hz;
+    Trace t;
+    t.patient = v.entry->patient_id;
+    t.period_ms = 1000 / hz;
+    t.labels.assign(v.labels, v.labels + v.entry->label_count);
+    for (uint64_t i = 0; i < v.entry->sample_count; i += step) {
+      const TraceSample& s = v.samples[i];
+      float x[IMU_CLS_CHANNELS] = {s.ax / ARCHIVE_ACCEL_LSB_PER_G, s.ay / ARCHIVE_ACCEL_LSB_PER_G,
+                                   s.az / ARCHIVE_ACCEL_LSB_PER_G, s.gx / ARCHIVE_GYRO_LSB_PER_DPS,
+                                   s.gy / ARCHIVE_GYRO_LSB_PER_DPS, s.gz / ARCHIVE_GYRO_LSB_PER_DPS};
+      for (int c = 0; c < IMU_CLS_CHANNELS; c++) {
+        t.raw.push_back(x[c]);
+        t.input.push_back(quantizeInput(x[c], c));
+      }
+    }
+    out.push_back(std::move(t));
+  }
+  return true;
+}
+
+static uint32_t sampleCount(const Trace& t) { return t.raw.size() / IMU_CLS_CHANNELS; }
+
+// Class of the window ending at sample `end`, or LABEL_SKIP
+static int windowLabel(const Trace& t, uint32_t end) {
+  uint32_t from = (end + 1 - IMU_CLS_WINDOW) * t.period_ms;
+  uint32_t to = (end + 1) * t.period_ms;
+  uint32_t seizure_ms = 0;
+  bool fall = false, clipped = false;
+  for (const TraceLabel& l : t.labels) {
+    if (l.end_ms <= from || l.start_ms >= to) continue;
+    if (l.type == LABEL_SEIZURE) {
+      seizure_ms += std::min(to, l.end_ms) - std::max(from, l.start_ms);
+    } else if (l.type == LABEL_FALL) {
+      if (l.start_ms >= from && l.end_ms <= to) fall = true;
+      else clipped = true;
+    }
+  }
+  if (seizure_ms * 2 >= to - from) return IMU_CLASS_SEIZURE;
+  if (seizure_ms || clipped) return LABEL_SKIP;
+  return fall ? IMU_CLASS_FALL : IMU_CLASS_NORMAL;
+}
+
+// ---- Float network, the firmware's shape ----
+
+struct Params {
+  float w1[IMU_CLS_C1][IMU_CLS_K1 * IMU_CLS_CHANNELS], b1[IMU_CLS_C1];
+  float w2[IMU_CLS_C2][IMU_CLS_K2 * IMU_CLS_C1], b2[IMU_CLS_C2];
+  float w3[IMU_CLS_CLASSES][IMU_CLS_C2], b3[IMU_CLS_CLASSES];
+
+  static const size_t COUNT;
+  float* data() { return &w1[0][0]; }
+};
+const size_t Params::COUNT = sizeof(Params) / sizeof(float);
+
+struct Activations {
+  float x[IMU_CLS_WINDOW * IMU_CLS_CHANNELS];
+  float a1[IMU_CLS_L1][IMU_CLS_C1];
+  float a2[IMU_CLS_L2][IMU_CLS_C2];
+  float p[IMU_CLS_C2];
+  float z[IMU_CLS_CLASSES];
+};
+
+static void loadWindow(const Example& e, float* x) {
+  const int8_t* in = &e.trace->input[(size_t)(e.end + 1 - IMU_CLS_WINDOW) * IMU_CLS_CHANNELS];
+  for (int i = 0; i < IMU_CLS_WINDOW * IMU_CLS_CHANNELS; i++) x[i] = in[i] / INPUT_NORM;
+}
+
+static void forward(const Params& m, Activations& a) {
+  for (int t = 0; t < IMU_CLS_L1; t++) {
+    const float* x = a.x + t * IMU_CLS_S1 * IMU_CLS_CHANNELS;
+    for (int f = 0; f < IMU_CLS_C1; f++) {
+      float acc = m.b1[f];
+      for (int i = 0; i < IMU_CLS_K1 * IMU_CLS_CHANNELS; i++) acc += m.w1[f][i] * x[i];
+      a.a1[t][f] = acc > 0 ? acc : 0;
+    }
+  }
+  for (int t = 0; t < IMU_CLS_L2; t++) {
+    const float* x = &a.a1[t * IMU_CLS_S2][0];
+    for (int f = 0; f < IMU_CLS_C2; f++) {
+      float acc = m.b2[f];
+      for (int i = 0; i < IMU_CLS_K2 * IMU_CLS_C1; i++) acc += m.w2[f][i] * x[i];
+      a.a2[t][f] = acc > 0 ? acc : 0;
+    }
+  }
+  for (int f = 0; f < IMU_CLS_C2; f++) {
+    float sum = 0;
+    for (int t = 0; t < IMU_CLS_L2; t++) sum += a.a2[t][f];
+    a.p[f] = sum / IMU_CLS_L2;
+  }
+  for (int c = 0; c < IMU_CLS_CLASSES; c++) {
+    float acc = m.b3[c];
+    for (int f = 0; f < IMU_CLS_C2; f++) acc += m.w3[c][f] * a.p[f];
+    a.z[c] = acc;
+  }
+}
+
+static int argmax(const float* z) {
+  int best = 0;
+  for (int c = 1; c < IMU_CLS_CLASSES; c++) best = z[c] > z[best] ? c : best;
+  return best;
+}
+
+// Softmax cross-entropy gradient of one example added to g; returns the loss
+static float backward(const Params& m, const Activations& a, int label, Params& g) {
+  float zmax = *std::max_element(a.z, a.z + IMU_CLS_CLASSES);
+  float e[IMU_CLS_CLASSES], sum = 0;
+  for (int c = 0; c < IMU_CLS_CLASSES; c++) sum += e[c] = expf(a.z[c] - zmax);
+  float dz[IMU_CLS_CLASSES];
+  for (int c = 0; c < IMU_CLS_CLASSES; c++) dz[c] = e[c] / sum - (c == label);
+
+  float dp[IMU_CLS_C2] = {};
+  for (int c = 0; c < IMU_CLS_CLASSES; c++) {
+    g.b3[c] += dz[c];
+    for (int f = 0; f < IMU_CLS_C2; f++) {
+      g.w3[c][f] += dz[c] * a.p[f];
+      dp[f] += m.w3[c][f] * dz[c];
+    }
+  }
+  float da1[IMU_CLS_L1][IMU_CLS_C1] = {};
+  for (int t = 0; t < IMU_CLS_L2; t++) {
+    const float* x = &a.a1[t * IMU_CLS_S2][0];
+    float* dx = &da1[t * IMU_CLS_S2][0];
+    for (int f = 0; f < IMU_CLS_C2; f++) {
+      if (a.a2[t][f] <= 0) continue;
+      float d = dp[f] / IMU_CLS_L2;
+      g.b2[f] += d;
+      for (int i = 0; i < IMU_CLS_K2 * IMU_CLS_C1; i++) {
+        g.w2[f][i] += d * x[i];
+        dx[i] += m.w2[f][i] * d;
+      }
+    }
+  }
+  for (int t = 0; t < IMU_CLS_L1; t++) {
+    const float* x = a.x + t * IMU_CLS_S1 * IMU_CLS_CHANNELS;
+    for (int f = 0; f < IMU_CLS_C1; f++) {
+      if (a.a1[t][f] <= 0) continue;
+      float d = da1[t][f];
+      g.b1[f] += d;
+      for (int i = 0; i < IMU_CLS_K1 * IMU_CLS_CHANNELS; i++) g.w1[f][i] += d * x[i];
+    }
+  }
+  return logf(sum) + zmax - a.z[label];
+}
+
+static void initParams(Params& m, std::mt19937& rng) {
+  memset(&m, 0, sizeof(m));
+  auto he = [&](float* w, int n, int fan_in) {
+    std::normal_distribution<float> d(0, sqrtf(2.0f / fan_in));
+    for (int i = 0; i < n; i++) w[i] = d(rng);
+  };
+  he(&m.w1[0][0], IMU_CLS_C1 * IMU_CLS_K1 * IMU_CLS_CHANNELS, IMU_CLS_K1 * IMU_CLS_CHANNELS);
+  he(&m.w2[0][0], IMU_CLS_C2 * IMU_CLS_K2 * IMU_CLS_C1, IMU_CLS_K2 * IMU_CLS_C1);
+  he(&m.w3[0][0], IMU_CLS_CLASSES * IMU_CLS_C2, IMU_CLS_C2);
+  for (float& b : m.b1) b = 0.01f;
+  for (float& b : m.b2) b = 0.01f;
+}
+
+// Each epoch draws every fall and seizure example and three times as many
+// normal ones, shuffled
+static void train(Params& m, const std::vector<Example>& examples, int epochs, std::mt19937& rng) {
+  std::vector<const Example*> by_class[IMU_CLS_CLASSES];
+  for (const Example& e : examples) by_class[e.label].push_back(&e);
+  size_t positives = by_class[IMU_CLASS_FALL].size() + by_class[IMU_CLASS_SEIZURE].size();
+  size_t normals = std::min(by_class[IMU_CLASS_NORMAL].size(), 3 * positives);
+
+  const int BATCH = 32;
+  const float LR = 0.003f, B1 = 0.9f, B2 = 0.999f, EPS = 1e-8f;
+  static Params mom, vel, grad;
+  memset(&mom, 0, sizeof(mom));
+  memset(&vel, 0, sizeof(vel));
+  uint64_t steps = 0;
+  static Activations a;
+
+  for (int epoch = 0; epoch < epochs; epoch++) {
+    std::vector<const Example*> order(by_class[IMU_CLASS_FALL].begin(), by_class[IMU_CLASS_FALL].end());
+    order.insert(order.end(), by_class[IMU_CLASS_SEIZURE].begin(), by_class[IMU_CLASS_SEIZURE].end());
+    std::shuffle(by_class[IMU_CLASS_NORMAL].begin(), by_class[IMU_CLASS_NORMAL].end(), rng);
+    order.insert(order.end(), by_class[IMU_CLASS_NORMAL].begin(), by_class[IMU_CLASS_NORMAL].begin() + normals);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    double loss = 0;
+    size_t correct = 0;
+    for (size_t start = 0; start < order.size(); start += BATCH) {
+      size_t end = std::min(order.size(), start + BATCH);
+      memset(&grad, 0, sizeof(grad));
+      for (size_t i = start; i < end; i++) {
+        loadWindow(*order[i], a.x);
+        forward(m, a);
+        correct += argmax(a.z) == order[i]->label;
+        loss += backward(m, a, order[i]->label, grad);
+      }
+      steps++;
+      float lr = LR * sqrtf(1 - powf(B2, steps)) / (1 - powf(B1, steps));
+      float* p = m.data();
+      float* g = grad.data();
+      float* mo = mom.data();
+      float* ve = vel.data();
+      for (size_t k = 0; k < Params::COUNT; k++) {
+        float gk = g[k] / (end - start);
+        mo[k] = B1 * mo[k] + (1 - B1) * gk;
+        ve[k] = B2 * ve[k] + (1 - B2) * gk * gk;
+        p[k] -= lr * mo[k] / (sqrtf(ve[k]) + EPS);
+      }
+    }
+    if (epoch == 0 || (epoch + 1) % 5 == 0 || epoch + 1 == epochs) {
+      printf("  epoch %2d: loss %.4f, train accuracy %.2f %% (%zu windows)\n", epoch + 1, loss / order.size(),
+             100.0 * correct / order.size(), order.size());
+    }
+  }
+}
+
+// ---- Quantization ----
+
+static ImuRequant requantFor(double ratio) {
+  int shift = (int)floor(30 - log2(ratio));
+  shift = std::max(1, std::min(62, shift));
+  ImuRequant q = {(int32_t)llround(ratio * ldexp(1.0, shift)), shift};
+  return q;
+}
+
+static float absMax(const float* w, int n) {
+  float m = 0;
+  for (int i = 0; i < n; i++) m = fmaxf(m, fabsf(w[i]));
+  return m > 0 ? m : 1;
+}
+
+static float percentile(std::vector<float>& v, double q) {
+  if (v.empty()) return 1;
+  size_t k = std::min(v.size() - 1, (size_t)(q * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k] > 0 ? v[k] : 1;
+}
+
+static std::vector<uint8_t> quantize(const Params& m, const std::vector<Example>& calibration, uint32_t hz) {
+  // Activation ranges
+  std::vector<float> r1, r2, rp;
+  static Activations a;
+  for (const Example& e : calibration) {
+    loadWindow(e, a.x);
+    forward(m, a);
+    r1.insert(r1.end(), &a.a1[0][0], &a.a1[0][0] + IMU_CLS_L1 * IMU_CLS_C1);
+    r2.insert(r2.end(), &a.a2[0][0], &a.a2[0][0] + IMU_CLS_L2 * IMU_CLS_C2);
+    rp.insert(rp.end(), a.p, a.p + IMU_CLS_C2);
+  }
+  double s1 = 127 / percentile(r1, 0.999), s2 = 127 / percentile(r2, 0.999), sp = 127 / percentile(rp, 0.999);
+
+  // conv1 sees the int8 input directly: fold the input normalisation in
+  float w1[IMU_CLS_C1][IMU_CLS_K1 * IMU_CLS_CHANNELS];
+  for (int f = 0; f < IMU_CLS_C1; f++) {
+    for (int i = 0; i < IMU_CLS_K1 * IMU_CLS_CHANNELS; i++) w1[f][i] = m.w1[f][i] / INPUT_NORM;
+  }
+  double sw1 = 127 / absMax(&w1[0][0], IMU_CLS_C1 * IMU_CLS_K1 * IMU_CLS_CHANNELS);
+  double sw2 = 127 / absMax(&m.w2[0][0], IMU_CLS_C2 * IMU_CLS_K2 * IMU_CLS_C1);
+  double sw3 = 127 / absMax(&m.w3[0][0], IMU_CLS_CLASSES * IMU_CLS_C2);
+
+  ImuModelHeader h = {};
+  h.magic = IMU_CLS_MAGIC;
+  h.window = IMU_CLS_WINDOW;
+  h.channels = IMU_CLS_CHANNELS;
+  h.hop = IMU_CLS_HOP;
+  h.classes = IMU_CLS_CLASSES;
+  h.c1_out = IMU_CLS_C1;
+  h.c1_kernel = IMU_CLS_K1;
+  h.c1_stride = IMU_CLS_S1;
+  h.c2_out = IMU_CLS_C2;
+  h.c2_kernel = IMU_CLS_K2;
+  h.c2_stride = IMU_CLS_S2;
+  h.trained = 1;
+  h.sample_hz = (uint8_t)hz;
+  memcpy(h.input_scale, INPUT_SCALE, sizeof(h.input_scale));
+  h.conv1 = requantFor(s1 / sw1);
+  h.conv2 = requantFor(s2 / (sw2 * s1));
+  h.pool = requantFor(sp / (IMU_CLS_L2 * s2));
+
+  std::vector<uint8_t> blob(IMU_CLS_BLOB_BYTES);
+  memcpy(blob.data(), &h, sizeof(h));
+  uint8_t* p = blob.data() + sizeof(h);
+  auto weights = [&](const float* w, int n, double scale) {
+    for (int i = 0; i < n; i++) *p++ = (uint8_t)(int8_t)lrint(std::max(-127.0, std::min(127.0, w[i] * scale)));
+  };
+  auto biases = [&](const float* b, int n, double scale) {
+    for (int i = 0; i < n; i++) {
+      int32_t q = (int32_t)llround(b[i] * scale);
+      memcpy(p, &q, 4);
+      p += 4;
+    }
+  };
+  weights(&w1[0][0], IMU_CLS_C1 * IMU_CLS_K1 * IMU_CLS_CHANNELS, sw1);
+  biases(m.b1, IMU_CLS_C1, sw1);
+  weights(&m.w2[0][0], IMU_CLS_C2 * IMU_CLS_K2 * IMU_CLS_C1, sw2);
+  biases(m.b2, IMU_CLS_C2, sw2 * s1);
+  weights(&m.w3[0][0], IMU_CLS_CLASSES * IMU_CLS_C2, sw3);
+  biases(m.b3, IMU_CLS_CLASSES, sw3 * sp);
+  return blob;
+}
+
+// ---- Test replay ----
+
+struct Score {
+  uint64_t confusion[IMU_CLS_CLASSES][IMU_CLS_CLASSES] = {};  // [truth][predicted]
+  uint64_t rms_hits[IMU_CLS_CLASSES] = {};                     // windows over the RMS threshold
+  uint64_t agree = 0, decisions = 0;
+  double hours = 0;
+};
+
+// Every test trace pushed through the firmware classifier at its hop; each
+// decision is scored against the window it covered
+static void replay(const uint8_t* blob, size_t len, const Params& m, const std::vector<Trace>& traces, Score& s) {
+  static ImuClassifier classifier;
+  static Activations a;
+  for (const Trace& t : traces) {
+    classifier.begin(blob, len);
+    uint32_t n = sampleCount(t);
+    s.hours += n * t.period_ms / 3600000.0;
+    for (uint32_t i = 0; i < n; i++) {
+      if (!classifier.push(&t.raw[(size_t)i * IMU_CLS_CHANNELS])) continue;
+      int truth = windowLabel(t, i);
+      if (truth == LABEL_SKIP) continue;
+      int predicted = classifier.label();
+      s.confusion[truth][predicted]++;
+
+      loadWindow({&t, i, truth}, a.x);
+      forward(m, a);
+      s.agree += argmax(a.z) == predicted;
+      s.decisions++;
+
+      double sum_sq = 0;
+      for (uint32_t k = i + 1 - IMU_CLS_WINDOW; k <= i; k++) {
+        const float* g = &t.raw[(size_t)k * IMU_CLS_CHANNELS + 3];
+        sum_sq += g[0] * g[0] + g[1] * g[1] + g[2] * g[2];
+      }
+      s.rms_hits[truth] += sqrt(sum_sq / IMU_CLS_WINDOW) > SEIZURE_RMS_DPS;
+    }
+  }
+}
+
+static uint64_t rowTotal(const Score& s, int truth) {
+  uint64_t n = 0;
+  for (int c = 0; c < IMU_CLS_CLASSES; c++) n += s.confusion[truth][c];
+  return n;
+}
+
+static double share(uint64_t part, uint64_t whole) { return whole ? (double)part / whole : 0; }
+
+static bool writeHeader(const char* path, const std::vector<uint8_t>& blob, const char* archive, uint32_t hz,
+                        uint32_t seed, const Score& s) {
+  FILE* f = fopen(path, "w");
+  if (!f) return false;
+  fprintf(f,
+          "#pragma once\n"
+          "// Weight blob for imu_classifier.h, written by tools/imu_classifier_train\n"
+          "// (seed %u) from %s, a synthetic archive from tools/threshold_sweep gen.\n"
+          "// Trained for %u Hz sampling. On the held-out patients the int8 model found\n"
+          "// %.1f %% of seizure windows and %.1f %% of fall windows, and called %.2f %% of\n"
+          "// normal windows a seizure (gyro RMS threshold: %.1f %% / %.2f %%).\n"
+          "//\n"
+          "// Reference model for the synthetic traces; retrain on recorded, labelled\n"
+          "// patient traces before relying on it.\n"
+          "\n"
+          "#include <stdint.h>\n"
+          "#include <stddef.h>\n"
+          "\n"
+          "alignas(4) static const uint8_t IMU_MODEL_BLOB[] = {",
+          seed, archive, hz, 100 * share(s.confusion[IMU_CLASS_SEIZURE][IMU_CLASS_SEIZURE], rowTotal(s, IMU_CLASS_SEIZURE)),
+          100 * share(s.confusion[IMU_CLASS_FALL][IMU_CLASS_FALL], rowTotal(s, IMU_CLASS_FALL)),
+          100 * share(s.confusion[IMU_CLASS_NORMAL][IMU_CLASS_SEIZURE], rowTotal(s, IMU_CLASS_NORMAL)),
+          100 * share(s.rms_hits[IMU_CLASS_SEIZURE], rowTotal(s, IMU_CLASS_SEIZURE)),
+          100 * share(s.rms_hits[IMU_CLASS_NORMAL], rowTotal(s, IMU_CLASS_NORMAL)));
+  for (size_t i = 0; i < blob.size(); i++) fprintf(f, "%s0x%02x,", i % 16 ? " " : "\n  ", blob[i]);
+  fprintf(f, "\n};\nstatic const size_t IMU_MODEL_BLOB_LEN = sizeof(IMU_MODEL_BLOB);\n");
+  return fclose(f) == 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s ARCHIVE [--write HEADER] [--blob FILE] [--hz 10] [--epochs 30] [--seed 1]\n", argv[0]);
+    return 2;
+  }
+  const char* archive = argv[1];
+  const char* header_path = NULL;
+  const char* blob_path = NULL;
+  uint32_t hz = 10, seed = 1;
+  int epochs = 30;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--write") == 0) header_path = argv[i + 1];
+    else if (strcmp(argv[i], "--blob") == 0) blob_path = argv[i + 1];
+    else if (strcmp(argv[i], "--hz") == 0) hz = strtoul(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "--epochs") == 0) epochs = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--seed") == 0) seed = strtoul(argv[i + 1], NULL, 10);
+  }
+  if (hz == 0 || hz > 255) {
+    fprintf(stderr, "--hz must be 1..255\n");
+    return 2;
+  }
+
+  std::vector<Trace> traces;
+  if (!loadTraces(archive, hz, traces)) return 1;
+  std::vector<Trace> train_traces, test_traces;
+  for (Trace& t : traces) (t.patient % 4 == 3 ? test_traces : train_traces).push_back(std::move(t));
+  if (train_traces.empty() || test_traces.empty()) {
+    fprintf(stderr, "need patients for both training and testing (ids 3 mod 4 are held out)\n");
+    return 1;
+  }
+
+  // Every normal window at the firmware's hop, every event window
+  std::vector<Example> examples;
+  size_t count[IMU_CLS_CLASSES] = {};
+  for (const Trace& t : train_traces) {
+    for (uint32_t end = IMU_CLS_WINDOW - 1; end < sampleCount(t); end++) {
+      int label = windowLabel(t, end);
+      if (label == LABEL_SKIP || (label == IMU_CLASS_NORMAL && end % IMU_CLS_HOP)) continue;
+      examples.push_back({&t, end, label});
+      count[label]++;
+    }
+  }
+  printf("%zu training and %zu test patients at %u Hz; training windows: %zu normal, %zu fall, %zu seizure\n",
+         train_traces.size(), test_traces.size(), hz, count[0], count[1], count[2]);
+  if (!count[IMU_CLASS_FALL] || !count[IMU_CLASS_SEIZURE]) {
+    fprintf(stderr, "the training patients need both fall and seizure labels\n");
+    return 1;
+  }
+
+  std::mt19937 rng(seed);
+  static Params model;
+  initParams(model, rng);
+  train(model, examples, epochs, rng);
+
+  std::vector<Example> calibration = examples;
+  std::shuffle(calibration.begin(), calibration.end(), rng);
+  calibration.resize(std::min<size_t>(calibration.size(), 5000));
+  std::vector<uint8_t> blob = quantize(model, calibration, hz);
+
+  std::vector<uint32_t> storage(blob.size() / 4 + 1);  // aligned, as in flash
+  memcpy(storage.data(), blob.data(), blob.size());
+  static ImuClassifier check;
+  if (!check.begin((const uint8_t*)storage.data(), blob.size()) || !check.trained()) {
+    fprintf(stderr, "exported blob rejected by ImuClassifier\n");
+    return 1;
+  }
+  Score s;
+  replay((const uint8_t*)storage.data(), blob.size(), model, test_traces, s);
+
+  printf("test patients, %.1f h, one decision per %u samples (int8 firmware path):\n", s.hours, IMU_CLS_HOP);
+  printf("  %-8s %8s %8s %8s %8s | %s\n", "truth", "windows", "normal", "fall", "seizure", "RMS > threshold");
+  for (int t = 0; t < IMU_CLS_CLASSES; t++) {
+    uint64_t n = rowTotal(s, t);
+    printf("  %-8s %8llu %7.2f%% %7.2f%% %7.2f%% | %7.2f%%\n", imuClassName(t), (unsigned long long)n,
+           100 * share(s.confusion[t][0], n), 100 * share(s.confusion[t][1], n), 100 * share(s.confusion[t][2], n),
+           100 * share(s.rms_hits[t], n));
+  }
+  double normal_seizure_per_h = s.confusion[IMU_CLASS_NORMAL][IMU_CLASS_SEIZURE] / s.hours;
+  printf("  normal windows called seizure: %.1f per hour (RMS threshold %.1f per hour)\n", normal_seizure_per_h,
+         s.rms_hits[IMU_CLASS_NORMAL] / s.hours);
+  printf("  int8 agrees with the float model on %.2f %% of windows\n", 100 * share(s.agree, s.decisions));
+
+  bool ok = true;
+  if (share(s.confusion[IMU_CLASS_SEIZURE][IMU_CLASS_SEIZURE], rowTotal(s, IMU_CLASS_SEIZURE)) < 0.9) {
+    printf("FAIL: under 90 %% of seizure windows found\n");
+    ok = false;
+  }
+  if (share(s.confusion[IMU_CLASS_NORMAL][IMU_CLASS_SEIZURE], rowTotal(s, IMU_CLASS_NORMAL)) > 0.02) {
+    printf("FAIL: over 2 %% of normal windows called seizure\n");
+    ok = false;
+  }
+  if (share(s.agree, s.decisions) < 0.98) {
+    printf("FAIL: quantization changed over 2 %% of decisions\n");
+    ok = false;
+  }
+  if (!ok) {
+    printf("FAILED, nothing written\n");
+    return 1;
+  }
+
+  if (blob_path) {
+    FILE* f = fopen(blob_path, "wb");
+    if (!f || fwrite(blob.data(), 1, blob.size(), f) != blob.size() || fclose(f) != 0) {
+      fprintf(stderr, "cannot write %s\n", blob_path);
+      return 1;
+    }
+  }
+  if (header_path) {
+    const char* name = strrchr(archive, '/');
+    if (!writeHeader(header_path, blob, name ? name + 1 : archive, hz, seed, s)) {
+      fprintf(stderr, "cannot write %s\n", header_path);
+      return 1;
+    }
+    printf("%zu byte blob written to %s\n", blob.size(), header_path);
+  }
+  printf("all checks passed\n");
+  return 0;
+}
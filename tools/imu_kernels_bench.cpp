@@ -0,0 +1,105 @@
+// Host check and benchmark for imu_kernels.h.
+//
+// Compares the selected SIMD path against the scalar one bit for bit on random
+// and extreme blocks of every length up to 300, then times both in samples/us.
+//
+//   g++ -O2 -mavx2   -o imu_kernels_bench tools/imu_kernels_bench.cpp
+//   g++ -O2 -msse4.1 -o imu_kernels_bench tools/imu_kernels_bench.cpp
+//   g++ -O2          -o imu_kernels_bench tools/imu_kernels_bench.cpp   (scalar only)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../imu_kernels.h"
+
+static const uint32_t FREEFALL_SQ = 8192u * 8192u;  // 0.5 g at +-2 g
+static const float ACCEL_SCALE = 1.0f / 16384.0f;
+static const float GYRO_SCALE = 1.0f / 131.0f;
+
+struct Buffers {
+  std::vector<uint32_t> accel_sq, gyro_sq, freefall;
+  std::vector<float> accel_mag, gyro_mag;
+  ImuBlockFeatures f;
+
+  explicit Buffers(size_t n)
+      : accel_sq(n), gyro_sq(n), freefall((n + 31) / 32 + 1), accel_mag(n), gyro_mag(n) {
+    f.accel_sq = accel_sq.data();
+    f.gyro_sq = gyro_sq.data();
+    f.accel_mag = accel_mag.data();
+    f.gyro_mag = gyro_mag.data();
+    f.freefall = freefall.data();
+  }
+};
+
+static bool same(const Buffers& a, const Buffers& b, size_t n) {
+  if (memcmp(a.f.max_abs, b.f.max_abs, sizeof(a.f.max_abs)) != 0) return false;
+  if (a.f.accel_sq_sum != b.f.accel_sq_sum || a.f.gyro_sq_sum != b.f.gyro_sq_sum) return false;
+  if (a.f.freefall_count != b.f.freefall_count) return false;
+  if (memcmp(a.accel_sq.data(), b.accel_sq.data(), n * 4) || memcmp(a.gyro_sq.data(), b.gyro_sq.data(), n * 4)) return false;
+  if (memcmp(a.accel_mag.data(), b.accel_mag.data(), n * 4) || memcmp(a.gyro_mag.data(), b.gyro_mag.data(), n * 4)) return false;
+  return memcmp(a.freefall.data(), b.freefall.data(), ((n + 31) / 32) * 4) == 0;
+}
+
+typedef void (*Kernel)(const ImuRawSample*, size_t, uint32_t, float, float, ImuBlockFeatures&);
+
+static double samplesPerUs(Kernel kernel, const std::vector<ImuRawSample>& data, size_t block) {
+  Buffers out(block);
+  size_t blocks = (data.size() - 1) / block;  // the SIMD loads may read 4 bytes past a block
+  uint64_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  int rounds = 0;
+  do {
+    for (size_t b = 0; b < blocks; b++) {
+      kernel(&data[b * block], block, FREEFALL_SQ, ACCEL_SCALE, GYRO_SCALE, out.f);
+      sink += out.f.gyro_sq_sum;
+    }
+    rounds++;
+  } while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  if (sink == 1) printf(" ");
+  return (double)rounds * blocks * block / us;
+}
+
+int main() {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> any(-32768, 32767);
+  std::uniform_int_distribution<int> small(-9000, 9000);
+  const int16_t extremes[] = {-32768, 32767, -32767, 0, 1, -1};
+
+  // Bit-exactness: +1 sample so the SIMD overread stays inside the vector
+  size_t checked = 0;
+  for (size_t n = 0; n <= 300; n++) {
+    for (int pattern = 0; pattern < 3; pattern++) {
+      std::vector<ImuRawSample> s(n + 1);
+      for (size_t i = 0; i < n + 1; i++) {
+        for (int k = 0; k < IMU_AXES; k++) {
+          if (pattern == 0) s[i].v[k] = any(rng);
+          else if (pattern == 1) s[i].v[k] = small(rng);
+          else s[i].v[k] = extremes[rng() % 6];
+        }
+      }
+      Buffers ref(n + 1), simd(n + 1);
+      imuBlockScalar(s.data(), n, FREEFALL_SQ, ACCEL_SCALE, GYRO_SCALE, ref.f);
+      imuBlockFeatures(s.data(), n, FREEFALL_SQ, ACCEL_SCALE, GYRO_SCALE, simd.f);
+      if (!same(ref, simd, n)) {
+        printf("MISMATCH: %s vs scalar, n=%zu pattern=%d\n", imuKernelName(), n, pattern);
+        return 1;
+      }
+      checked += n;
+    }
+  }
+  printf("%s matches scalar bit for bit on %zu samples\n", imuKernelName(), checked);
+
+  // Throughput over 1 M samples, FIFO-sized and large blocks
+  std::vector<ImuRawSample> data(1 << 20);
+  for (ImuRawSample& s : data) for (int k = 0; k < IMU_AXES; k++) s.v[k] = small(rng);
+  printf("%-8s %8s %14s\n", "kernel", "block", "samples/us");
+  const size_t blocks[] = {32, 1024};
+  for (size_t block : blocks) {
+    printf("%-8s %8zu %14.1f\n", "scalar", block, samplesPerUs(imuBlockScalar, data, block));
+    printf("%-8s %8zu %14.1f\n", imuKernelName(), block, samplesPerUs(imuBlockFeatures, data, block));
+  }
+  return 0;
+}
@@ -0,0 +1,207 @@
+// Multithreaded host torture test for seqlock.h and the CommandMailbox in
+// http_snapshot.h.
+//
+// SeqLock: one writer thread publishes a 40-byte state as fast as it can,
+// as the detection task in newfallseizurelogic.cpp does after every sample.
+// Every field of version n is derived from n, so a reader can tell if its
+// copy mixes two versions. The readers (default 4) read in a loop. They
+// count torn copies, versions that go backwards and versions that do not
+// match the payload. On a single core the threads only interleave where the
+// scheduler preempts them, so expect few new versions per read there.
+//
+// CommandMailbox: poster threads, like the web handlers, each post their
+// own command bit and wait until the taker, like loop(), has taken it. The
+// taker counts how often it saw each bit, so a post that got lost shows up
+// as a poster stuck waiting.
+//
+//   g++ -O2 -std=c++17 -pthread -Itools/host -o seqlock_torture tools/seqlock_torture.cpp
+//   ./seqlock_torture [--seconds 3] [--readers 4] [--posters 4]
+//
+// Also worth running built with -fsanitize=thread. Exit status is non-zero
+// on any torn or out-of-order read, or if a posted command was not taken.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../seqlock.h"
+#include "../http_snapshot.h"
+
+// 40 bytes like DetectorState; every field is a different function of n, so
+// no two versions agree on any of them by accident
+struct TortureState {
+  uint32_t n;
+  uint32_t n_squared;
+  uint32_t n_not;
+  uint16_t low, high;
+  float n_float;
+  uint8_t bytes[8];
+  uint32_t mixed;
+  uint32_t check;
+};
+
+static uint32_t mix(uint32_t n) {
+  n ^= n >> 16;
+  n *= 0x7feb352d;
+  n ^= n >> 15;
+  return n;
+}
+
+static TortureState makeState(uint32_t n) {
+  TortureState s;
+  s.n = n;
+  s.n_squared = n * n;
+  s.n_not = ~n;
+  s.low = (uint16_t)n;
+  s.high = (uint16_t)(n >> 16);
+  s.n_float = (float)(n & 0xFFFFF);
+  for (int i = 0; i < 8; i++) s.bytes[i] = (uint8_t)(n + i);
+  s.mixed = mix(n);
+  s.check = s.n ^ s.n_squared ^ s.mixed;
+  return s;
+}
+
+static bool consistent(const TortureState& s) {
+  TortureState want = makeState(s.n);
+  return memcmp(&s, &want, sizeof(s)) == 0;
+}
+
+struct ReaderStats {
+  uint64_t reads = 0;
+  uint64_t torn = 0;
+  uint64_t backwards = 0;
+  uint64_t mismatched = 0;
+  uint64_t changes = 0;
+};
+
+int main(int argc, char** argv) {
+  double seconds = 3;
+  int readers = 4, posters = 4;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--seconds")) seconds = atof(argv[i + 1]);
+    else if (!strcmp(argv[i], "--readers")) readers = atoi(argv[i + 1]);
+    else if (!strcmp(argv[i], "--posters")) posters = atoi(argv[i + 1]);
+  }
+  if (posters > 32) posters = 32;
+  int failures = 0;
+
+  // --- SeqLock ---
+  static SeqLock<TortureState> lock;
+  lock.write(makeState(0));
+  std::atomic<bool> stop{false};
+  uint64_t writes = 0;
+  std::vector<ReaderStats> stats(readers);
+
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; r++) {
+    threads.emplace_back([&, r] {
+      ReaderStats& st = stats[r];
+      uint32_t last_version = 0, last_n = 0;
+      TortureState s;
+      while (!stop.load(std::memory_order_relaxed)) {
+        uint32_t version = lock.read(s);
+        st.reads++;
+        if (!consistent(s)) st.torn++;
+        if (version < last_version || s.n < last_n) st.backwards++;
+        // State n is the (n + 1)th write, so it carries version 2(n + 1)
+        if (version != 2 * (s.n + 1)) st.mismatched++;
+        if (s.n != last_n) st.changes++;
+        last_version = version;
+        last_n = s.n;
+      }
+    });
+  }
+  threads.emplace_back([&] {
+    uint32_t n = 0;
+    while (!stop.load(std::memory_order_relaxed)) lock.write(makeState(++n));
+    writes = n;
+  });
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (std::thread& t : threads) t.join();
+  threads.clear();
+
+  ReaderStats total;
+  for (const ReaderStats& st : stats) {
+    total.reads += st.reads;
+    total.torn += st.torn;
+    total.backwards += st.backwards;
+    total.mismatched += st.mismatched;
+    total.changes += st.changes;
+  }
+  printf("seqlock: %d readers, %.1f s: %llu writes, %llu reads (%.3f new versions per read), %llu torn, "
+         "%llu backwards, %llu version mismatches\n",
+         readers, seconds, (unsigned long long)writes, (unsigned long long)total.reads,
+         total.reads ? (double)total.changes / total.reads : 0.0, (unsigned long long)total.torn,
+         (unsigned long long)total.backwards, (unsigned long long)total.mismatched);
+  if (total.torn || total.backwards || total.mismatched) {
+    printf("FAIL: a reader saw a torn or out-of-order state\n");
+    failures++;
+  }
+  if (writes == 0 || total.reads == 0) {
+    printf("FAIL: writer or readers made no progress\n");
+    failures++;
+  }
+
+  // --- CommandMailbox ---
+  static CommandMailbox mailbox;
+  std::atomic<uint64_t> taken[32];
+  for (std::atomic<uint64_t>& t : taken) t = 0;
+  std::vector<uint64_t> posted(posters, 0);
+  std::atomic<bool> posting{true};
+  std::atomic<int> stuck{0};
+  stop = false;
+
+  for (int p = 0; p < posters; p++) {
+    threads.emplace_back([&, p] {
+      uint32_t bit = 1u << p;
+      while (posting.load(std::memory_order_relaxed)) {
+        uint64_t before = taken[p].load();
+        mailbox.post(bit);
+        posted[p]++;
+        // Wait for the taker to see it; a lost post never arrives
+        auto t0 = std::chrono::steady_clock::now();
+        while (taken[p].load() == before) {
+          if (std::chrono::steady_clock::now() - t0 > std::chrono::seconds(1)) {
+            stuck++;
+            return;
+          }
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  threads.emplace_back([&] {
+    while (!stop.load(std::memory_order_relaxed)) {
+      uint32_t commands = mailbox.take();
+      for (int p = 0; p < posters; p++) {
+        if (commands & (1u << p)) taken[p]++;
+      }
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  posting = false;
+  for (int p = 0; p < posters; p++) threads[p].join();
+  stop = true;
+  threads.back().join();
+
+  uint64_t posts = 0, takes = 0;
+  for (int p = 0; p < posters; p++) {
+    posts += posted[p];
+    takes += taken[p];
+  }
+  printf("mailbox: %d posters, %.1f s: %llu posts, %llu taken, %d posters stuck\n", posters, seconds,
+         (unsigned long long)posts, (unsigned long long)takes, stuck.load());
+  if (stuck || takes != posts) {
+    printf("FAIL: a posted command was never taken\n");
+    failures++;
+  }
+
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
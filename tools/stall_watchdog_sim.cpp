@@ -0,0 +1,154 @@
+// Host run of stall_watchdog.h with injected stalls.
+//
+// A sampling thread beats every 10 ms and walks through the same stages as
+// the detection task in newfallseizurelogic.cpp, blocking for a scripted
+// time in some of them. A supervisor thread runs check() like the sketch
+// does. A restart abandons the sampler's current block and re-runs begin()
+// on the same log, as a reset that keeps RTC memory would. The reports are
+// then compared with the script.
+//
+//   g++ -O2 -std=c++17 -pthread -o stall_watchdog_sim tools/stall_watchdog_sim.cpp
+//   ./stall_watchdog_sim
+//
+// Exit status is non-zero if a stall was missed, misattributed or mis-timed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../stall_watchdog.h"
+
+static const uint32_t SAMPLE_MS = 10;
+static const uint32_t DEADLINE_MS = 100;
+static const uint32_t RESTART_MS = 1500;
+static const uint32_t CHECK_MS = 10;
+static const uint32_t TOLERANCE_MS = 30;
+
+struct Injected {
+  uint32_t at_sample;
+  const char* stage;
+  uint32_t block_ms;
+};
+
+// Short blocks stay under the deadline and must not be reported
+static const Injected SCRIPT[] = {
+    {20, "mpu-read", 50},
+    {40, "mpu-read", 250},
+    {60, "publish", 120},
+    {80, "commands", 600},
+    {100, "mpu-init", 2000},   // past RESTART_MS
+    {130, "mpu-read", 300},
+};
+static const size_t SCRIPT_LEN = sizeof(SCRIPT) / sizeof(SCRIPT[0]);
+
+static std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+static uint32_t nowMs() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void sleepMs(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+int main() {
+  static StallLog log;  // RTC memory on the device: survives the "restart"
+  StallWatchdog watchdog(log, DEADLINE_MS, RESTART_MS);
+  watchdog.begin(nowMs());
+
+  std::atomic<bool> done{false};
+  std::atomic<bool> resetting{false};
+  std::atomic<int> restarts{0};
+
+  // Blocks like a hung call, but gives up when the board is "reset"
+  auto block = [&](uint32_t ms) {
+    uint32_t start = nowMs();
+    while (nowMs() - start < ms) {
+      if (resetting) {
+        resetting = false;
+        return;
+      }
+      sleepMs(1);
+    }
+  };
+
+  std::thread sampler([&] {
+    size_t next = 0;
+    for (uint32_t sample = 0; sample < 160; sample++) {
+      watchdog.beat(nowMs());
+      watchdog.stage("commands");
+      watchdog.stage("mpu-read");
+      if (next < SCRIPT_LEN && SCRIPT[next].at_sample == sample) {
+        watchdog.stage(SCRIPT[next].stage);
+        block(SCRIPT[next].block_ms);
+        next++;
+      }
+      watchdog.stage("publish");
+      watchdog.stage("sleep");
+      sleepMs(SAMPLE_MS);
+    }
+    done = true;
+  });
+
+  std::thread supervisor([&] {
+    while (!done) {
+      uint32_t now = nowMs();
+      switch (watchdog.check(now)) {
+        case STALL_DETECTED:
+          printf("%6u ms: stall detected\n", now);
+          break;
+        case STALL_RESTART:
+          printf("%6u ms: restart\n", now);
+          restarts++;
+          resetting = true;
+          while (resetting) sleepMs(1);
+          watchdog.begin(nowMs());
+          break;
+        default:
+          break;
+      }
+      sleepMs(CHECK_MS);
+    }
+  });
+
+  sampler.join();
+  supervisor.join();
+
+  char json[2048];
+  watchdog.toJson(json, sizeof(json));
+  printf("%s\n", json);
+
+  StallReport reports[STALL_MAX_REPORTS];
+  int n = watchdog.reports(reports);
+  int failures = 0;
+  int r = 0;
+  for (size_t i = 0; i < SCRIPT_LEN; i++) {
+    const Injected& s = SCRIPT[i];
+    if (s.block_ms <= DEADLINE_MS) continue;
+    if (r >= n) {
+      printf("FAIL: %s stall of %u ms not reported\n", s.stage, s.block_ms);
+      failures++;
+      continue;
+    }
+    const StallReport& rep = reports[r++];
+    bool restarted = s.block_ms >= RESTART_MS;
+    // A restart ends the report at the reset, not at the next beat
+    bool timed = restarted ? rep.duration_ms >= RESTART_MS
+                           : rep.duration_ms + TOLERANCE_MS >= s.block_ms &&
+                                 rep.duration_ms <= s.block_ms + SAMPLE_MS + TOLERANCE_MS;
+    bool ok = strcmp(rep.stage, s.stage) == 0 && timed && rep.restarted == restarted && !rep.ongoing;
+    printf("%s: %-8s blocked %4u ms, reported %-8s %4u ms%s\n", ok ? "ok  " : "FAIL", s.stage, s.block_ms, rep.stage,
+           rep.duration_ms, rep.restarted ? " (restarted)" : "");
+    failures += !ok;
+  }
+  if (r != n) {
+    printf("FAIL: %d unexpected reports\n", n - r);
+    failures++;
+  }
+  if (restarts != 1) {
+    printf("FAIL: %d restarts, expected 1\n", restarts.load());
+    failures++;
+  }
+  printf("%s\n", failures ? "FAILED" : "all stalls accounted for");
+  return failures ? 1 : 0;
+}
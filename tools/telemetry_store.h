@@ -0,0 +1,885 @@
+#pragma once
+// Columnar time-series store for fleet telemetry on a gateway (Linux only).
+//
+// Rows are the uplink's TelemetryFrames (telemetry_frame.h) stamped with the
+// gateway's clock. Each device appends to its own in-memory head. A full head
+// (STORE_BLOCK_ROWS rows) is sealed into a block: one column per field, each
+// bit-packed as deltas or against its minimum (storePackColumn), preceded by
+// rollups (min, max, sum and count per value, OR of the flags) for every
+// minute the block covers. The block's index entry also carries a rollup of
+// the whole block.
+//
+// Sealed blocks are written out in segments. A segment is an immutable,
+// append-once file holding blocks of many devices sorted by device, then
+// time; sharing segments saves a file per device per flush. Layout, all
+// little-endian:
+//
+//   StoreSegmentHeader
+//   per block: StoreMinute[minutes], then the packed columns (8-byte aligned)
+//   StoreBlockEntry[block_count]        at header.index_offset
+//
+// Segments are mapped read-only. Queries read the index and the minute
+// rollups in place and unpack columns only for blocks a bucket cuts through.
+// A background thread flushes sealed blocks every STORE_FLUSH_MS and merges
+// segments in tiers of STORE_COMPACT_FANIN, copying blocks unchanged, so a
+// device's blocks end up next to each other.
+//
+// Ingest takes only the device's stripe lock. A query copies the segment set
+// and the device's unflushed rows under a shared lock, then works without
+// locks; segments it holds stay mapped until it lets go. A flush or
+// compaction swaps the segment set under the exclusive lock, so no row is
+// seen twice or missed.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../telemetry_frame.h"
+
+#define STORE_MAGIC          0x53544842 // "BHTS"
+#define STORE_VERSION        1
+#define STORE_BLOCK_ROWS     1024       // 17 min at one frame per second
+#define STORE_ROLLUP_MS      60000
+#define STORE_STRIPES        64
+#define STORE_FLUSH_MS       1000
+#define STORE_FLUSH_BYTES    (64u << 20) // flush early past this much sealed data
+#define STORE_COMPACT_FANIN  4
+#define STORE_MAX_LEVEL      3
+
+enum StoreValue {
+  STORE_HR,         // BPM * 10, 0 = no reading
+  STORE_SPO2,       // % * 10, 0 = no reading
+  STORE_ACCEL,      // mg, mean over the frame
+  STORE_ACCEL_MAX,
+  STORE_GYRO,       // deg/s * 10, mean over the frame
+  STORE_GYRO_MAX,
+  STORE_VALUES
+};
+
+inline const char* storeValueName(int k) {
+  static const char* names[STORE_VALUES] = {"hr", "spo2", "accel", "accel_max", "gyro", "gyro_max"};
+  return (k >= 0 && k < STORE_VALUES) ? names[k] : "?";
+}
+
+struct StoreRow {
+  int64_t t_ms;     // gateway time, ms since the epoch
+  uint32_t seq;     // the frame's sequence number
+  uint16_t v[STORE_VALUES];
+  uint8_t flags;    // UplinkFlags
+};
+
+inline StoreRow storeRow(int64_t t_ms, const TelemetryFrame& f) {
+  StoreRow r;
+  r.t_ms = t_ms;
+  r.seq = f.seq;
+  r.v[STORE_HR] = f.hr_x10;
+  r.v[STORE_SPO2] = f.spo2_x10;
+  r.v[STORE_ACCEL] = f.accel_mg;
+  r.v[STORE_ACCEL_MAX] = f.accel_max_mg;
+  r.v[STORE_GYRO] = f.gyro_dps_x10;
+  r.v[STORE_GYRO_MAX] = f.gyro_max_dps_x10;
+  r.flags = f.flags;
+  return r;
+}
+
+// A missing HR or SpO2 reading is left out of the rollups
+inline bool storeHasReading(int k, uint16_t v) { return v != 0 || k > STORE_SPO2; }
+
+inline int64_t storeFloorDiv(int64_t a, int64_t b) { return a / b - (a % b != 0 && (a < 0) != (b < 0)); }
+
+struct StoreRollup {
+  uint32_t rows;
+  uint16_t min[STORE_VALUES];
+  uint16_t max[STORE_VALUES];
+  uint16_t count[STORE_VALUES];  // rows with a reading
+  uint32_t sum[STORE_VALUES];
+  uint8_t flags;
+  uint8_t reserved[3];
+};
+
+inline void storeRollupClear(StoreRollup& r) {
+  memset(&r, 0, sizeof(r));
+  for (int k = 0; k < STORE_VALUES; k++) r.min[k] = 0xFFFF;
+}
+
+inline void storeRollupAdd(StoreRollup& r, const StoreRow& row) {
+  r.rows++;
+  r.flags |= row.flags;
+  for (int k = 0; k < STORE_VALUES; k++) {
+    uint16_t v = row.v[k];
+    if (!storeHasReading(k, v)) continue;
+    if (v < r.min[k]) r.min[k] = v;
+    if (v > r.max[k]) r.max[k] = v;
+    r.count[k]++;
+    r.sum[k] += v;
+  }
+}
+
+struct StoreMinute {
+  uint32_t minute;  // t_ms / STORE_ROLLUP_MS
+  StoreRollup rollup;
+};
+
+struct StoreBlockEntry {
+  uint32_t device;
+  uint32_t rows;
+  int64_t t_min;
+  int64_t t_max;
+  uint64_t offset;   // of the block, from the start of the segment
+  uint32_t bytes;
+  uint32_t minutes;  // StoreMinute entries at the start of the block
+  StoreRollup rollup;
+};
+
+struct StoreSegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t level;        // 0 for a flush, one more than its inputs for a merge
+  uint32_t block_count;
+  uint64_t first_id;     // the flushes this segment holds
+  uint64_t last_id;
+  uint64_t index_offset;
+  uint64_t rows;
+};
+
+// One query bucket; sums and counts are wide enough for any range
+struct StoreBucket {
+  int64_t t_ms;  // start of the bucket
+  uint32_t rows;
+  uint8_t flags;
+  uint16_t min[STORE_VALUES];
+  uint16_t max[STORE_VALUES];
+  uint32_t count[STORE_VALUES];
+  uint64_t sum[STORE_VALUES];
+
+  float mean(int k) const { return count[k] ? (float)sum[k] / count[k] : 0; }
+
+  void clear(int64_t t) {
+    memset(this, 0, sizeof(*this));
+    t_ms = t;
+    for (int k = 0; k < STORE_VALUES; k++) min[k] = 0xFFFF;
+  }
+
+  void add(const StoreRollup& r) {
+    rows += r.rows;
+    flags |= r.flags;
+    for (int k = 0; k < STORE_VALUES; k++) {
+      if (!r.count[k]) continue;
+      if (r.min[k] < min[k]) min[k] = r.min[k];
+      if (r.max[k] > max[k]) max[k] = r.max[k];
+      count[k] += r.count[k];
+      sum[k] += r.sum[k];
+    }
+  }
+
+  void add(const StoreRow& row) {
+    rows++;
+    flags |= row.flags;
+    for (int k = 0; k < STORE_VALUES; k++) {
+      uint16_t v = row.v[k];
+      if (!storeHasReading(k, v)) continue;
+      if (v < min[k]) min[k] = v;
+      if (v > max[k]) max[k] = v;
+      count[k]++;
+      sum[k] += v;
+    }
+  }
+};
+
+// How a query was answered
+struct StoreQueryStats {
+  uint32_t blocks_whole;    // block rollup into one bucket
+  uint32_t blocks_minutes;  // minute rollups
+  uint32_t blocks_decoded;  // columns unpacked
+  uint32_t head_rows;       // unsealed rows scanned
+};
+
+// ---- Column codec ----
+//
+// Each column of a block is bit-packed one of two ways, whichever takes
+// fewer bits:
+//
+//   STORE_PACK_DELTA  differences between consecutive values, less the
+//                     smallest difference: time at about 1 s steps, the
+//                     frame sequence, slowly moving vitals
+//   STORE_PACK_FOR    values less the smallest (frame of reference): noisy
+//                     columns, where a difference spans twice the range
+//
+// Layout: uint8 mode, uint8 width, int64 base (first value for deltas,
+// smallest value otherwise), int64 smallest difference (0 otherwise), then
+// the packed values, `width` bits each, in little-endian words. A width of 0
+// (a constant column or a constant step) takes no words.
+
+enum StorePacking : uint8_t { STORE_PACK_DELTA, STORE_PACK_FOR };
+
+#define STORE_COLUMN_HEADER 18
+
+inline uint8_t storeBitWidth(uint64_t span) {
+  uint8_t width = 0;
+  while (width < 64 && (span >> width)) width++;
+  return width;
+}
+
+inline void storePackColumn(const int64_t* v, uint32_t n, std::vector<uint8_t>& out) {
+  int64_t dlo = 0, dhi = 0;
+  int64_t vlo = n ? v[0] : 0, vhi = vlo;
+  for (uint32_t i = 1; i < n; i++) {
+    int64_t d = v[i] - v[i - 1];
+    if (i == 1 || d < dlo) dlo = d;
+    if (i == 1 || d > dhi) dhi = d;
+    if (v[i] < vlo) vlo = v[i];
+    if (v[i] > vhi) vhi = v[i];
+  }
+  uint8_t dwidth = storeBitWidth((uint64_t)(dhi - dlo));
+  uint8_t fwidth = storeBitWidth((uint64_t)(vhi - vlo));
+  // Deltas pack one value fewer, so they win a tie
+  bool delta = (uint64_t)dwidth * (n ? n - 1 : 0) <= (uint64_t)fwidth * n;
+  uint8_t width = delta ? dwidth : fwidth;
+  int64_t base = delta ? (n ? v[0] : 0) : vlo;
+  int64_t lo = delta ? dlo : 0;
+  size_t at = out.size();
+  out.resize(at + STORE_COLUMN_HEADER);
+  out[at] = delta ? STORE_PACK_DELTA : STORE_PACK_FOR;
+  out[at + 1] = width;
+  memcpy(&out[at + 2], &base, 8);
+  memcpy(&out[at + 10], &lo, 8);
+  if (width == 0) return;
+
+  uint64_t acc = 0;
+  unsigned used = 0;
+  auto put = [&out](uint64_t w) {
+    size_t p = out.size();
+    out.resize(p + 8);
+    memcpy(&out[p], &w, 8);
+  };
+  for (uint32_t i = delta ? 1 : 0; i < n; i++) {
+    uint64_t x = delta ? (uint64_t)(v[i] - v[i - 1] - lo) : (uint64_t)(v[i] - base);
+    acc |= x << used;
+    if (used + width >= 64) {
+      put(acc);
+      acc = used ? x >> (64 - used) : 0;
+      used = used + width - 64;
+    } else {
+      used += width;
+    }
+  }
+  if (used) put(acc);
+}
+
+// Returns the byte after the column, NULL if it is corrupt or runs past `end`
+inline const uint8_t* storeUnpackColumn(const uint8_t* p, const uint8_t* end, uint32_t n, int64_t* v) {
+  if (end - p < STORE_COLUMN_HEADER) return NULL;
+  uint8_t mode = p[0];
+  uint8_t width = p[1];
+  int64_t base, lo;
+  memcpy(&base, p + 2, 8);
+  memcpy(&lo, p + 10, 8);
+  p += STORE_COLUMN_HEADER;
+  if (mode > STORE_PACK_FOR || width > 64) return NULL;
+  if (n == 0) return p;
+  bool delta = mode == STORE_PACK_DELTA;
+  uint32_t first = delta ? 1 : 0;
+  v[0] = base;
+  if (width == 0) {
+    for (uint32_t i = first; i < n; i++) v[i] = delta ? v[i - 1] + lo : base;
+    return p;
+  }
+  size_t words = ((size_t)(n - first) * width + 63) / 64;
+  if ((size_t)(end - p) < words * 8) return NULL;
+  uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+  uint64_t acc = 0;
+  unsigned avail = 0;
+  for (uint32_t i = first; i < n; i++) {
+    uint64_t x;
+    if (avail >= width) {
+      x = acc & mask;
+      acc = width == 64 ? 0 : acc >> width;
+      avail -= width;
+    } else {
+      uint64_t w;
+      memcpy(&w, p, 8);
+      p += 8;
+      x = (acc | (w << avail)) & mask;
+      unsigned taken = width - avail;
+      acc = taken == 64 ? 0 : w >> taken;
+      avail = 64 - taken;
+    }
+    v[i] = delta ? v[i - 1] + lo + (int64_t)x : base + (int64_t)x;
+  }
+  return p;
+}
+
+// ---- Blocks ----
+
+// Encodes `n` rows of one device, in time order, into `out` (appended, from
+// an 8-byte boundary) and fills everything in `e` but the offset
+inline void storeEncodeBlock(uint32_t device, const StoreRow* rows, uint32_t n, std::vector<uint8_t>& out,
+                             StoreBlockEntry& e) {
+  memset(&e, 0, sizeof(e));
+  e.device = device;
+  e.rows = n;
+  storeRollupClear(e.rollup);
+  size_t start = out.size();
+
+  std::vector<StoreMinute> minutes;
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t minute = (uint32_t)storeFloorDiv(rows[i].t_ms, STORE_ROLLUP_MS);
+    if (minutes.empty() || minutes.back().minute != minute) {
+      minutes.push_back(StoreMinute());
+      minutes.back().minute = minute;
+      storeRollupClear(minutes.back().rollup);
+    }
+    storeRollupAdd(minutes.back().rollup, rows[i]);
+    storeRollupAdd(e.rollup, rows[i]);
+    if (i == 0 || rows[i].t_ms < e.t_min) e.t_min = rows[i].t_ms;
+    if (i == 0 || rows[i].t_ms > e.t_max) e.t_max = rows[i].t_ms;
+  }
+  e.minutes = minutes.size();
+  out.resize(start + minutes.size() * sizeof(StoreMinute));
+  memcpy(&out[start], minutes.data(), minutes.size() * sizeof(StoreMinute));
+
+  std::vector<int64_t> col(n);
+  for (uint32_t i = 0; i < n; i++) col[i] = rows[i].t_ms;
+  storePackColumn(col.data(), n, out);
+  for (uint32_t i = 0; i < n; i++) col[i] = rows[i].seq;
+  storePackColumn(col.data(), n, out);
+  for (int k = 0; k < STORE_VALUES; k++) {
+    for (uint32_t i = 0; i < n; i++) col[i] = rows[i].v[k];
+    storePackColumn(col.data(), n, out);
+  }
+  for (uint32_t i = 0; i < n; i++) col[i] = rows[i].flags;
+  storePackColumn(col.data(), n, out);
+  out.resize((out.size() + 7) & ~(size_t)7);
+  e.bytes = out.size() - start;
+}
+
+inline const StoreMinute* storeBlockMinutes(const uint8_t* block) { return (const StoreMinute*)block; }
+
+// Unpacks a block into `rows` (e.rows of them); false if it is corrupt
+inline bool storeDecodeBlock(const StoreBlockEntry& e, const uint8_t* block, StoreRow* rows) {
+  const uint8_t* end = block + e.bytes;
+  const uint8_t* p = block + (size_t)e.minutes * sizeof(StoreMinute);
+  std::vector<int64_t> col(e.rows);
+  for (int c = 0; c < STORE_VALUES + 3; c++) {
+    p = storeUnpackColumn(p, end, e.rows, col.data());
+    if (!p) return false;
+    for (uint32_t i = 0; i < e.rows; i++) {
+      if (c == 0) rows[i].t_ms = col[i];
+      else if (c == 1) rows[i].seq = (uint32_t)col[i];
+      else if (c < STORE_VALUES + 2) rows[i].v[c - 2] = (uint16_t)col[i];
+      else rows[i].flags = (uint8_t)col[i];
+    }
+  }
+  return true;
+}
+
+// A sealed block not yet in a segment
+struct StoreBlock {
+  StoreBlockEntry entry;
+  std::vector<uint8_t> bytes;
+};
+
+inline bool storeEntryBefore(const StoreBlockEntry& a, const StoreBlockEntry& b) {
+  return a.device != b.device ? a.device < b.device : a.t_min < b.t_min;
+}
+
+// ---- Segments ----
+
+class StoreSegment {
+public:
+  std::atomic<bool> obsolete{false};  // merged away: deleted with the last reference
+
+  ~StoreSegment() {
+    if (base) munmap((void*)base, size);
+    if (fd >= 0) ::close(fd);
+    if (obsolete) unlink(path.c_str());
+  }
+
+  bool open(const std::string& path, std::string& error) {
+    this->path = path;
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail(error, "cannot open segment");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(StoreSegmentHeader)) return fail(error, "segment too small");
+    size = st.st_size;
+    base = (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      base = NULL;
+      return fail(error, "mmap failed");
+    }
+    madvise((void*)base, size, MADV_RANDOM);
+
+    const StoreSegmentHeader* h = (const StoreSegmentHeader*)base;
+    if (h->magic != STORE_MAGIC || h->version != STORE_VERSION) return fail(error, "not a store segment");
+    if (h->index_offset % 8 || h->index_offset + (uint64_t)h->block_count * sizeof(StoreBlockEntry) > size) {
+      return fail(error, "index out of range");
+    }
+    const StoreBlockEntry* e = entries();
+    for (uint32_t i = 0; i < h->block_count; i++) {
+      if (e[i].offset % 8 || e[i].offset + e[i].bytes > h->index_offset ||
+          (uint64_t)e[i].minutes * sizeof(StoreMinute) > e[i].bytes || e[i].rows == 0) {
+        return fail(error, "block out of range");
+      }
+      if (i && storeEntryBefore(e[i], e[i - 1])) return fail(error, "index out of order");
+    }
+    return true;
+  }
+
+  const StoreSegmentHeader& header() const { return *(const StoreSegmentHeader*)base; }
+  const StoreBlockEntry* entries() const { return (const StoreBlockEntry*)(base + header().index_offset); }
+  const uint8_t* block(const StoreBlockEntry& e) const { return base + e.offset; }
+  size_t bytes() const { return size; }
+  const std::string& file() const { return path; }
+
+  // The device's blocks, in time order
+  void device(uint32_t id, const StoreBlockEntry*& first, const StoreBlockEntry*& last) const {
+    const StoreBlockEntry* begin = entries();
+    const StoreBlockEntry* end = begin + header().block_count;
+    first = std::lower_bound(begin, end, id, [](const StoreBlockEntry& e, uint32_t d) { return e.device < d; });
+    last = std::upper_bound(first, end, id, [](uint32_t d, const StoreBlockEntry& e) { return d < e.device; });
+  }
+
+private:
+  std::string path;
+  int fd = -1;
+  const uint8_t* base = NULL;
+  size_t size = 0;
+
+  bool fail(std::string& error, const char* why) {
+    error = path + ": " + why;
+    return false;
+  }
+};
+
+// Writes blocks, already sorted by storeEntryBefore, to `path` through a
+// temporary file; the segment appears complete or not at all
+inline bool storeWriteSegment(const std::string& path, uint32_t level, uint64_t first_id, uint64_t last_id,
+                              const std::vector<std::pair<const StoreBlockEntry*, const uint8_t*>>& blocks) {
+  std::string tmp = path + ".tmp";
+  FILE* file = fopen(tmp.c_str(), "wb");
+  if (!file) return false;
+  setvbuf(file, NULL, _IOFBF, 1 << 20);
+  StoreSegmentHeader h = {STORE_MAGIC, STORE_VERSION, level, (uint32_t)blocks.size(), first_id, last_id, 0, 0};
+  bool ok = fwrite(&h, sizeof(h), 1, file) == 1;
+  std::vector<StoreBlockEntry> index;
+  index.reserve(blocks.size());
+  uint64_t at = sizeof(h);
+  for (size_t i = 0; ok && i < blocks.size(); i++) {
+    StoreBlockEntry e = *blocks[i].first;
+    e.offset = at;
+    ok = fwrite(blocks[i].second, 1, e.bytes, file) == e.bytes;
+    at += e.bytes;
+    h.rows += e.rows;
+    index.push_back(e);
+  }
+  h.index_offset = at;
+  ok = ok && fwrite(index.data(), sizeof(StoreBlockEntry), index.size(), file) == index.size();
+  ok = ok && fseeko(file, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, file) == 1;
+  ok = ok && fflush(file) == 0 && fdatasync(fileno(file)) == 0;
+  ok = fclose(file) == 0 && ok;
+  ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+  if (!ok) unlink(tmp.c_str());
+  return ok;
+}
+
+// ---- Store ----
+
+struct StoreStats {
+  uint64_t rows;            // appended since open
+  uint64_t head_rows;       // not sealed yet
+  uint64_t sealed_blocks;   // sealed, not flushed yet
+  uint64_t segments;
+  uint64_t segment_rows;
+  uint64_t segment_bytes;
+  uint64_t flushes;
+  uint64_t compactions;
+  uint64_t compacted_bytes; // written by compactions
+};
+
+class TelemetryStore {
+public:
+  ~TelemetryStore() { close(); }
+
+  // Opens or creates the store in `dir` and starts the background thread
+  bool open(const char* dir, std::string& error) {
+    this->dir = dir;
+    mkdir(dir, 0755);
+    DIR* d = opendir(dir);
+    if (!d) {
+      error = std::string(dir) + ": cannot open";
+      return false;
+    }
+    auto version = std::make_shared<Version>();
+    while (struct dirent* ent = readdir(d)) {
+      std::string name = ent->d_name;
+      std::string path = this->dir + "/" + name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+        unlink(path.c_str());  // cut short by a crash
+      } else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bts") == 0) {
+        auto seg = std::make_shared<StoreSegment>();
+        if (!seg->open(path, error)) {
+          closedir(d);
+          return false;
+        }
+        version->segments.push_back(seg);
+      }
+    }
+    closedir(d);
+    // A merge that finished before its inputs were deleted covers them
+    auto& segs = version->segments;
+    for (auto& s : segs) {
+      for (auto& t : segs) {
+        const StoreSegmentHeader &a = s->header(), &b = t->header();
+        if (s != t && b.first_id <= a.first_id && a.last_id <= b.last_id &&
+            (b.first_id != a.first_id || b.last_id != a.last_id)) {
+          s->obsolete = true;
+        }
+      }
+    }
+    segs.erase(std::remove_if(segs.begin(), segs.end(), [](const std::shared_ptr<StoreSegment>& s) { return s->obsolete.load(); }),
+               segs.end());
+    std::sort(segs.begin(), segs.end(), [](const std::shared_ptr<StoreSegment>& a, const std::shared_ptr<StoreSegment>& b) {
+      return a->header().first_id < b->header().first_id;
+    });
+    next_id = segs.empty() ? 1 : segs.back()->header().last_id + 1;
+    current = version;
+    stop = false;
+    worker = std::thread([this] { background(); });
+    return true;
+  }
+
+  // Seals every head, flushes and stops the background thread
+  void close() {
+    if (!worker.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(wake_lock);
+      stop = true;
+    }
+    wake.notify_one();
+    worker.join();
+    for (Stripe& s : stripes) {
+      std::lock_guard<std::mutex> lock(s.lock);
+      for (auto& h : s.heads) {
+        if (!h.second.empty()) seal(s, h.first, h.second);
+      }
+      s.heads.clear();
+    }
+    flush();
+    std::unique_lock<std::shared_mutex> lock(swap_lock);
+    current.reset();
+  }
+
+  // Rows of one device must come in time order
+  void append(uint32_t device, const StoreRow& row) {
+    Stripe& s = stripes[device % STORE_STRIPES];
+    bool full;
+    {
+      std::lock_guard<std::mutex> lock(s.lock);
+      std::vector<StoreRow>& head = s.heads[device];
+      if (head.capacity() < STORE_BLOCK_ROWS) head.reserve(STORE_BLOCK_ROWS);
+      head.push_back(row);
+      if (head.size() == STORE_BLOCK_ROWS) seal(s, device, head);
+      full = sealed_bytes.load(std::memory_order_relaxed) >= STORE_FLUSH_BYTES;
+    }
+    appended.fetch_add(1, std::memory_order_relaxed);
+    if (full) wake.notify_one();
+  }
+
+  void append(uint32_t device, int64_t t_ms, const TelemetryFrame& f) { append(device, storeRow(t_ms, f)); }
+
+  // Rollups of one device over [from_ms, to_ms) in buckets of step_ms from
+  // from_ms. Minute rollups answer whole minutes: when from_ms, to_ms and
+  // step_ms are multiples of STORE_ROLLUP_MS no column is unpacked except
+  // for rows not sealed yet. Returns the number of rows.
+  size_t query(uint32_t device, int64_t from_ms, int64_t to_ms, int64_t step_ms, std::vector<StoreBucket>& out,
+               StoreQueryStats* stats = NULL) const {
+    StoreQueryStats local = {};
+    StoreQueryStats& st = stats ? *stats : local;
+    out.clear();
+    if (to_ms <= from_ms || step_ms <= 0) return 0;
+    size_t buckets = (to_ms - from_ms + step_ms - 1) / step_ms;
+    out.resize(buckets);
+    for (size_t b = 0; b < buckets; b++) out[b].clear(from_ms + (int64_t)b * step_ms);
+    bool minutes_ok = step_ms % STORE_ROLLUP_MS == 0 && from_ms % STORE_ROLLUP_MS == 0 && to_ms % STORE_ROLLUP_MS == 0;
+    size_t rows = 0;
+    std::vector<StoreRow> decoded;
+
+    auto block = [&](const StoreBlockEntry& e, const uint8_t* p) {
+      if (e.t_max < from_ms || e.t_min >= to_ms) return;
+      if (e.t_min >= from_ms && e.t_max < to_ms && (e.t_min - from_ms) / step_ms == (e.t_max - from_ms) / step_ms) {
+        out[(e.t_min - from_ms) / step_ms].add(e.rollup);
+        rows += e.rows;
+        st.blocks_whole++;
+        return;
+      }
+      if (minutes_ok) {
+        const StoreMinute* m = storeBlockMinutes(p);
+        for (uint32_t i = 0; i < e.minutes; i++) {
+          int64_t t = (int64_t)m[i].minute * STORE_ROLLUP_MS;
+          if (t < from_ms || t >= to_ms) continue;
+          out[(t - from_ms) / step_ms].add(m[i].rollup);
+          rows += m[i].rollup.rows;
+        }
+        st.blocks_minutes++;
+        return;
+      }
+      decoded.resize(e.rows);
+      if (!storeDecodeBlock(e, p, decoded.data())) return;
+      st.blocks_decoded++;
+      for (const StoreRow& r : decoded) {
+        if (r.t_ms < from_ms || r.t_ms >= to_ms) continue;
+        out[(r.t_ms - from_ms) / step_ms].add(r);
+        rows++;
+      }
+    };
+
+    Snapshot snap = snapshot(device);
+    for (const auto& seg : snap.version->segments) {
+      const StoreBlockEntry *first, *last;
+      seg->device(device, first, last);
+      for (const StoreBlockEntry* e = first; e != last; e++) block(*e, seg->block(*e));
+    }
+    for (const auto& b : snap.sealed) block(b->entry, b->bytes.data());
+    for (const StoreRow& r : snap.head) {
+      if (r.t_ms < from_ms || r.t_ms >= to_ms) continue;
+      out[(r.t_ms - from_ms) / step_ms].add(r);
+      rows++;
+      st.head_rows++;
+    }
+    return rows;
+  }
+
+  // The device's rows in [from_ms, to_ms), in time order
+  size_t rows(uint32_t device, int64_t from_ms, int64_t to_ms, std::vector<StoreRow>& out) const {
+    out.clear();
+    std::vector<StoreRow> decoded;
+    auto block = [&](const StoreBlockEntry& e, const uint8_t* p) {
+      if (e.t_max < from_ms || e.t_min >= to_ms) return;
+      decoded.resize(e.rows);
+      if (!storeDecodeBlock(e, p, decoded.data())) return;
+      for (const StoreRow& r : decoded) {
+        if (r.t_ms >= from_ms && r.t_ms < to_ms) out.push_back(r);
+      }
+    };
+    Snapshot snap = snapshot(device);
+    for (const auto& seg : snap.version->segments) {
+      const StoreBlockEntry *first, *last;
+      seg->device(device, first, last);
+      for (const StoreBlockEntry* e = first; e != last; e++) block(*e, seg->block(*e));
+    }
+    for (const auto& b : snap.sealed) block(b->entry, b->bytes.data());
+    for (const StoreRow& r : snap.head) {
+      if (r.t_ms >= from_ms && r.t_ms < to_ms) out.push_back(r);
+    }
+    std::stable_sort(out.begin(), out.end(), [](const StoreRow& a, const StoreRow& b) { return a.t_ms < b.t_ms; });
+    return out.size();
+  }
+
+  // Writes every sealed block to a new segment now
+  bool flush() {
+    std::lock_guard<std::mutex> serial(maintenance);
+    std::vector<std::shared_ptr<const StoreBlock>> batch;
+    size_t taken[STORE_STRIPES];
+    for (int s = 0; s < STORE_STRIPES; s++) {
+      std::lock_guard<std::mutex> lock(stripes[s].lock);
+      taken[s] = stripes[s].sealed.size();
+      batch.insert(batch.end(), stripes[s].sealed.begin(), stripes[s].sealed.end());
+    }
+    if (batch.empty()) return true;
+    std::vector<std::pair<const StoreBlockEntry*, const uint8_t*>> blocks;
+    size_t bytes = 0;
+    for (const auto& b : batch) {
+      blocks.push_back({&b->entry, b->bytes.data()});
+      bytes += b->bytes.size();
+    }
+    std::sort(blocks.begin(), blocks.end(), [](const std::pair<const StoreBlockEntry*, const uint8_t*>& a,
+                                               const std::pair<const StoreBlockEntry*, const uint8_t*>& b) {
+      return storeEntryBefore(*a.first, *b.first);
+    });
+    uint64_t id = next_id++;
+    auto seg = writeAndOpen(0, id, id, blocks);
+    if (!seg) return false;
+
+    std::unique_lock<std::shared_mutex> lock(swap_lock);
+    auto version = std::make_shared<Version>(*current);
+    version->segments.push_back(seg);
+    current = version;
+    for (int s = 0; s < STORE_STRIPES; s++) {
+      std::lock_guard<std::mutex> stripe(stripes[s].lock);
+      auto& sealed = stripes[s].sealed;
+      sealed.erase(sealed.begin(), sealed.begin() + taken[s]);
+    }
+    sealed_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    flushes++;
+    return true;
+  }
+
+  // Merges the oldest STORE_COMPACT_FANIN segments of the lowest full tier;
+  // false if there was nothing to merge or the merge failed
+  bool compact() {
+    std::lock_guard<std::mutex> serial(maintenance);
+    std::shared_ptr<const Version> version = current;
+    std::vector<std::shared_ptr<StoreSegment>> inputs;
+    for (uint32_t level = 0; level < STORE_MAX_LEVEL && inputs.empty(); level++) {
+      for (const auto& s : version->segments) {
+        if (s->header().level == level) inputs.push_back(s);
+      }
+      if (inputs.size() < STORE_COMPACT_FANIN) inputs.clear();
+      else inputs.resize(STORE_COMPACT_FANIN);  // oldest first
+    }
+    if (inputs.empty()) return false;
+
+    std::vector<std::pair<const StoreBlockEntry*, const uint8_t*>> blocks;
+    uint64_t first_id = UINT64_MAX, last_id = 0;
+    uint32_t level = 0;
+    for (const auto& s : inputs) {
+      const StoreSegmentHeader& h = s->header();
+      for (uint32_t i = 0; i < h.block_count; i++) blocks.push_back({&s->entries()[i], s->block(s->entries()[i])});
+      first_id = std::min(first_id, h.first_id);
+      last_id = std::max(last_id, h.last_id);
+      level = std::max(level, h.level + 1);
+    }
+    std::stable_sort(blocks.begin(), blocks.end(), [](const std::pair<const StoreBlockEntry*, const uint8_t*>& a,
+                                                      const std::pair<const StoreBlockEntry*, const uint8_t*>& b) {
+      return storeEntryBefore(*a.first, *b.first);
+    });
+    auto seg = writeAndOpen(level, first_id, last_id, blocks);
+    if (!seg) return false;
+
+    std::unique_lock<std::shared_mutex> lock(swap_lock);
+    auto next = std::make_shared<Version>();
+    bool placed = false;
+    for (const auto& s : current->segments) {
+      if (std::find(inputs.begin(), inputs.end(), s) == inputs.end()) {
+        next->segments.push_back(s);
+      } else if (!placed) {
+        next->segments.push_back(seg);
+        placed = true;
+      }
+    }
+    current = next;
+    for (const auto& s : inputs) s->obsolete = true;
+    compactions++;
+    compacted_bytes += seg->bytes();
+    return true;
+  }
+
+  StoreStats stats() const {
+    StoreStats s = {};
+    s.rows = appended.load(std::memory_order_relaxed);
+    for (const Stripe& st : stripes) {
+      std::lock_guard<std::mutex> lock(st.lock);
+      for (const auto& h : st.heads) s.head_rows += h.second.size();
+      s.sealed_blocks += st.sealed.size();
+    }
+    std::shared_ptr<const Version> version;
+    {
+      std::shared_lock<std::shared_mutex> lock(swap_lock);
+      version = current;
+      s.flushes = flushes;
+      s.compactions = compactions;
+      s.compacted_bytes = compacted_bytes;
+    }
+    if (version) {
+      for (const auto& seg : version->segments) {
+        s.segments++;
+        s.segment_rows += seg->header().rows;
+        s.segment_bytes += seg->bytes();
+      }
+    }
+    return s;
+  }
+
+private:
+  struct Version {
+    std::vector<std::shared_ptr<StoreSegment>> segments;  // oldest first
+  };
+
+  struct alignas(64) Stripe {
+    mutable std::mutex lock;
+    std::unordered_map<uint32_t, std::vector<StoreRow>> heads;
+    std::vector<std::shared_ptr<const StoreBlock>> sealed;  // oldest first
+  };
+
+  struct Snapshot {
+    std::shared_ptr<const Version> version;
+    std::vector<std::shared_ptr<const StoreBlock>> sealed;
+    std::vector<StoreRow> head;
+  };
+
+  std::string dir;
+  Stripe stripes[STORE_STRIPES];
+  mutable std::shared_mutex swap_lock;  // current, and sealed blocks leaving the stripes
+  std::shared_ptr<const Version> current;
+  std::mutex maintenance;               // one flush or compaction at a time
+  uint64_t next_id = 1;
+  uint64_t flushes = 0, compactions = 0, compacted_bytes = 0;
+  std::atomic<uint64_t> appended{0};
+  std::atomic<size_t> sealed_bytes{0};
+  std::thread worker;
+  std::mutex wake_lock;
+  std::condition_variable wake;
+  bool stop = false;
+
+  // Called with the stripe locked
+  void seal(Stripe& s, uint32_t device, std::vector<StoreRow>& head) {
+    auto b = std::make_shared<StoreBlock>();
+    storeEncodeBlock(device, head.data(), head.size(), b->bytes, b->entry);
+    sealed_bytes.fetch_add(b->bytes.size(), std::memory_order_relaxed);
+    s.sealed.push_back(b);
+    head.clear();
+  }
+
+  Snapshot snapshot(uint32_t device) const {
+    Snapshot snap;
+    const Stripe& s = stripes[device % STORE_STRIPES];
+    std::shared_lock<std::shared_mutex> lock(swap_lock);
+    snap.version = current;
+    std::lock_guard<std::mutex> stripe(s.lock);
+    for (const auto& b : s.sealed) {
+      if (b->entry.device == device) snap.sealed.push_back(b);
+    }
+    auto h = s.heads.find(device);
+    if (h != s.heads.end()) snap.head = h->second;
+    return snap;
+  }
+
+  std::shared_ptr<StoreSegment> writeAndOpen(uint32_t level, uint64_t first_id, uint64_t last_id,
+                                             const std::vector<std::pair<const StoreBlockEntry*, const uint8_t*>>& blocks) {
+    char name[64];
+    snprintf(name, sizeof(name), "/seg-%016llx-%016llx.bts", (unsigned long long)first_id, (unsigned long long)last_id);
+    std::string path = dir + name;
+    if (!storeWriteSegment(path, level, first_id, last_id, blocks)) return NULL;
+    auto seg = std::make_shared<StoreSegment>();
+    std::string error;
+    if (!seg->open(path, error)) return NULL;
+    return seg;
+  }
+
+  void background() {
+    std::unique_lock<std::mutex> lock(wake_lock);
+    while (!stop) {
+      wake.wait_for(lock, std::chrono::milliseconds(STORE_FLUSH_MS));
+      if (stop) break;
+      lock.unlock();
+      flush();
+      while (compact()) {
+      }
+      lock.lock();
+    }
+  }
+};
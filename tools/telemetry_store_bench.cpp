@@ -0,0 +1,358 @@
+// Host check and benchmark for tools/telemetry_store.h.
+//
+// Ingest: --devices (1000) wearables report one frame a second for --hours
+// (25) of gateway time, interleaved the way a gateway receives them, from
+// --writers threads, flat out. Frames come from a random walk per device:
+// HR and SpO2 with dropouts (0), motion bursts and flag changes. At the same
+// time --readers threads ask for the last 24 h of a random device at 1-minute
+// resolution, against what has been written so far, while the background
+// thread flushes and compacts.
+//
+// Then the store is closed and reopened, and the same query is timed on the
+// segments alone, next to a 90 s resolution that has to unpack columns.
+//
+// Check: for a sample of devices the frames are generated again, and the
+// buckets at 1 min, 90 s and 1 h must match sums, counts, minima, maxima and
+// flags computed from them directly; the raw rows of the last 2 h must come
+// back unchanged. The first check runs during ingest too, on a device whose
+// rows are partly in heads, partly sealed and partly in segments.
+//
+//   g++ -O2 -std=c++17 -pthread -o telemetry_store_bench tools/telemetry_store_bench.cpp
+//   ./telemetry_store_bench [--devices N] [--hours H] [--writers N] [--readers N]
+//                           [--queries N] [--dir PATH] [--keep]
+//
+// --dir (/tmp/telemetry_store_bench) is emptied of segments first and
+// removed afterwards unless --keep. Exit status is non-zero on any mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "telemetry_store.h"
+
+static const int64_t T0_MS = 1767225600000LL;  // 2026-01-01 00:00 UTC
+static const int64_t DAY_MS = 24 * 3600 * 1000LL;
+
+struct Options {
+  uint32_t devices = 1000;
+  double hours = 25;
+  int writers = 1;
+  int readers = 1;
+  int queries = 2000;
+  std::string dir = "/tmp/telemetry_store_bench";
+  bool keep = false;
+};
+
+static inline uint32_t xorshift(uint32_t& s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+// One device's frames, reproducible from the device id
+class FrameSource {
+public:
+  explicit FrameSource(uint32_t device) {
+    rng = 0x9E3779B9u * (device + 1) ^ 0x5bd1e995u;
+    xorshift(rng);
+    hr = 650 + xorshift(rng) % 300;
+    spo2 = 960 + xorshift(rng) % 30;
+  }
+
+  StoreRow next() {
+    StoreRow r;
+    r.t_ms = T0_MS + (int64_t)seq * 1000 + xorshift(rng) % 40;  // gateway receive jitter
+    r.seq = seq++;
+    hr += (int)(xorshift(rng) % 11) - 5;
+    hr = std::min(std::max(hr, 400), 1800);
+    spo2 += (int)(xorshift(rng) % 5) - 2;
+    spo2 = std::min(std::max(spo2, 850), 1000);
+    bool reading = xorshift(rng) % 100 != 0;
+    r.v[STORE_HR] = reading ? hr : 0;
+    r.v[STORE_SPO2] = reading ? spo2 : 0;
+    if (burst == 0 && xorshift(rng) % 600 == 0) burst = 5 + xorshift(rng) % 60;
+    if (burst) burst--;
+    uint16_t accel = 990 + xorshift(rng) % 25 + (burst ? 400 + xorshift(rng) % 2000 : 0);
+    uint16_t gyro = 20 + xorshift(rng) % 30 + (burst ? 600 + xorshift(rng) % 1500 : 0);
+    r.v[STORE_ACCEL] = accel;
+    r.v[STORE_ACCEL_MAX] = accel + xorshift(rng) % 200;
+    r.v[STORE_GYRO] = gyro;
+    r.v[STORE_GYRO_MAX] = gyro + xorshift(rng) % 300;
+    if (xorshift(rng) % 1800 == 0) flags = (uint8_t)(xorshift(rng) & 0x0E);
+    r.flags = flags | (burst ? UPLINK_MOTION : 0);
+    return r;
+  }
+
+private:
+  uint32_t rng;
+  uint32_t seq = 0;
+  int hr, spo2;
+  int burst = 0;
+  uint8_t flags = 0;
+};
+
+static bool sameBucket(const StoreBucket& a, const StoreBucket& b) {
+  if (a.t_ms != b.t_ms || a.rows != b.rows || a.flags != b.flags) return false;
+  for (int k = 0; k < STORE_VALUES; k++) {
+    if (a.count[k] != b.count[k] || a.sum[k] != b.sum[k]) return false;
+    if (a.count[k] && (a.min[k] != b.min[k] || a.max[k] != b.max[k])) return false;
+  }
+  return true;
+}
+
+// The device's first `seconds` frames against the store; returns mismatches
+static int checkDevice(const TelemetryStore& store, uint32_t device, uint32_t seconds, bool verbose) {
+  std::vector<StoreRow> truth;
+  FrameSource src(device);
+  for (uint32_t i = 0; i < seconds; i++) truth.push_back(src.next());
+  int64_t end = truth.empty() ? T0_MS : truth.back().t_ms + 1;
+  int64_t to = (end + STORE_ROLLUP_MS - 1) / STORE_ROLLUP_MS * STORE_ROLLUP_MS;
+  int mismatches = 0;
+
+  const int64_t steps[] = {60000, 90000, 3600000};
+  for (int64_t step : steps) {
+    int64_t from = to - DAY_MS;
+    std::vector<StoreBucket> expect((to - from + step - 1) / step);
+    for (size_t b = 0; b < expect.size(); b++) expect[b].clear(from + (int64_t)b * step);
+    for (const StoreRow& r : truth) {
+      if (r.t_ms >= from && r.t_ms < to) expect[(r.t_ms - from) / step].add(r);
+    }
+    std::vector<StoreBucket> got;
+    store.query(device, from, to, step, got);
+    for (size_t b = 0; b < expect.size(); b++) {
+      if (b < got.size() && sameBucket(got[b], expect[b])) continue;
+      if (verbose && mismatches < 5) {
+        printf("  device %u step %lld bucket %zu: rows %u, expected %u\n", device, (long long)step, b,
+               b < got.size() ? got[b].rows : 0, expect[b].rows);
+      }
+      mismatches++;
+    }
+  }
+
+  std::vector<StoreRow> got;
+  int64_t from = end - 2 * 3600 * 1000LL;
+  store.rows(device, from, end, got);
+  size_t k = 0;
+  for (const StoreRow& r : truth) {
+    if (r.t_ms < from) continue;
+    if (k >= got.size() || memcmp(&got[k].v, &r.v, sizeof(r.v)) != 0 || got[k].t_ms != r.t_ms ||
+        got[k].seq != r.seq || got[k].flags != r.flags) {
+      mismatches++;
+      break;
+    }
+    k++;
+  }
+  if (k != got.size()) mismatches++;
+  return mismatches;
+}
+
+static double percentile(std::vector<double>& v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(v.size() * p))];
+}
+
+static void emptyDir(const std::string& dir, bool remove) {
+  DIR* d = opendir(dir.c_str());
+  if (!d) return;
+  while (struct dirent* ent = readdir(d)) {
+    std::string name = ent->d_name;
+    if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".bts") == 0 || name.compare(name.size() - 4, 4, ".tmp") == 0)) {
+      unlink((dir + "/" + name).c_str());
+    }
+  }
+  closedir(d);
+  if (remove) rmdir(dir.c_str());
+}
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(a, "--keep") == 0) {
+      o.keep = true;
+      continue;
+    }
+    if (!v) {
+      fprintf(stderr, "usage: telemetry_store_bench [--devices N] [--hours H] [--writers N] [--readers N]\n"
+                      "                             [--queries N] [--dir PATH] [--keep]\n");
+      return 2;
+    }
+    if (strcmp(a, "--devices") == 0) o.devices = strtoul(v, NULL, 10);
+    else if (strcmp(a, "--hours") == 0) o.hours = atof(v);
+    else if (strcmp(a, "--writers") == 0) o.writers = std::max(1, atoi(v));
+    else if (strcmp(a, "--readers") == 0) o.readers = std::max(0, atoi(v));
+    else if (strcmp(a, "--queries") == 0) o.queries = atoi(v);
+    else if (strcmp(a, "--dir") == 0) o.dir = v;
+    else {
+      fprintf(stderr, "unknown option %s\n", a);
+      return 2;
+    }
+    i++;
+  }
+  uint32_t seconds = (uint32_t)(o.hours * 3600);
+  emptyDir(o.dir, false);
+
+  TelemetryStore store;
+  std::string error;
+  if (!store.open(o.dir.c_str(), error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  // ---- Ingest with concurrent queries ----
+  std::atomic<uint32_t> progress{0};  // seconds every writer has finished
+  std::atomic<int> writers_done{0};
+  std::vector<std::atomic<uint32_t>> writer_second(o.writers);
+  for (auto& w : writer_second) w = 0;
+  std::vector<std::thread> threads;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int w = 0; w < o.writers; w++) {
+    threads.emplace_back([&, w] {
+      std::vector<FrameSource> sources;
+      std::vector<uint32_t> ids;
+      for (uint32_t d = w; d < o.devices; d += o.writers) {
+        sources.emplace_back(d);
+        ids.push_back(d);
+      }
+      for (uint32_t s = 0; s < seconds; s++) {
+        for (size_t i = 0; i < sources.size(); i++) store.append(ids[i], sources[i].next());
+        writer_second[w].store(s + 1, std::memory_order_release);
+      }
+      writers_done++;
+    });
+  }
+  std::vector<std::vector<double>> ingest_latency(o.readers);
+  std::atomic<int> mid_mismatches{0};
+  for (int r = 0; r < o.readers; r++) {
+    threads.emplace_back([&, r] {
+      uint32_t rng = 12345 + r;
+      std::vector<StoreBucket> out;
+      bool checked = false;
+      while (writers_done < o.writers) {
+        uint32_t done = UINT32_MAX;
+        for (auto& w : writer_second) done = std::min(done, w.load(std::memory_order_acquire));
+        if (done < 600) {
+          std::this_thread::yield();
+          continue;
+        }
+        int64_t to = (T0_MS + (int64_t)done * 1000) / STORE_ROLLUP_MS * STORE_ROLLUP_MS;
+        uint32_t device = xorshift(rng) % o.devices;
+        auto q0 = std::chrono::steady_clock::now();
+        store.query(device, to - DAY_MS, to, STORE_ROLLUP_MS, out);
+        ingest_latency[r].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - q0).count());
+        // Once, half way: the last hour of a device whose rows are in a
+        // head, sealed blocks and segments. Only seconds every writer has
+        // finished are complete.
+        if (r == 0 && !checked && done > seconds / 2 && done > 3700) {
+          checked = true;
+          uint32_t d = device;
+          uint32_t s = done;
+          std::vector<StoreRow> rows;
+          FrameSource src(d);
+          std::vector<StoreRow> truth;
+          for (uint32_t i = 0; i < s; i++) truth.push_back(src.next());
+          int64_t end = truth.back().t_ms + 1;
+          int64_t from = end - 3600 * 1000LL;
+          store.rows(d, from, end, rows);
+          size_t k = 0;
+          int bad = 0;
+          for (const StoreRow& t : truth) {
+            if (t.t_ms < from) continue;
+            if (k >= rows.size() || rows[k].seq != t.seq || memcmp(rows[k].v, t.v, sizeof(t.v)) != 0) {
+              bad++;
+              break;
+            }
+            k++;
+          }
+          StoreStats st = store.stats();
+          printf("mid-ingest check on device %u at %u s: %zu rows of the last hour, %s (%llu head rows, %llu "
+                 "sealed blocks, %llu segments)\n",
+                 d, s, k, bad ? "MISMATCH" : "ok", (unsigned long long)st.head_rows,
+                 (unsigned long long)st.sealed_blocks, (unsigned long long)st.segments);
+          mid_mismatches += bad;
+        }
+      }
+    });
+  }
+  for (std::thread& t : threads) t.join();
+  double ingest_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  StoreStats before_close = store.stats();
+  auto c0 = std::chrono::steady_clock::now();
+  store.close();
+  double close_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - c0).count();
+
+  uint64_t rows = (uint64_t)o.devices * seconds;
+  printf("ingest: %u devices x %u s = %.1f M rows in %.2f s with %d writer(s): %.2f M rows/s "
+         "(%llu flushes, %llu compactions, %.0f MB rewritten), close %.2f s\n",
+         o.devices, seconds, rows / 1e6, ingest_s, o.writers, rows / ingest_s / 1e6,
+         (unsigned long long)before_close.flushes, (unsigned long long)before_close.compactions,
+         before_close.compacted_bytes / 1e6, close_s);
+  std::vector<double> during;
+  for (auto& v : ingest_latency) during.insert(during.end(), v.begin(), v.end());
+  if (!during.empty()) {
+    printf("  last 24 h at 1 min during ingest: %zu queries, p50 %.0f us, p99 %.0f us\n", during.size(),
+           percentile(during, 0.5), percentile(during, 0.99));
+  }
+
+  // ---- Reopen and query the segments ----
+  TelemetryStore reopened;
+  if (!reopened.open(o.dir.c_str(), error)) {
+    fprintf(stderr, "reopen: %s\n", error.c_str());
+    return 1;
+  }
+  StoreStats st = reopened.stats();
+  printf("on disk: %llu segments, %.1f MB, %.2f bytes per row (%.1f raw)\n", (unsigned long long)st.segments,
+         st.segment_bytes / 1e6, (double)st.segment_bytes / std::max<uint64_t>(1, st.segment_rows),
+         (double)(8 + 4 + 2 * STORE_VALUES + 1));
+  int failures = 0;
+  if (st.segment_rows != rows) {
+    printf("FAIL: %llu rows in segments, %llu appended\n", (unsigned long long)st.segment_rows,
+           (unsigned long long)rows);
+    failures++;
+  }
+
+  int64_t end = T0_MS + (int64_t)seconds * 1000;
+  int64_t to = (end + STORE_ROLLUP_MS - 1) / STORE_ROLLUP_MS * STORE_ROLLUP_MS;
+  const int64_t steps[] = {STORE_ROLLUP_MS, 90000};
+  for (int64_t step : steps) {
+    std::vector<double> latency;
+    std::vector<StoreBucket> out;
+    StoreQueryStats qs = {};
+    uint32_t rng = 777;
+    size_t total = 0;
+    for (int q = 0; q < o.queries; q++) {
+      uint32_t device = xorshift(rng) % o.devices;
+      auto q0 = std::chrono::steady_clock::now();
+      total += reopened.query(device, to - DAY_MS, to, step, out, &qs);
+      latency.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - q0).count());
+    }
+    printf("  last 24 h at %lld s: %d queries, %zu rows each, %zu buckets, p50 %.0f us, p99 %.0f us "
+           "(blocks per query: %.1f whole, %.1f minute rollups, %.1f unpacked)\n",
+           (long long)step / 1000, o.queries, o.queries ? total / o.queries : 0, out.size(),
+           percentile(latency, 0.5), percentile(latency, 0.99), (double)qs.blocks_whole / std::max(1, o.queries),
+           (double)qs.blocks_minutes / std::max(1, o.queries), (double)qs.blocks_decoded / std::max(1, o.queries));
+  }
+
+  // ---- Check ----
+  int mismatches = mid_mismatches;
+  int checked = 0;
+  for (uint32_t d = 0; d < o.devices; d += std::max(1u, o.devices / 16)) {
+    mismatches += checkDevice(reopened, d, seconds, true);
+    checked++;
+  }
+  printf("check: %d devices against regenerated frames, %d mismatches\n", checked, mismatches);
+  if (mismatches) failures++;
+
+  reopened.close();
+  if (!o.keep) emptyDir(o.dir, true);
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
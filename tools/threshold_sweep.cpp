@@ -0,0 +1,558 @@
+// Offline threshold sweep over recorded patient traces (Linux).
+//
+// Replays every trace of an archive (see trace_archive.h) through the fall and
+// seizure detectors from detectors.h and the vitals rules from rule_engine.h
+// for every combination of the given thresholds, and prints sensitivity and
+// false alarms per hour for each combination.
+//
+// The archive is memory-mapped. Each trace is decoded once into shared
+// read-only arrays that every configuration reads, and is freed after its
+// last configuration ran. Work items (one trace x a batch of configurations)
+// are spread over per-thread deques; idle threads steal from the others.
+//
+//   g++ -O2 -std=c++17 -pthread -o threshold_sweep tools/threshold_sweep.cpp
+//
+//   threshold_sweep gen traces.bha --patients 16 --hours 4
+//   threshold_sweep sweep traces.bha --freefall 0.4:0.8:0.1 --seizure-rms 60,80,100
+//
+// Grid axes take a single value, a list (a,b,c) or a range (from:to:step);
+// axes not given keep the firmware defaults.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "trace_archive.h"
+#include "../detectors.h"
+#include "../rule_engine.h"
+
+static const size_t CONFIGS_PER_TASK = 8;
+
+struct SweepConfig {
+  FallDetectorConfig fall;
+  SeizureDetectorConfig seizure;  // window_samples set per trace from window_ms
+  uint32_t seizure_window_ms;
+  float hr_high;
+  float spo2_low;
+  uint32_t vitals_for_ms;
+};
+
+struct Grid {
+  std::vector<float> freefall = {0.5f};
+  std::vector<float> gyro_fall = {100};
+  std::vector<float> seizure_rms = {80};
+  std::vector<float> seizure_ms = {13000};
+  std::vector<float> hr_high = {100};
+  std::vector<float> spo2_low = {95};
+  uint32_t seizure_window_ms = 1000;
+  uint32_t vitals_for_ms = 60000;
+  uint32_t tolerance_ms = 5000;
+  uint32_t reset_ms = 60000;     // a latched flag is acknowledged this long after it was raised
+};
+
+// Per configuration, summed over traces
+struct SweepResult {
+  std::atomic<uint64_t> events[LABEL_TYPES];
+  std::atomic<uint64_t> detected[LABEL_TYPES];
+  std::atomic<uint64_t> false_alarms[LABEL_TYPES];
+};
+
+// Decoded channels of one trace, shared by all configurations
+struct DecodedTrace {
+  std::vector<uint32_t> t_ms;
+  std::vector<float> amag, wx, wy, wz, wmag, hr, spo2;
+};
+
+struct TraceSlot {
+  TraceView view;
+  std::once_flag decoded_once;
+  std::shared_ptr<const DecodedTrace> decoded;
+  std::atomic<size_t> configs_left;
+  std::mutex lock;
+};
+
+struct Task {
+  uint32_t trace;
+  uint32_t config_begin;
+  uint32_t config_end;
+};
+
+static bool parseAxis(const char* text, std::vector<float>& out) {
+  out.clear();
+  float from, to, step;
+  if (sscanf(text, "%f:%f:%f", &from, &to, &step) == 3) {
+    if (step <= 0 || to < from) return false;
+    for (int i = 0; from + i * step <= to + step * 1e-3f; i++) out.push_back(from + i * step);
+    return true;
+  }
+  std::string s = text;
+  size_t pos = 0;
+  while (pos <= s.size()) {
+    size_t comma = s.find(',', pos);
+    std::string item = s.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+    char* end;
+    float v = strtof(item.c_str(), &end);
+    if (item.empty() || *end) return false;
+    out.push_back(v);
+    if (comma == std::string::npos) break;
+    pos = comma + 1;
+  }
+  return !out.empty();
+}
+
+static std::vector<SweepConfig> expandGrid(const Grid& g) {
+  std::vector<SweepConfig> configs;
+  for (float ff : g.freefall)
+    for (float gf : g.gyro_fall)
+      for (float rms : g.seizure_rms)
+        for (float sms : g.seizure_ms)
+          for (float hr : g.hr_high)
+            for (float spo2 : g.spo2_low) {
+              SweepConfig c;
+              c.fall = {ff, gf, 100, 0};
+              c.seizure = {rms, 0, (uint32_t)sms};
+              c.seizure_window_ms = g.seizure_window_ms;
+              c.hr_high = hr;
+              c.spo2_low = spo2;
+              c.vitals_for_ms = g.vitals_for_ms;
+              configs.push_back(c);
+            }
+  return configs;
+}
+
+static std::shared_ptr<const DecodedTrace> decode(const TraceView& v) {
+  std::shared_ptr<DecodedTrace> d = std::make_shared<DecodedTrace>();
+  size_t n = v.entry->sample_count;
+  d->t_ms.resize(n);
+  d->amag.resize(n); d->wx.resize(n); d->wy.resize(n); d->wz.resize(n);
+  d->wmag.resize(n); d->hr.resize(n); d->spo2.resize(n);
+  const float a_scale = 1.0f / ARCHIVE_ACCEL_LSB_PER_G;
+  const float g_scale = 1.0f / ARCHIVE_GYRO_LSB_PER_DPS;
+  for (size_t i = 0; i < n; i++) {
+    const TraceSample& s = v.samples[i];
+    float ax = s.ax * a_scale, ay = s.ay * a_scale, az = s.az * a_scale;
+    float wx = s.gx * g_scale, wy = s.gy * g_scale, wz = s.gz * g_scale;
+    d->t_ms[i] = (uint32_t)(i * 1000 / v.entry->sample_hz);
+    d->amag[i] = sqrtf(ax * ax + ay * ay + az * az);
+    d->wx[i] = wx;
+    d->wy[i] = wy;
+    d->wz[i] = wz;
+    d->wmag[i] = sqrtf(wx * wx + wy * wy + wz * wz);
+    d->hr[i] = s.hr_x10 / 10.0f;
+    d->spo2[i] = s.spo2_x10 / 10.0f;
+  }
+  return d;
+}
+
+// Detection edges that fall inside a label (with tolerance) count it as
+// detected; edges outside every label of their type are false alarms
+static void score(const std::vector<uint32_t>& edges, int type, const TraceView& v, uint32_t tolerance_ms,
+                  SweepResult& r) {
+  uint64_t events = 0, detected = 0, false_alarms = 0;
+  for (uint32_t l = 0; l < v.entry->label_count; l++) {
+    const TraceLabel& label = v.labels[l];
+    if (label.type != type) continue;
+    events++;
+    uint32_t from = label.start_ms > tolerance_ms ? label.start_ms - tolerance_ms : 0;
+    for (uint32_t t : edges) {
+      if (t >= from && t <= label.end_ms + tolerance_ms) {
+        detected++;
+        break;
+      }
+    }
+  }
+  for (uint32_t t : edges) {
+    bool inside = false;
+    for (uint32_t l = 0; l < v.entry->label_count && !inside; l++) {
+      const TraceLabel& label = v.labels[l];
+      uint32_t from = label.start_ms > tolerance_ms ? label.start_ms - tolerance_ms : 0;
+      inside = label.type == type && t >= from && t <= label.end_ms + tolerance_ms;
+    }
+    if (!inside) false_alarms++;
+  }
+  r.events[type] += events;
+  r.detected[type] += detected;
+  r.false_alarms[type] += false_alarms;
+}
+
+static void runConfig(const SweepConfig& config, const Grid& grid, const TraceView& v, const DecodedTrace& d,
+                      SweepResult& result) {
+  SeizureDetectorConfig seizure_config = config.seizure;
+  uint32_t window = config.seizure_window_ms * v.entry->sample_hz / 1000;
+  seizure_config.window_samples = window ? window : 1;
+  FallDetector fall(config.fall);
+  SeizureDetector seizure(seizure_config);
+
+  // Vitals go through the same rule engine as the firmware
+  RuleEngine rules;
+  char text[160], error[RULE_ERROR_LEN];
+  snprintf(text, sizeof(text), "SEPSIS 0 %u Tachycardia: hr > %g\nSEPSIS 0 %u Hypoxemia: spo2 < %g & spo2 > 0\n",
+           config.vitals_for_ms, config.hr_high, config.vitals_for_ms, config.spo2_low);
+  if (!rules.load(text, error, sizeof(error))) {
+    fprintf(stderr, "rule error: %s\n", error);
+    return;
+  }
+
+  std::vector<uint32_t> edges[LABEL_TYPES];
+  int prev_fall = 0, prev_seizure = 0;
+  bool prev_sepsis = false;
+  uint32_t fall_raised = 0, seizure_raised = 0;
+  int seizure_alert_level = config.seizure.alert_ms ? 2 : 1;
+  float metrics[METRIC_COUNT] = {};
+
+  size_t n = d.t_ms.size();
+  for (size_t i = 0; i < n; i++) {
+    uint32_t t = d.t_ms[i];
+
+    int f = fall.update(t, d.amag[i], d.wx[i], d.wy[i], d.wz[i]);
+    if (f && !prev_fall) {
+      edges[LABEL_FALL].push_back(t);
+      fall_raised = t;
+    }
+    if (f && t - fall_raised >= grid.reset_ms) {
+      fall.reset();
+      f = 0;
+    }
+    prev_fall = f;
+
+    int s = seizure.update(t, d.wmag[i]);
+    if (s >= seizure_alert_level && prev_seizure < seizure_alert_level) {
+      edges[LABEL_SEIZURE].push_back(t);
+      seizure_raised = t;
+    }
+    if (s == 2 && t - seizure_raised >= grid.reset_ms) {
+      seizure.reset();
+      s = 0;
+    }
+    prev_seizure = s;
+
+    metrics[METRIC_HR] = d.hr[i];
+    metrics[METRIC_SPO2] = d.spo2[i];
+    bool sepsis = rules.evaluate(metrics, t).top_severity == ALERT_SEPSIS;
+    if (sepsis && !prev_sepsis) edges[LABEL_SEPSIS].push_back(t);
+    prev_sepsis = sepsis;
+  }
+
+  for (int type = 0; type < LABEL_TYPES; type++) score(edges[type], type, v, grid.tolerance_ms, result);
+}
+
+// Per-thread deques: the owner takes from the front (trace order, so threads
+// tend to share decoded traces), thieves take from the back
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(size_t threads) : queues(threads) {}
+
+  void distribute(const std::vector<Task>& tasks) {
+    size_t w = queues.size();
+    for (size_t i = 0; i < w; i++) {
+      size_t begin = tasks.size() * i / w, end = tasks.size() * (i + 1) / w;
+      queues[i].tasks.assign(tasks.begin() + begin, tasks.begin() + end);
+    }
+  }
+
+  template <typename F>
+  void run(F work) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < queues.size(); i++) {
+      threads.emplace_back([this, i, &work] {
+        Task task;
+        while (take(i, task) || steal(i, task)) work(task);
+      });
+    }
+    for (std::thread& t : threads) t.join();
+  }
+
+  std::atomic<uint64_t> steals{0};
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+  std::vector<Queue> queues;
+
+  bool take(size_t i, Task& task) {
+    std::lock_guard<std::mutex> guard(queues[i].lock);
+    if (queues[i].tasks.empty()) return false;
+    task = queues[i].tasks.front();
+    queues[i].tasks.pop_front();
+    return true;
+  }
+
+  // Tasks never spawn tasks, so one pass finding every queue empty means done
+  bool steal(size_t self, Task& task) {
+    for (size_t k = 1; k < queues.size(); k++) {
+      Queue& victim = queues[(self + k) % queues.size()];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (victim.tasks.empty()) continue;
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      steals++;
+      return true;
+    }
+    return false;
+  }
+};
+
+static int sweep(const char* path, const Grid& grid, size_t threads) {
+  ArchiveReader archive;
+  std::string error;
+  if (!archive.open(path, error)) {
+    fprintf(stderr, "%s: %s\n", path, error.c_str());
+    return 1;
+  }
+
+  std::vector<SweepConfig> configs = expandGrid(grid);
+  const std::vector<TraceView>& views = archive.all();
+  std::vector<std::unique_ptr<TraceSlot>> slots;
+  uint64_t samples = 0;
+  double hours = 0;
+  for (const TraceView& v : views) {
+    slots.emplace_back(new TraceSlot());
+    slots.back()->view = v;
+    slots.back()->configs_left = configs.size();
+    samples += v.entry->sample_count;
+    hours += (double)v.entry->sample_count / v.entry->sample_hz / 3600.0;
+  }
+
+  std::vector<Task> tasks;
+  for (uint32_t t = 0; t < views.size(); t++) {
+    for (uint32_t c = 0; c < configs.size(); c += CONFIGS_PER_TASK) {
+      uint32_t end = c + CONFIGS_PER_TASK < configs.size() ? c + CONFIGS_PER_TASK : configs.size();
+      tasks.push_back({t, c, end});
+    }
+  }
+
+  std::unique_ptr<SweepResult[]> results(new SweepResult[configs.size()]());
+  WorkStealingPool pool(threads);
+  pool.distribute(tasks);
+
+  auto start = std::chrono::steady_clock::now();
+  pool.run([&](const Task& task) {
+    TraceSlot& slot = *slots[task.trace];
+    std::call_once(slot.decoded_once, [&] {
+      std::lock_guard<std::mutex> guard(slot.lock);
+      slot.decoded = decode(slot.view);
+    });
+    std::shared_ptr<const DecodedTrace> decoded;
+    {
+      std::lock_guard<std::mutex> guard(slot.lock);
+      decoded = slot.decoded;
+    }
+    for (uint32_t c = task.config_begin; c < task.config_end; c++) {
+      runConfig(configs[c], grid, slot.view, *decoded, results[c]);
+    }
+    // Last configuration of this trace: drop the decoded copy
+    if (slot.configs_left.fetch_sub(task.config_end - task.config_begin) == task.config_end - task.config_begin) {
+      std::lock_guard<std::mutex> guard(slot.lock);
+      slot.decoded.reset();
+    }
+  });
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%5s %8s %8s %8s %8s %6s %6s | %8s %8s | %8s %8s | %8s %8s\n", "cfg", "freefall", "gyro_dps", "sz_rms",
+         "sz_ms", "hr_hi", "spo2_lo", "fall_sen", "fall_fa", "sz_sen", "sz_fa", "sep_sen", "sep_fa");
+  for (size_t c = 0; c < configs.size(); c++) {
+    const SweepConfig& cfg = configs[c];
+    printf("%5zu %8.2f %8.0f %8.0f %8u %6.0f %6.1f", c, cfg.fall.freefall_g, cfg.fall.gyro_fall_dps,
+           cfg.seizure.rms_threshold, cfg.seizure.alert_ms, cfg.hr_high, cfg.spo2_low);
+    for (int type = 0; type < LABEL_TYPES; type++) {
+      uint64_t events = results[c].events[type];
+      double sensitivity = events ? (double)results[c].detected[type] / events : 0;
+      printf(" | %8.3f %8.3f", sensitivity, results[c].false_alarms[type] / hours);
+    }
+    printf("\n");
+  }
+  printf("# sensitivity = detected / labelled events; fa = false alarms per hour (%.1f h recorded)\n", hours);
+  if (!configs.empty()) {
+    printf("# labelled events:");
+    for (int type = 0; type < LABEL_TYPES; type++) {
+      printf(" %s %llu", traceLabelName(type), (unsigned long long)results[0].events[type].load());
+    }
+    printf("\n");
+  }
+  fprintf(stderr, "%zu traces, %.1f M samples, %zu configs, %zu threads (%llu steals): %.2f s, %.1f M sample-configs/s\n",
+          views.size(), samples / 1e6, configs.size(), threads, (unsigned long long)pool.steals.load(), seconds,
+          samples * (double)configs.size() / seconds / 1e6);
+  return 0;
+}
+
+// Synthetic archive with labelled events and look-alike distractors, for
+// trying the tool and measuring its scaling without patient data
+static int generate(const char* path, int patients, double hours, uint32_t seed) {
+  const uint32_t hz = 100;
+  ArchiveWriter writer;
+  if (!writer.open(path)) {
+    fprintf(stderr, "cannot write %s\n", path);
+    return 1;
+  }
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0, 1);
+  std::uniform_real_distribution<float> uniform(0, 1);
+
+  for (int p = 0; p < patients; p++) {
+    size_t n = (size_t)(hours * 3600 * hz);
+    std::vector<float> amag(n, 1.0f), wx(n), wy(n), wz(n), hr(n), spo2(n);
+    for (size_t i = 0; i < n; i++) {
+      wx[i] = 3 * noise(rng);
+      wy[i] = 3 * noise(rng);
+      wz[i] = 3 * noise(rng);
+      amag[i] = 1.0f + 0.03f * noise(rng);
+      hr[i] = 72 + 6 * sinf(i / (hz * 900.0f)) + noise(rng);
+      spo2[i] = 97.5f + 0.5f * noise(rng);
+    }
+    std::vector<TraceLabel> labels;
+    auto label = [&](TraceLabelType type, size_t from, size_t to) {
+      TraceLabel l = {};
+      l.type = type;
+      l.start_ms = from * 1000 / hz;
+      l.end_ms = to * 1000 / hz;
+      labels.push_back(l);
+    };
+    auto at = [&](double seconds) { return (size_t)(seconds * hz); };
+    double total_s = hours * 3600;
+
+    // Events, each placed at a random time (overlaps are harmless)
+    for (double t = 0; t < total_s - 600; t += 600) {
+      float r = uniform(rng);
+      size_t i = at(t + 60 + uniform(rng) * 400);
+      if (r < 0.08f) {
+        // Fall: 250-400 ms free fall while tumbling, then impact
+        size_t len = at(0.25 + 0.15 * uniform(rng));
+        float spin = 120 + 120 * uniform(rng);
+        for (size_t k = 0; k < len; k++) {
+          amag[i + k] = 0.15f + 0.2f * uniform(rng);
+          wx[i + k] = spin;
+        }
+        for (size_t k = len; k < len + at(0.1); k++) amag[i + k] = 3.0f;
+        label(LABEL_FALL, i, i + len + at(0.1));
+      } else if (r < 0.13f) {
+        // Seizure: 20-90 s of 4 Hz shaking
+        size_t len = at(20 + 70 * uniform(rng));
+        float amp = 110 + 120 * uniform(rng);
+        for (size_t k = 0; k < len; k++) wy[i + k] += amp * sinf(2 * M_PI * 4 * k / hz);
+        label(LABEL_SEIZURE, i, i + len);
+      } else if (r < 0.16f) {
+        // Sepsis: 10-20 min of raised HR and falling SpO2
+        size_t len = at(600 + 600 * uniform(rng));
+        if (i + len >= n) continue;
+        for (size_t k = 0; k < len; k++) {
+          hr[i + k] += 35 + 5 * uniform(rng);
+          spo2[i + k] -= 3.5f;
+        }
+        label(LABEL_SEPSIS, i, i + len);
+      } else if (r < 0.30f) {
+        // Sitting down hard: brief low-g dip with some rotation
+        size_t len = at(0.12 + 0.1 * uniform(rng));
+        for (size_t k = 0; k < len; k++) {
+          amag[i + k] = 0.45f + 0.3f * uniform(rng);
+          wz[i + k] = 60 + 60 * uniform(rng);
+        }
+      } else if (r < 0.50f) {
+        // Brisk walking: 30-120 s of 2 Hz swing
+        size_t len = at(30 + 90 * uniform(rng));
+        float amp = 60 + 60 * uniform(rng);
+        for (size_t k = 0; k < len; k++) wx[i + k] += amp * sinf(2 * M_PI * 2 * k / hz);
+      } else if (r < 0.55f) {
+        // Exercise: 5 min of raised HR, SpO2 normal
+        size_t len = at(300);
+        for (size_t k = 0; k < len && i + k < n; k++) hr[i + k] += 30;
+      }
+    }
+
+    std::vector<TraceSample> samples(n);
+    for (size_t i = 0; i < n; i++) {
+      TraceSample& s = samples[i];
+      s.ax = 0;
+      s.ay = 0;
+      s.az = (int16_t)fminf(32767, amag[i] * ARCHIVE_ACCEL_LSB_PER_G);
+      s.gx = (int16_t)fmaxf(-32768, fminf(32767, wx[i] * ARCHIVE_GYRO_LSB_PER_DPS));
+      s.gy = (int16_t)fmaxf(-32768, fminf(32767, wy[i] * ARCHIVE_GYRO_LSB_PER_DPS));
+      s.gz = (int16_t)fmaxf(-32768, fminf(32767, wz[i] * ARCHIVE_GYRO_LSB_PER_DPS));
+      s.hr_x10 = (uint16_t)(hr[i] * 10);
+      s.spo2_x10 = (uint16_t)(fminf(100, spo2[i]) * 10);
+    }
+    if (!writer.addTrace(p, hz, samples, labels)) {
+      fprintf(stderr, "write failed\n");
+      return 1;
+    }
+  }
+  if (!writer.finish()) {
+    fprintf(stderr, "write failed\n");
+    return 1;
+  }
+  return 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: threshold_sweep gen ARCHIVE [--patients N] [--hours H] [--seed S]\n"
+          "       threshold_sweep sweep ARCHIVE [--threads N] [--freefall G] [--gyro-fall DPS]\n"
+          "                             [--seizure-rms DPS] [--seizure-ms MS] [--hr-high BPM] [--spo2-low PCT]\n"
+          "                             [--seizure-window-ms MS] [--vitals-for-ms MS] [--tolerance-ms MS] [--reset-ms MS]\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    usage();
+    return 2;
+  }
+  const char* mode = argv[1];
+  const char* path = argv[2];
+
+  if (strcmp(mode, "gen") == 0) {
+    int patients = 8;
+    double hours = 2;
+    uint32_t seed = 1;
+    for (int i = 3; i + 1 < argc; i += 2) {
+      if (strcmp(argv[i], "--patients") == 0) patients = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "--hours") == 0) hours = atof(argv[i + 1]);
+      else if (strcmp(argv[i], "--seed") == 0) seed = strtoul(argv[i + 1], NULL, 10);
+      else { usage(); return 2; }
+    }
+    return generate(path, patients, hours, seed);
+  }
+
+  if (strcmp(mode, "sweep") != 0) {
+    usage();
+    return 2;
+  }
+  Grid grid;
+  size_t threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  for (int i = 3; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    const char* opt = argv[i];
+    const char* val = argv[i + 1];
+    bool ok = true;
+    if (strcmp(opt, "--threads") == 0) threads = strtoul(val, NULL, 10);
+    else if (strcmp(opt, "--freefall") == 0) ok = parseAxis(val, grid.freefall);
+    else if (strcmp(opt, "--gyro-fall") == 0) ok = parseAxis(val, grid.gyro_fall);
+    else if (strcmp(opt, "--seizure-rms") == 0) ok = parseAxis(val, grid.seizure_rms);
+    else if (strcmp(opt, "--seizure-ms") == 0) ok = parseAxis(val, grid.seizure_ms);
+    else if (strcmp(opt, "--hr-high") == 0) ok = parseAxis(val, grid.hr_high);
+    else if (strcmp(opt, "--spo2-low") == 0) ok = parseAxis(val, grid.spo2_low);
+    else if (strcmp(opt, "--seizure-window-ms") == 0) grid.seizure_window_ms = strtoul(val, NULL, 10);
+    else if (strcmp(opt, "--vitals-for-ms") == 0) grid.vitals_for_ms = strtoul(val, NULL, 10);
+    else if (strcmp(opt, "--tolerance-ms") == 0) grid.tolerance_ms = strtoul(val, NULL, 10);
+    else if (strcmp(opt, "--reset-ms") == 0) grid.reset_ms = strtoul(val, NULL, 10);
+    else ok = false;
+    if (!ok || threads == 0) {
+      fprintf(stderr, "bad option %s %s\n", opt, val);
+      return 2;
+    }
+  }
+  return sweep(path, grid, threads);
+}
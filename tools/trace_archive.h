@@ -0,0 +1,175 @@
+#pragma once
+// Labelled patient trace archive for the offline tools (Linux only).
+//
+// Layout, all little-endian:
+//
+//   ArchiveHeader
+//   per trace: TraceSample[sample_count], TraceLabel[label_count]
+//   TraceIndexEntry[trace_count]        at header.index_offset
+//
+// Samples are fixed-rate and fixed-point (accel 1/4096 g, gyro 1/65.5 deg/s,
+// HR and SpO2 in tenths), the same units the MPU6050/MAX30100 setup in
+// combinedsense.cpp produces. Labels mark clinician-annotated events.
+//
+// ArchiveReader maps the file read-only; traces are views into the mapping.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ARCHIVE_MAGIC   0x41544842 // "BHTA"
+#define ARCHIVE_VERSION 1
+
+const float ARCHIVE_ACCEL_LSB_PER_G = 4096.0f;
+const float ARCHIVE_GYRO_LSB_PER_DPS = 65.5f;
+
+enum TraceLabelType : uint8_t {
+  LABEL_FALL = 0,
+  LABEL_SEIZURE,
+  LABEL_SEPSIS,
+  LABEL_TYPES
+};
+
+inline const char* traceLabelName(int type) {
+  static const char* names[LABEL_TYPES] = {"fall", "seizure", "sepsis"};
+  return (type >= 0 && type < LABEL_TYPES) ? names[type] : "?";
+}
+
+struct ArchiveHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t trace_count;
+  uint32_t reserved;
+  uint64_t index_offset;
+};
+
+struct TraceSample {
+  int16_t ax, ay, az;
+  int16_t gx, gy, gz;
+  uint16_t hr_x10;
+  uint16_t spo2_x10;
+};
+
+struct TraceLabel {
+  uint8_t type;      // TraceLabelType
+  uint8_t reserved[3];
+  uint32_t start_ms;
+  uint32_t end_ms;
+};
+
+struct TraceIndexEntry {
+  uint64_t samples_offset;
+  uint64_t sample_count;
+  uint64_t labels_offset;
+  uint32_t label_count;
+  uint32_t sample_hz;
+  uint32_t patient_id;
+  uint32_t reserved;
+};
+
+struct TraceView {
+  const TraceIndexEntry* entry;
+  const TraceSample* samples;
+  const TraceLabel* labels;
+};
+
+class ArchiveReader {
+public:
+  ~ArchiveReader() { close(); }
+
+  bool open(const char* path, std::string& error) {
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0) return fail(error, "cannot open archive");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ArchiveHeader)) return fail(error, "archive too small");
+    size = st.st_size;
+    base = (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      base = NULL;
+      return fail(error, "mmap failed");
+    }
+    madvise((void*)base, size, MADV_SEQUENTIAL);
+
+    const ArchiveHeader* h = (const ArchiveHeader*)base;
+    if (h->magic != ARCHIVE_MAGIC || h->version != ARCHIVE_VERSION) return fail(error, "not a trace archive");
+    if (h->index_offset + (uint64_t)h->trace_count * sizeof(TraceIndexEntry) > size) return fail(error, "index out of range");
+    const TraceIndexEntry* index = (const TraceIndexEntry*)(base + h->index_offset);
+    for (uint32_t i = 0; i < h->trace_count; i++) {
+      const TraceIndexEntry& e = index[i];
+      if (e.samples_offset + e.sample_count * sizeof(TraceSample) > size ||
+          e.labels_offset + (uint64_t)e.label_count * sizeof(TraceLabel) > size || e.sample_hz == 0) {
+        return fail(error, "trace out of range");
+      }
+      traces.push_back({&e, (const TraceSample*)(base + e.samples_offset), (const TraceLabel*)(base + e.labels_offset)});
+    }
+    return true;
+  }
+
+  void close() {
+    if (base) munmap((void*)base, size);
+    if (fd >= 0) ::close(fd);
+    base = NULL;
+    fd = -1;
+    traces.clear();
+  }
+
+  const std::vector<TraceView>& all() const { return traces; }
+  size_t bytes() const { return size; }
+
+private:
+  int fd = -1;
+  const uint8_t* base = NULL;
+  size_t size = 0;
+  std::vector<TraceView> traces;
+
+  bool fail(std::string& error, const char* why) {
+    error = why;
+    close();
+    return false;
+  }
+};
+
+// Streams traces to a file; finish() writes the index and the final header
+class ArchiveWriter {
+public:
+  bool open(const char* path) {
+    file = fopen(path, "wb");
+    if (!file) return false;
+    ArchiveHeader h = {};
+    return fwrite(&h, sizeof(h), 1, file) == 1;
+  }
+
+  bool addTrace(uint32_t patient_id, uint32_t sample_hz, const std::vector<TraceSample>& samples,
+                const std::vector<TraceLabel>& labels) {
+    TraceIndexEntry e = {};
+    e.patient_id = patient_id;
+    e.sample_hz = sample_hz;
+    e.samples_offset = ftello(file);
+    e.sample_count = samples.size();
+    if (fwrite(samples.data(), sizeof(TraceSample), samples.size(), file) != samples.size()) return false;
+    e.labels_offset = ftello(file);
+    e.label_count = labels.size();
+    if (fwrite(labels.data(), sizeof(TraceLabel), labels.size(), file) != labels.size()) return false;
+    index.push_back(e);
+    return true;
+  }
+
+  bool finish() {
+    ArchiveHeader h = {ARCHIVE_MAGIC, ARCHIVE_VERSION, (uint32_t)index.size(), 0, (uint64_t)ftello(file)};
+    bool ok = fwrite(index.data(), sizeof(TraceIndexEntry), index.size(), file) == index.size();
+    ok = ok && fseeko(file, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    file = NULL;
+    return ok;
+  }
+
+private:
+  FILE* file = NULL;
+  std::vector<TraceIndexEntry> index;
+};
@@ -0,0 +1,255 @@
+// Inspect, index and benchmark trace_format.h recordings (Linux).
+//
+//   g++ -O2 -std=c++17 -o trace_tool tools/trace_tool.cpp
+//
+//   trace_tool extract CAPTURE OUT    cut a trace out of a raw Serial capture
+//   trace_tool info TRACE             header, channels, chunk and encoding stats
+//   trace_tool verify TRACE           check every chunk CRC
+//   trace_tool index TRACE            append a chunk index for O(1) open
+//   trace_tool seek TRACE MS          print the sample at MS after the start
+//   trace_tool bench TRACE            read throughput in GB/s
+//   trace_tool gen OUT MINUTES [raw]  synthetic 100 Hz IMU + PPG trace
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "../trace_format.h"
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool openTrace(TraceReader& reader, const char* path) {
+  std::string error;
+  if (reader.open(path, error)) return true;
+  fprintf(stderr, "%s: %s\n", path, error.c_str());
+  return false;
+}
+
+// The ESP32 prints its boot log on the same UART before the sketch starts,
+// so a capture begins with text; the trace starts at the first valid header
+static int extract(const char* capture, const char* out) {
+  FILE* in = fopen(capture, "rb");
+  if (!in) {
+    fprintf(stderr, "cannot read %s\n", capture);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) data.insert(data.end(), buf, buf + n);
+  fclose(in);
+
+  for (size_t off = 0; off + sizeof(TraceFileHeader) <= data.size(); off++) {
+    TraceFileHeader h;
+    memcpy(&h, &data[off], sizeof(h));
+    if (h.magic != TRACE_MAGIC || h.crc != traceCrc32(0, &h, offsetof(TraceFileHeader, crc))) continue;
+    FILE* file = fopen(out, "wb");
+    if (!file || fwrite(&data[off], 1, data.size() - off, file) != data.size() - off || fclose(file) != 0) {
+      fprintf(stderr, "cannot write %s\n", out);
+      return 1;
+    }
+    printf("trace at byte %zu, %zu bytes\n", off, data.size() - off);
+    return 0;
+  }
+  fprintf(stderr, "no trace header in %s\n", capture);
+  return 1;
+}
+
+static int info(const char* path) {
+  TraceReader reader;
+  if (!openTrace(reader, path)) return 1;
+  const TraceFileHeader& h = reader.header();
+  printf("%u Hz, %u samples/chunk, %zu chunks, %llu samples (%.1f s), %zu bytes, %s\n", h.sample_hz,
+         h.chunk_samples, reader.chunks(), (unsigned long long)reader.samples(), (double)reader.samples() / h.sample_hz,
+         reader.bytes(), reader.hasIndex() ? "indexed" : "no index");
+  for (int c = 0; c < h.channel_count; c++) {
+    printf("  %-8.8s scale %g offset %g\n", h.channels[c].name, h.channels[c].scale, h.channels[c].offset);
+  }
+  size_t delta = 0;
+  for (size_t i = 0; i < reader.chunks(); i++) delta += reader.chunk(i).encoding == TRACE_DELTA;
+  double raw_bytes = (double)reader.samples() * h.channel_count * sizeof(int16_t);
+  printf("%zu raw / %zu delta chunks, %.2f bytes per raw byte\n", reader.chunks() - delta, delta,
+         raw_bytes ? reader.bytes() / raw_bytes : 0);
+  return 0;
+}
+
+static int verify(const char* path) {
+  TraceReader reader;
+  if (!openTrace(reader, path)) return 1;
+  std::vector<int16_t> samples((size_t)reader.header().chunk_samples * reader.header().channel_count);
+  size_t bad = 0;
+  for (size_t i = 0; i < reader.chunks(); i++) {
+    if (!reader.verify(i) || !reader.decode(i, samples.data())) {
+      printf("chunk %zu (sample %llu): corrupt\n", i, (unsigned long long)reader.chunk(i).first_sample);
+      bad++;
+    }
+  }
+  printf("%zu of %zu chunks ok\n", reader.chunks() - bad, reader.chunks());
+  return bad ? 1 : 0;
+}
+
+static int writeIndex(const char* path) {
+  TraceReader reader;
+  if (!openTrace(reader, path)) return 1;
+  if (!traceWriteIndex(path, reader)) {
+    fprintf(stderr, "cannot write index to %s\n", path);
+    return 1;
+  }
+  printf("%zu chunks indexed\n", reader.chunks());
+  return 0;
+}
+
+static int seek(const char* path, uint64_t ms) {
+  TraceReader reader;
+  if (!openTrace(reader, path)) return 1;
+  const TraceFileHeader& h = reader.header();
+  uint64_t sample = ms * h.sample_hz / 1000;
+  size_t i = reader.chunkForSample(sample);
+  if (i == reader.chunks() || sample >= reader.samples()) {
+    fprintf(stderr, "%llu ms is past the end\n", (unsigned long long)ms);
+    return 1;
+  }
+  std::vector<int16_t> samples((size_t)h.chunk_samples * h.channel_count);
+  if (!reader.verify(i) || !reader.decode(i, samples.data())) {
+    fprintf(stderr, "chunk %zu is corrupt\n", i);
+    return 1;
+  }
+  const int16_t* s = &samples[(sample - reader.chunk(i).first_sample) * h.channel_count];
+  printf("sample %llu (chunk %zu):", (unsigned long long)sample, i);
+  for (int c = 0; c < h.channel_count; c++) printf(" %.8s=%g", h.channels[c].name, reader.scaled(c, s[c]));
+  printf("\n");
+  return 0;
+}
+
+// Three passes: summing raw chunks in place (zero copy), CRC checking every
+// chunk, and decoding every chunk into a buffer. Run twice to see page cache
+// speed rather than disk speed.
+static int bench(const char* path) {
+  auto start = std::chrono::steady_clock::now();
+  TraceReader reader;
+  if (!openTrace(reader, path)) return 1;
+  double open_s = secondsSince(start);
+  const TraceFileHeader& h = reader.header();
+  double gb = reader.bytes() / 1e9;
+  printf("open (%s): %.3f ms\n", reader.hasIndex() ? "index" : "scan", open_s * 1e3);
+
+  for (int round = 0; round < 2; round++) {
+    start = std::chrono::steady_clock::now();
+    int64_t sum = 0;
+    size_t raw_chunks = 0;
+    for (size_t i = 0; i < reader.chunks(); i++) {
+      const int16_t* raw = reader.rawSamples(i);
+      if (!raw) continue;
+      raw_chunks++;
+      size_t values = (size_t)reader.chunk(i).sample_count * h.channel_count;
+      for (size_t k = 0; k < values; k++) sum += raw[k];
+    }
+    double scan_s = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t ok = 0;
+    for (size_t i = 0; i < reader.chunks(); i++) ok += reader.verify(i);
+    double crc_s = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<int16_t> samples((size_t)h.chunk_samples * h.channel_count);
+    uint64_t decoded = 0;
+    for (size_t i = 0; i < reader.chunks(); i++) {
+      decoded += reader.decode(i, samples.data());
+      sum += samples[0];
+    }
+    double decode_s = secondsSince(start);
+
+    double decoded_gb = decoded * h.channel_count * sizeof(int16_t) / 1e9;
+    printf("round %d: zero-copy sum %.2f GB/s (%zu raw chunks), crc %.2f GB/s (%zu/%zu ok), decode %.2f GB/s out "
+           "(%.1f M samples/s)  [%lld]\n",
+           round + 1, raw_chunks ? raw_chunks * (double)h.chunk_samples * h.channel_count * 2 / 1e9 / scan_s : 0,
+           raw_chunks, gb / crc_s, ok, reader.chunks(), decoded_gb / decode_s, decoded / decode_s / 1e6,
+           (long long)sum);
+  }
+  return 0;
+}
+
+// Patient at rest with occasional movement: MPU6050 at +-2 g / 250 deg/s
+// and a MAX30100 style PPG
+static int gen(const char* path, double minutes, bool allow_delta) {
+  const uint32_t hz = 100;
+  TraceFileHeader h;
+  traceInitHeader(h, hz, 0, allow_delta);
+  traceAddChannel(h, "ax", 1 / 16384.0f);
+  traceAddChannel(h, "ay", 1 / 16384.0f);
+  traceAddChannel(h, "az", 1 / 16384.0f);
+  traceAddChannel(h, "gx", 1 / 131.0f);
+  traceAddChannel(h, "gy", 1 / 131.0f);
+  traceAddChannel(h, "gz", 1 / 131.0f);
+  traceAddChannel(h, "ir", 1, 32768);
+  traceAddChannel(h, "red", 1, 32768);
+
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "cannot write %s\n", path);
+    return 1;
+  }
+  FileTraceSink sink(file);
+  static TraceStreamWriter writer;
+  writer.begin(sink, h);
+
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0, 1);
+  uint64_t n = (uint64_t)(minutes * 60 * hz);
+  for (uint64_t i = 0; i < n; i++) {
+    float t = (float)i / hz;
+    float moving = fmodf(t, 120) < 10 ? 1 : 0;
+    float beat = sinf(2 * M_PI * 1.2f * t);
+    int16_t s[8] = {
+        (int16_t)(200 * noise(rng) * (1 + 20 * moving)),
+        (int16_t)(200 * noise(rng) * (1 + 20 * moving)),
+        (int16_t)(16384 + 200 * noise(rng)),
+        (int16_t)(60 * noise(rng) * (1 + 50 * moving)),
+        (int16_t)(60 * noise(rng) * (1 + 50 * moving)),
+        (int16_t)(60 * noise(rng) * (1 + 50 * moving)),
+        (int16_t)(50000 - 32768 + 400 * beat + 20 * noise(rng)),
+        (int16_t)(42000 - 32768 + 250 * beat + 20 * noise(rng)),
+    };
+    writer.add(s, (uint32_t)(i * 1000 / hz));
+  }
+  bool ok = writer.finish();
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "write failed\n");
+    return 1;
+  }
+  printf("%llu samples in %u chunks\n", (unsigned long long)writer.samples(), writer.chunks());
+  return 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: trace_tool extract CAPTURE OUT | info TRACE | verify TRACE | index TRACE |\n"
+          "                  seek TRACE MS | bench TRACE | gen OUT MINUTES [raw]\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    usage();
+    return 2;
+  }
+  const char* cmd = argv[1];
+  if (strcmp(cmd, "extract") == 0 && argc == 4) return extract(argv[2], argv[3]);
+  if (strcmp(cmd, "info") == 0) return info(argv[2]);
+  if (strcmp(cmd, "verify") == 0) return verify(argv[2]);
+  if (strcmp(cmd, "index") == 0) return writeIndex(argv[2]);
+  if (strcmp(cmd, "seek") == 0 && argc == 4) return seek(argv[2], strtoull(argv[3], NULL, 10));
+  if (strcmp(cmd, "bench") == 0) return bench(argv[2]);
+  if (strcmp(cmd, "gen") == 0 && argc >= 4) {
+    return gen(argv[2], atof(argv[3]), !(argc == 5 && strcmp(argv[4], "raw") == 0));
+  }
+  usage();
+  return 2;
+}
@@ -0,0 +1,341 @@
+// Host run of telemetry_uplink.h: bytes and wakeups per hour against HTTP
+// polling, and the offline flash buffer.
+//
+// The uplink runs unchanged on in-memory LittleFS and esp-mqtt stand-ins
+// (tools/host) with a virtual clock. loop() feeds it every 10 ms as
+// combinedsense.cpp does; the tool plays the broker, acknowledging each
+// publish after a 60 ms round trip and checking that frames arrive in
+// sequence.
+//
+//   steady       1 h online, nothing changes
+//   active       1 h online, a motion episode every 6 min and 20 min of
+//                SEPSIS, each flag change publishing straight away
+//   outage       2 h with the broker gone for 30 min in the middle
+//   long-outage  3 h with the broker gone for 2.5 h, more than the flash
+//                ring holds
+//
+// Wire bytes count MQTT and TCP/IP headers (40 B a segment) and the TCP
+// ACKs each exchange costs; TLS and WiFi framing are left out on both sides.
+// A wakeup is one exchange with the radio up: a publish and its PUBACK, or a
+// keepalive ping. The HTTP rows model the dashboard's poll of a JSON body
+// with the same fields as a frame, with the connection kept alive or opened
+// per request, which is what a 1 s poll needs to see what one frame holds.
+//
+//   g++ -O2 -std=c++17 -Itools/host -o uplink_traffic_sim tools/uplink_traffic_sim.cpp
+//   ./uplink_traffic_sim
+//
+// Exit status is non-zero if a frame is lost that the uplink did not count
+// as dropped, a batch is malformed, an online run writes to flash beyond the
+// ring header, the ring file grows past its capacity, frames are left queued,
+// or the uplink does not beat 1 s HTTP polling on both bytes and wakeups.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "../telemetry_uplink.h"
+
+static const uint32_t LOOP_MS = 10;
+static const uint32_t RTT_MS = 60;
+static const uint32_t CONNECT_MS = 2000;
+static const uint32_t KEEPALIVE_S = 60;
+static const uint32_t TCP_IP_BYTES = 40;
+static const char* TOPIC = "byteheal/esp32-0123456789ab/telemetry";
+
+static uint64_t now_us = 0;
+static uint64_t clockNow() { return now_us; }
+static void clockSleep(uint64_t us) { now_us += us; }
+
+struct Scenario {
+  const char* name;
+  uint32_t duration_ms;
+  uint32_t down_from_ms = 0, down_to_ms = 0;
+  bool active = false;
+};
+
+struct InFlight {
+  int msg_id;
+  uint32_t ack_at_ms;
+  std::vector<TelemetryFrame> frames;
+};
+
+struct Broker {
+  bool up = false;
+  std::deque<InFlight> pending;
+  uint32_t next_seq = 0;
+  uint32_t frames = 0, duplicates = 0, gaps = 0, malformed = 0;
+  uint32_t publishes = 0, pings = 0;
+  uint64_t wire_bytes = 0;
+  uint32_t last_exchange_ms = 0;
+
+  bool publish(int msg_id, const char* topic, const char* data, int len, int qos) {
+    if (!up || qos != 1) return false;
+    TelemetryBatchHeader header;
+    memcpy(&header, data, sizeof(header));
+    InFlight f = {msg_id, millis() + RTT_MS, {}};
+    if (header.version != UPLINK_FORMAT_VERSION || header.frame_bytes != sizeof(TelemetryFrame) ||
+        len != (int)(sizeof(header) + header.count * sizeof(TelemetryFrame))) {
+      malformed++;
+      return true;
+    }
+    f.frames.resize(header.count);
+    memcpy(f.frames.data(), data + sizeof(header), header.count * sizeof(TelemetryFrame));
+    pending.push_back(f);
+
+    // PUBLISH (fixed header, topic, packet id) in one segment, PUBACK back,
+    // and the device's ACK of the PUBACK
+    uint32_t body = 2 + strlen(topic) + 2 + len;
+    uint32_t publish = 1 + (body > 127 ? 2 : 1) + body;
+    wire_bytes += publish + TCP_IP_BYTES + 4 + TCP_IP_BYTES + TCP_IP_BYTES;
+    publishes++;
+    last_exchange_ms = millis();
+    return true;
+  }
+
+  // Frames reach the broker as a batch; at least once, in order
+  void receive(const InFlight& f) {
+    for (const TelemetryFrame& frame : f.frames) {
+      if (frame.seq < next_seq) {
+        duplicates++;
+        continue;
+      }
+      if (frame.seq > next_seq) gaps += frame.seq - next_seq;
+      next_seq = frame.seq + 1;
+      frames++;
+    }
+  }
+
+  void tick(uint32_t now) {
+    while (!pending.empty() && (int32_t)(now - pending.front().ack_at_ms) >= 0) {
+      InFlight f = pending.front();
+      pending.pop_front();
+      receive(f);
+      hostMqttEvent(MQTT_EVENT_PUBLISHED, f.msg_id);
+    }
+    // esp-mqtt pings once the connection has been quiet for the keepalive
+    if (up && now - last_exchange_ms >= KEEPALIVE_S * 1000) {
+      wire_bytes += 2 + TCP_IP_BYTES + 2 + TCP_IP_BYTES + TCP_IP_BYTES;
+      pings++;
+      last_exchange_ms = now;
+    }
+  }
+
+  void drop() {
+    // A batch the broker already had goes out again after the reconnect
+    for (const InFlight& f : pending) {
+      if (millis() - (f.ack_at_ms - RTT_MS) >= RTT_MS / 2) receive(f);
+    }
+    pending.clear();
+  }
+};
+
+// What the sketch would hand over at time t
+static UplinkState stateAt(const Scenario& s, uint32_t t, std::mt19937& rng) {
+  std::normal_distribution<float> noise(0, 1);
+  UplinkState st = {};
+  st.hr = roundf(72 + 2 * noise(rng));
+  st.spo2 = 97;
+  st.accel_g = 1 + 0.02f * noise(rng);
+  st.gyro_dps = fabsf(2 * noise(rng));
+  if (s.active) {
+    uint32_t in_episode = (t + 356300) % 360000;
+    if (in_episode < 17300) {
+      st.flags |= UPLINK_MOTION;
+      st.motion_ms = in_episode;
+      st.accel_g += 0.5f * fabsf(noise(rng));
+      st.gyro_dps += 80 * fabsf(noise(rng));
+    }
+    if (t >= 1234500 && t < 2434500) {
+      st.flags |= UPLINK_SEPSIS;
+      st.hr += 30;
+    }
+  }
+  return st;
+}
+
+struct HttpPoll {
+  const char* label;
+  uint32_t period_s;
+  bool keep_alive;
+};
+
+// One poll of a JSON body carrying a frame's fields
+static uint32_t httpPollBytes(const HttpPoll& p, const TelemetryFrame& f) {
+  char body[256];
+  int body_len = snprintf(body, sizeof(body),
+                          "{\"seq\":%u,\"t_ms\":%u,\"hr\":%.1f,\"spo2\":%.1f,\"accel\":%.3f,\"accel_max\":%.3f,"
+                          "\"gyro\":%.1f,\"gyro_max\":%.1f,\"flags\":%u,\"motion_s\":%u}",
+                          f.seq, f.t_ms, f.hr_x10 / 10.0, f.spo2_x10 / 10.0, f.accel_mg / 1000.0,
+                          f.accel_max_mg / 1000.0, f.gyro_dps_x10 / 10.0, f.gyro_max_dps_x10 / 10.0, f.flags,
+                          f.motion_s);
+  std::string request = std::string("GET /data HTTP/1.1\r\nHost: 192.168.1.50\r\n") +
+                        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n" +
+                        "Accept: */*\r\nAccept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\n" +
+                        "Referer: http://192.168.1.50/\r\nConnection: " + (p.keep_alive ? "keep-alive" : "close") +
+                        "\r\n\r\n";
+  char response[192];
+  int response_len = snprintf(response, sizeof(response),
+                              "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                              "Connection: %s\r\n\r\n",
+                              body_len, p.keep_alive ? "keep-alive" : "close");
+  // Request and response segments, the ACK of each
+  uint32_t bytes = request.size() + response_len + body_len + 4 * TCP_IP_BYTES;
+  // SYN, SYN-ACK, ACK (SYNs carry 20 B of options), then FIN and ACK each way
+  if (!p.keep_alive) bytes += 3 * TCP_IP_BYTES + 2 * 20 + 4 * TCP_IP_BYTES;
+  return bytes;
+}
+
+static bool run(const Scenario& s) {
+  LittleFS.remove("/uplink.ring");
+  LittleFS.bytes_written = 0;
+  hostMqtt().client = esp_mqtt_client();
+  Broker broker;
+  hostMqtt().on_publish = [&](int msg_id, const char* topic, const char* data, int len, int qos) {
+    return broker.publish(msg_id, topic, data, len, qos);
+  };
+  now_us = 0;
+  std::unique_ptr<TelemetryUplink> uplink(new TelemetryUplink());
+  bool ok = true;
+  if (!uplink->begin("mqtt://192.168.1.10:1883", "esp32-0123456789ab", TOPIC)) {
+    printf("%s: uplink failed to start\n", s.name);
+    return false;
+  }
+  uint64_t header_bytes = LittleFS.bytes_written;
+
+  std::mt19937 rng(3);
+  uint32_t max_queued = 0;
+  TelemetryFrame last_frame = {};
+  for (uint32_t t = 0; t < s.duration_ms; t += LOOP_MS) {
+    now_us = (uint64_t)t * 1000;
+    bool down = t >= s.down_from_ms && t < s.down_to_ms;
+    bool want_up = t >= CONNECT_MS && !down;
+    if (want_up != broker.up) {
+      broker.up = want_up;
+      if (!want_up) broker.drop();
+      broker.last_exchange_ms = t;
+      hostMqttEvent(want_up ? MQTT_EVENT_CONNECTED : MQTT_EVENT_DISCONNECTED);
+    }
+    broker.tick(t);
+
+    uplink->sample(stateAt(s, t, rng), t);
+    uplink->loop(t);
+    if (uplink->queued() > max_queued) max_queued = uplink->queued();
+  }
+
+  // Let the last batches drain
+  for (uint32_t t = s.duration_ms; t < s.duration_ms + 600000 && uplink->queued(); t += LOOP_MS) {
+    now_us = (uint64_t)t * 1000;
+    broker.tick(t);
+    uplink->loop(t);
+  }
+  now_us += (uint64_t)RTT_MS * 1000;
+  broker.tick(millis());
+  uplink->loop(millis());
+
+  File file = LittleFS.open("/uplink.ring", "r");
+  size_t file_bytes = file ? file.size() : 0;
+  uint32_t produced = broker.next_seq;
+  uint32_t dropped = uplink->droppedFrames();
+  double hours = s.duration_ms / 3600000.0;
+  printf("%s: %.1f h, %u frames, %u publishes (%u after reconnect), %u pings\n", s.name, hours, produced,
+         broker.publishes, uplink->frames_replayed, broker.pings);
+  printf("  delivered %u, duplicates %u, lost %u (counted as dropped %u), peak queue %u frames\n", broker.frames,
+         broker.duplicates, broker.gaps, dropped, max_queued);
+  printf("  ring file %zu B (header %llu B), %.1f KB written to flash\n", file_bytes,
+         (unsigned long long)header_bytes, LittleFS.bytes_written / 1024.0);
+  if (s.down_to_ms == 0) {
+    printf("  per hour: %.0f wakeups, %.1f KB on the wire (%.1f KB of frames)\n",
+           (broker.publishes + broker.pings) / hours, broker.wire_bytes / 1024.0 / hours,
+           produced * sizeof(TelemetryFrame) / 1024.0 / hours);
+  }
+
+  if (broker.gaps != dropped || broker.malformed) {
+    printf("  FAIL: %u frames missing, uplink counted %u dropped, %u malformed\n", broker.gaps, dropped,
+           broker.malformed);
+    ok = false;
+  }
+  if (s.down_to_ms == 0 && (dropped || LittleFS.bytes_written != header_bytes)) {
+    printf("  FAIL: online run dropped frames or wrote to flash\n");
+    ok = false;
+  }
+  if (file_bytes > header_bytes + (size_t)UPLINK_FLASH_FRAMES * sizeof(TelemetryFrame)) {
+    printf("  FAIL: ring file larger than its capacity\n");
+    ok = false;
+  }
+  if (uplink->queued()) {
+    printf("  FAIL: %u frames still queued after the drain\n", uplink->queued());
+    ok = false;
+  }
+
+  // Compare with the dashboard polling the same data
+  if (s.down_to_ms == 0) {
+    static const HttpPoll POLLS[] = {{"HTTP 1 s, keep-alive", 1, true},
+                                     {"HTTP 1 s, new connection", 1, false},
+                                     {"HTTP 10 s, keep-alive", 10, true}};
+    last_frame.seq = produced;
+    last_frame.t_ms = s.duration_ms;
+    last_frame.hr_x10 = 723;
+    last_frame.spo2_x10 = 970;
+    last_frame.accel_mg = 1003;
+    last_frame.accel_max_mg = 1041;
+    last_frame.gyro_dps_x10 = 21;
+    last_frame.gyro_max_dps_x10 = 57;
+    double mqtt_kb = broker.wire_bytes / 1024.0 / hours;
+    double mqtt_wakeups = (broker.publishes + broker.pings) / hours;
+    for (const HttpPoll& p : POLLS) {
+      double polls = 3600.0 / p.period_s;
+      double kb = polls * httpPollBytes(p, last_frame) / 1024.0;
+      printf("  %-26s %6.0f wakeups/h %8.1f KB/h  (uplink: %.1fx fewer wakeups, %.1fx fewer bytes)\n", p.label,
+             polls, kb, polls / mqtt_wakeups, kb / mqtt_kb);
+      if (p.period_s == 1 && (mqtt_wakeups >= polls || mqtt_kb >= kb)) {
+        printf("  FAIL: uplink does not beat %s\n", p.label);
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+int main() {
+  hostClockDriver(clockNow, clockSleep);
+
+  Scenario steady = {"steady", 3600000};
+  Scenario active = {"active", 3600000};
+  active.active = true;
+  Scenario outage = {"outage", 7200000, 2700000, 4500000};
+  outage.active = true;
+  Scenario long_outage = {"long-outage", 10800000, 1800000, 10800000 - 1800000};
+
+  bool ok = true;
+  for (const Scenario* s : {&steady, &active, &outage, &long_outage}) ok &= run(*s);
+
+  // A reboot keeps what was spilled: reopening finds the same ring
+  {
+    LittleFS.remove("/uplink.ring");
+    FlashFrameRing a;
+    a.begin(LittleFS, "/uplink.ring", 16);
+    TelemetryFrame frames[20] = {};
+    for (uint32_t i = 0; i < 20; i++) frames[i].seq = i;
+    a.push(frames, 20);
+    FlashFrameRing b;
+    b.begin(LittleFS, "/uplink.ring", 16);
+    TelemetryFrame out[16];
+    uint32_t n = b.peek(out, 16);
+    bool same = n == 16 && b.dropped() == 4 && b.fileBytes() == a.fileBytes();
+    for (uint32_t i = 0; same && i < n; i++) same = out[i].seq == i + 4;
+    printf("reopened ring: %u frames from seq %u, %u dropped, %u B file\n", n, n ? out[0].seq : 0, b.dropped(),
+           b.fileBytes());
+    if (!same) {
+      printf("  FAIL: reopened ring does not match what was written\n");
+      ok = false;
+    }
+  }
+
+  printf(ok ? "all checks passed\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+// Host check and benchmark for vitals_history.h.
+//
+// Feeds 10 days of synthetic vitals at 100 Hz, as the sensor callbacks in
+// combinedsense.cpp do: HR and SpO2 step with each beat and drift with a
+// circadian swing, accel and gyro are noisy with bursts of movement. It then
+// reports, per metric and tier, the points held, bits per point, bytes per
+// ingested sample and how far back the tier reaches (now, and the least over
+// the last three days), and times the queries /history makes by default (no step)
+// for ranges from 10 min to a week.
+//
+//   g++ -O2 -std=c++17 -o vitals_history_bench tools/vitals_history_bench.cpp
+//   ./vitals_history_bench
+//
+// Exit status is non-zero if any metric's tier keeps less than its config
+// promises (10 min at 1 s, 24 h at 1 min, a week at 15 min), a default query
+// does not reach back to `from` (within one point) when some tier does, or a
+// 1 min HR point's mean, min or max is off from the samples it covers by more
+// than the metric resolution.
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../vitals_history.h"
+
+static const uint32_t DAYS = 10;
+static const uint32_t RUN_S = DAYS * 86400;
+static const uint32_t HZ = 100;
+
+// What HISTORY_TIER_CONFIG promises each tier keeps, for every metric
+static const uint32_t TIER_REACH_S[HISTORY_TIERS] = {600, 86400, 7 * 86400};
+
+struct MinuteTruth {
+  float min, max;
+  double sum;
+  uint32_t n;
+};
+
+int main() {
+  static VitalsHistory history;
+  history.begin();
+  std::mt19937 rng(7);
+  std::normal_distribution<float> noise(0, 1);
+  std::uniform_real_distribution<float> uniform(0, 1);
+
+  // Exact HR per minute (of the values as snapped on the way in) for the
+  // last day, to check the 1 min tier against
+  std::vector<MinuteTruth> truth(RUN_S / 60);
+  float hr = 72, spo2 = 97, beat_left = 0;
+  float activity = 0;
+  // Shortest reach per metric and tier once a week of data is in; the last
+  // three days span block drops in every tier
+  uint32_t min_reach[HISTORY_METRIC_COUNT][HISTORY_TIERS];
+  for (auto& m : min_reach) {
+    for (uint32_t& r : m) r = UINT32_MAX;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t t = 0; t < RUN_S; t++) {
+    float circadian = sinf(2 * (float)M_PI * t / 86400);
+    if (uniform(rng) < 0.002f) activity = 1 + 2 * uniform(rng);  // someone gets up
+    activity *= 0.98f;
+    MinuteTruth& m = truth[t / 60];
+    for (uint32_t k = 0; k < HZ; k++) {
+      // The beat detector updates HR and SpO2 once per beat
+      beat_left -= 1.0f / HZ;
+      if (beat_left <= 0) {
+        hr = roundf(70 + 6 * circadian + 15 * activity + 2 * noise(rng));
+        spo2 = fminf(100, roundf(97 + 0.5f * circadian + 0.6f * noise(rng)));
+        beat_left = 60.0f / hr;
+      }
+      float accel = 1 + 0.02f * noise(rng) + 0.4f * activity * fabsf(noise(rng));
+      float gyro = fabsf(2 * noise(rng) + 60 * activity * noise(rng));
+      history.add(HISTORY_HR, t, hr);
+      history.add(HISTORY_SPO2, t, spo2);
+      history.add(HISTORY_ACCEL, t, accel);
+      history.add(HISTORY_GYRO, t, gyro);
+
+      float snapped = roundf(hr / 0.125f) * 0.125f;
+      if (m.n == 0 || snapped < m.min) m.min = snapped;
+      if (m.n == 0 || snapped > m.max) m.max = snapped;
+      m.sum += snapped;
+      m.n++;
+    }
+    if (t >= TIER_REACH_S[HISTORY_TIERS - 1] + 3600 && t % 60 == 0) {
+      for (int mi = 0; mi < HISTORY_METRIC_COUNT; mi++) {
+        for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+          min_reach[mi][tier] = std::min(min_reach[mi][tier], t - history.metric(mi).oldest(tier));
+        }
+      }
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  uint32_t now = RUN_S - 1;
+  int failures = 0;
+
+  printf("%u days at %u Hz, 4 metrics: %zu bytes of history, add() %.1f ns\n", DAYS, HZ,
+         (size_t)VitalsHistory::bytes(),
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)RUN_S * HZ * HISTORY_METRIC_COUNT));
+  printf("  %-6s %6s %8s %8s %8s %8s %10s\n", "metric", "step", "points", "bits/pt", "reach h", "min h", "B/sample");
+  for (int m = 0; m < HISTORY_METRIC_COUNT; m++) {
+    const MetricHistory& series = history.metric(m);
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) {
+      uint32_t points = series.tierPoints(tier);
+      uint32_t reach = now - series.oldest(tier);
+      uint32_t block_bytes = HISTORY_TIER_CONFIG[tier].blocks * (uint32_t)sizeof(HistoryBlock);
+      printf("  %-6s %5us %8u %8.1f %8.1f %8.1f %10.5f\n", historyMetricName(m), HISTORY_TIER_CONFIG[tier].step_s,
+             points, points ? (float)series.tierBits(tier) / points : 0.0f, reach / 3600.0f,
+             min_reach[m][tier] / 3600.0f, (double)block_bytes / ((double)reach * HZ));
+      if (min_reach[m][tier] < TIER_REACH_S[tier]) {
+        printf("FAIL: %s %us tier reached back only %u min, it should keep %u min\n", historyMetricName(m),
+               HISTORY_TIER_CONFIG[tier].step_s, min_reach[m][tier] / 60, TIER_REACH_S[tier] / 60);
+        failures++;
+      }
+    }
+  }
+
+  // What /history returns when no step is given
+  struct Range {
+    const char* label;
+    uint32_t back_s;
+  };
+  static const Range RANGES[] = {{"10 min", 600}, {"1 h", 3600}, {"6 h", 6 * 3600},
+                                 {"24 h", 86400}, {"3 days", 3 * 86400}, {"7 days", 7 * 86400}};
+  const MetricHistory& hr_series = history.metric(HISTORY_HR);
+  printf("  %-8s %6s %7s %10s %10s\n", "range", "step", "points", "reach h", "query us");
+  for (const Range& r : RANGES) {
+    uint32_t from = now - r.back_s;
+    uint32_t step = hr_series.resolveStep(from, 0);
+    uint32_t first = 0, count = 0;
+    auto q0 = std::chrono::steady_clock::now();
+    uint32_t rounds = 0;
+    do {
+      first = 0xFFFFFFFF;
+      count = hr_series.query(from, step, [&](const HistoryPoint& p) {
+        if (p.t < first) first = p.t;
+      });
+      rounds++;
+    } while (std::chrono::steady_clock::now() - q0 < std::chrono::milliseconds(50));
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - q0).count() / rounds;
+    printf("  %-8s %5us %7u %10.1f %10.1f\n", r.label, step, count, (now - first) / 3600.0f, us);
+
+    bool reachable = false;
+    for (int tier = 0; tier < HISTORY_TIERS; tier++) reachable |= hr_series.oldest(tier) <= from;
+    if (reachable && (count == 0 || first > from + step)) {
+      printf("FAIL: %s query starts %u s after from\n", r.label, first - from);
+      failures++;
+    }
+  }
+
+  // 1 min points of the last day against the exact minutes
+  float worst_mean = 0, worst_edge = 0;
+  hr_series.query(now - 86400, 60, [&](const HistoryPoint& p) {
+    const MinuteTruth& m = truth[p.t / 60];
+    worst_mean = fmaxf(worst_mean, fabsf(p.mean - (float)(m.sum / m.n)));
+    worst_edge = fmaxf(worst_edge, fmaxf(fabsf(p.min - m.min), fabsf(p.max - m.max)));
+  });
+  printf("1 min HR points vs exact: mean within %.3f BPM, min/max within %.3f BPM\n", worst_mean, worst_edge);
+  if (worst_mean > 0.125f || worst_edge > 0.125f) {
+    printf("FAIL: 1 min HR points off by more than the resolution\n");
+    failures++;
+  }
+
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+// Host check and benchmark for vitals_stats.h.
+//
+// Generates 24 h of 1 Hz HR and SpO2 for a patient with a circadian swing,
+// sensor noise, PPG glitches (1 % of readings anywhere in range, some
+// dropouts) and, from hour 16, a slow sepsis-like drift: HR +25 BPM and SpO2
+// -4 % over two hours. It then checks
+//
+//   - the 30 min median against an exact median of the same window
+//   - the sepsis rules from combinedsense.cpp, instantaneous vs trend based:
+//     alerts before the drift (false) and delay after its onset
+//   - that one off reading after a 40 min gap (finger off) fires no trend rule
+//   - memory per trend, and the cost of add() and snapshot()
+//
+//   g++ -O2 -std=c++17 -o vitals_stats_bench tools/vitals_stats_bench.cpp
+//   ./vitals_stats_bench
+//
+// Exit status is non-zero if the median is off by more than a bin, a trend
+// rule fires before the drift or after the gap, or the drift is not seen
+// within 90 min.
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <vector>
+#include "../rule_engine.h"
+#include "../vitals_stats.h"
+
+static const uint32_t DAY_S = 86400;
+static const uint32_t ONSET_S = 16 * 3600;
+static const uint32_t RAMP_S = 2 * 3600;
+
+// As defaultRules() in combinedsense.cpp, cooldowns 0 so every activation counts
+static const char* INSTANT_RULES =
+    "SEPSIS 0 0 Tachycardia: hr > 100\n"
+    "SEPSIS 0 0 Hypoxemia: spo2 < 95 & spo2 > 0\n";
+static const char* TREND_RULES =
+    "SEPSIS 0 0 Tachycardia: hr_p50 > 100\n"
+    "SEPSIS 0 0 Hypoxemia: spo2_p50 < 95 & spo2_p50 > 0\n"
+    "SEPSIS 0 0 HR Above Baseline: hr_dev > 15 & hr_cusum > 150\n"
+    "SEPSIS 0 0 SpO2 Below Baseline: spo2_dev < -3 & spo2_cusum > 30\n";
+
+struct Reading {
+  float hr;
+  float spo2;
+};
+
+static std::vector<Reading> generate(uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0, 1);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  std::vector<Reading> out(DAY_S);
+  for (uint32_t t = 0; t < DAY_S; t++) {
+    float ramp = t < ONSET_S ? 0 : fminf(1.0f, (float)(t - ONSET_S) / RAMP_S);
+    float circadian = sinf(2 * (float)M_PI * t / DAY_S);
+    float hr = 72 + 6 * circadian + 25 * ramp + 3 * noise(rng);
+    float spo2 = 97 + 0.5f * circadian - 4 * ramp + 0.7f * noise(rng);
+    float u = uniform(rng);
+    if (u < 0.01f) hr = 40 + 160 * uniform(rng);              // beat detector glitch
+    else if (u < 0.02f) spo2 = 80 + 20 * uniform(rng);        // motion artefact
+    else if (u < 0.025f) hr = spo2 = 0;                       // finger off
+    out[t] = {roundf(hr), fminf(100, roundf(spo2))};
+  }
+  return out;
+}
+
+static float exactMedian(std::vector<float> v) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(v.size() - 1) / 2];
+}
+
+struct RuleRun {
+  const char* name;
+  RuleEngine engine;
+  uint32_t false_alarms = 0;   // seconds active before the onset
+  int64_t first_after = -1;    // seconds after the onset
+};
+
+int main() {
+  std::vector<Reading> day = generate(42);
+  int failures = 0;
+
+  VitalsStats stats;
+  stats.begin();
+  RuleRun runs[2];
+  runs[0].name = "instantaneous";
+  runs[1].name = "trend";
+  char error[RULE_ERROR_LEN];
+  if (!runs[0].engine.load(INSTANT_RULES, error, sizeof(error)) || !runs[1].engine.load(TREND_RULES, error, sizeof(error))) {
+    printf("rule error: %s\n", error);
+    return 1;
+  }
+
+  std::deque<uint32_t> hr_window, spo2_window;  // seconds with a reading
+  float worst_hr = 0, worst_spo2 = 0;
+  float metrics[METRIC_COUNT] = {};
+  for (uint32_t t = 0; t < DAY_S; t++) {
+    uint32_t now_ms = t * 1000;
+    const Reading& r = day[t];
+    stats.add(now_ms, r.hr, r.spo2);
+
+    // Exact medians over the same buckets the trend keeps
+    uint32_t bucket_s = VITALS_HR_CONFIG.window_ms / VITALS_BUCKETS / 1000;
+    uint32_t oldest = (t / bucket_s - (VITALS_BUCKETS - 1)) * bucket_s;
+    if (r.hr > 0) hr_window.push_back(t);
+    if (r.spo2 > 0) spo2_window.push_back(t);
+    while (!hr_window.empty() && hr_window.front() < oldest) hr_window.pop_front();
+    while (!spo2_window.empty() && spo2_window.front() < oldest) spo2_window.pop_front();
+
+    VitalTrendSnapshot hr = stats.hr.snapshot(now_ms);
+    VitalTrendSnapshot spo2 = stats.spo2.snapshot(now_ms);
+    if (t % 60 == 0 && t >= 3600) {
+      std::vector<float> hv, sv;
+      for (uint32_t s : hr_window) hv.push_back(day[s].hr);
+      for (uint32_t s : spo2_window) sv.push_back(day[s].spo2);
+      worst_hr = fmaxf(worst_hr, fabsf(hr.p50 - exactMedian(hv)));
+      worst_spo2 = fmaxf(worst_spo2, fabsf(spo2.p50 - exactMedian(sv)));
+    }
+
+    metrics[METRIC_HR] = r.hr;
+    metrics[METRIC_SPO2] = r.spo2;
+    metrics[METRIC_HR_AVG] = hr.fast;
+    metrics[METRIC_HR_P50] = hr.p50;
+    metrics[METRIC_HR_BASE] = hr.baseline;
+    metrics[METRIC_HR_DEV] = hr.deviation;
+    metrics[METRIC_HR_CUSUM] = hr.cusum;
+    metrics[METRIC_SPO2_AVG] = spo2.fast;
+    metrics[METRIC_SPO2_P50] = spo2.p50;
+    metrics[METRIC_SPO2_BASE] = spo2.baseline;
+    metrics[METRIC_SPO2_DEV] = spo2.deviation;
+    metrics[METRIC_SPO2_CUSUM] = spo2.cusum;
+    for (RuleRun& run : runs) {
+      RuleResult result = run.engine.evaluate(metrics, now_ms);
+      if (!result.active) continue;
+      if (t < ONSET_S) run.false_alarms++;
+      else if (run.first_after < 0) run.first_after = t - ONSET_S;
+    }
+
+    if (t == ONSET_S - 1) {
+      printf("before the drift: HR p50 %.1f, baseline %.1f, cusum %.1f; SpO2 p50 %.1f, baseline %.1f, cusum %.1f\n",
+             hr.p50, hr.baseline, hr.cusum, spo2.p50, spo2.baseline, spo2.cusum);
+    }
+    if (t == ONSET_S + RAMP_S) {
+      printf("after the drift:  HR p50 %.1f, baseline %.1f, cusum %.1f; SpO2 p50 %.1f, baseline %.1f, cusum %.1f\n",
+             hr.p50, hr.baseline, hr.cusum, spo2.p50, spo2.baseline, spo2.cusum);
+    }
+  }
+
+  printf("30 min median vs exact: worst HR %.2f BPM, SpO2 %.2f %%\n", worst_hr, worst_spo2);
+  if (worst_hr > VITALS_HR_CONFIG.step || worst_spo2 > VITALS_SPO2_CONFIG.step) {
+    printf("FAIL: median off by more than a bin\n");
+    failures++;
+  }
+  for (const RuleRun& run : runs) {
+    printf("%-14s rules: active %u s in the 16 h before the drift, first alert %lld min after its onset\n", run.name,
+           (unsigned)run.false_alarms, run.first_after < 0 ? -1LL : (long long)(run.first_after / 60));
+  }
+  if (runs[1].false_alarms) {
+    printf("FAIL: trend rules fired before the drift\n");
+    failures++;
+  }
+  if (runs[1].first_after < 0 || runs[1].first_after > 90 * 60) {
+    printf("FAIL: drift not detected within 90 min\n");
+    failures++;
+  }
+
+  // One glitch after a long gap: 2 h at 70 BPM, the finger off for 40 min,
+  // then a single 100 BPM reading. It must not count as 40 min above baseline.
+  {
+    VitalsStats gap;
+    gap.begin();
+    RuleEngine engine;
+    engine.load(TREND_RULES, error, sizeof(error));
+    uint32_t t = 0;
+    for (; t < 7200; t++) gap.add(t * 1000, 70, 97);
+    t += 40 * 60;
+    gap.add(t * 1000, 100, 97);
+    VitalTrendSnapshot hr = gap.hr.snapshot(t * 1000);
+    float m[METRIC_COUNT] = {};
+    m[METRIC_HR] = 100;
+    m[METRIC_SPO2] = 97;
+    m[METRIC_HR_P50] = hr.p50;
+    m[METRIC_HR_DEV] = hr.deviation;
+    m[METRIC_HR_CUSUM] = hr.cusum;
+    m[METRIC_SPO2_P50] = 97;
+    RuleResult result = engine.evaluate(m, t * 1000);
+    printf("one 100 BPM reading after a 40 min gap: dev %.1f, cusum %.2f, %s\n", hr.deviation, hr.cusum,
+           result.active ? "alert" : "no alert");
+    if (result.active) {
+      printf("FAIL: a single reading after a gap fired a trend rule\n");
+      failures++;
+    }
+  }
+
+  // Cost
+  VitalsStats timed;
+  timed.begin();
+  uint32_t rounds = 20;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < rounds; k++) {
+    for (uint32_t t = 0; t < DAY_S; t++) timed.add((k * DAY_S + t) * 1000, day[t].hr, day[t].spo2);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  float sink = 0;
+  uint32_t snapshots = 200000;
+  for (uint32_t k = 0; k < snapshots; k++) sink += timed.hr.snapshot(rounds * DAY_S * 1000 + k).p50;
+  auto t2 = std::chrono::steady_clock::now();
+  double add_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / (rounds * DAY_S);
+  double snap_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / snapshots;
+
+  printf("memory: HR trend %zu B, SpO2 trend %zu B, VitalsStats %zu B\n", sizeof(VitalTrend<VITALS_HR_BINS>),
+         sizeof(VitalTrend<VITALS_SPO2_BINS>), sizeof(VitalsStats));
+  printf("cost: add (HR + SpO2) %.1f ns, HR snapshot %.1f ns (checksum %.0f)\n", add_ns, snap_ns, fmodf(sink, 1000));
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
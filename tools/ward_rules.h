@@ -0,0 +1,441 @@
+#pragma once
+// Batch rule evaluation for a whole ward on the gateway (Linux only).
+//
+// The rule text and its meaning are rule_engine.h's: a rule is active once
+// its conditions have held for for_ms, and the active rules of a patient's
+// top severity alert at most once per cooldown_ms. RuleEngine keeps that per
+// patient as one object; here it is kept per rule across patients, as
+// structure of arrays:
+//
+//   metrics     one float column per RuleMetric, written by the ingest
+//   thresholds  the compiled value per condition, or a column of them once
+//               any patient has their own (setThreshold())
+//   timers      since_ms and last_alert_ms columns per rule
+//   flags       holding / alerted bit words per rule, 64 patients a word
+//
+// A tick goes one word of 64 patients at a time. Each condition is a sweep
+// of its metric column against its threshold into a 64-bit word (with AVX2,
+// eight compares and movemasks), each rule ANDs its condition words, and the
+// timer columns are only read for the words where some patient's rule holds.
+// The results are bit words as well: active() and alerts() per rule, and
+// result() for one patient. The path is chosen at compile time as in
+// imu_kernels.h (-mavx2 or scalar); both give RuleEngine's bits exactly.
+//
+// A WardRules is one shard and belongs to one thread. WardShards splits a ward
+// into shards of whole words, one per worker thread. Each worker allocates its
+// own shard (first touch places the pages near it) and is the only thread
+// that writes it. A NaN metric satisfies no condition; padding patients are
+// NaN.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include "../rule_engine.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WARD_RULES_AVX2 1
+#endif
+
+#define WARD_WORD 64  // patients per bit word
+
+// Columns start on a cache line
+template <typename T>
+struct WardAllocator {
+  typedef T value_type;
+  WardAllocator() = default;
+  template <typename U>
+  WardAllocator(const WardAllocator<U>&) {}
+  T* allocate(size_t n) {
+    void* p = aligned_alloc(64, (n * sizeof(T) + 63) / 64 * 64);
+    if (!p) throw std::bad_alloc();
+    return (T*)p;
+  }
+  void deallocate(T* p, size_t) { free(p); }
+  template <typename U>
+  bool operator==(const WardAllocator<U>&) const { return true; }
+  template <typename U>
+  bool operator!=(const WardAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using WardColumn = std::vector<T, WardAllocator<T>>;
+
+// ---- Kernels over one word of patients ----
+
+// Bit i set when v[i] <accept> threshold (t[i] when per patient, else t0),
+// with RuleEngine's comparison outcome bits
+static inline uint64_t wardCompareScalar(const float* v, const float* t, float t0, uint8_t accept) {
+  uint64_t bits = 0;
+  for (int i = 0; i < WARD_WORD; i++) {
+    float th = t ? t[i] : t0;
+    uint8_t outcome = (v[i] > th) | ((v[i] < th) << 1) | ((v[i] == th) << 2);
+    bits |= (uint64_t)((outcome & accept) != 0) << i;
+  }
+  return bits;
+}
+
+// Bit i set when now_ms - t[i] > limit, unsigned like the millis() arithmetic
+static inline uint64_t wardElapsedOverScalar(const uint32_t* t, uint32_t now_ms, uint32_t limit) {
+  uint64_t bits = 0;
+  for (int i = 0; i < WARD_WORD; i++) bits |= (uint64_t)(now_ms - t[i] > limit) << i;
+  return bits;
+}
+
+#if defined(WARD_RULES_AVX2)
+
+// The ordered predicates are false for NaN, as the scalar compares are
+template <int PREDICATE, bool PER_PATIENT>
+static inline uint64_t wardCompareAVX2(const float* v, const float* t, float t0) {
+  uint64_t bits = 0;
+  __m256 th = _mm256_set1_ps(t0);
+  for (int j = 0; j < WARD_WORD / 8; j++) {
+    if (PER_PATIENT) th = _mm256_load_ps(t + 8 * j);
+    __m256 hit = _mm256_cmp_ps(_mm256_load_ps(v + 8 * j), th, PREDICATE);
+    bits |= (uint64_t)(uint32_t)_mm256_movemask_ps(hit) << (8 * j);
+  }
+  return bits;
+}
+
+template <bool PER_PATIENT>
+static inline uint64_t wardCompareAVX2(const float* v, const float* t, float t0, uint8_t accept) {
+  switch (accept) {
+    case RULE_GT: return wardCompareAVX2<_CMP_GT_OQ, PER_PATIENT>(v, t, t0);
+    case RULE_LT: return wardCompareAVX2<_CMP_LT_OQ, PER_PATIENT>(v, t, t0);
+    case RULE_GE: return wardCompareAVX2<_CMP_GE_OQ, PER_PATIENT>(v, t, t0);
+    case RULE_LE: return wardCompareAVX2<_CMP_LE_OQ, PER_PATIENT>(v, t, t0);
+  }
+  return wardCompareScalar(v, t, t0, accept);
+}
+
+// Unsigned compare through the signed one on biased values
+static inline uint64_t wardElapsedOverAVX2(const uint32_t* t, uint32_t now_ms, uint32_t limit) {
+  const __m256i bias = _mm256_set1_epi32((int)0x80000000u);
+  const __m256i now = _mm256_set1_epi32((int)now_ms);
+  const __m256i over = _mm256_xor_si256(_mm256_set1_epi32((int)limit), bias);
+  uint64_t bits = 0;
+  for (int j = 0; j < WARD_WORD / 8; j++) {
+    __m256i d = _mm256_sub_epi32(now, _mm256_load_si256((const __m256i*)(t + 8 * j)));
+    __m256i hit = _mm256_cmpgt_epi32(_mm256_xor_si256(d, bias), over);
+    bits |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(hit)) << (8 * j);
+  }
+  return bits;
+}
+
+#endif
+
+static inline uint64_t wardCompare(const float* v, const float* t, float t0, uint8_t accept) {
+#if defined(WARD_RULES_AVX2)
+  return t ? wardCompareAVX2<true>(v, t, t0, accept) : wardCompareAVX2<false>(v, t, t0, accept);
+#else
+  return wardCompareScalar(v, t, t0, accept);
+#endif
+}
+
+static inline uint64_t wardElapsedOver(const uint32_t* t, uint32_t now_ms, uint32_t limit) {
+#if defined(WARD_RULES_AVX2)
+  return wardElapsedOverAVX2(t, now_ms, limit);
+#else
+  return wardElapsedOverScalar(t, now_ms, limit);
+#endif
+}
+
+static inline const char* wardKernelName() {
+#if defined(WARD_RULES_AVX2)
+  return "avx2";
+#else
+  return "scalar";
+#endif
+}
+
+// t[i] = now_ms for the set bits; few, as they are edges
+static inline void wardStamp(uint32_t* t, uint64_t bits, uint32_t now_ms) {
+  for (; bits; bits &= bits - 1) t[__builtin_ctzll(bits)] = now_ms;
+}
+
+// ---- One shard ----
+
+class alignas(64) WardRules {
+public:
+  // Room for `patients`, rounded up to whole words. No rules until load().
+  void begin(uint32_t patients) {
+    count = patients;
+    words = (patients + WARD_WORD - 1) / WARD_WORD;
+    memset(&set, 0, sizeof(set));
+    for (int m = 0; m < METRIC_COUNT; m++) metrics[m].assign(padded(), NAN);
+    for (int c = 0; c < RULE_MAX_CONDITIONS; c++) WardColumn<float>().swap(personal[c]);
+    for (int r = 0; r < RULE_MAX_RULES; r++) RuleColumns().swap(state[r]);
+  }
+
+  // Compile and apply between ticks. As in RuleEngine, rules that keep their
+  // label keep their timers. Per-patient thresholds are dropped, as
+  // condition numbers change with the text; set them again afterwards.
+  bool load(const char* text, char* error, size_t error_len) {
+    std::unique_ptr<RuleSet> next(new RuleSet);
+    if (!compileRules(text, *next, error, error_len)) return false;
+    std::unique_ptr<RuleColumns[]> carried(new RuleColumns[RULE_MAX_RULES]);
+    for (int i = 0; i < next->rule_count; i++) {
+      int old = -1;
+      for (int j = 0; j < set.rule_count && old < 0; j++) {
+        if (strcmp(next->rules[i].label, set.rules[j].label) == 0) old = j;
+      }
+      if (old >= 0) carried[i] = state[old];
+      else carried[i].reset(padded(), words);
+    }
+    for (int r = 0; r < RULE_MAX_RULES; r++) state[r].swap(carried[r]);
+    for (int c = 0; c < RULE_MAX_CONDITIONS; c++) WardColumn<float>().swap(personal[c]);
+    set = *next;
+    return true;
+  }
+
+  uint32_t patients() const { return count; }
+  const RuleSet& rules() const { return set; }
+
+  // Metric column, one float per patient (padded() long)
+  float* metric(int m) { return metrics[m].data(); }
+
+  // This patient's own threshold for a condition of the loaded rules
+  void setThreshold(uint32_t patient, int condition, float value) {
+    WardColumn<float>& column = personal[condition];
+    if (column.empty()) column.assign(padded(), set.conditions[condition].threshold);
+    column[patient] = value;
+  }
+
+  float threshold(uint32_t patient, int condition) const {
+    const WardColumn<float>& column = personal[condition];
+    return column.empty() ? set.conditions[condition].threshold : column[patient];
+  }
+
+  void evaluate(uint32_t now_ms) {
+    uint64_t cond[RULE_MAX_CONDITIONS];
+    uint64_t active[RULE_MAX_RULES];
+    for (uint32_t w = 0; w < words; w++) {
+      size_t base = (size_t)w * WARD_WORD;
+
+      for (int c = 0; c < set.condition_count; c++) {
+        const RuleCondition& rc = set.conditions[c];
+        const float* t = personal[c].empty() ? NULL : &personal[c][base];
+        cond[c] = wardCompare(&metrics[rc.metric][base], t, rc.threshold, rc.accept);
+      }
+
+      // Hold times; active patients per severity
+      uint64_t level[ALERT_PRIORITY_COUNT] = {};
+      for (int r = 0; r < set.rule_count; r++) {
+        const Rule& rule = set.rules[r];
+        RuleColumns& st = state[r];
+        uint64_t holds = ~0ULL;
+        for (uint64_t m = rule.mask; m; m &= m - 1) holds &= cond[__builtin_ctzll(m)];
+        wardStamp(&st.since_ms[base], holds & ~st.holding[w], now_ms);
+        st.holding[w] = holds;
+        if (holds && rule.for_ms) holds &= wardElapsedOver(&st.since_ms[base], now_ms, rule.for_ms - 1);
+        active[r] = holds;
+        level[rule.severity] |= holds;
+      }
+
+      // Each patient's top severity only
+      uint64_t higher = 0;
+      for (int s = 0; s < ALERT_PRIORITY_COUNT; s++) {
+        uint64_t here = level[s] & ~higher;
+        higher |= level[s];
+        level[s] = here;
+      }
+
+      // Cooldowns
+      for (int r = 0; r < set.rule_count; r++) {
+        const Rule& rule = set.rules[r];
+        RuleColumns& st = state[r];
+        uint64_t due = active[r] & level[rule.severity];
+        uint64_t recent = due & st.alerted[w];
+        if (recent) due &= ~recent | wardElapsedOver(&st.last_alert_ms[base], now_ms, rule.cooldown_ms);
+        wardStamp(&st.last_alert_ms[base], due, now_ms);
+        st.alerted[w] |= due;
+        st.active[w] = active[r];
+        st.alerts[w] = due;
+      }
+    }
+  }
+
+  // Bit words from the last evaluate(), wordCount() of them; bit i of word w
+  // is patient 64 w + i
+  uint32_t wordCount() const { return words; }
+  const uint64_t* active(int rule) const { return state[rule].active.data(); }
+  const uint64_t* alerts(int rule) const { return state[rule].alerts.data(); }
+
+  // One patient's outcome of the last evaluate(), as RuleEngine returns it
+  RuleResult result(uint32_t patient) const {
+    RuleResult out = {-1, 0, 0};
+    uint32_t w = patient / WARD_WORD;
+    uint64_t bit = 1ULL << (patient % WARD_WORD);
+    for (int r = 0; r < set.rule_count; r++) {
+      if (!(state[r].active[w] & bit)) continue;
+      out.active |= 1UL << r;
+      if (out.top_severity < 0 || set.rules[r].severity < out.top_severity) out.top_severity = set.rules[r].severity;
+      if (state[r].alerts[w] & bit) out.alerts |= 1UL << r;
+    }
+    return out;
+  }
+
+  size_t padded() const { return (size_t)words * WARD_WORD; }
+
+  size_t bytes() const {
+    size_t n = sizeof(*this);
+    for (int m = 0; m < METRIC_COUNT; m++) n += metrics[m].capacity() * sizeof(float);
+    for (int c = 0; c < RULE_MAX_CONDITIONS; c++) n += personal[c].capacity() * sizeof(float);
+    for (int r = 0; r < RULE_MAX_RULES; r++) n += state[r].bytes();
+    return n;
+  }
+
+private:
+  struct RuleColumns {
+    WardColumn<uint32_t> since_ms;
+    WardColumn<uint32_t> last_alert_ms;
+    WardColumn<uint64_t> holding;
+    WardColumn<uint64_t> alerted;
+    WardColumn<uint64_t> active;
+    WardColumn<uint64_t> alerts;
+
+    void reset(size_t patients, size_t words) {
+      since_ms.assign(patients, 0);
+      last_alert_ms.assign(patients, 0);
+      holding.assign(words, 0);
+      alerted.assign(words, 0);
+      active.assign(words, 0);
+      alerts.assign(words, 0);
+    }
+
+    void swap(RuleColumns& o) {
+      since_ms.swap(o.since_ms);
+      last_alert_ms.swap(o.last_alert_ms);
+      holding.swap(o.holding);
+      alerted.swap(o.alerted);
+      active.swap(o.active);
+      alerts.swap(o.alerts);
+    }
+
+    size_t bytes() const {
+      return (since_ms.capacity() + last_alert_ms.capacity()) * sizeof(uint32_t) +
+             (holding.capacity() + alerted.capacity() + active.capacity() + alerts.capacity()) * sizeof(uint64_t);
+    }
+  };
+
+  RuleSet set;
+  uint32_t count = 0;
+  uint32_t words = 0;
+  WardColumn<float> metrics[METRIC_COUNT];
+  WardColumn<float> personal[RULE_MAX_CONDITIONS];  // empty: the compiled threshold
+  RuleColumns state[RULE_MAX_RULES];
+};
+
+// ---- Shards on worker threads ----
+
+class WardShards {
+public:
+  ~WardShards() { stop(); }
+
+  // `patients` split into `threads` shards of whole words, each allocated by
+  // its own worker. With `pin`, worker i runs on CPU i (mod the CPU count).
+  void begin(uint32_t patients, int threads, bool pin) {
+    stop();
+    uint32_t words = (patients + WARD_WORD - 1) / WARD_WORD;
+    if (threads < 1) threads = 1;
+    if ((uint32_t)threads > words) threads = words ? words : 1;
+    shards.clear();
+    firsts.clear();
+    sizes.clear();
+    for (int i = 0; i < threads; i++) {
+      uint32_t w0 = (uint64_t)words * i / threads, w1 = (uint64_t)words * (i + 1) / threads;
+      uint32_t first = w0 * WARD_WORD;
+      uint32_t last = w1 * WARD_WORD < patients ? w1 * WARD_WORD : patients;
+      firsts.push_back(first);
+      sizes.push_back(last - first);
+      shards.emplace_back(new WardRules);
+    }
+    generation = 0;
+    pending = 0;
+    quit = false;
+    int cpus = (int)std::thread::hardware_concurrency();
+    for (int i = 0; i < threads; i++) {
+      workers.emplace_back([this, i] { work(i); });
+      if (pin && cpus > 0) {
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(i % cpus, &cpu);
+        pthread_setaffinity_np(workers.back().native_handle(), sizeof(cpu), &cpu);
+      }
+    }
+    run([this](WardRules& shard, int i) { shard.begin(sizes[i]); });
+  }
+
+  // fn(shard, index) on every shard's own worker; returns when all are done
+  void run(const std::function<void(WardRules&, int)>& fn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    job = &fn;
+    pending = (int)shards.size();
+    generation++;
+    wake.notify_all();
+    done.wait(lock, [this] { return pending == 0; });
+    job = NULL;
+  }
+
+  int count() const { return (int)shards.size(); }
+  WardRules& shard(int i) { return *shards[i]; }
+  uint32_t first(int i) const { return firsts[i]; }
+
+  // Shard and index within it of a ward patient
+  WardRules& locate(uint32_t patient, uint32_t& local) {
+    int i = count() - 1;
+    while (i > 0 && firsts[i] > patient) i--;
+    local = patient - firsts[i];
+    return *shards[i];
+  }
+
+private:
+  std::vector<std::unique_ptr<WardRules>> shards;
+  std::vector<uint32_t> firsts;
+  std::vector<uint32_t> sizes;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(WardRules&, int)>* job = NULL;
+  uint64_t generation = 0;
+  int pending = 0;
+  bool quit = false;
+
+  void work(int i) {
+    uint64_t seen = 0;
+    for (;;) {
+      const std::function<void(WardRules&, int)>* fn;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return quit || generation != seen; });
+        if (quit) return;
+        seen = generation;
+        fn = job;
+      }
+      (*fn)(*shards[i], i);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending == 0) done.notify_one();
+    }
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+      wake.notify_all();
+    }
+    for (std::thread& t : workers) t.join();
+    workers.clear();
+  }
+};
@@ -0,0 +1,360 @@
+// Host check and benchmark for tools/ward_rules.h.
+//
+// Cross-check: a ward of 4037 simulated patients (not a whole number of
+// words) over 2 h of 1 Hz ticks, with missed ticks, sensor dropouts (NaN),
+// episodes of tachycardia, desaturation and motion, one patient in eight on
+// their own HR limits, and a rule reload half way. Each patient also runs
+// its own RuleEngine from rule_engine.h, loaded with the same text and the
+// same limits. Every tick, active rules, alerts and top severity must match
+// for every patient. The ward runs as three shards to cover the split.
+//
+// Throughput: --patients (100000) on --threads shards (one per CPU), with
+// the same synthetic vitals written each tick. Reports the time per tick to
+// evaluate the whole ward and ns per patient-tick, next to a loop over one
+// RuleEngine per patient for the first --baseline (20000) patients.
+//
+//   g++ -O2 -std=c++17 -mavx2 -pthread -o ward_rules_bench tools/ward_rules_bench.cpp
+//   g++ -O2 -std=c++17 -pthread -o ward_rules_bench tools/ward_rules_bench.cpp   (scalar)
+//   ./ward_rules_bench [--patients N] [--threads N] [--ticks N] [--baseline N] [--pin]
+//
+// Exit status is non-zero on any mismatch, if the cross-check raised no
+// alerts at all, or if a tick of the full ward takes a second or more.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "ward_rules.h"
+
+// combinedsense.cpp's defaultRules() with HR limits as parameters, plus a
+// held rule so the for_ms timers are covered
+static std::string wardRulesText(float tachy, float brady, float seizure_hr) {
+  char text[2048];
+  snprintf(text, sizeof(text),
+           "CRITICAL 60000 0 Extreme Tachycardia: hr > %.9g\n"
+           "CRITICAL 60000 0 Extreme Bradycardia: hr < %.9g & hr > 0\n"
+           "CRITICAL 60000 0 Severe Hypoxemia: spo2 < 85 & spo2 > 0\n"
+           "CRITICAL 60000 0 Violent Motion: accel > 5\n"
+           "CRITICAL 60000 0 Violent Rotation: gyro > 100\n"
+           "CRITICAL 60000 0 Prolonged Seizure Activity: motion_ms > 30000\n"
+           "SEIZURE 180000 0 High HR: hr > %.9g\n"
+           "SEIZURE 180000 0 Low SpO2: spo2 < 90 & spo2 > 0\n"
+           "SEIZURE 180000 0 Prolonged Motion: motion_ms > 10000\n"
+           "SEPSIS 300000 60000 Hypoxemia Held: spo2 < 95 & spo2 > 0\n"
+           "SEPSIS 300000 0 Tachycardia: hr_p50 > 100\n"
+           "SEPSIS 300000 0 HR Above Baseline: hr_dev > 15 & hr_cusum > 150\n"
+           "SEPSIS 300000 0 SpO2 Below Baseline: spo2_dev < -3 & spo2_cusum > 30\n",
+           tachy, brady, seizure_hr);
+  return text;
+}
+
+// After the reload: tighter tachycardia, one rule gone, one new
+static const char* RELOADED_RULES =
+    "CRITICAL 60000 0 Extreme Tachycardia: hr > 135\n"
+    "CRITICAL 60000 0 Extreme Bradycardia: hr < 50 & hr > 0\n"
+    "CRITICAL 60000 0 Severe Hypoxemia: spo2 < 85 & spo2 > 0\n"
+    "CRITICAL 60000 0 Violent Motion: accel > 5\n"
+    "CRITICAL 60000 0 Prolonged Seizure Activity: motion_ms > 30000\n"
+    "SEIZURE 120000 0 High HR: hr > 120\n"
+    "SEIZURE 180000 0 Low SpO2: spo2 < 90 & spo2 > 0\n"
+    "SEIZURE 180000 5000 Motion With Tachycardia: motion_ms > 5000 & hr >= 110\n"
+    "SEPSIS 300000 60000 Hypoxemia Held: spo2 < 95 & spo2 > 0\n"
+    "SEPSIS 300000 0 Tachycardia: hr_p50 > 100\n";
+
+static const float OWN_TACHY = 150, OWN_BRADY = 40, OWN_SEIZURE_HR = 130;
+
+static bool ownLimits(uint32_t p) { return p % 8 == 3; }
+
+// ---- Synthetic vitals ----
+
+static inline uint32_t xorshift(uint32_t& s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+static inline float uniform(uint32_t& s) { return (xorshift(s) >> 8) * (1.0f / 16777216.0f); }
+
+struct Patient {
+  uint32_t rng;
+  float hr_base, spo2_base;
+  int episode;       // 0 none, 1 tachycardia, 2 desaturation, 3 motion, 4 sensor off
+  uint32_t episode_left;
+  uint32_t motion_ms;
+  float drift;       // slow sepsis-like drift
+};
+
+static void initPatient(Patient& pt, uint32_t p) {
+  pt.rng = 2654435761u * (p + 1);
+  pt.hr_base = 60 + 30 * uniform(pt.rng);
+  pt.spo2_base = 95 + 4 * uniform(pt.rng);
+  pt.episode = 0;
+  pt.episode_left = 0;
+  pt.motion_ms = 0;
+  pt.drift = 0;
+}
+
+// One second of one patient into metrics[METRIC_COUNT]
+static void stepPatient(Patient& pt, float* m) {
+  if (pt.episode_left == 0) {
+    pt.episode = 0;
+    float u = uniform(pt.rng);
+    if (u < 0.004f) pt.episode = 1;
+    else if (u < 0.007f) pt.episode = 2;
+    else if (u < 0.010f) pt.episode = 3;
+    else if (u < 0.011f) pt.episode = 4;
+    if (pt.episode) pt.episode_left = 10 + xorshift(pt.rng) % 180;
+  }
+  if (pt.episode_left) pt.episode_left--;
+  if (uniform(pt.rng) < 0.0001f) pt.drift += 5;
+
+  float noise = uniform(pt.rng) - 0.5f;
+  float hr = pt.hr_base + pt.drift + 4 * noise;
+  float spo2 = pt.spo2_base - pt.drift / 10 + noise;
+  float accel = 1 + 0.1f * noise, gyro = 5 + 4 * noise;
+  switch (pt.episode) {
+    case 1: hr += 40 + 30 * uniform(pt.rng); break;
+    case 2: spo2 -= 5 + 12 * uniform(pt.rng); break;
+    case 3:
+      accel = 2 + 4 * uniform(pt.rng);
+      gyro = 40 + 80 * uniform(pt.rng);
+      hr += 25;
+      break;
+  }
+  // Integer readings now and then, so thresholds are hit exactly
+  if (xorshift(pt.rng) % 16 == 0) hr = (float)(int)hr;
+  pt.motion_ms = pt.episode == 3 ? pt.motion_ms + 1000 : 0;
+
+  m[METRIC_HR] = hr;
+  m[METRIC_SPO2] = spo2 > 100 ? 100 : spo2;
+  m[METRIC_ACCEL] = accel;
+  m[METRIC_GYRO] = gyro;
+  m[METRIC_MOTION_MS] = (float)pt.motion_ms;
+  m[METRIC_HR_P50] = pt.hr_base + pt.drift;
+  m[METRIC_HR_DEV] = pt.drift;
+  m[METRIC_HR_CUSUM] = pt.drift * 12;
+  m[METRIC_SPO2_P50] = pt.spo2_base - pt.drift / 10;
+  m[METRIC_SPO2_DEV] = -pt.drift / 6;
+  m[METRIC_SPO2_CUSUM] = pt.drift * 2;
+  if (pt.episode == 4) {
+    for (int k = 0; k < METRIC_COUNT; k++) m[k] = NAN;
+  }
+}
+
+static uint32_t argValue(int argc, char** argv, const char* name, uint32_t fallback) {
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], name) == 0) return (uint32_t)strtoul(argv[i + 1], NULL, 10);
+  }
+  return fallback;
+}
+
+static bool argFlag(int argc, char** argv, const char* name) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], name) == 0) return true;
+  }
+  return false;
+}
+
+// Per-patient limits on the ward for the HR conditions of the default text
+static void applyOwnLimits(WardShards& ward) {
+  ward.run([&](WardRules& shard, int i) {
+    const RuleSet& set = shard.rules();
+    for (uint32_t local = 0; local < shard.patients(); local++) {
+      if (!ownLimits(ward.first(i) + local)) continue;
+      for (int r = 0; r < set.rule_count; r++) {
+        const Rule& rule = set.rules[r];
+        int c = __builtin_ctzll(rule.mask);  // the first condition is the HR limit
+        if (strcmp(rule.label, "Extreme Tachycardia") == 0) shard.setThreshold(local, c, OWN_TACHY);
+        if (strcmp(rule.label, "Extreme Bradycardia") == 0) shard.setThreshold(local, c, OWN_BRADY);
+        if (strcmp(rule.label, "High HR") == 0) shard.setThreshold(local, c, OWN_SEIZURE_HR);
+      }
+    }
+  });
+}
+
+static int crossCheck() {
+  const uint32_t PATIENTS = 4037;
+  const uint32_t TICKS = 7200;
+  char error[RULE_ERROR_LEN];
+  std::string plain = wardRulesText(140, 50, 120);
+  std::string own = wardRulesText(OWN_TACHY, OWN_BRADY, OWN_SEIZURE_HR);
+
+  std::vector<RuleEngine> engines(PATIENTS);
+  std::vector<Patient> patients(PATIENTS);
+  for (uint32_t p = 0; p < PATIENTS; p++) {
+    initPatient(patients[p], p);
+    if (!engines[p].load((ownLimits(p) ? own : plain).c_str(), error, sizeof(error))) {
+      printf("FAIL: reference rules rejected: %s\n", error);
+      return 1;
+    }
+  }
+
+  WardShards ward;
+  ward.begin(PATIENTS, 3, false);
+  bool loaded = true;
+  ward.run([&](WardRules& shard, int) {
+    char e[RULE_ERROR_LEN];
+    if (!shard.load(plain.c_str(), e, sizeof(e))) loaded = false;
+  });
+  if (!loaded) {
+    printf("FAIL: ward rules rejected\n");
+    return 1;
+  }
+  applyOwnLimits(ward);
+
+  uint64_t mismatches = 0, alerts = 0, active = 0;
+  uint32_t now_ms = 1000;
+  float m[METRIC_COUNT];
+  for (int k = 0; k < METRIC_COUNT; k++) m[k] = 0;
+  for (uint32_t tick = 0; tick < TICKS; tick++) {
+    if (tick == TICKS / 2) {
+      for (uint32_t p = 0; p < PATIENTS; p++) engines[p].load(RELOADED_RULES, error, sizeof(error));
+      ward.run([&](WardRules& shard, int) { shard.load(RELOADED_RULES, error, sizeof(error)); });
+    }
+    // Missed ticks now and then, some of them long
+    now_ms += tick % 97 == 0 ? 61000 : tick % 13 == 0 ? 2000 : 1000;
+
+    for (uint32_t p = 0; p < PATIENTS; p++) {
+      stepPatient(patients[p], m);
+      uint32_t local;
+      WardRules& shard = ward.locate(p, local);
+      for (int k = 0; k < METRIC_COUNT; k++) shard.metric(k)[local] = m[k];
+    }
+    ward.run([&](WardRules& shard, int) { shard.evaluate(now_ms); });
+
+    for (uint32_t p = 0; p < PATIENTS; p++) {
+      float* col[METRIC_COUNT];
+      uint32_t local;
+      WardRules& shard = ward.locate(p, local);
+      for (int k = 0; k < METRIC_COUNT; k++) {
+        col[k] = shard.metric(k);
+        m[k] = col[k][local];
+      }
+      RuleResult want = engines[p].evaluate(m, now_ms);
+      RuleResult got = shard.result(local);
+      if (want.top_severity != got.top_severity || want.active != got.active || want.alerts != got.alerts) {
+        if (mismatches < 5) {
+          printf("MISMATCH: patient %u tick %u: engine top %d active %08x alerts %08x, ward top %d active %08x alerts %08x\n",
+                 p, tick, want.top_severity, (unsigned)want.active, (unsigned)want.alerts, got.top_severity,
+                 (unsigned)got.active, (unsigned)got.alerts);
+        }
+        mismatches++;
+      }
+      alerts += __builtin_popcount(want.alerts);
+      active += __builtin_popcount(want.active);
+    }
+  }
+  printf("cross-check (%s): %u patients x %u ticks in 3 shards, reload at tick %u: %llu alerts, %llu active "
+         "rule-ticks, %llu mismatches\n",
+         wardKernelName(), PATIENTS, TICKS, TICKS / 2, (unsigned long long)alerts, (unsigned long long)active,
+         (unsigned long long)mismatches);
+  if (mismatches) return 1;
+  if (alerts == 0) {
+    printf("FAIL: the cross-check raised no alerts\n");
+    return 1;
+  }
+  return 0;
+}
+
+static double percentile(std::vector<double> v, double q) {
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(q * (v.size() - 1))];
+}
+
+int main(int argc, char** argv) {
+  int failures = crossCheck();
+
+  uint32_t patients = argValue(argc, argv, "--patients", 100000);
+  int threads = (int)argValue(argc, argv, "--threads", std::max(1u, std::thread::hardware_concurrency()));
+  uint32_t ticks = argValue(argc, argv, "--ticks", 60);
+  uint32_t baseline = std::min(patients, argValue(argc, argv, "--baseline", 20000));
+  bool pin = argFlag(argc, argv, "--pin");
+  std::string plain = wardRulesText(140, 50, 120);
+
+  WardShards ward;
+  ward.begin(patients, threads, pin);
+  std::vector<std::vector<Patient>> sims(ward.count());
+  ward.run([&](WardRules& shard, int i) {
+    char e[RULE_ERROR_LEN];
+    shard.load(plain.c_str(), e, sizeof(e));
+    sims[i].resize(shard.patients());
+    for (uint32_t local = 0; local < shard.patients(); local++) initPatient(sims[i][local], ward.first(i) + local);
+  });
+  applyOwnLimits(ward);
+  size_t bytes = 0;
+  for (int i = 0; i < ward.count(); i++) bytes += ward.shard(i).bytes();
+
+  std::vector<double> ingest_ms, eval_ms;
+  uint64_t alerts = 0;
+  uint32_t now_ms = 1000;
+  for (uint32_t tick = 0; tick < ticks; tick++) {
+    now_ms += 1000;
+    auto t0 = std::chrono::steady_clock::now();
+    ward.run([&](WardRules& shard, int i) {
+      float m[METRIC_COUNT];
+      for (uint32_t local = 0; local < shard.patients(); local++) {
+        stepPatient(sims[i][local], m);
+        for (int k = 0; k < METRIC_COUNT; k++) shard.metric(k)[local] = m[k];
+      }
+    });
+    auto t1 = std::chrono::steady_clock::now();
+    ward.run([&](WardRules& shard, int) { shard.evaluate(now_ms); });
+    auto t2 = std::chrono::steady_clock::now();
+    ingest_ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    eval_ms.push_back(std::chrono::duration<double, std::milli>(t2 - t1).count());
+    for (int i = 0; i < ward.count(); i++) {
+      const WardRules& shard = ward.shard(i);
+      for (int r = 0; r < shard.rules().rule_count; r++) {
+        for (uint32_t w = 0; w < shard.wordCount(); w++) alerts += __builtin_popcountll(shard.alerts(r)[w]);
+      }
+    }
+  }
+  double p50 = percentile(eval_ms, 0.5), p99 = percentile(eval_ms, 0.99);
+  double worst = *std::max_element(eval_ms.begin(), eval_ms.end());
+  printf("\nward (%s): %u patients, %d shards%s, %u ticks, %.1f MB\n", wardKernelName(), patients, ward.count(),
+         pin ? " pinned" : "", ticks, bytes / 1e6);
+  printf("  evaluate per tick: p50 %.2f ms  p99 %.2f ms  max %.2f ms  (%.1f ns per patient-tick, %.0fx headroom at 1 Hz)\n",
+         p50, p99, worst, p50 * 1e6 / patients, 1000 / worst);
+  printf("  ingest per tick:   p50 %.2f ms (synthetic vitals, all %d metrics)\n", percentile(ingest_ms, 0.5),
+         METRIC_COUNT);
+  printf("  %llu alerts raised\n", (unsigned long long)alerts);
+  if (worst >= 1000) {
+    printf("FAIL: a tick took %.0f ms, over the 1 Hz budget\n", worst);
+    failures++;
+  }
+
+  // Baseline: one RuleEngine per patient, a loop over the objects
+  if (baseline) {
+    std::vector<RuleEngine> engines(baseline);
+    std::vector<Patient> sim(baseline);
+    std::vector<float> m((size_t)baseline * METRIC_COUNT);
+    char e[RULE_ERROR_LEN];
+    for (uint32_t p = 0; p < baseline; p++) {
+      initPatient(sim[p], p);
+      engines[p].load(plain.c_str(), e, sizeof(e));
+    }
+    std::vector<double> base_ms;
+    uint64_t sink = 0;
+    now_ms = 1000;
+    for (uint32_t tick = 0; tick < ticks; tick++) {
+      now_ms += 1000;
+      for (uint32_t p = 0; p < baseline; p++) stepPatient(sim[p], &m[(size_t)p * METRIC_COUNT]);
+      auto t0 = std::chrono::steady_clock::now();
+      for (uint32_t p = 0; p < baseline; p++) sink += engines[p].evaluate(&m[(size_t)p * METRIC_COUNT], now_ms).alerts;
+      base_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    }
+    double b50 = percentile(base_ms, 0.5);
+    printf("\nbaseline: RuleEngine per patient, %u patients, 1 thread, %.1f MB: p50 %.2f ms per tick "
+           "(%.1f ns per patient-tick)%s\n",
+           baseline, baseline * sizeof(RuleEngine) / 1e6, b50, b50 * 1e6 / baseline, sink == 1 ? " " : "");
+    printf("  ward per patient-tick on %d shard(s): %.1fx faster\n", ward.count(),
+           (b50 / baseline) / (p50 / patients));
+  }
+
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+// Host check and benchmark for window_ops.h.
+//
+// Randomized check: thousands of streams with random windows (50 ms to
+// 60 s), rates, jitter, repeated timestamps, gaps longer than the window,
+// start times just before the millis() wrap, and values that are random,
+// tied, ramping up or down, or constant. After every sample, and at random
+// times between samples, WindowMin, WindowMax, WindowSum and TimeSinceTrue
+// must agree with a brute-force pass over every sample kept so far (minima
+// and maxima exactly; sums to within 64 float epsilons of the magnitudes the
+// running sum has taken in and given back since it was last re-added, i.e.
+// the last 2 * N samples). Rings are sized so they never fill; a separate
+// case overfills one and expects it counted.
+//
+// Benchmark: per sample plus query cost of each operator with the windows and
+// rates combinedsense.cpp uses, next to a scan of the same window, and one
+// simulated second of the sketch's windows (100 pulse oximeter samples, 20 MPU
+// blocks, 100 rule evaluations).
+//
+//   g++ -O2 -std=c++17 -o window_ops_bench tools/window_ops_bench.cpp
+//   ./window_ops_bench [--streams N] [--seed S]
+//
+// Exit status is non-zero on any mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <chrono>
+#include <vector>
+#include "../window_ops.h"
+
+static inline uint32_t xorshift(uint32_t& s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+static inline float uniform(uint32_t& s) { return (xorshift(s) >> 8) * (1.0f / 16777216.0f); }
+
+struct Sample {
+  uint32_t t;
+  float v;
+  float w;
+};
+
+enum ValueMode { VALUES_RANDOM, VALUES_TIED, VALUES_UP, VALUES_DOWN, VALUES_CONSTANT, VALUES_MODES };
+
+static const uint16_t RING = 512;
+
+struct Reference {
+  bool any;
+  float min, max;
+  double sum, weight;
+};
+
+static Reference brute(const std::vector<Sample>& all, uint32_t now, uint32_t window) {
+  Reference r = {false, 0, 0, 0, 0};
+  for (const Sample& s : all) {
+    if (now - s.t >= window) continue;
+    if (!r.any || s.v < r.min) r.min = s.v;
+    if (!r.any || s.v > r.max) r.max = s.v;
+    r.any = true;
+    r.sum += s.v;
+    r.weight += s.w;
+  }
+  return r;
+}
+
+// One random stream; returns mismatches
+static int checkStream(uint32_t& rng, int stream, uint64_t& queries) {
+  uint32_t window = 50 + xorshift(rng) % 60000;
+  // Keep under RING samples per window even with repeated timestamps
+  uint32_t period = window / (RING / 4) + 1 + xorshift(rng) % (window / 8 + 1);
+  uint32_t t = xorshift(rng) % 4 ? xorshift(rng) : UINT32_MAX - xorshift(rng) % (20 * window + 1);
+  int mode = xorshift(rng) % VALUES_MODES;
+  int samples = 50 + xorshift(rng) % 1500;
+  float threshold = 0.7f;
+
+  WindowMin<RING> wmin;
+  WindowMax<RING> wmax;
+  WindowSum<RING> wsum;
+  TimeSinceTrue since;
+  wmin.begin(window);
+  wmax.begin(window);
+  wsum.begin(window);
+  since.begin();
+
+  std::vector<Sample> all;
+  bool seen = false, holding = false;
+  uint32_t last_true = 0, true_from = 0;
+  float ramp = 0;
+  int mismatches = 0;
+
+  auto check = [&](uint32_t now, const char* where) {
+    queries++;
+    Reference r = brute(all, now, window);
+    float mn = wmin.value(now, NAN), mx = wmax.value(now, NAN);
+    float sum = wsum.sum(now), weight = wsum.weight(now);
+    bool ok = r.any ? (mn == r.min && mx == r.max) : (isnan(mn) && isnan(mx));
+    double recent = 0;
+    for (size_t k = all.size() > 2 * RING ? all.size() - 2 * RING : 0; k < all.size(); k++) recent += fabs(all[k].v);
+    double tol = 64 * FLT_EPSILON * recent + 1e-6;
+    ok = ok && fabs(sum - r.sum) <= tol && fabs(weight - r.weight) <= 1e-4 * (r.weight + 1);
+    uint32_t expect_since = !seen ? UINT32_MAX : holding ? 0 : now - last_true;
+    uint32_t expect_held = holding ? now - true_from : 0;
+    ok = ok && since.since(now) == expect_since && since.heldFor(now) == expect_held;
+    ok = ok && wmin.overflows() == 0 && wmax.overflows() == 0 && wsum.overflows() == 0;
+    if (!ok && mismatches++ < 3) {
+      printf("  stream %d (%s, window %u, mode %d): min %g/%g max %g/%g sum %g/%g weight %g/%g since %u/%u\n",
+             stream, where, window, mode, mn, r.min, mx, r.max, sum, r.sum, weight, r.weight, since.since(now),
+             expect_since);
+    }
+  };
+
+  for (int i = 0; i < samples; i++) {
+    // Mostly steady, sometimes the same millisecond, sometimes a long gap
+    uint32_t r = xorshift(rng) % 100;
+    if (r < 5) t += 0;
+    else if (r < 8) t += window + xorshift(rng) % (2 * window);
+    else t += period / 2 + xorshift(rng) % (period + 1);
+
+    float v;
+    switch (mode) {
+      case VALUES_RANDOM: v = uniform(rng) * 200 - 50; break;
+      case VALUES_TIED: v = (float)(xorshift(rng) % 4); break;
+      case VALUES_UP: v = ramp += uniform(rng); break;
+      case VALUES_DOWN: v = ramp -= uniform(rng); break;
+      default: v = 42; break;
+    }
+    float w = xorshift(rng) % 3 ? 1.0f : (float)(1 + xorshift(rng) % 8);
+    wmin.add(t, v);
+    wmax.add(t, v);
+    wsum.add(t, v, w);
+    all.push_back({t, v, w});
+
+    bool cond = mode == VALUES_TIED ? v >= 2 : uniform(rng) > threshold;
+    since.add(t, cond);
+    if (cond) {
+      if (!holding) true_from = t;
+      last_true = t;
+      seen = true;
+    }
+    holding = cond;
+    check(t, "after a sample");
+
+    // A query between samples, as a rule evaluation would make
+    if (xorshift(rng) % 4 == 0) {
+      t += xorshift(rng) % (xorshift(rng) % 8 ? period + 1 : 2 * window + 1);
+      check(t, "between samples");
+    }
+  }
+  return mismatches;
+}
+
+template <typename F>
+static double nsPer(int n, F f) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++) f(i);
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / n;
+}
+
+static volatile float sink;
+
+int main(int argc, char** argv) {
+  int streams = 4000;
+  uint32_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--streams") == 0) streams = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--seed") == 0) seed = strtoul(argv[i + 1], NULL, 10);
+    else {
+      fprintf(stderr, "usage: window_ops_bench [--streams N] [--seed S]\n");
+      return 2;
+    }
+  }
+  int failures = 0;
+
+  // ---- Randomized check ----
+  uint32_t rng = seed * 2654435761u + 1;
+  int mismatches = 0;
+  uint64_t queries = 0;
+  for (int s = 0; s < streams; s++) mismatches += checkStream(rng, s, queries);
+  printf("randomized: %d streams, %llu queries against brute force, %d mismatches\n", streams,
+         (unsigned long long)queries, mismatches);
+  if (mismatches) failures++;
+
+  // A ring that is too small drops its oldest entries and says so
+  {
+    WindowSum<16> small;
+    WindowMax<16> falling;
+    small.begin(1000);
+    falling.begin(1000);
+    for (uint32_t t = 0; t < 100; t++) {
+      small.add(t, 1);
+      falling.add(t, 100.0f - t);
+    }
+    bool ok = small.overflows() == 84 && small.size() == 16 && small.sum(99) == 16 && falling.overflows() == 84 &&
+              falling.value(99) == 16;
+    printf("overfilled ring: %u and %u entries dropped, window narrowed to the last 16: %s\n", small.overflows(),
+           falling.overflows(), ok ? "ok" : "MISMATCH");
+    if (!ok) failures++;
+  }
+
+  // ---- Benchmark ----
+  // SpO2-like random walk at 100 Hz, 20 s window
+  const int n = 2000000;
+  std::vector<float> walk(n);
+  float x = 96;
+  for (int i = 0; i < n; i++) {
+    x += (uniform(rng) - 0.5f) * 0.4f;
+    if (x < 85) x = 85;
+    if (x > 100) x = 100;
+    walk[i] = roundf(x);
+  }
+  static WindowMin<64> spo2_min;
+  spo2_min.begin(20000);
+  double deque_ns = nsPer(n, [&](int i) {
+    spo2_min.add(i * 10, walk[i]);
+    sink = spo2_min.value(i * 10);
+  });
+  // The same by scanning a ring of the last 20 s
+  static float ring[2048];
+  double scan_ns = nsPer(n / 20, [&](int i) {
+    ring[i & 2047] = walk[i];
+    float m = ring[i & 2047];
+    int count = i < 2000 ? i + 1 : 2000;
+    for (int k = 0; k < count; k++) m = fminf(m, ring[(i - k) & 2047]);
+    sink = m;
+  });
+  printf("spo2 min over 20 s at 100 Hz: %.1f ns per sample + query (deque of 64, %u dropped), %.0f ns scanning "
+         "the window\n",
+         deque_ns, spo2_min.overflows(), scan_ns);
+
+  static WindowSum<256> gyro_sq;
+  static WindowMax<256> gyro_peak;
+  gyro_sq.begin(10000);
+  gyro_peak.begin(10000);
+  double sum_ns = nsPer(n, [&](int i) {
+    float rms = 20 + 200 * fabsf(sinf(i * 0.01f));
+    gyro_sq.add(i * 50, rms * rms * 5, 5);
+    sink = sqrtf(gyro_sq.mean(i * 50));
+  });
+  double peak_ns = nsPer(n, [&](int i) {
+    gyro_peak.add(i * 50, walk[i]);
+    sink = gyro_peak.value(i * 50);
+  });
+  printf("gyro RMS over 10 s at 20 Hz: %.1f ns per block + query; peak of it: %.1f ns (%u, %u dropped)\n", sum_ns,
+         peak_ns, gyro_sq.overflows(), gyro_peak.overflows());
+
+  // One simulated second of combinedsense's windows
+  static WindowMin<64> hr_min, spo2_low;
+  static WindowMax<64> hr_max;
+  static WindowMax<256> accel_peak, rms_peak;
+  static WindowSum<256> gyro_window;
+  static TimeSinceTrue motion;
+  hr_min.begin(20000);
+  hr_max.begin(20000);
+  spo2_low.begin(20000);
+  accel_peak.begin(10000);
+  gyro_window.begin(10000);
+  rms_peak.begin(10000);
+  motion.begin();
+  const int seconds = 20000;
+  int fired = 0;
+  double second_ns = nsPer(seconds, [&](int s) {
+    for (int k = 0; k < 100; k++) {
+      uint32_t now = s * 1000 + k * 10;
+      float hr = 70 + walk[(s * 100 + k) % n] - 96;
+      hr_min.add(now, hr);
+      hr_max.add(now, hr);
+      spo2_low.add(now, walk[(s * 100 + k) % n]);
+      if (k % 5 == 0) {
+        float rms = (s % 120) < 30 ? 150 : 10;
+        accel_peak.add(now, 1 + rms / 100);
+        gyro_window.add(now, rms * rms * 5, 5);
+        rms_peak.add(now, sqrtf(gyro_window.mean(now)));
+        motion.add(now, rms > 50);
+      }
+      // The rule from rule_engine.h's header
+      fired += spo2_low.value(now) < 90 && spo2_low.value(now) > 0 && rms_peak.value(now) > 60;
+      sink = hr_min.value(now) + hr_max.value(now) + accel_peak.value(now) + (float)motion.since(now);
+    }
+  });
+  printf("combinedsense windows: %.1f us of CPU per second of data (100 Hz vitals, 20 Hz MPU, 100 evaluations), "
+         "%d evaluations fired\n",
+         second_ns / 1000, fired);
+  printf("state: WindowMin<64> %zu B, WindowSum<256> %zu B, WindowMax<256> %zu B, TimeSinceTrue %zu B\n",
+         sizeof(WindowMin<64>), sizeof(WindowSum<256>), sizeof(WindowMax<256>), sizeof(TimeSinceTrue));
+
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
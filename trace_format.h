@@ -0,0 +1,529 @@
+#pragma once
+// Binary sensor trace recording format.
+//
+// A trace is a fixed-rate stream of samples of up to TRACE_MAX_CHANNELS int16
+// channels. Each channel carries its own scale and offset, so raw sensor
+// counts are stored as-is and converted on read:
+//
+//   value = raw * scale + offset
+//
+// Layout, all little-endian:
+//
+//   TraceFileHeader                              (CRC over the header)
+//   chunk: TraceChunkHeader, payload, pad, CRC32 over all of it (8-aligned)
+//   ...
+//   TraceFooter                                  (absent if the stream was cut)
+//   [uint64 chunk offsets, TraceFooter with index_offset]  (trace_tool index)
+//
+// Every chunk but the last holds exactly chunk_samples samples, so the chunk
+// of a sample or timestamp is a division and, with the index, one lookup.
+// A chunk payload is either raw interleaved int16 ([sample][channel]) or
+// delta encoded: per channel the difference to the previous sample, zigzag
+// and varint coded. The writer picks whichever is smaller per chunk.
+//
+// TraceStreamWriter runs on the device with one chunk of buffer and writes to
+// any TraceSink (Serial, a file). It never seeks, so a capture cut off at
+// reset is still readable up to its last complete chunk. TraceReader (Linux)
+// maps a file and hands out raw chunks without copying.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#define TRACE_MAGIC         0x52544842 // "BHTR"
+#define TRACE_CHUNK_MAGIC   0x4B4E4843 // "CHNK"
+#define TRACE_FOOTER_MAGIC  0x45544842 // "BHTE"
+#define TRACE_VERSION       1
+#define TRACE_MAX_CHANNELS  8
+#define TRACE_CHUNK_SAMPLES 256        // writer chunk size; readers accept any
+
+enum TraceEncoding : uint8_t {
+  TRACE_RAW = 0,
+  TRACE_DELTA
+};
+
+// Header flags
+#define TRACE_ALLOW_DELTA 0x01
+
+struct TraceChannel {
+  char name[8];      // not necessarily NUL-terminated
+  float scale;
+  float offset;
+};
+
+struct TraceFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t channel_count;
+  uint8_t flags;
+  uint32_t sample_hz;
+  uint32_t chunk_samples;
+  uint64_t start_ms;         // wall clock of sample 0 if known, else 0
+  TraceChannel channels[TRACE_MAX_CHANNELS];
+  uint32_t reserved;
+  uint32_t crc;              // over the header up to here
+};
+
+struct TraceChunkHeader {
+  uint32_t magic;
+  uint32_t sequence;
+  uint64_t first_sample;
+  uint32_t first_ms;         // device clock at the first sample
+  uint16_t sample_count;
+  uint8_t encoding;          // TraceEncoding
+  uint8_t reserved;
+  uint32_t payload_bytes;    // without padding
+  uint32_t reserved2;
+};
+
+struct TraceFooter {
+  uint32_t magic;
+  uint32_t chunk_count;
+  uint64_t sample_count;
+  uint64_t index_offset;     // 0 = no index, readers scan the chunks
+  uint32_t reserved;
+  uint32_t crc;              // over the footer up to here
+};
+
+static_assert(sizeof(TraceFileHeader) == 160, "trace header layout");
+static_assert(sizeof(TraceChunkHeader) == 32, "trace chunk layout");
+static_assert(sizeof(TraceFooter) == 32, "trace footer layout");
+
+// Bytes a chunk occupies in the file
+inline size_t traceChunkBytes(uint32_t payload_bytes) {
+  return (sizeof(TraceChunkHeader) + payload_bytes + sizeof(uint32_t) + 7) & ~(size_t)7;
+}
+
+// CRC-32 (IEEE, reflected), chainable: crc = traceCrc32(crc, ...) from 0.
+// Byte table on the device, slicing-by-8 on the host.
+inline uint32_t traceCrc32(uint32_t crc, const void* data, size_t len) {
+#ifdef ARDUINO
+  static uint32_t table[256];
+  if (!table[1]) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320u & -(c & 1));
+      table[i] = c;
+    }
+  }
+  const uint8_t* p = (const uint8_t*)data;
+  crc = ~crc;
+  while (len--) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+#else
+  struct Tables {
+    uint32_t t[8][256];
+    Tables() {
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320u & -(c & 1));
+        t[0][i] = c;
+      }
+      for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+      }
+    }
+  };
+  static const Tables tables;
+  const uint32_t (*t)[256] = tables.t;
+  const uint8_t* p = (const uint8_t*)data;
+  crc = ~crc;
+  while (len >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;
+    crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len--) crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+#endif
+}
+
+// Fill in a header; channels are added with traceAddChannel
+inline void traceInitHeader(TraceFileHeader& h, uint32_t sample_hz, uint64_t start_ms, bool allow_delta) {
+  memset(&h, 0, sizeof(h));
+  h.magic = TRACE_MAGIC;
+  h.version = TRACE_VERSION;
+  h.flags = allow_delta ? TRACE_ALLOW_DELTA : 0;
+  h.sample_hz = sample_hz;
+  h.chunk_samples = TRACE_CHUNK_SAMPLES;
+  h.start_ms = start_ms;
+}
+
+inline bool traceAddChannel(TraceFileHeader& h, const char* name, float scale, float offset = 0) {
+  if (h.channel_count >= TRACE_MAX_CHANNELS) return false;
+  TraceChannel& c = h.channels[h.channel_count++];
+  strncpy(c.name, name, sizeof(c.name));
+  c.scale = scale;
+  c.offset = offset;
+  return true;
+}
+
+// Delta coding of one chunk. Differences wrap at 16 bits, so any int16 step
+// round-trips exactly; zigzag puts small steps of either sign in one byte.
+inline uint16_t traceZigzag(int16_t d) { return (uint16_t)(((uint16_t)d << 1) ^ (uint16_t)(d >> 15)); }
+inline int16_t traceUnzigzag(uint16_t z) { return (int16_t)((z >> 1) ^ (uint16_t)-(int16_t)(z & 1)); }
+inline size_t traceVarintBytes(uint16_t z) { return z < 0x80 ? 1 : z < 0x4000 ? 2 : 3; }
+
+// Decode a delta payload into interleaved samples. Returns false if the
+// payload is shorter or longer than sample_count samples.
+inline bool traceDecodeDelta(const uint8_t* p, size_t bytes, uint16_t sample_count, uint8_t channels, int16_t* out) {
+  const uint8_t* end = p + bytes;
+  int16_t prev[TRACE_MAX_CHANNELS] = {};
+  for (size_t s = 0; s < sample_count; s++) {
+    for (uint8_t c = 0; c < channels; c++) {
+      uint32_t z = 0;
+      for (int shift = 0;; shift += 7) {
+        if (p >= end || shift > 14) return false;
+        uint8_t b = *p++;
+        z |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+      }
+      prev[c] = (int16_t)(prev[c] + traceUnzigzag((uint16_t)z));
+      *out++ = prev[c];
+    }
+  }
+  return p == end;
+}
+
+// Destination for the streaming writer
+class TraceSink {
+public:
+  virtual bool write(const void* data, size_t len) = 0;
+};
+
+#ifdef ARDUINO
+// Serial or any other Print
+class PrintTraceSink : public TraceSink {
+public:
+  explicit PrintTraceSink(Print& out) : out(out) {}
+  bool write(const void* data, size_t len) override { return out.write((const uint8_t*)data, len) == len; }
+
+private:
+  Print& out;
+};
+#endif
+
+// Buffers one chunk and writes it when full. Memory use is fixed:
+// TRACE_CHUNK_SAMPLES * TRACE_MAX_CHANNELS samples plus a small staging
+// buffer for encoding.
+class TraceStreamWriter {
+public:
+  // Writes the header. The header must have its channels set.
+  bool begin(TraceSink& out, TraceFileHeader& h) {
+    sink = &out;
+    h.chunk_samples = TRACE_CHUNK_SAMPLES;
+    h.crc = traceCrc32(0, &h, offsetof(TraceFileHeader, crc));
+    channels = h.channel_count;
+    allow_delta = h.flags & TRACE_ALLOW_DELTA;
+    count = 0;
+    sequence = 0;
+    total = 0;
+    ok = channels > 0 && sink->write(&h, sizeof(h));
+    return ok;
+  }
+
+  // One sample of channel_count raw values
+  bool add(const int16_t* values, uint32_t now_ms) {
+    if (!ok) return false;
+    if (count == 0) first_ms = now_ms;
+    memcpy(&buffer[count * channels], values, channels * sizeof(int16_t));
+    if (++count == TRACE_CHUNK_SAMPLES) flushChunk();
+    return ok;
+  }
+
+  // Writes the partial last chunk and the footer
+  bool finish() {
+    if (!ok) return false;
+    if (count) flushChunk();
+    TraceFooter f = {TRACE_FOOTER_MAGIC, sequence, total, 0, 0, 0};
+    f.crc = traceCrc32(0, &f, offsetof(TraceFooter, crc));
+    ok = ok && sink->write(&f, sizeof(f));
+    return ok;
+  }
+
+  uint64_t samples() const { return total + count; }
+  uint32_t chunks() const { return sequence; }
+  bool healthy() const { return ok; }
+
+private:
+  TraceSink* sink = NULL;
+  int16_t buffer[TRACE_CHUNK_SAMPLES * TRACE_MAX_CHANNELS];
+  uint8_t staging[64];
+  size_t staged = 0;
+  uint32_t crc = 0;
+  uint16_t count = 0;
+  uint8_t channels = 0;
+  bool allow_delta = false;
+  bool ok = false;
+  uint32_t sequence = 0;
+  uint32_t first_ms = 0;
+  uint64_t total = 0;
+
+  void put(const void* data, size_t len) {
+    crc = traceCrc32(crc, data, len);
+    ok = ok && sink->write(data, len);
+  }
+
+  void stage(uint8_t b) {
+    staging[staged++] = b;
+    if (staged == sizeof(staging)) {
+      put(staging, staged);
+      staged = 0;
+    }
+  }
+
+  // Sizes the delta encoding first so the header can go out before the
+  // payload without buffering the encoded bytes
+  void flushChunk() {
+    size_t values = (size_t)count * channels;
+    size_t raw_bytes = values * sizeof(int16_t);
+    size_t delta_bytes = 0;
+    if (allow_delta) {
+      for (size_t i = 0; i < values; i++) {
+        int16_t prev = i >= channels ? buffer[i - channels] : 0;
+        delta_bytes += traceVarintBytes(traceZigzag((int16_t)(buffer[i] - prev)));
+      }
+    }
+    bool delta = allow_delta && delta_bytes < raw_bytes;
+
+    TraceChunkHeader h = {};
+    h.magic = TRACE_CHUNK_MAGIC;
+    h.sequence = sequence;
+    h.first_sample = total;
+    h.first_ms = first_ms;
+    h.sample_count = count;
+    h.encoding = delta ? TRACE_DELTA : TRACE_RAW;
+    h.payload_bytes = delta ? delta_bytes : raw_bytes;
+
+    crc = 0;
+    put(&h, sizeof(h));
+    if (delta) {
+      staged = 0;
+      for (size_t i = 0; i < values; i++) {
+        int16_t prev = i >= channels ? buffer[i - channels] : 0;
+        uint16_t z = traceZigzag((int16_t)(buffer[i] - prev));
+        while (z >= 0x80) {
+          stage((uint8_t)(z | 0x80));
+          z >>= 7;
+        }
+        stage((uint8_t)z);
+      }
+      if (staged) put(staging, staged);
+    } else {
+      put(buffer, raw_bytes);
+    }
+    static const uint8_t zeros[7] = {};
+    size_t pad = traceChunkBytes(h.payload_bytes) - sizeof(h) - h.payload_bytes - sizeof(uint32_t);
+    if (pad) put(zeros, pad);
+    uint32_t sum = crc;
+    ok = ok && sink->write(&sum, sizeof(sum));
+
+    total += count;
+    sequence++;
+    count = 0;
+  }
+};
+
+#ifndef ARDUINO
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class FileTraceSink : public TraceSink {
+public:
+  explicit FileTraceSink(FILE* file) : file(file) {}
+  bool write(const void* data, size_t len) override { return fwrite(data, 1, len, file) == len; }
+
+private:
+  FILE* file;
+};
+
+// Read-only view of a trace file. Chunk lookups are O(1): through the
+// stored index when the file has one, otherwise through offsets collected
+// by one pass over the chunk headers at open.
+class TraceReader {
+public:
+  ~TraceReader() { close(); }
+
+  bool open(const char* path, std::string& error) {
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0) return fail(error, "cannot open trace");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceFileHeader)) return fail(error, "trace too small");
+    size = st.st_size;
+    base = (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      base = NULL;
+      return fail(error, "mmap failed");
+    }
+
+    hdr = (const TraceFileHeader*)base;
+    if (hdr->magic != TRACE_MAGIC || hdr->version != TRACE_VERSION) return fail(error, "not a trace file");
+    if (hdr->crc != traceCrc32(0, hdr, offsetof(TraceFileHeader, crc))) return fail(error, "header CRC mismatch");
+    if (hdr->channel_count == 0 || hdr->channel_count > TRACE_MAX_CHANNELS || hdr->chunk_samples == 0 ||
+        hdr->sample_hz == 0) {
+      return fail(error, "bad header");
+    }
+
+    // A cut-off stream may end anywhere, so the footer is copied out
+    TraceFooter f = {};
+    if (size >= sizeof(TraceFileHeader) + sizeof(TraceFooter)) memcpy(&f, base + size - sizeof(f), sizeof(f));
+    if (f.magic == TRACE_FOOTER_MAGIC && f.crc == traceCrc32(0, &f, offsetof(TraceFooter, crc)) && f.index_offset &&
+        (f.index_offset & 7) == 0 && f.index_offset + (uint64_t)f.chunk_count * sizeof(uint64_t) <= size - sizeof(f)) {
+      index = (const uint64_t*)(base + f.index_offset);
+      chunk_count = f.chunk_count;
+      indexed = true;
+    } else {
+      scan();
+      index = scanned.data();
+      chunk_count = scanned.size();
+    }
+
+    total_samples = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+      const TraceChunkHeader* c = chunkAt(i);
+      if (!c) return fail(error, "chunk out of range");
+      if (c->first_sample != (uint64_t)i * hdr->chunk_samples ||
+          (i + 1 < chunk_count && c->sample_count != hdr->chunk_samples)) {
+        return fail(error, "chunks out of sequence");
+      }
+      total_samples += c->sample_count;
+    }
+    return true;
+  }
+
+  void close() {
+    if (base) munmap((void*)base, size);
+    if (fd >= 0) ::close(fd);
+    base = NULL;
+    fd = -1;
+    hdr = NULL;
+    index = NULL;
+    chunk_count = 0;
+    indexed = false;
+    scanned.clear();
+  }
+
+  const TraceFileHeader& header() const { return *hdr; }
+  size_t chunks() const { return chunk_count; }
+  uint64_t samples() const { return total_samples; }
+  bool hasIndex() const { return indexed; }
+  size_t bytes() const { return size; }
+  const uint8_t* data() const { return base; }
+  uint64_t chunkOffset(size_t i) const { return index[i]; }
+
+  const TraceChunkHeader& chunk(size_t i) const { return *(const TraceChunkHeader*)(base + index[i]); }
+  const uint8_t* payload(size_t i) const { return base + index[i] + sizeof(TraceChunkHeader); }
+
+  // Chunk holding a sample or a time (ms since sample 0); chunks() if past the end
+  size_t chunkForSample(uint64_t sample) const {
+    uint64_t i = sample / hdr->chunk_samples;
+    return i < chunk_count ? (size_t)i : chunk_count;
+  }
+  size_t chunkForTime(uint64_t ms) const { return chunkForSample(ms * hdr->sample_hz / 1000); }
+
+  bool verify(size_t i) const {
+    const TraceChunkHeader& c = chunk(i);
+    size_t len = traceChunkBytes(c.payload_bytes) - sizeof(uint32_t);
+    uint32_t stored;
+    memcpy(&stored, base + index[i] + len, sizeof(stored));
+    return traceCrc32(0, base + index[i], len) == stored;
+  }
+
+  // Samples of a raw chunk, straight from the mapping; NULL if delta encoded
+  const int16_t* rawSamples(size_t i) const {
+    return chunk(i).encoding == TRACE_RAW ? (const int16_t*)payload(i) : NULL;
+  }
+
+  // Any chunk into `out` (sample_count * channel_count values); returns the
+  // sample count, 0 on a corrupt payload
+  size_t decode(size_t i, int16_t* out) const {
+    const TraceChunkHeader& c = chunk(i);
+    if (c.encoding == TRACE_RAW) {
+      memcpy(out, payload(i), (size_t)c.sample_count * hdr->channel_count * sizeof(int16_t));
+      return c.sample_count;
+    }
+    if (c.encoding == TRACE_DELTA && traceDecodeDelta(payload(i), c.payload_bytes, c.sample_count, hdr->channel_count, out)) {
+      return c.sample_count;
+    }
+    return 0;
+  }
+
+  float scaled(uint8_t channel, int16_t raw) const {
+    return raw * hdr->channels[channel].scale + hdr->channels[channel].offset;
+  }
+
+private:
+  int fd = -1;
+  const uint8_t* base = NULL;
+  size_t size = 0;
+  const TraceFileHeader* hdr = NULL;
+  const uint64_t* index = NULL;
+  size_t chunk_count = 0;
+  uint64_t total_samples = 0;
+  bool indexed = false;
+  std::vector<uint64_t> scanned;
+
+  // Hop from chunk header to chunk header; stops at the footer or at the
+  // first incomplete chunk of a cut-off stream
+  void scan() {
+    uint64_t off = sizeof(TraceFileHeader);
+    while (off + sizeof(TraceChunkHeader) <= size) {
+      const TraceChunkHeader* c = (const TraceChunkHeader*)(base + off);
+      if (c->magic != TRACE_CHUNK_MAGIC) break;
+      size_t len = traceChunkBytes(c->payload_bytes);
+      if (off + len > size) break;
+      scanned.push_back(off);
+      off += len;
+    }
+  }
+
+  const TraceChunkHeader* chunkAt(size_t i) const {
+    if ((index[i] & 7) || index[i] + sizeof(TraceChunkHeader) > size) return NULL;
+    const TraceChunkHeader* c = (const TraceChunkHeader*)(base + index[i]);
+    if (c->magic != TRACE_CHUNK_MAGIC || index[i] + traceChunkBytes(c->payload_bytes) > size) return NULL;
+    if (c->encoding == TRACE_RAW && c->payload_bytes != (uint32_t)c->sample_count * hdr->channel_count * sizeof(int16_t)) {
+      return NULL;
+    }
+    return c;
+  }
+
+  bool fail(std::string& error, const char* why) {
+    error = why;
+    close();
+    return false;
+  }
+};
+
+// Appends a chunk index and a footer pointing at it, so later opens skip the
+// chunk scan. `reader` must be open on `path`.
+inline bool traceWriteIndex(const char* path, const TraceReader& reader) {
+  if (reader.hasIndex()) return true;
+  FILE* file = fopen(path, "ab");
+  if (!file) return false;
+  uint64_t index_offset = reader.bytes();
+  bool ok = true;
+  for (size_t i = 0; i < reader.chunks() && ok; i++) {
+    uint64_t off = reader.chunkOffset(i);
+    ok = fwrite(&off, sizeof(off), 1, file) == 1;
+  }
+  TraceFooter f = {TRACE_FOOTER_MAGIC, (uint32_t)reader.chunks(), reader.samples(), index_offset, 0, 0};
+  f.crc = traceCrc32(0, &f, offsetof(TraceFooter, crc));
+  ok = ok && fwrite(&f, sizeof(f), 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+  return ok;
+}
+#endif
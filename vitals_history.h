@@ -0,0 +1,488 @@
+#pragma once
+// In-RAM vitals history with Gorilla-style compression.
+//
+// Each metric keeps several resolution tiers (1 s, 1 min, 15 min by default).
+// A tier stores one rollup point (min, max, mean) per step in a ring of fixed
+// size compressed blocks, so memory is fixed up front and the oldest block is
+// dropped when the ring wraps; retention is whatever fits in the budget.
+//
+// Inside a block, timestamps are delta-of-delta encoded (a regular step costs
+// one bit) and each value column is XOR encoded against the previous value
+// (a repeat costs one bit). Values are snapped to a per-metric power-of-two
+// resolution first, which keeps the XOR residue down to a few mantissa bits.
+//
+// Timestamps are seconds of uptime. Everything here is plain C++ and runs the
+// same on the host.
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define HISTORY_BLOCK_BYTES 256
+#define HISTORY_TIERS       3
+
+// Worst case for one point: timestamp '1111' + 32 bits, three values at
+// '11' + 5 + 6 + 32 bits each
+#define HISTORY_MAX_POINT_BITS (36 + 3 * 45)
+
+struct HistoryPoint {
+  uint32_t t;
+  float min;
+  float max;
+  float mean;
+};
+
+// ---- Bit stream ----
+
+class BitWriter {
+public:
+  BitWriter(uint8_t* buf, uint32_t capacity_bits, uint32_t used_bits)
+    : buf(buf), capacity(capacity_bits), pos(used_bits) {}
+
+  void write(uint32_t value, int bits) {
+    for (int i = bits - 1; i >= 0; i--) {
+      uint32_t byte = pos >> 3;
+      uint8_t mask = 0x80 >> (pos & 7);
+      if (value & (1UL << i)) buf[byte] |= mask;
+      else buf[byte] &= ~mask;
+      pos++;
+    }
+  }
+
+  uint32_t position() const { return pos; }
+  uint32_t remaining() const { return capacity - pos; }
+
+private:
+  uint8_t* buf;
+  uint32_t capacity;
+  uint32_t pos;
+};
+
+class BitReader {
+public:
+  BitReader(const uint8_t* buf) : buf(buf), pos(0) {}
+
+  uint32_t read(int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++) {
+      value = (value << 1) | ((buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+      pos++;
+    }
+    return value;
+  }
+
+private:
+  const uint8_t* buf;
+  uint32_t pos;
+};
+
+// ---- Gorilla column codecs ----
+
+struct TimestampCodec {
+  uint32_t prev = 0;
+  int32_t prev_delta = 0;
+
+  void encode(BitWriter& w, uint32_t t, bool first) {
+    if (first) {
+      w.write(t, 32);
+    } else {
+      int32_t delta = (int32_t)(t - prev);
+      int32_t dod = delta - prev_delta;
+      if (dod == 0) {
+        w.write(0, 1);
+      } else if (dod >= -63 && dod <= 64) {
+        w.write(0x2, 2);
+        w.write((uint32_t)dod & 0x7F, 7);
+      } else if (dod >= -255 && dod <= 256) {
+        w.write(0x6, 3);
+        w.write((uint32_t)dod & 0x1FF, 9);
+      } else if (dod >= -2047 && dod <= 2048) {
+        w.write(0xE, 4);
+        w.write((uint32_t)dod & 0xFFF, 12);
+      } else {
+        w.write(0xF, 4);
+        w.write((uint32_t)dod, 32);
+      }
+      prev_delta = delta;
+    }
+    prev = t;
+  }
+
+  uint32_t decode(BitReader& r, bool first) {
+    if (first) {
+      prev = r.read(32);
+      return prev;
+    }
+    int32_t dod;
+    if (r.read(1) == 0) dod = 0;
+    else if (r.read(1) == 0) dod = signExtend(r.read(7), 7);
+    else if (r.read(1) == 0) dod = signExtend(r.read(9), 9);
+    else if (r.read(1) == 0) dod = signExtend(r.read(12), 12);
+    else dod = (int32_t)r.read(32);
+    prev_delta += dod;
+    prev += prev_delta;
+    return prev;
+  }
+
+  // The n-bit fields hold dod in [-(2^(n-1)-1), 2^(n-1)], so the all-zero
+  // upper half maps back to positive and 2^(n-1) itself stays positive.
+  static int32_t signExtend(uint32_t v, int bits) {
+    uint32_t half = 1UL << (bits - 1);
+    return v > half ? (int32_t)v - (int32_t)(1UL << bits) : (int32_t)v;
+  }
+};
+
+struct XorCodec {
+  uint32_t prev = 0;
+  uint8_t lead = 0xFF;  // window of the previous non-zero XOR
+  uint8_t trail = 0;
+
+  void encode(BitWriter& w, float value, bool first) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    if (first) {
+      w.write(bits, 32);
+      prev = bits;
+      return;
+    }
+    uint32_t x = bits ^ prev;
+    prev = bits;
+    if (x == 0) {
+      w.write(0, 1);
+      return;
+    }
+    uint8_t l = leadingZeros(x);
+    uint8_t t = trailingZeros(x);
+    if (l > 31) l = 31;
+    if (lead != 0xFF && l >= lead && t >= trail) {
+      // Fits the previous window
+      w.write(0x2, 2);
+      w.write(x >> trail, 32 - lead - trail);
+    } else {
+      uint8_t len = 32 - l - t;
+      w.write(0x3, 2);
+      w.write(l, 5);
+      w.write(len - 1, 6);
+      w.write(x >> t, len);
+      lead = l;
+      trail = t;
+    }
+  }
+
+  float decode(BitReader& r, bool first) {
+    if (first) {
+      prev = r.read(32);
+    } else if (r.read(1) == 1) {
+      if (r.read(1) == 0) {
+        prev ^= r.read(32 - lead - trail) << trail;
+      } else {
+        lead = r.read(5);
+        uint8_t len = r.read(6) + 1;
+        trail = 32 - lead - len;
+        prev ^= r.read(len) << trail;
+      }
+    }
+    float value;
+    memcpy(&value, &prev, 4);
+    return value;
+  }
+
+  static uint8_t leadingZeros(uint32_t x) {
+    uint8_t n = 0;
+    while (!(x & 0x80000000UL)) { x <<= 1; n++; }
+    return n;
+  }
+
+  static uint8_t trailingZeros(uint32_t x) {
+    uint8_t n = 0;
+    while (!(x & 1)) { x >>= 1; n++; }
+    return n;
+  }
+};
+
+// ---- Compressed block of rollup points ----
+
+// Encoder state; only the block being appended to needs one
+struct HistoryEncoder {
+  TimestampCodec ts;
+  XorCodec min, max, mean;
+};
+
+struct HistoryBlock {
+  uint8_t data[HISTORY_BLOCK_BYTES];
+  uint16_t count;
+  uint16_t bits;
+  uint32_t first_t;
+  uint32_t last_t;
+
+  void reset() {
+    count = 0;
+    bits = 0;
+  }
+
+  bool append(HistoryEncoder& enc, const HistoryPoint& p) {
+    BitWriter w(data, HISTORY_BLOCK_BYTES * 8, bits);
+    if (w.remaining() < HISTORY_MAX_POINT_BITS) return false;
+    bool first = count == 0;
+    enc.ts.encode(w, p.t, first);
+    enc.min.encode(w, p.min, first);
+    enc.max.encode(w, p.max, first);
+    enc.mean.encode(w, p.mean, first);
+    bits = w.position();
+    if (first) first_t = p.t;
+    last_t = p.t;
+    count++;
+    return true;
+  }
+
+  // Decode every point in order
+  template <typename F>
+  void forEach(F&& f) const {
+    BitReader r(data);
+    TimestampCodec t;
+    XorCodec a, b, c;
+    for (uint16_t i = 0; i < count; i++) {
+      HistoryPoint p;
+      p.t = t.decode(r, i == 0);
+      p.min = a.decode(r, i == 0);
+      p.max = b.decode(r, i == 0);
+      p.mean = c.decode(r, i == 0);
+      f(p);
+    }
+  }
+};
+
+// ---- Rollup accumulator ----
+
+struct Rollup {
+  uint32_t bucket = 0;
+  uint32_t n = 0;
+  float min = 0, max = 0;
+  double sum = 0;
+
+  void add(float lo, float hi, float mean) {
+    if (n == 0 || lo < min) min = lo;
+    if (n == 0 || hi > max) max = hi;
+    sum += mean;
+    n++;
+  }
+
+  HistoryPoint point() const {
+    HistoryPoint p = {bucket, min, max, (float)(sum / n)};
+    return p;
+  }
+};
+
+// ---- One metric: tiers of block rings ----
+
+struct HistoryTierConfig {
+  uint32_t step_s;
+  uint16_t blocks;
+};
+
+// Block counts sized for the noisiest metric, gyro, at the worst bits per
+// point tools/vitals_history_bench measures (30 at 1 s while moving, 28 at
+// 1 min, 36 at 15 min). A block closes with up to HISTORY_MAX_POINT_BITS
+// unused and opens with a raw point, so it holds about 1700 / bits points;
+// one more block covers the one dropped when the ring wraps. About 14 KB per
+// metric; steadier signals compress better and keep more.
+static const HistoryTierConfig HISTORY_TIER_CONFIG[HISTORY_TIERS] = {
+  {1, 12},   // 1 s, >= 10 min
+  {60, 25},  // 1 min, >= 24 h
+  {900, 16}, // 15 min, >= 1 week
+};
+
+#define HISTORY_BLOCKS_PER_METRIC (12 + 25 + 16)
+
+class MetricHistory {
+public:
+  void begin(float resolution) {
+    this->resolution = resolution;
+    int offset = 0;
+    for (int i = 0; i < HISTORY_TIERS; i++) {
+      tiers[i].first_block = offset;
+      tiers[i].block_count = HISTORY_TIER_CONFIG[i].blocks;
+      tiers[i].head = 0;
+      tiers[i].used = 1;
+      tiers[i].acc = Rollup();
+      tiers[i].enc = HistoryEncoder();
+      blocks[offset].reset();
+      offset += HISTORY_TIER_CONFIG[i].blocks;
+    }
+  }
+
+  void add(uint32_t t, float value) {
+    value = roundf(value / resolution) * resolution;
+    feed(0, t, value, value, value);
+    samples++;
+  }
+
+  // Points covering [from, now] at (at least) `step` seconds, finest tier that
+  // still reaches back to `from`; step 0 lets the range alone pick the tier.
+  // Partial current buckets are not included.
+  template <typename F>
+  uint32_t query(uint32_t from, uint32_t step, F&& emit) const {
+    int tier = pickTier(from, step);
+    step = resolveStep(from, step);
+
+    // Re-aggregate tier points into the requested step
+    Rollup out;
+    bool open = false;
+    uint32_t emitted = 0;
+    forEachBlock(tier, [&](const HistoryBlock& b) {
+      if (b.count == 0 || b.last_t < from) return;
+      b.forEach([&](const HistoryPoint& p) {
+        if (p.t < from) return;
+        uint32_t bucket = p.t - (p.t % step);
+        if (open && bucket != out.bucket) {
+          emit(out.point());
+          emitted++;
+          open = false;
+        }
+        if (!open) {
+          out = Rollup();
+          out.bucket = bucket;
+          open = true;
+        }
+        out.add(p.min, p.max, p.mean);
+      });
+    });
+    if (open) {
+      emit(out.point());
+      emitted++;
+    }
+    return emitted;
+  }
+
+  // Step a query will actually use: never finer than the tier it reads
+  uint32_t resolveStep(uint32_t from, uint32_t step) const {
+    uint32_t tier_step = HISTORY_TIER_CONFIG[pickTier(from, step)].step_s;
+    return step < tier_step ? tier_step : step;
+  }
+
+  // Oldest timestamp still held in a tier
+  uint32_t oldest(int tier) const {
+    const Tier& t = tiers[tier];
+    int idx = (t.head + t.block_count - (t.used - 1)) % t.block_count;
+    const HistoryBlock& b = blocks[t.first_block + idx];
+    return b.count ? b.first_t : 0xFFFFFFFF;
+  }
+
+  uint32_t tierPoints(int tier) const {
+    uint32_t n = 0;
+    forEachBlock(tier, [&](const HistoryBlock& b) { n += b.count; });
+    return n;
+  }
+
+  uint32_t tierBits(int tier) const {
+    uint32_t n = 0;
+    forEachBlock(tier, [&](const HistoryBlock& b) { n += b.bits; });
+    return n;
+  }
+
+  uint32_t samples = 0;
+
+private:
+  struct Tier {
+    uint16_t first_block;
+    uint16_t block_count;
+    uint16_t head;  // block currently appended to
+    uint16_t used;  // blocks holding data, including head
+    Rollup acc;
+    HistoryEncoder enc;
+  };
+
+  HistoryBlock blocks[HISTORY_BLOCKS_PER_METRIC];
+  Tier tiers[HISTORY_TIERS];
+  float resolution = 1;
+
+  // Finest tier no coarser than `step` (any tier for step 0) that reaches back
+  // to `from`, else the coarsest such tier
+  int pickTier(uint32_t from, uint32_t step) const {
+    int tier = 0;
+    for (int i = 0; i < HISTORY_TIERS; i++) {
+      if (i > 0 && step && HISTORY_TIER_CONFIG[i].step_s > step) break;
+      tier = i;
+      if (oldest(i) <= from) break;
+    }
+    return tier;
+  }
+
+  void feed(int tier, uint32_t t, float lo, float hi, float mean) {
+    Tier& tr = tiers[tier];
+    uint32_t step = HISTORY_TIER_CONFIG[tier].step_s;
+    uint32_t bucket = t - (t % step);
+
+    if (tr.acc.n && bucket != tr.acc.bucket) {
+      HistoryPoint p = tr.acc.point();
+      store(tier, p);
+      if (tier + 1 < HISTORY_TIERS) feed(tier + 1, p.t, p.min, p.max, p.mean);
+      tr.acc = Rollup();
+    }
+    if (tr.acc.n == 0) tr.acc.bucket = bucket;
+    tr.acc.add(lo, hi, mean);
+  }
+
+  void store(int tier, HistoryPoint p) {
+    Tier& t = tiers[tier];
+    p.mean = roundf(p.mean / resolution) * resolution;
+    if (blocks[t.first_block + t.head].append(t.enc, p)) return;
+
+    // Head is full: move on, dropping the oldest block when the ring is full
+    t.head = (t.head + 1) % t.block_count;
+    if (t.used < t.block_count) t.used++;
+    HistoryBlock& b = blocks[t.first_block + t.head];
+    b.reset();
+    t.enc = HistoryEncoder();
+    b.append(t.enc, p);
+  }
+
+  template <typename F>
+  void forEachBlock(int tier, F&& f) const {
+    const Tier& t = tiers[tier];
+    for (int i = t.used - 1; i >= 0; i--) {
+      int idx = (t.head + t.block_count - i) % t.block_count;
+      f(blocks[t.first_block + idx]);
+    }
+  }
+};
+
+// ---- The vitals tracked on the device ----
+
+enum HistoryMetric {
+  HISTORY_HR = 0,
+  HISTORY_SPO2,
+  HISTORY_ACCEL,
+  HISTORY_GYRO,
+  HISTORY_METRIC_COUNT
+};
+
+inline const char* historyMetricName(int m) {
+  static const char* names[HISTORY_METRIC_COUNT] = {"hr", "spo2", "accel", "gyro"};
+  return (m >= 0 && m < HISTORY_METRIC_COUNT) ? names[m] : "?";
+}
+
+inline int historyMetricFromName(const char* name) {
+  for (int i = 0; i < HISTORY_METRIC_COUNT; i++) {
+    if (strcmp(name, historyMetricName(i)) == 0) return i;
+  }
+  return -1;
+}
+
+class VitalsHistory {
+public:
+  void begin() {
+    metrics[HISTORY_HR].begin(0.125f);     // 1/8 BPM
+    metrics[HISTORY_SPO2].begin(0.125f);   // 1/8 %
+    metrics[HISTORY_ACCEL].begin(1.0f / 64); // ~0.016 g
+    metrics[HISTORY_GYRO].begin(0.25f);    // 1/4 deg/s
+  }
+
+  void add(HistoryMetric m, uint32_t t, float value) { metrics[m].add(t, value); }
+  MetricHistory& metric(int m) { return metrics[m]; }
+
+  static uint32_t bytes() { return sizeof(VitalsHistory); }
+
+private:
+  MetricHistory metrics[HISTORY_METRIC_COUNT];
+};
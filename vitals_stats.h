@@ -0,0 +1,213 @@
+#pragma once
+// Constant-memory long-horizon statistics for one vital sign.
+//
+// Readings are taken at most once per VITALS_SAMPLE_MS and feed:
+//
+// - a windowed quantile: a fixed-bin histogram over a sliding window made of
+//   VITALS_BUCKETS time buckets. Each bucket keeps its own counts, so the
+//   oldest bucket can be subtracted from the window totals when it expires;
+//   a quantile is one pass over the bins, interpolated within the bin. Bins
+//   are centred on multiples of the step, so with 1 BPM bins the median of
+//   the last 30 min is exact for whole-BPM readings.
+// - two time-based EWMAs: a fast one (minutes) and the patient's baseline
+//   (hours). Both keep a decayed sum and weight, so they are unbiased from
+//   the first reading and tolerate gaps. The baseline only counts once it has
+//   seen baseline_min_s of data, and it holds while a deviation is building,
+//   so a slow drift does not drag the baseline along with it.
+// - a one-sided CUSUM of the readings against the baseline, less an
+//   allowance, in units x minutes. Noise around the baseline keeps it near 0;
+//   a sustained shift grows it linearly. Each reading is weighted by the time
+//   since the last one, capped at VITALS_SAMPLE_MS, so gaps add nothing.
+//
+// Everything is plain C++ and runs the same on the host.
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define VITALS_SAMPLE_MS 1000
+#define VITALS_BUCKETS   6
+
+struct VitalTrendConfig {
+  float lo;                 // centre of the first bin
+  float step;               // bin width
+  uint32_t window_ms;       // quantile window, split into VITALS_BUCKETS
+  float fast_tau_s;
+  float baseline_tau_s;
+  uint32_t baseline_min_s;  // readings needed before the baseline is used
+  float allowance;          // CUSUM slack around the baseline
+  int8_t direction;         // +1: rises are deviations, -1: drops are
+};
+
+struct VitalTrendSnapshot {
+  float fast;      // fast EWMA, 0 before the first reading
+  float p50;       // median over the window, 0 when it is empty
+  float baseline;  // 0 until established
+  float deviation; // p50 - baseline, 0 until the baseline is established
+  float cusum;     // x minutes
+};
+
+template <int BINS>
+class VitalTrend {
+public:
+  void begin(const VitalTrendConfig& config) {
+    this->config = config;
+    memset(counts, 0, sizeof(counts));
+    memset(window, 0, sizeof(window));
+    window_count = 0;
+    bucket_ms = config.window_ms / VITALS_BUCKETS;
+    bucket_index = 0;
+    fast = {0, 0};
+    base = {0, 0};
+    base_samples = 0;
+    cusum = 0;
+    last_ms = 0;
+    started = false;
+  }
+
+  // A reading; skipped if it comes within VITALS_SAMPLE_MS of the last one
+  // that was taken. Values outside the histogram are clamped into it.
+  void add(uint32_t now_ms, float v) {
+    if (started && now_ms - last_ms < VITALS_SAMPLE_MS) return;
+    float dt_s = started ? (now_ms - last_ms) / 1000.0f : 0;
+    last_ms = now_ms;
+
+    advance(now_ms);
+    int bin = binOf(v);
+    counts[bucket_index % VITALS_BUCKETS][bin]++;
+    window[bin]++;
+    window_count++;
+
+    decay(fast, dt_s, config.fast_tau_s);
+    fast.sum += v;
+    fast.weight += 1;
+
+    // CUSUM against the baseline once it is established, scaled to minutes.
+    // A reading counts for at most one sample period: after a gap (finger
+    // off) it says nothing about the minutes nobody measured.
+    if (baselineReady()) {
+      float excess = config.direction * (v - baselineValue()) - config.allowance;
+      cusum += excess * fminf(dt_s, VITALS_SAMPLE_MS / 1000.0f) / 60.0f;
+      if (cusum < 0) cusum = 0;
+    }
+    // The baseline holds while a deviation is accumulating
+    if (cusum == 0) {
+      decay(base, dt_s, config.baseline_tau_s);
+      base.sum += v;
+      base.weight += 1;
+      base_samples++;
+    }
+    started = true;
+  }
+
+  // Quantile q in [0, 1] over the window ending now; 0 when it is empty
+  float quantile(uint32_t now_ms, float q) {
+    advance(now_ms);
+    if (window_count == 0) return 0;
+    float rank = q * window_count;
+    uint32_t below = 0;
+    for (int i = 0; i < BINS; i++) {
+      if (window[i] && below + window[i] >= rank) {
+        float within = (rank - below) / window[i];
+        return config.lo + (i - 0.5f + within) * config.step;
+      }
+      below += window[i];
+    }
+    return config.lo + (BINS - 0.5f) * config.step;
+  }
+
+  VitalTrendSnapshot snapshot(uint32_t now_ms) {
+    VitalTrendSnapshot s;
+    s.fast = fast.weight > 0 ? fast.sum / fast.weight : 0;
+    s.p50 = quantile(now_ms, 0.5f);
+    s.baseline = baselineReady() ? baselineValue() : 0;
+    s.deviation = baselineReady() && window_count ? s.p50 - s.baseline : 0;
+    s.cusum = cusum;
+    return s;
+  }
+
+  uint32_t windowCount() const { return window_count; }
+  bool baselineReady() const { return base_samples >= config.baseline_min_s * 1000 / VITALS_SAMPLE_MS; }
+
+private:
+  struct Ewma {
+    float sum;
+    float weight;
+  };
+
+  VitalTrendConfig config;
+  uint16_t counts[VITALS_BUCKETS][BINS];
+  uint16_t window[BINS];   // sum of counts over the buckets
+  uint32_t window_count;
+  uint32_t bucket_ms;
+  uint32_t bucket_index;   // now_ms / bucket_ms of the newest bucket
+  Ewma fast, base;
+  uint32_t base_samples;
+  float cusum;
+  uint32_t last_ms;
+  bool started;
+
+  int binOf(float v) const {
+    int bin = (int)floorf((v - config.lo) / config.step + 0.5f);
+    return bin < 0 ? 0 : bin >= BINS ? BINS - 1 : bin;
+  }
+
+  float baselineValue() const { return base.weight > 0 ? base.sum / base.weight : 0; }
+
+  static void decay(Ewma& e, float dt_s, float tau_s) {
+    if (dt_s <= 0 || e.weight == 0) return;
+    float k = expf(-dt_s / tau_s);
+    e.sum *= k;
+    e.weight *= k;
+  }
+
+  // Expire the buckets that fell out of the window
+  void advance(uint32_t now_ms) {
+    uint32_t index = now_ms / bucket_ms;
+    if (window_count == 0) {
+      bucket_index = index;
+      return;
+    }
+    if (index - bucket_index >= VITALS_BUCKETS) {
+      memset(counts, 0, sizeof(counts));
+      memset(window, 0, sizeof(window));
+      window_count = 0;
+      bucket_index = index;
+      return;
+    }
+    while (bucket_index != index) {
+      bucket_index++;
+      uint16_t* expired = counts[bucket_index % VITALS_BUCKETS];
+      for (int i = 0; i < BINS; i++) {
+        window[i] -= expired[i];
+        window_count -= expired[i];
+      }
+      memset(expired, 0, sizeof(counts[0]));
+    }
+  }
+};
+
+// ---- The vitals combinedsense.cpp trends ----
+
+#define VITALS_HR_BINS   201  // 30..230 BPM in 1 BPM bins
+#define VITALS_SPO2_BINS 61   // 70..100 % in 0.5 % bins
+
+// 30 min medians, 5 min EWMAs, baselines over ~6 h once 30 min are in
+static const VitalTrendConfig VITALS_HR_CONFIG = {30.0f, 1.0f, 1800000, 300.0f, 21600.0f, 1800, 10.0f, 1};
+static const VitalTrendConfig VITALS_SPO2_CONFIG = {70.0f, 0.5f, 1800000, 300.0f, 21600.0f, 1800, 2.0f, -1};
+
+struct VitalsStats {
+  VitalTrend<VITALS_HR_BINS> hr;
+  VitalTrend<VITALS_SPO2_BINS> spo2;
+
+  void begin() {
+    hr.begin(VITALS_HR_CONFIG);
+    spo2.begin(VITALS_SPO2_CONFIG);
+  }
+
+  // A reading of 0 means no finger / no estimate and is skipped
+  void add(uint32_t now_ms, float hr_bpm, float spo2_pct) {
+    if (hr_bpm > 0) hr.add(now_ms, hr_bpm);
+    if (spo2_pct > 0) spo2.add(now_ms, spo2_pct);
+  }
+};
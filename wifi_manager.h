@@ -0,0 +1,214 @@
+#pragma once
+// Background WiFi connection manager.
+//
+// begin() only starts connecting, so sensors can sample while the link comes
+// up; loop() drives the state machine and must be called regularly.
+//
+// After a successful connection the AP's BSSID and channel and the DHCP
+// lease (IP, gateway, mask, DNS) are cached in RTC memory, which survives
+// soft resets and deep sleep, and in NVS, which survives power loss. The next
+// connect skips the scan and DHCP by joining that BSSID on that channel with
+// the cached address configured statically; if that does not come up quickly
+// the cache is dropped and a normal scan + DHCP connect is used. Lost
+// connections are retried with exponential backoff.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Preferences.h>
+
+#define WIFI_CACHE_MAGIC        0x57494643 // "WIFC"
+#define WIFI_FAST_TIMEOUT_MS    1500
+#define WIFI_FULL_TIMEOUT_MS    10000
+#define WIFI_BACKOFF_MIN_MS     500
+#define WIFI_BACKOFF_MAX_MS     30000
+
+struct WiFiCache {
+  uint32_t magic;
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+RTC_DATA_ATTR static WiFiCache rtc_wifi_cache;
+
+enum WiFiManagerState {
+  WIFI_MGR_IDLE,
+  WIFI_MGR_FAST_CONNECT, // cached BSSID/channel + static IP
+  WIFI_MGR_FULL_CONNECT, // scan + DHCP
+  WIFI_MGR_CONNECTED,
+  WIFI_MGR_BACKOFF
+};
+
+class WiFiManager {
+public:
+  void begin(const char* ssid, const char* password, bool reuse_lease = true) {
+    this->ssid = ssid;
+    this->password = password;
+    this->reuse_lease = reuse_lease;
+
+    // We persist what we need ourselves and handle reconnects here
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+
+    loadCache();
+    startConnect(millis());
+  }
+
+  void loop(uint32_t now) {
+    wl_status_t status = WiFi.status();
+
+    switch (state) {
+      case WIFI_MGR_FAST_CONNECT:
+      case WIFI_MGR_FULL_CONNECT: {
+        if (status == WL_CONNECTED) {
+          onConnected(now);
+          break;
+        }
+        uint32_t timeout = state == WIFI_MGR_FAST_CONNECT ? WIFI_FAST_TIMEOUT_MS : WIFI_FULL_TIMEOUT_MS;
+        if (now - attempt_start_ms < timeout && status != WL_CONNECT_FAILED && status != WL_NO_SSID_AVAIL) break;
+
+        if (state == WIFI_MGR_FAST_CONNECT) {
+          // Cache is stale (AP moved channel, lease gone): fall back immediately
+          fast_failures++;
+          cache_valid = false;
+          startFull(now);
+        } else {
+          enterBackoff(now);
+        }
+        break;
+      }
+
+      case WIFI_MGR_CONNECTED:
+        if (status != WL_CONNECTED) {
+          disconnects++;
+          Serial.println("WiFi connection lost, reconnecting");
+          startConnect(now);
+        }
+        break;
+
+      case WIFI_MGR_BACKOFF:
+        if (now - attempt_start_ms >= backoff_ms) startConnect(now);
+        break;
+
+      case WIFI_MGR_IDLE:
+        break;
+    }
+  }
+
+  bool connected() const { return state == WIFI_MGR_CONNECTED; }
+  WiFiManagerState currentState() const { return state; }
+
+  // Statistics
+  uint32_t connects = 0;
+  uint32_t fast_connects = 0;
+  uint32_t fast_failures = 0;
+  uint32_t disconnects = 0;
+  uint32_t first_connect_ms = 0;  // millis() of the first connection since boot
+  uint32_t last_connect_duration_ms = 0;
+
+private:
+  const char* ssid = NULL;
+  const char* password = NULL;
+  bool reuse_lease = true;
+  bool cache_valid = false;
+  WiFiManagerState state = WIFI_MGR_IDLE;
+  uint32_t attempt_start_ms = 0;
+  uint32_t outage_start_ms = 0;
+  uint32_t backoff_ms = WIFI_BACKOFF_MIN_MS;
+
+  void loadCache() {
+    if (rtc_wifi_cache.magic == WIFI_CACHE_MAGIC) {
+      cache_valid = true;
+      return;
+    }
+    Preferences prefs;
+    if (prefs.begin("wifi", true)) {
+      WiFiCache stored;
+      if (prefs.getBytes("cache", &stored, sizeof(stored)) == sizeof(stored) &&
+          stored.magic == WIFI_CACHE_MAGIC) {
+        rtc_wifi_cache = stored;
+        cache_valid = true;
+      }
+      prefs.end();
+    }
+  }
+
+  void saveCache() {
+    WiFiCache fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = WIFI_CACHE_MAGIC;
+    memcpy(fresh.bssid, WiFi.BSSID(), 6);
+    fresh.channel = WiFi.channel();
+    fresh.ip = WiFi.localIP();
+    fresh.gateway = WiFi.gatewayIP();
+    fresh.subnet = WiFi.subnetMask();
+    fresh.dns = WiFi.dnsIP();
+
+    bool changed = !cache_valid || memcmp(&fresh, &rtc_wifi_cache, sizeof(fresh)) != 0;
+    rtc_wifi_cache = fresh;
+    cache_valid = true;
+
+    // Only touch flash when something actually changed
+    if (changed) {
+      Preferences prefs;
+      if (prefs.begin("wifi", false)) {
+        prefs.putBytes("cache", &fresh, sizeof(fresh));
+        prefs.end();
+      }
+    }
+  }
+
+  void startConnect(uint32_t now) {
+    if (state != WIFI_MGR_BACKOFF && state != WIFI_MGR_FAST_CONNECT && state != WIFI_MGR_FULL_CONNECT) {
+      outage_start_ms = now;
+    }
+    if (cache_valid) startFast(now);
+    else startFull(now);
+  }
+
+  void startFast(uint32_t now) {
+    WiFi.disconnect();
+    if (reuse_lease && rtc_wifi_cache.ip != 0) {
+      WiFi.config(IPAddress(rtc_wifi_cache.ip), IPAddress(rtc_wifi_cache.gateway),
+                  IPAddress(rtc_wifi_cache.subnet), IPAddress(rtc_wifi_cache.dns));
+    }
+    WiFi.begin(ssid, password, rtc_wifi_cache.channel, rtc_wifi_cache.bssid);
+    state = WIFI_MGR_FAST_CONNECT;
+    attempt_start_ms = now;
+  }
+
+  void startFull(uint32_t now) {
+    WiFi.disconnect();
+    WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0)); // back to DHCP
+    WiFi.begin(ssid, password);
+    state = WIFI_MGR_FULL_CONNECT;
+    attempt_start_ms = now;
+  }
+
+  void enterBackoff(uint32_t now) {
+    WiFi.disconnect();
+    state = WIFI_MGR_BACKOFF;
+    attempt_start_ms = now;
+    Serial.printf("WiFi connect failed, retrying in %u ms\n", backoff_ms);
+    backoff_ms = backoff_ms * 2 > WIFI_BACKOFF_MAX_MS ? WIFI_BACKOFF_MAX_MS : backoff_ms * 2;
+  }
+
+  void onConnected(uint32_t now) {
+    bool fast = state == WIFI_MGR_FAST_CONNECT;
+    if (fast) fast_connects++;
+    connects++;
+    if (first_connect_ms == 0) first_connect_ms = now;
+    last_connect_duration_ms = now - outage_start_ms;
+    backoff_ms = WIFI_BACKOFF_MIN_MS;
+    state = WIFI_MGR_CONNECTED;
+    saveCache();
+
+    Serial.printf("WiFi connected (%s, %u ms)! IP address: %s\n",
+                  fast ? "cached" : "scan",
+                  last_connect_duration_ms, WiFi.localIP().toString().c_str());
+  }
+};
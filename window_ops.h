@@ -0,0 +1,199 @@
+#pragma once
+// Sliding-window operators over timestamped sensor samples.
+//
+// Each operator keeps the samples of one stream that fall in the last
+// window_ms, in a fixed-capacity ring, and is fed at whatever rate its sensor
+// produces. Queries take the current time and expire samples first, so a
+// stream that stops empties its windows instead of holding the last value.
+// Operators on different streams, at different rates, can be combined in one
+// rule because they all answer "as of now".
+//
+//   WindowMin / WindowMax  sliding minimum / maximum. A monotonic deque: a
+//                          new sample removes the samples it dominates from
+//                          the back, the front is the answer. Amortised O(1)
+//                          per sample, O(1) per query.
+//   WindowSum              sum and weight of the samples in the window, for
+//                          means and RMS (feed squares). Running sums, exactly
+//                          re-added once per N removals so float error cannot
+//                          build up.
+//   TimeSinceTrue          how long ago a condition last held, and for how
+//                          long it has been holding. O(1), no buffer.
+//
+// The window is (now - window_ms, now]. Times are millis() and must not go
+// backwards for one operator; differences are unsigned, so the wrap after 49
+// days is fine. A ring holds N samples; a WindowMin/Max only needs room for a
+// monotonic run of distinct values within the window, a WindowSum for every
+// sample in it. When a ring is full the oldest entry is dropped and counted in
+// overflows(), which narrows the window until the rate falls again.
+//
+// Everything here is plain C++ and runs the same on the host.
+
+#include <stdint.h>
+
+template <uint16_t N, bool MAX>
+class WindowExtreme {
+  static_assert(N && (N & (N - 1)) == 0, "window capacity must be a power of two");
+
+public:
+  void begin(uint32_t window_ms) {
+    this->window_ms = window_ms;
+    head = tail = 0;
+    lost = 0;
+  }
+
+  void add(uint32_t t_ms, float v) {
+    expire(t_ms);
+    // Samples no better than the new one can never be the answer again
+    while (tail != head && !beats(slots[(uint16_t)(tail - 1) & (N - 1)].v, v)) tail--;
+    if ((uint16_t)(tail - head) == N) {
+      head++;
+      lost++;
+    }
+    slots[tail & (N - 1)] = {t_ms, v};
+    tail++;
+  }
+
+  // Minimum or maximum over the window, `empty` when it has no samples
+  float value(uint32_t now_ms, float empty = 0) {
+    expire(now_ms);
+    return head == tail ? empty : slots[head & (N - 1)].v;
+  }
+
+  uint16_t size() const { return tail - head; }
+  uint32_t overflows() const { return lost; }
+
+private:
+  struct Sample {
+    uint32_t t_ms;
+    float v;
+  };
+
+  Sample slots[N];
+  uint32_t window_ms;
+  uint16_t head, tail;
+  uint32_t lost;
+
+  static bool beats(float kept, float v) { return MAX ? kept > v : kept < v; }
+
+  void expire(uint32_t now_ms) {
+    while (head != tail && now_ms - slots[head & (N - 1)].t_ms >= window_ms) head++;
+  }
+};
+
+template <uint16_t N> using WindowMin = WindowExtreme<N, false>;
+template <uint16_t N> using WindowMax = WindowExtreme<N, true>;
+
+template <uint16_t N>
+class WindowSum {
+  static_assert(N && (N & (N - 1)) == 0, "window capacity must be a power of two");
+
+public:
+  void begin(uint32_t window_ms) {
+    this->window_ms = window_ms;
+    head = tail = 0;
+    total = weights = 0;
+    removed = 0;
+    lost = 0;
+  }
+
+  // `weight` is how many readings `v` stands for, e.g. the samples in a block
+  void add(uint32_t t_ms, float v, float weight = 1) {
+    expire(t_ms);
+    if ((uint16_t)(tail - head) == N) {
+      drop();
+      lost++;
+    }
+    slots[tail & (N - 1)] = {t_ms, v, weight};
+    tail++;
+    total += v;
+    weights += weight;
+  }
+
+  float sum(uint32_t now_ms) {
+    expire(now_ms);
+    return total;
+  }
+
+  float weight(uint32_t now_ms) {
+    expire(now_ms);
+    return weights;
+  }
+
+  // sum / weight, `empty` when the window has no weight
+  float mean(uint32_t now_ms, float empty = 0) {
+    expire(now_ms);
+    return weights > 0 ? total / weights : empty;
+  }
+
+  uint16_t size() const { return tail - head; }
+  uint32_t overflows() const { return lost; }
+
+private:
+  struct Sample {
+    uint32_t t_ms;
+    float v;
+    float weight;
+  };
+
+  Sample slots[N];
+  uint32_t window_ms;
+  uint16_t head, tail;
+  float total, weights;
+  uint16_t removed;  // since the sums were last re-added
+  uint32_t lost;
+
+  void drop() {
+    const Sample& s = slots[head & (N - 1)];
+    total -= s.v;
+    weights -= s.weight;
+    head++;
+    if (++removed >= N || head == tail) resum();
+  }
+
+  void resum() {
+    removed = 0;
+    total = weights = 0;
+    for (uint16_t i = head; i != tail; i++) {
+      total += slots[i & (N - 1)].v;
+      weights += slots[i & (N - 1)].weight;
+    }
+  }
+
+  void expire(uint32_t now_ms) {
+    while (head != tail && now_ms - slots[head & (N - 1)].t_ms >= window_ms) drop();
+  }
+};
+
+class TimeSinceTrue {
+public:
+  void begin() {
+    seen = false;
+    holding = false;
+    last_true_ms = since_ms = 0;
+  }
+
+  // The condition as sampled at t_ms
+  void add(uint32_t t_ms, bool value) {
+    if (value) {
+      if (!holding) since_ms = t_ms;
+      last_true_ms = t_ms;
+      seen = true;
+    }
+    holding = value;
+  }
+
+  // ms since the condition was last true, 0 while it is, UINT32_MAX if never
+  uint32_t since(uint32_t now_ms) const {
+    if (!seen) return UINT32_MAX;
+    return holding ? 0 : now_ms - last_true_ms;
+  }
+
+  // ms the condition has been true without a break, 0 while it is false
+  uint32_t heldFor(uint32_t now_ms) const { return holding ? now_ms - since_ms : 0; }
+
+private:
+  bool seen;
+  bool holding;
+  uint32_t last_true_ms;
+  uint32_t since_ms;
+};